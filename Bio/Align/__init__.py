@@ -14,6 +14,8 @@ class, used in the Bio.AlignIO module.
 """
 from __future__ import print_function
 
+import array
+import struct
 import sys  # Only needed to check if we are using Python 2 or 3
 from Bio.Seq import Seq
 from Bio.SeqRecord import SeqRecord, _RestrictedDict
@@ -1217,12 +1219,16 @@ class PairwiseAlignments(object):
 
     This class also supports indexing, which is fast for increasing indices,
     but may be slow for random access of a large number of alignments.
+    Alignments skipped over by indexing are not created.
 
     Note that pairwise aligners can return an astronomical number of alignments,
     even for relatively short sequences, if they align poorly to each other. We
     therefore recommend to first check the number of alignments, accessible as
     len(alignments), which can be calculated quickly even if the number of
-    alignments is very large.
+    alignments is very large.  Iterating over the alignments or indexing
+    them (with a non-negative index) does not calculate the number of
+    alignments.  To check if there are at least a given number of alignments,
+    use the count method.
     """
 
     def __init__(self, seqA, seqB, score, paths):
@@ -1247,18 +1253,38 @@ class PairwiseAlignments(object):
     def __len__(self):
         return len(self.paths)
 
+    def count(self, maximum=None):
+        """Return the number of alignments, or maximum if there are more.
+
+        With maximum, the number of alignments is counted only up to maximum,
+        which avoids the OverflowError raised by len(alignments) if there are
+        too many alignments.  The number of alignments is calculated without
+        generating the alignments.
+        """
+        if maximum is None:
+            return len(self.paths)
+        return self.paths.count(maximum)
+
     def __getitem__(self, index):
+        if index < 0:
+            index += len(self)
+            if index < 0:
+                raise IndexError("index out of range")
         if index == self.index:
             return self.alignment
         if index < self.index:
             self.paths.reset()
             self.index = -1
-        while self.index < index:
-            try:
-                alignment = next(self)
-            except StopIteration:
+        if index > self.index + 1:
+            n = index - self.index - 1
+            skipped = self.paths.skip(n)
+            self.index += skipped
+            if skipped < n:
                 raise IndexError("index out of range")
-        return alignment
+        try:
+            return next(self)
+        except StopIteration:
+            raise IndexError("index out of range")
 
     def __iter__(self):
         self.paths.reset()
@@ -1276,6 +1302,88 @@ class PairwiseAlignments(object):
         next = __next__
 
 
+# typecode of an array.array storing Py_ssize_t values, as used for offsets
+for _offsets_typecode in "lq":
+    try:
+        if array.array(_offsets_typecode).itemsize == struct.calcsize("n"):
+            break
+    except ValueError:  # no 'q' typecode on Python 2
+        pass
+
+
+def _as_sequence(sequence):
+    """Return the sequence as a string or a bytes-like object (PRIVATE)."""
+    if isinstance(sequence, str):
+        return sequence
+    try:
+        memoryview(sequence)
+    except TypeError:
+        return str(sequence)
+    return sequence
+
+
+def _as_string(sequence, alphabet):
+    """Return the sequence as a plain string (PRIVATE).
+
+    Sequences given as bytes-like objects store either characters (for
+    unsigned bytes and characters), or the index of each letter in the
+    alphabet (for signed bytes and integers), as in the C code.
+    """
+    if isinstance(sequence, str):
+        return sequence
+    try:
+        view = memoryview(sequence)
+    except TypeError:
+        return str(sequence)
+    if view.format in ("B", "c"):
+        sequence = view.tobytes()
+        if not isinstance(sequence, str):  # Python 3
+            sequence = sequence.decode("latin-1")
+        return sequence
+    return "".join(alphabet[item] for item in view.tolist())
+
+
+def _as_bytes(sequence):
+    """Return the sequence as a bytes-like object (PRIVATE)."""
+    if isinstance(sequence, (bytes, bytearray, memoryview)):
+        return sequence
+    sequence = str(sequence)
+    if not isinstance(sequence, bytes):  # Python 3
+        sequence = sequence.encode("ascii")
+    return sequence
+
+
+def _pack_sequences(sequences):
+    """Store sequences consecutively in a bytes object (PRIVATE).
+
+    Returns the bytes object and an array of offsets, such that sequence i
+    is stored from offsets[i] to offsets[i+1].
+    """
+    sequences = [_as_bytes(sequence) for sequence in sequences]
+    offsets = array.array(_offsets_typecode, [0])
+    offset = 0
+    for sequence in sequences:
+        offset += len(sequence)
+        offsets.append(offset)
+    return b"".join(sequences), offsets
+
+
+def _as_offsets(offsets):
+    """Return the offsets as an array, if they are not one already (PRIVATE)."""
+    try:
+        memoryview(offsets)
+    except TypeError:
+        offsets = array.array(_offsets_typecode, offsets)
+    return offsets
+
+
+def _band_edges_array(band_edges, n):
+    """Return an array for n band edge flags, or None if not wanted (PRIVATE)."""
+    if not band_edges:
+        return None
+    return array.array("B", [0]) * n
+
+
 class PairwiseAligner(_aligners.PairwiseAligner):
     """Performs pairwise sequence alignment using dynamic programming.
 
@@ -1409,20 +1517,290 @@ class PairwiseAligner(_aligners.PairwiseAligner):
             raise AttributeError(message)
         _aligners.PairwiseAligner.__setattr__(self, key, value)
 
+    @classmethod
+    def from_bytes(cls, data):
+        """Create an aligner from the bytes returned by its to_bytes method.
+
+        The bytes store all parameters and the substitution matrix of the
+        aligner in native byte order, and can be restored in a process on a
+        platform of the same kind.  Aligners can also be pickled, which
+        stores the same bytes together with any gap functions:
+
+        >>> from Bio import Align
+        >>> aligner = Align.PairwiseAligner()
+        >>> aligner.mismatch_score = -1
+        >>> aligner.gap_score = -2
+        >>> copy = Align.PairwiseAligner.from_bytes(aligner.to_bytes())
+        >>> copy.score("GAACT", "GAT")
+        -1.0
+        """
+        aligner = cls()
+        aligner.__setstate__((data, None, None))
+        return aligner
+
     def align(self, seqA, seqB):
-        """Return the alignments of two sequences using PairwiseAligner."""
-        seqA = str(seqA)
-        seqB = str(seqB)
+        """Return the alignments of two sequences using PairwiseAligner.
+
+        The sequences can be strings, Seq objects, or bytes-like objects
+        (such as bytes, a memoryview of a memory-mapped file, or a NumPy
+        array) storing unsigned single-byte characters, or signed bytes or
+        integers giving the index of each letter in the alphabet of the
+        aligner. The alignments store bytes-like objects as strings.
+        """
+        seqA = _as_sequence(seqA)
+        seqB = _as_sequence(seqB)
         score, paths = _aligners.PairwiseAligner.align(self, seqA, seqB)
+        seqA = _as_string(seqA, self.alphabet)
+        seqB = _as_string(seqB, self.alphabet)
         alignments = PairwiseAlignments(seqA, seqB, score, paths)
         return alignments
 
+    def align_best(self, seqA, seqB, cigar=False):
+        """Return the score and the first optimal alignment in a compact form.
+
+        The sequences can be given as in align.  Only the first alignment
+        returned by align is created, and only as the coordinates of its path
+        (the start, end, and each change of direction) in an int array,
+        flattened as target and query position pairs:
+
+        >>> from Bio import Align
+        >>> aligner = Align.PairwiseAligner()
+        >>> score, coordinates = aligner.align_best("GAACT", "GAT")
+        >>> score
+        3.0
+        >>> list(coordinates)
+        [0, 0, 2, 2, 4, 2, 5, 3]
+
+        With cigar=True, the start position of the alignment in the target
+        and its CIGAR string are returned instead. Query letters outside a
+        local alignment are soft-clipped:
+
+        >>> score, start, cigar = aligner.align_best("GAACT", "GAT", cigar=True)
+        >>> start
+        0
+        >>> print(cigar.decode())
+        2M2D1M
+
+        The alignment is None if there is no alignment, as may happen in
+        local mode.
+        """
+        seqA = _as_sequence(seqA)
+        seqB = _as_sequence(seqB)
+        if cigar:
+            return _aligners.PairwiseAligner.align_best(self, seqA, seqB, True)
+        score, data = _aligners.PairwiseAligner.align_best(self, seqA, seqB)
+        if data is None:
+            return score, None
+        return score, array.array("i", data)
+
     def score(self, seqA, seqB):
-        """Return the alignments score of two sequences using PairwiseAligner."""
-        seqA = str(seqA)
-        seqB = str(seqB)
+        """Return the alignments score of two sequences using PairwiseAligner.
+
+        The sequences can be given in the same way as for align.  The score
+        of a global alignment of two long sequences (using the
+        Needleman-Wunsch or Gotoh algorithm) is calculated using the number
+        of threads given by the n_threads attribute, with the global
+        interpreter lock released.
+        """
+        seqA = _as_sequence(seqA)
+        seqB = _as_sequence(seqB)
         return _aligners.PairwiseAligner.score(self, seqA, seqB)
 
+    def score_many(self, target, queries, offsets=None, n_threads=None,
+                   band_edges=False):
+        """Return the alignment scores of a target against many queries.
+
+        Arguments:
+         - target  - The target sequence.
+         - queries - The query sequences; either an iterable over sequences,
+                     or, if offsets is given, a bytes-like object (such as
+                     bytes, a memoryview, or a NumPy uint8 array) storing the
+                     query sequences consecutively.
+         - offsets - The start positions of the query sequences in queries,
+                     followed by the end position of the last query.
+         - n_threads - The number of threads to use, or 0 to use one thread
+                     per processor; by default, the n_threads attribute of
+                     the aligner is used.
+         - band_edges - If True, also return an array of unsigned bytes
+                     that is 1 for each query whose banded alignment touched
+                     the edge of the band, as band_edge_touched does for a
+                     single alignment, and 0 otherwise.
+
+        The scores are returned as an array of doubles, which can be
+        converted to a NumPy array without copying using numpy.frombuffer.
+        The global interpreter lock is released during the calculation,
+        unless a gap function is used.
+
+        >>> from Bio import Align
+        >>> aligner = Align.PairwiseAligner()
+        >>> scores = aligner.score_many("GAACT", ["GAT", "GACT", "AC"])
+        >>> list(scores)
+        [3.0, 4.0, 2.0]
+        """
+        target = _as_bytes(target)
+        if offsets is None:
+            queries, offsets = _pack_sequences(queries)
+        else:
+            offsets = _as_offsets(offsets)
+        scores = array.array("d", [0.0]) * (len(offsets) - 1)
+        edges = _band_edges_array(band_edges, len(scores))
+        _aligners.PairwiseAligner.score_many(self, target, queries, offsets,
+                                             scores, n_threads, edges)
+        if band_edges:
+            return scores, edges
+        return scores
+
+    def score_pairs(self, targets, queries,
+                    target_offsets=None, query_offsets=None, n_threads=None,
+                    band_edges=False):
+        """Return the alignment scores of pairs of targets and queries.
+
+        Arguments:
+         - targets        - The target sequences; either an iterable over
+                            sequences, or, if target_offsets is given, a
+                            bytes-like object storing the target sequences
+                            consecutively.
+         - queries        - The query sequences, stored in the same way.
+         - target_offsets - The start positions of the target sequences in
+                            targets, followed by the end position of the
+                            last target.
+         - query_offsets  - The same for the query sequences.
+         - n_threads      - The number of threads to use, or 0 to use one
+                            thread per processor; by default, the n_threads
+                            attribute of the aligner is used.
+         - band_edges     - If True, also return the band edge flags of the
+                            pairs, as in score_many.
+
+        Target i is aligned to query i; the scores are returned as an array
+        of doubles.  The global interpreter lock is released during the
+        calculation, unless a gap function is used.
+        """
+        if target_offsets is None:
+            targets, target_offsets = _pack_sequences(targets)
+        else:
+            target_offsets = _as_offsets(target_offsets)
+        if query_offsets is None:
+            queries, query_offsets = _pack_sequences(queries)
+        else:
+            query_offsets = _as_offsets(query_offsets)
+        scores = array.array("d", [0.0]) * (len(query_offsets) - 1)
+        edges = _band_edges_array(band_edges, len(scores))
+        _aligners.PairwiseAligner.score_pairs(self, targets, target_offsets,
+                                              queries, query_offsets, scores,
+                                              n_threads, edges)
+        if band_edges:
+            return scores, edges
+        return scores
+
+    def score_all_pairs(self, sequences, offsets=None, n_threads=None,
+                        band_edges=False):
+        """Return the alignment scores of all pairs of sequences.
+
+        Arguments:
+         - sequences - The sequences; either an iterable over sequences, or,
+                       if offsets is given, a bytes-like object storing the
+                       sequences consecutively.
+         - offsets   - The start positions of the sequences in sequences,
+                       followed by the end position of the last sequence.
+         - n_threads - The number of threads to use, or 0 to use one thread
+                       per processor; by default, the n_threads attribute of
+                       the aligner is used.
+         - band_edges - If True, also return the band edge flags of the
+                       pairs, as in score_many, in the same layout as the
+                       scores.
+
+        For N sequences, the N*(N-1)/2 scores are returned as an array of
+        doubles, in which the score of sequence j (as the target) aligned to
+        sequence i (as the query), with j < i, is stored at index
+        i*(i-1)/2 + j.  This is the condensed (lower-triangular) layout of a
+        distance matrix as accepted by Bio.Cluster.  The global interpreter
+        lock is released during the calculation, unless a gap function is
+        used.
+
+        >>> from Bio import Align
+        >>> aligner = Align.PairwiseAligner()
+        >>> scores = aligner.score_all_pairs(["GAACT", "GAT", "GACT"])
+        >>> list(scores)
+        [3.0, 4.0, 3.0]
+        """
+        if offsets is None:
+            sequences, offsets = _pack_sequences(sequences)
+        else:
+            offsets = _as_offsets(offsets)
+        n = len(offsets) - 1
+        scores = array.array("d", [0.0]) * (n * (n - 1) // 2)
+        edges = _band_edges_array(band_edges, len(scores))
+        _aligners.PairwiseAligner.score_all_pairs(self, sequences, offsets,
+                                                  scores, n_threads, edges)
+        if band_edges:
+            return scores, edges
+        return scores
+
+    def search(self, query, database, k=10, min_score=None, offsets=None,
+               n_threads=None):
+        """Return the best alignments of a query against a database.
+
+        Arguments:
+         - query     - The query sequence.
+         - database  - The database sequences, used as the targets; either
+                       an iterable over sequences, or, if offsets is given, a
+                       bytes-like object storing the sequences consecutively.
+         - k         - The maximum number of hits to return.
+         - min_score - The minimum alignment score of a hit (optional).
+         - offsets   - The start positions of the database sequences in
+                       database, followed by the end position of the last
+                       sequence.
+         - n_threads - The number of threads to use, or 0 to use one thread
+                       per processor; by default, the n_threads attribute of
+                       the aligner is used.
+
+        Returns a list of up to k tuples (index, score, alignments) for the
+        database sequences with the highest alignment score, sorted by
+        decreasing score (and by index for equal scores), where alignments
+        is the result of align(target, query) for database sequence target.
+        Only the scores are kept while searching, and only the hits are
+        aligned.  If no gap score is positive, database sequences for which
+        an upper bound of the score is too low to give a hit are skipped.
+        The global interpreter lock is released during the search, unless a
+        gap function is used.
+
+        >>> from Bio import Align
+        >>> aligner = Align.PairwiseAligner()
+        >>> hits = aligner.search("GACT", ["GAT", "GAACT", "AC", "GACT"], k=2)
+        >>> for index, score, alignments in hits:
+        ...     print(index, score)
+        ...     print(alignments[0])
+        1 4.0
+        GAACT
+        ||-||
+        GA-CT
+        <BLANKLINE>
+        3 4.0
+        GACT
+        ||||
+        GACT
+        <BLANKLINE>
+        """
+        if offsets is None:
+            database = list(database)
+            data, offsets = _pack_sequences(database)
+        else:
+            data = database
+            offsets = _as_offsets(offsets)
+        if min_score is None:
+            min_score = float("-inf")
+        hits = _aligners.PairwiseAligner.search(self, _as_bytes(query), data,
+                                                offsets, k, min_score,
+                                                n_threads)
+        result = []
+        for index, score in hits:
+            if data is database:
+                target = memoryview(data)[offsets[index]:offsets[index + 1]]
+            else:
+                target = database[index]
+            result.append((index, score, self.align(target, query)))
+        return result
+
 
 if __name__ == "__main__":
     from Bio._utils import run_doctest
@@ -10,6 +10,7 @@
 #define PY_SSIZE_T_CLEAN
 #include "Python.h"
 #include "float.h"
+#include "limits.h"
 
 
 #define HORIZONTAL 0x1
@@ -23,17 +24,24 @@
 #define DONE 0x3
 #define NONE 0x7
 
-#define OVERFLOW_ERROR -1
 #define MEMORY_ERROR -2
+#define PYTHON_ERROR -3
+
+/* The score-only kernels run without holding the GIL, and therefore use the
+ * raw memory allocator.  Python 2 does not have one; use the C library. */
+#if PY_MAJOR_VERSION < 3
+#define PyMem_RawMalloc malloc
+#define PyMem_RawCalloc calloc
+#define PyMem_RawRealloc realloc
+#define PyMem_RawFree free
+#endif
 
-#define CHARINDEX(s) (c = s, c >= 'a' ? c - 'a' : c - 'A')
-
+/* Add the count t to s, saturating at maximum (a parameter of the counting
+ * functions); a count equal to maximum means at least maximum paths. */
 #define SAFE_ADD(t, s) \
-{   if (s != OVERFLOW_ERROR) { \
-        term = t; \
-        if (term > PY_SSIZE_T_MAX - s) s = OVERFLOW_ERROR; \
-        else s += term; \
-    } \
+{   term = t; \
+    if (term > maximum - s) s = maximum; \
+    else s += term; \
 }
 
 
@@ -42,7 +50,7 @@ typedef enum {NeedlemanWunschSmithWaterman,
               WatermanSmithBeyer,
               Unknown} Algorithm;
 
-typedef enum {Global, Local} Mode;
+typedef enum {Global, Local, Extension} Mode;
 
 typedef struct {
     unsigned char trace : 5;
@@ -61,6 +69,9 @@ typedef struct {
     int* IxIy;
 } TraceGapsWatermanSmithBeyer;
 
+/* Return the character of the alphabet given by item, which should be a
+ * single printable ASCII character other than a space.  Returns -1 and sets
+ * an exception if item is not a valid character. */
 static int _convert_single_letter(PyObject* item)
 {
     int i;
@@ -102,10 +113,12 @@ static int _convert_single_letter(PyObject* item)
         letter = *((char*)(view.buf));
         PyBuffer_Release(&view);
     }
-    if (letter >= 'a' && letter <= 'z') i = letter - 'a';
-    else if (letter >= 'A' && letter <= 'Z') i = letter - 'A';
+    /* letters are case-insensitive, and stored as upper case */
+    if (letter >= 'a' && letter <= 'z') i = letter - 'a' + 'A';
+    else if (letter > ' ' && letter <= '~') i = letter;
     else {
-        PyErr_SetString(PyExc_ValueError, "expected an ASCII character");
+        PyErr_SetString(PyExc_ValueError,
+                        "expected a printable ASCII character");
         return -1;
     }
     return i;
@@ -182,6 +195,50 @@ _create_path(Trace** M, int i, int j) {
     return PyErr_NoMemory();
 }
 
+/* Convert the steps of a path starting at (0, 0) to a tuple of coordinates,
+ * as returned by _create_path. */
+static PyObject*
+_create_path_from_steps(const unsigned char* steps, int n)
+{
+    int i = 0;
+    int j = 0;
+    int k;
+    int m = 1;
+    int direction = 0;
+    PyObject* tuple;
+    PyObject* row;
+
+    for (k = 0; k < n; k++) {
+        if (steps[k] != direction) {
+            m++;
+            direction = steps[k];
+        }
+    }
+    tuple = PyTuple_New(m);
+    if (!tuple) return NULL;
+    m = 0;
+    direction = 0;
+    for (k = 0; k <= n; k++) {
+        if (k == n || steps[k] != direction) {
+            row = Py_BuildValue("ii", i, j);
+            if (!row) {
+                Py_DECREF(tuple);
+                return NULL;
+            }
+            PyTuple_SET_ITEM(tuple, m, row);
+            m++;
+            if (k == n) break;
+            direction = steps[k];
+        }
+        switch (steps[k]) {
+            case HORIZONTAL: j++; break;
+            case VERTICAL: i++; break;
+            case DIAGONAL: i++; j++; break;
+        }
+    }
+    return tuple;
+}
+
 typedef struct {
     PyObject_HEAD
     Trace** M;
@@ -193,11 +250,45 @@ typedef struct {
     int iB;
     Mode mode;
     Algorithm algorithm;
-    Py_ssize_t length;
+    Py_ssize_t length; /* number of paths, if known; 0 otherwise */
+    int skip; /* 1 while skipping paths without creating them */
+    int i0; /* start of the last path generated or skipped */
+    int j0;
+    unsigned char* steps; /* the steps of a single stored path, if any */
+    int nsteps;
+    int band_offset;
+    int band_width; /* -1 if the traceback matrix is not banded */
 } PathGenerator;
 
+/* Return the path starting at M[i][j], or None while skipping paths. */
+static PyObject*
+_next_path(PathGenerator* self, Trace** M, int i, int j)
+{
+    self->i0 = i;
+    self->j0 = j;
+    if (self->skip) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+    return _create_path(M, i, j);
+}
+
+/* Columns lo to hi of row i are inside the band of the given width around
+ * the diagonal j = i + offset.  Only these columns of a banded traceback
+ * matrix are allocated; the row pointers are shifted by lo, so that the
+ * matrix can be indexed as usual. */
+static void
+_band_limits(int i, int nB, int offset, int width, int* lo, int* hi)
+{
+    int k;
+    k = i + offset - width;
+    *lo = (k > 0) ? k : 0;
+    k = i + offset + width;
+    *hi = (k < nB) ? k : nB;
+}
+
 static Py_ssize_t
-PathGenerator_needlemanwunsch_length(PathGenerator* self)
+PathGenerator_needlemanwunsch_length(PathGenerator* self, Py_ssize_t maximum)
 {
     int i;
     int j;
@@ -239,7 +330,7 @@ PathGenerator_needlemanwunsch_length(PathGenerator* self)
 }
 
 static Py_ssize_t
-PathGenerator_smithwaterman_length(PathGenerator* self)
+PathGenerator_smithwaterman_length(PathGenerator* self, Py_ssize_t maximum)
 {
     int i;
     int j;
@@ -277,10 +368,12 @@ PathGenerator_smithwaterman_length(PathGenerator* self)
 }
 
 static Py_ssize_t
-PathGenerator_gotoh_global_length(PathGenerator* self)
+PathGenerator_gotoh_global_length(PathGenerator* self, Py_ssize_t maximum)
 {
     int i;
     int j;
+    int lo = 0;
+    int hi;
     int trace;
     const int nA = self->nA;
     const int nB = self->nB;
@@ -308,14 +401,28 @@ PathGenerator_gotoh_global_length(PathGenerator* self)
         Ix_counts[j] = 0;
         Iy_counts[j] = 1;
     }
+    hi = nB;
     for (i = 1; i <= nA; i++) {
-        M_temp = M_counts[0];
-        M_counts[0] = 0;
-        Ix_temp = Ix_counts[0];
-        Ix_counts[0] = 1;
-        Iy_temp = Iy_counts[0];
-        Iy_counts[0] = 0;
-        for (j = 1; j <= nB; j++) {
+        /* In a banded traceback matrix, the traces only refer to cells
+         * inside the band, so the counts outside it are never used. */
+        if (self->band_width >= 0)
+            _band_limits(i, nB, self->band_offset, self->band_width, &lo, &hi);
+        if (lo == 0) {
+            M_temp = M_counts[0];
+            M_counts[0] = 0;
+            Ix_temp = Ix_counts[0];
+            Ix_counts[0] = 1;
+            Iy_temp = Iy_counts[0];
+            Iy_counts[0] = 0;
+            j = 1;
+        }
+        else {
+            M_temp = M_counts[lo-1];
+            Ix_temp = Ix_counts[lo-1];
+            Iy_temp = Iy_counts[lo-1];
+            j = lo;
+        }
+        for ( ; j <= hi; j++) {
             count = 0;
             trace = M[i][j].trace;
             if (trace & M_MATRIX) SAFE_ADD(M_temp, count);
@@ -351,7 +458,7 @@ exit:
 }
 
 static Py_ssize_t
-PathGenerator_gotoh_local_length(PathGenerator* self)
+PathGenerator_gotoh_local_length(PathGenerator* self, Py_ssize_t maximum)
 {
     int i;
     int j;
@@ -425,7 +532,7 @@ exit:
 }
 
 static Py_ssize_t
-PathGenerator_waterman_smith_beyer_global_length(PathGenerator* self)
+PathGenerator_waterman_smith_beyer_global_length(PathGenerator* self, Py_ssize_t maximum)
 {
     int i;
     int j;
@@ -535,7 +642,7 @@ exit:
 }
 
 static Py_ssize_t
-PathGenerator_waterman_smith_beyer_local_length(PathGenerator* self)
+PathGenerator_waterman_smith_beyer_local_length(PathGenerator* self, Py_ssize_t maximum)
 {
     int i;
     int j;
@@ -640,78 +747,92 @@ exit:
     return count;
 }
 
-static Py_ssize_t PathGenerator_length(PathGenerator* self) {
-    Py_ssize_t length = self->length;
-    if (length == 0) {
-        switch (self->algorithm) {
-            case NeedlemanWunschSmithWaterman:
-                switch (self->mode) {
-                    case Global:
-                        length = PathGenerator_needlemanwunsch_length(self);
-                        break;
-                    case Local:
-                        length = PathGenerator_smithwaterman_length(self);
-                        break;
-                    default:
-                        /* should not happen, but some compilers complain that
-                         * that length can be used uninitialized.
-                         */
-                        PyErr_SetString(PyExc_RuntimeError, "Unknown mode");
-                        return -1;
-                }
-                break;
-            case Gotoh:
-                switch (self->mode) {
-                    case Global:
-                        length = PathGenerator_gotoh_global_length(self);
-                        break;
-                    case Local:
-                        length = PathGenerator_gotoh_local_length(self);
-                        break;
-                    default:
-                        /* should not happen, but some compilers complain that
-                         * that length can be used uninitialized.
-                         */
-                        PyErr_SetString(PyExc_RuntimeError, "Unknown mode");
-                        return -1;
-                }
-                break;
-            case WatermanSmithBeyer:
-                switch (self->mode) {
-                    case Global:
-                        length = PathGenerator_waterman_smith_beyer_global_length(self);
-                        break;
-                    case Local:
-                        length = PathGenerator_waterman_smith_beyer_local_length(self);
-                        break;
-                    default:
-                        /* should not happen, but some compilers complain that
-                         * that length can be used uninitialized.
-                         */
-                        PyErr_SetString(PyExc_RuntimeError, "Unknown mode");
-                        return -1;
-                }
-                break;
-            case Unknown:
-            default:
-                PyErr_SetString(PyExc_RuntimeError, "Unknown algorithm");
-                return -1;
-        }
-        self->length = length;
+/* Count the paths, up to maximum (which should be positive); the count is
+ * stored in self->length if it is exact, or if maximum is PY_SSIZE_T_MAX.
+ * Returns MEMORY_ERROR without setting an exception if out of memory, or
+ * PYTHON_ERROR with an exception set for an unknown algorithm or mode. */
+static Py_ssize_t
+PathGenerator_count_paths(PathGenerator* self, Py_ssize_t maximum)
+{
+    Py_ssize_t count = self->length;
+    if (count > 0) return (count < maximum) ? count : maximum;
+    switch (self->algorithm) {
+        case NeedlemanWunschSmithWaterman:
+            switch (self->mode) {
+                case Global:
+                    count = PathGenerator_needlemanwunsch_length(self, maximum);
+                    break;
+                case Local:
+                    count = PathGenerator_smithwaterman_length(self, maximum);
+                    break;
+                default:
+                    /* should not happen, but some compilers complain that
+                     * that length can be used uninitialized.
+                     */
+                    PyErr_SetString(PyExc_RuntimeError, "Unknown mode");
+                    return PYTHON_ERROR;
+            }
+            break;
+        case Gotoh:
+            switch (self->mode) {
+                case Global:
+                    count = PathGenerator_gotoh_global_length(self, maximum);
+                    break;
+                case Local:
+                    count = PathGenerator_gotoh_local_length(self, maximum);
+                    break;
+                default:
+                    /* should not happen, but some compilers complain that
+                     * that length can be used uninitialized.
+                     */
+                    PyErr_SetString(PyExc_RuntimeError, "Unknown mode");
+                    return PYTHON_ERROR;
+            }
+            break;
+        case WatermanSmithBeyer:
+            switch (self->mode) {
+                case Global:
+                    count = PathGenerator_waterman_smith_beyer_global_length(self, maximum);
+                    break;
+                case Local:
+                    count = PathGenerator_waterman_smith_beyer_local_length(self, maximum);
+                    break;
+                default:
+                    /* should not happen, but some compilers complain that
+                     * that length can be used uninitialized.
+                     */
+                    PyErr_SetString(PyExc_RuntimeError, "Unknown mode");
+                    return PYTHON_ERROR;
+            }
+            break;
+        case Unknown:
+        default:
+            PyErr_SetString(PyExc_RuntimeError, "Unknown algorithm");
+            return PYTHON_ERROR;
     }
+    if (count >= 0 && (count < maximum || maximum == PY_SSIZE_T_MAX))
+        self->length = count;
+    return count;
+}
+
+static Py_ssize_t
+PathGenerator_length(PathGenerator* self)
+{
+    const Py_ssize_t length = PathGenerator_count_paths(self, PY_SSIZE_T_MAX);
     switch (length) {
-        case OVERFLOW_ERROR:
+        case PY_SSIZE_T_MAX:
             PyErr_Format(PyExc_OverflowError,
                          "number of optimal alignments is larger than %zd",
                          PY_SSIZE_T_MAX);
-            break;
+            return -1;
         case MEMORY_ERROR:
             PyErr_SetNone(PyExc_MemoryError);
-            break;
+            return -1;
+        case PYTHON_ERROR:
+            return -1;
         default:
-            break;
+            return length;
     }
-    return length;
 }
 
 static void
@@ -721,11 +842,16 @@ PathGenerator_dealloc(PathGenerator* self)
     const int nA = self->nA;
     const Algorithm algorithm = self->algorithm;
     Trace** M = self->M;
+    int lo = 0;
+    int hi;
+    if (self->steps) PyMem_Free(self->steps);
+    /* the traceback matrices are stored as a single block starting at the
+     * first cell of row 0 */
+    if (self->band_width >= 0)
+        _band_limits(0, self->nB, self->band_offset, self->band_width,
+                     &lo, &hi);
     if (M) {
-        for (i = 0; i <= nA; i++) {
-            if (!M[i]) break;
-            PyMem_Free(M[i]);
-        }
+        if (M[0]) PyMem_Free(M[0] + lo);
         PyMem_Free(M);
     }
     switch (algorithm) {
@@ -734,10 +860,7 @@ PathGenerator_dealloc(PathGenerator* self)
         case Gotoh: {
             TraceGapsGotoh** gaps = self->gaps.gotoh;
             if (gaps) {
-                for (i = 0; i <= nA; i++) {
-                    if (!gaps[i]) break;
-                    PyMem_Free(gaps[i]);
-                }
+                if (gaps[0]) PyMem_Free(gaps[0] + lo);
                 PyMem_Free(gaps);
             }
             break;
@@ -747,20 +870,14 @@ PathGenerator_dealloc(PathGenerator* self)
             if (gaps) {
                 int j;
                 const int nB = self->nB;
-                int* trace;
-                for (i = 0; i <= nA; i++) {
-                    if (!gaps[i]) break;
-                    for (j = 0; j <= nB; j++) {
-                        trace = gaps[i][j].MIx;
-                        if (trace) PyMem_Free(trace);
-                        trace = gaps[i][j].IyIx;
-                        if (trace) PyMem_Free(trace);
-                        trace = gaps[i][j].MIy;
-                        if (trace) PyMem_Free(trace);
-                        trace = gaps[i][j].IxIy;
-                        if (trace) PyMem_Free(trace);
+                if (gaps[0]) {
+                    for (i = 0; i <= nA; i++) {
+                        for (j = 0; j <= nB; j++) {
+                            /* the four lists of gaps share a single block */
+                            if (gaps[i][j].MIx) PyMem_Free(gaps[i][j].MIx);
+                        }
                     }
-                    PyMem_Free(gaps[i]);
+                    PyMem_Free(gaps[0]);
                 }
                 PyMem_Free(gaps);
             }
@@ -834,7 +951,7 @@ static PyObject* PathGenerator_next_needlemanwunsch(PathGenerator* self)
         else if (trace & DIAGONAL) M[--i][--j].path = DIAGONAL;
         else break;
     }
-    return _create_path(M, 0, 0);
+    return _next_path(self, M, 0, 0);
 }
 
 static PyObject* PathGenerator_next_smithwaterman(PathGenerator* self)
@@ -915,7 +1032,7 @@ static PyObject* PathGenerator_next_smithwaterman(PathGenerator* self)
         else if (trace & STARTPOINT) {
             self->iA = i;
             self->iB = j;
-            return _create_path(M, i, j);
+            return _next_path(self, M, i, j);
         }
         else {
             PyErr_SetString(PyExc_RuntimeError,
@@ -1057,7 +1174,7 @@ static PyObject* PathGenerator_next_gotoh_global(PathGenerator* self)
         }
         else break;
     }
-    return _create_path(M, 0, 0);
+    return _next_path(self, M, 0, 0);
 }
 
 static PyObject* PathGenerator_next_gotoh_local(PathGenerator* self)
@@ -1159,7 +1276,7 @@ static PyObject* PathGenerator_next_gotoh_local(PathGenerator* self)
         if (trace == STARTPOINT) {
             self->iA = i;
             self->iB = j;
-            return _create_path(M, i, j);
+            return _next_path(self, M, i, j);
         }
         switch (m) {
             case M_MATRIX:
@@ -1362,7 +1479,7 @@ PathGenerator_next_waterman_smith_beyer_global(PathGenerator* self)
                 if (trace & M_MATRIX) m = M_MATRIX;
                 else if (trace & Ix_MATRIX) m = Ix_MATRIX;
                 else if (trace & Iy_MATRIX) m = Iy_MATRIX;
-                else return _create_path(M, i, j);
+                else return _next_path(self, M, i, j);
                 i--;
                 j--;
                 M[i][j].path = DIAGONAL;
@@ -1598,7 +1715,7 @@ PathGenerator_next_waterman_smith_beyer_local(PathGenerator* self)
                 else if (trace == STARTPOINT) {
                     self->iA = i;
                     self->iB = j;
-                    return _create_path(M, i, j);
+                    return _next_path(self, M, i, j);
                 }
                 else {
                     PyErr_SetString(PyExc_RuntimeError,
@@ -1618,6 +1735,17 @@ PathGenerator_next(PathGenerator* self)
 {
     const Mode mode = self->mode;
     const Algorithm algorithm = self->algorithm;
+    if (self->steps) {
+        if (self->iA) return NULL;
+        self->iA = 1;
+        self->i0 = 0;
+        self->j0 = 0;
+        if (self->skip) {
+            Py_INCREF(Py_None);
+            return Py_None;
+        }
+        return _create_path_from_steps(self->steps, self->nsteps);
+    }
     switch (algorithm) {
         case NeedlemanWunschSmithWaterman:
             switch (mode) {
@@ -1625,6 +1753,9 @@ PathGenerator_next(PathGenerator* self)
                     return PathGenerator_next_needlemanwunsch(self);
                 case Local:
                     return PathGenerator_next_smithwaterman(self);
+                case Extension:
+                    /* extension alignments are stored as a single path */
+                    return NULL;
             }
         case Gotoh:
             switch (mode) {
@@ -1632,6 +1763,9 @@ PathGenerator_next(PathGenerator* self)
                     return PathGenerator_next_gotoh_global(self);
                 case Local:
                     return PathGenerator_next_gotoh_local(self);
+                case Extension:
+                    /* extension alignments are stored as a single path */
+                    return NULL;
             }
         case WatermanSmithBeyer:
             switch (mode) {
@@ -1639,6 +1773,9 @@ PathGenerator_next(PathGenerator* self)
                     return PathGenerator_next_waterman_smith_beyer_global(self);
                 case Local:
                     return PathGenerator_next_waterman_smith_beyer_local(self);
+                case Extension:
+                    /* extension alignments are stored as a single path */
+                    return NULL;
             }
         case Unknown:
         default:
@@ -1652,6 +1789,11 @@ static const char PathGenerator_reset__doc__[] = "reset the iterator";
 static PyObject*
 PathGenerator_reset(PathGenerator* self)
 {
+    if (self->steps) {
+        self->iA = 0;
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
     switch (self->mode) {
         case Local:
             self->iA = 0;
@@ -1672,18 +1814,83 @@ PathGenerator_reset(PathGenerator* self)
                 default:
                     break;
             }
+            break;
         }
+        case Extension:
+            break;
     }
     Py_INCREF(Py_None);
     return Py_None;
 }
 
+static const char PathGenerator_count__doc__[] =
+"count(maximum)\n"
+"\n"
+"Return the number of paths, or maximum if there are at least maximum\n"
+"paths.  The number of paths is calculated from the traceback matrices\n"
+"without generating the paths, and is stored for later use if it is exact.\n";
+
+static PyObject*
+PathGenerator_count(PathGenerator* self, PyObject* args)
+{
+    Py_ssize_t maximum;
+    Py_ssize_t count;
+    if (!PyArg_ParseTuple(args, "n", &maximum)) return NULL;
+    if (maximum < 1) {
+        PyErr_SetString(PyExc_ValueError, "maximum should be positive");
+        return NULL;
+    }
+    count = PathGenerator_count_paths(self, maximum);
+    switch (count) {
+        case MEMORY_ERROR:
+            return PyErr_NoMemory();
+        case PYTHON_ERROR:
+            return NULL;
+        default:
+            return PyLong_FromSsize_t(count);
+    }
+}
+
+static const char PathGenerator_skip__doc__[] =
+"skip(n)\n"
+"\n"
+"Skip the next n paths without creating them, and return the number of\n"
+"paths skipped, which is less than n if the paths ran out.\n";
+
+static PyObject*
+PathGenerator_skip(PathGenerator* self, PyObject* args)
+{
+    Py_ssize_t n;
+    Py_ssize_t i;
+    PyObject* path;
+    if (!PyArg_ParseTuple(args, "n", &n)) return NULL;
+    self->skip = 1;
+    for (i = 0; i < n; i++) {
+        path = PathGenerator_next(self);
+        if (!path) break;
+        Py_DECREF(path);
+    }
+    self->skip = 0;
+    if (PyErr_Occurred()) return NULL;
+    return PyLong_FromSsize_t(i);
+}
+
 static PyMethodDef PathGenerator_methods[] = {
     {"reset",
      (PyCFunction)PathGenerator_reset,
      METH_NOARGS,
      PathGenerator_reset__doc__
     },
+    {"count",
+     (PyCFunction)PathGenerator_count,
+     METH_VARARGS,
+     PathGenerator_count__doc__
+    },
+    {"skip",
+     (PyCFunction)PathGenerator_skip,
+     METH_VARARGS,
+     PathGenerator_skip__doc__
+    },
     {NULL}  /* Sentinel */
 };
 
@@ -1729,6 +1936,230 @@ static PyTypeObject PathGenerator_Type = {
     PathGenerator_methods,          /* tp_methods */
 };
 
+/* ---------------------- thread pool ---------------------- */
+
+/* A pool of worker threads, owned by the module and started on first use,
+ * for calculations on many independent items (such as the pairs in a batch)
+ * without the GIL.  Each participating thread starts with a contiguous range
+ * of items; a thread that runs out of items steals half of the remaining
+ * items of another thread.  Results are stored by item index, so they are in
+ * input order.  Jobs submitted from different Python threads are run one
+ * after the other.  On Windows, the items are processed serially.
+ */
+
+#ifndef _WIN32
+#define HAVE_PTHREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define MAXIMUM_NUMBER_OF_THREADS 1024
+
+typedef void (*ParallelFunction)(void* data, Py_ssize_t index);
+
+static int
+_number_of_processors(void)
+{
+#if defined(HAVE_PTHREADS) && defined(_SC_NPROCESSORS_ONLN)
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > MAXIMUM_NUMBER_OF_THREADS) return MAXIMUM_NUMBER_OF_THREADS;
+    if (n > 0) return (int)n;
+#endif
+    return 1;
+}
+
+#ifdef HAVE_PTHREADS
+
+typedef struct {
+    pthread_mutex_t lock;
+    Py_ssize_t start;
+    Py_ssize_t end;
+} WorkRange;
+
+typedef struct {
+    ParallelFunction function;
+    void* data;
+    WorkRange* ranges;
+    int n;
+} ParallelJob;
+
+static struct {
+    pthread_mutex_t submit;   /* held while a job is running */
+    pthread_mutex_t mutex;    /* protects the fields below */
+    pthread_cond_t wakeup;
+    pthread_cond_t finished;
+    int nthreads;
+    unsigned long generation;
+    int remaining;
+    ParallelJob* job;
+} pool = {PTHREAD_MUTEX_INITIALIZER,
+          PTHREAD_MUTEX_INITIALIZER,
+          PTHREAD_COND_INITIALIZER,
+          PTHREAD_COND_INITIALIZER,
+          0, 0, 0, NULL};
+
+static void
+_parallel_run(ParallelJob* job, int t)
+{
+    Py_ssize_t i;
+    Py_ssize_t start;
+    Py_ssize_t end;
+    Py_ssize_t size;
+    int k;
+    int v;
+    const int n = job->n;
+    WorkRange* ranges = job->ranges;
+    WorkRange* range = &ranges[t];
+    WorkRange* victim;
+
+    while (1) {
+        pthread_mutex_lock(&range->lock);
+        if (range->start < range->end) {
+            i = range->start++;
+            pthread_mutex_unlock(&range->lock);
+            job->function(job->data, i);
+            continue;
+        }
+        pthread_mutex_unlock(&range->lock);
+        /* Steal the second half of the remaining items of the thread with
+         * the most items left.  The sizes may change once the locks are
+         * released, so check the victim again before stealing from it. */
+        start = end = 0;
+        while (1) {
+            v = -1;
+            size = 0;
+            for (k = 1; k < n; k++) {
+                victim = &ranges[(t + k) % n];
+                pthread_mutex_lock(&victim->lock);
+                if (victim->end - victim->start > size) {
+                    size = victim->end - victim->start;
+                    v = (t + k) % n;
+                }
+                pthread_mutex_unlock(&victim->lock);
+            }
+            if (v < 0) break;
+            victim = &ranges[v];
+            pthread_mutex_lock(&victim->lock);
+            if (victim->start < victim->end) {
+                end = victim->end;
+                start = end - (end - victim->start + 1) / 2;
+                victim->end = start;
+            }
+            pthread_mutex_unlock(&victim->lock);
+            if (start < end) break;
+        }
+        if (start == end) return;
+        pthread_mutex_lock(&range->lock);
+        range->start = start;
+        range->end = end;
+        pthread_mutex_unlock(&range->lock);
+    }
+}
+
+static void*
+_parallel_worker(void* argument)
+{
+    const int t = (int)(Py_ssize_t)argument;
+    unsigned long generation = 0;
+    ParallelJob* job;
+    pthread_mutex_lock(&pool.mutex);
+    while (1) {
+        while (pool.generation == generation)
+            pthread_cond_wait(&pool.wakeup, &pool.mutex);
+        generation = pool.generation;
+        job = pool.job;
+        pthread_mutex_unlock(&pool.mutex);
+        if (t < job->n) _parallel_run(job, t);
+        pthread_mutex_lock(&pool.mutex);
+        pool.remaining--;
+        if (pool.remaining == 0) pthread_cond_signal(&pool.finished);
+    }
+    return NULL;
+}
+
+static void
+_parallel_reset_after_fork(void)
+{
+    /* The worker threads do not exist in the child process. */
+    pthread_mutex_init(&pool.submit, NULL);
+    pthread_mutex_init(&pool.mutex, NULL);
+    pthread_cond_init(&pool.wakeup, NULL);
+    pthread_cond_init(&pool.finished, NULL);
+    pool.nthreads = 0;
+    pool.remaining = 0;
+    pool.job = NULL;
+}
+
+#endif
+
+/* Call function(data, i) for i = 0, ..., n-1, using up to nthreads threads
+ * (including the calling thread).  Must be called without holding the GIL
+ * if function releases it; function itself must not use the Python C API.
+ */
+static void
+_parallel_for(Py_ssize_t n, int nthreads, ParallelFunction function, void* data)
+{
+    Py_ssize_t i;
+#ifdef HAVE_PTHREADS
+    int t;
+    pthread_t thread;
+    ParallelJob job;
+    WorkRange* ranges;
+
+    if (nthreads > n) nthreads = (int)n;
+    if (nthreads > MAXIMUM_NUMBER_OF_THREADS)
+        nthreads = MAXIMUM_NUMBER_OF_THREADS;
+    if (nthreads > 1) {
+        ranges = PyMem_RawMalloc(nthreads * sizeof(WorkRange));
+        if (ranges) {
+            pthread_mutex_lock(&pool.submit);
+            pthread_mutex_lock(&pool.mutex);
+            while (pool.nthreads < nthreads - 1) {
+                if (pthread_create(&thread, NULL, _parallel_worker,
+                                   (void*)(Py_ssize_t)(pool.nthreads + 1)) != 0)
+                    break;
+                pthread_detach(thread);
+                pool.nthreads++;
+            }
+            if (nthreads > pool.nthreads + 1) nthreads = pool.nthreads + 1;
+            for (t = 0; t < nthreads; t++) {
+                pthread_mutex_init(&ranges[t].lock, NULL);
+                ranges[t].start = n * t / nthreads;
+                ranges[t].end = n * (t + 1) / nthreads;
+            }
+            job.function = function;
+            job.data = data;
+            job.ranges = ranges;
+            job.n = nthreads;
+            pool.job = &job;
+            pool.remaining = pool.nthreads;
+            pool.generation++;
+            pthread_cond_broadcast(&pool.wakeup);
+            pthread_mutex_unlock(&pool.mutex);
+            _parallel_run(&job, 0);
+            pthread_mutex_lock(&pool.mutex);
+            while (pool.remaining > 0)
+                pthread_cond_wait(&pool.finished, &pool.mutex);
+            pool.job = NULL;
+            pthread_mutex_unlock(&pool.mutex);
+            pthread_mutex_unlock(&pool.submit);
+            for (t = 0; t < nthreads; t++)
+                pthread_mutex_destroy(&ranges[t].lock);
+            PyMem_RawFree(ranges);
+            return;
+        }
+    }
+#endif
+    for (i = 0; i < n; i++) function(data, i);
+}
+
+/* Gap scores for the Waterman-Smith-Beyer algorithm, calculated at the start
+ * of each score or alignment calculation and freed at its end. */
+typedef struct {
+    double** target; /* target[i][k-1]: gap of length k at target position i */
+    double** query; /* query[j][k-1]: gap of length k at query position j */
+} GapTables;
+
 typedef struct {
     PyObject_HEAD
     Mode mode;
@@ -1750,16 +2181,114 @@ typedef struct {
     double query_right_extend_gap_score;
     PyObject* target_gap_function;
     PyObject* query_gap_function;
-    double substitution_matrix[26][26]; /* 26 letters in the alphabet */
-    int* letters;
+    double** substitution_matrix; /* alphabet_size rows and columns */
+    int substitution_matrix_given; /* 0 if using match and mismatch scores */
+    char matrix_letters[128]; /* characters in the substitution matrix keys */
+    int alphabet_size;
+    char alphabet[128]; /* characters of the alphabet, NUL-terminated */
+    signed char mapping[128]; /* index of each ASCII character, or -1 */
+    int n_threads;
+    int linear_space;
+    int band_width; /* -1 if the alignment is not banded */
+    int band_offset;
+    int band_edge_touched;
+    double xdrop; /* negative if extension alignments are not pruned */
+    GapTables gap_tables;
 } Aligner;
 
+/* Return the number of threads to use for n_threads as given to a method:
+ * the n_threads attribute of the aligner if negative (not given), and the
+ * number of processors if zero.  The n_threads attribute stores 0 as is, so
+ * that it is resolved on the machine running the calculation. */
+static int
+_get_number_of_threads(const Aligner* self, int n_threads)
+{
+    if (n_threads < 0) n_threads = self->n_threads;
+    if (n_threads == 0) n_threads = _number_of_processors();
+    return n_threads;
+}
+
+#define DEFAULT_ALPHABET "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+
+/* Fill the substitution matrix with the match and mismatch scores; the
+ * letter X, if present in the alphabet, scores zero against all letters. */
+static void
+_fill_substitution_matrix(Aligner* self)
+{
+    int i, j;
+    const int n = self->alphabet_size;
+    double** matrix = self->substitution_matrix;
+    for (i = 0; i < n; i++) {
+        matrix[i][i] = self->match;
+        for (j = 0; j < i; j++) {
+            matrix[i][j] = self->mismatch;
+            matrix[j][i] = self->mismatch;
+        }
+    }
+    i = self->mapping['X'];
+    if (i >= 0 && self->alphabet[i] == 'X') {
+        for (j = 0; j < n; j++) {
+            matrix[i][j] = 0;
+            matrix[j][i] = 0;
+        }
+    }
+}
+
+/* Allocate a square matrix with n rows and columns as a single block, with
+ * the row pointers stored in front of the scores. */
+static double**
+_create_substitution_matrix(int n)
+{
+    int i;
+    double** matrix = PyMem_Malloc(n*sizeof(double*) + n*n*sizeof(double));
+    if (!matrix) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    matrix[0] = (double*)(matrix + n);
+    for (i = 1; i < n; i++) matrix[i] = matrix[i-1] + n;
+    return matrix;
+}
+
+/* Store the alphabet and its substitution matrix, replacing the previous
+ * one.  Each character of the alphabet, and for letters also the lower case
+ * letter, is mapped to its index; all other characters are invalid. */
+static void
+_set_alphabet(Aligner* self, const char* alphabet, int n, double** matrix)
+{
+    int i;
+    int c;
+    PyMem_Free(self->substitution_matrix);
+    self->substitution_matrix = matrix;
+    self->alphabet_size = n;
+    memset(self->mapping, -1, sizeof(self->mapping));
+    for (i = 0; i < n; i++) {
+        c = alphabet[i];
+        self->alphabet[i] = c;
+        self->mapping[c] = i;
+        if (c >= 'A' && c <= 'Z') self->mapping[c - 'A' + 'a'] = i;
+    }
+    self->alphabet[i] = '\0';
+}
+
+/* Use the match and mismatch scores for the alphabet; returns -1 and sets
+ * an exception if a memory error occurs. */
+static int
+_use_match_mismatch_scores(Aligner* self, const char* alphabet, int n)
+{
+    double** matrix = _create_substitution_matrix(n);
+    if (!matrix) return -1;
+    _set_alphabet(self, alphabet, n, matrix);
+    self->substitution_matrix_given = 0;
+    self->matrix_letters[0] = '\0';
+    _fill_substitution_matrix(self);
+    return 0;
+}
+
 static int
 Aligner_init(Aligner *self, PyObject *args, PyObject *kwds)
 {
     static char *kwlist[] = {"match", "mismatch", NULL};
-    int i, j;
-    const int n = 26;
 
     self->mode = Global;
     self->match = 1.0;
@@ -1782,23 +2311,24 @@ Aligner_init(Aligner *self, PyObject *args, PyObject *kwds)
     if (!PyArg_ParseTupleAndKeywords(args, kwds, "|dd", kwlist,
                                      &self->match, &self->mismatch))
         return -1;
-    for (i = 0; i < n; i++) {
-        self->substitution_matrix[i][i] = self->match;
-        for (j = 0; j < i; j++) {
-            self->substitution_matrix[i][j] = self->mismatch;
-            self->substitution_matrix[j][i] = self->mismatch;
-        }
-    }
-    i = 'X' - 'A';
-    self->substitution_matrix[i][i] = 0.0;
-    self->letters = NULL;
+    if (_use_match_mismatch_scores(self, DEFAULT_ALPHABET,
+                                   sizeof(DEFAULT_ALPHABET) - 1) < 0)
+        return -1;
     self->algorithm = Unknown;
+    self->n_threads = 1;
+    self->linear_space = 0;
+    self->band_width = -1;
+    self->band_offset = 0;
+    self->band_edge_touched = 0;
+    self->xdrop = -1.0;
     return 0;
 }
 
 static void
 Aligner_dealloc(Aligner* self)
-{   if (self->letters) PyMem_Free(self->letters);
+{   PyMem_Free(self->substitution_matrix);
+    PyMem_Free(self->gap_tables.target);
+    PyMem_Free(self->gap_tables.query);
     Py_XDECREF(self->target_gap_function);
     Py_XDECREF(self->query_gap_function);
     Py_TYPE(self)->tp_free((PyObject*)self);
@@ -1823,7 +2353,7 @@ Aligner_str(Aligner* self)
     char* p = text;
     n = sprintf(text, "Pairwise sequence aligner with parameters\n");
     p += n;
-    if (self->letters) {
+    if (self->substitution_matrix_given) {
         n = sprintf(p, "  match/mismatch_score: <substitution matrix>\n");
         p += n;
     } else {
@@ -1903,6 +2433,7 @@ Aligner_str(Aligner* self)
     switch (self->mode) {
         case Global: n = sprintf(p, "  mode: global\n"); break;
         case Local: n = sprintf(p, "  mode: local\n"); break;
+        case Extension: n = sprintf(p, "  mode: extension\n"); break;
     }
     p += n;
 #if PY_MAJOR_VERSION >= 3
@@ -1919,7 +2450,8 @@ Aligner_str(Aligner* self)
 #endif
 }
 
-static char Aligner_mode__doc__[] = "alignment mode ('global' or 'local')";
+static char Aligner_mode__doc__[] =
+"alignment mode ('global', 'local', or 'extension')";
 
 static PyObject*
 Aligner_get_mode(Aligner* self, void* closure)
@@ -1927,6 +2459,7 @@ Aligner_get_mode(Aligner* self, void* closure)
     switch (self->mode) {
         case Global: message = "global"; break;
         case Local: message = "local"; break;
+        case Extension: message = "extension"; break;
     }
 #if PY_MAJOR_VERSION >= 3
     return PyUnicode_FromString(message);
@@ -1953,6 +2486,10 @@ Aligner_set_mode(Aligner* self, PyObject* value, void* closure)
             self->mode = Local;
             return 0;
         }
+        if (PyUnicode_CompareWithASCIIString(value, "extension") == 0) {
+            self->mode = Extension;
+            return 0;
+        }
 #else
         mode = PyString_AsString(value);
         if (strcmp(mode, "global") == 0) {
@@ -1963,10 +2500,14 @@ Aligner_set_mode(Aligner* self, PyObject* value, void* closure)
             self->mode = Local;
             return 0;
         }
+        if (strcmp(mode, "extension") == 0) {
+            self->mode = Extension;
+            return 0;
+        }
 #endif
     }
     PyErr_SetString(PyExc_ValueError,
-                    "invalid mode (expected 'global' or 'local'");
+                    "invalid mode (expected 'global', 'local', or 'extension')");
     return -1;
 }
 
@@ -1974,7 +2515,7 @@ static char Aligner_match_score__doc__[] = "match score";
 
 static PyObject*
 Aligner_get_match_score(Aligner* self, void* closure)
-{   if (self->letters) {
+{   if (self->substitution_matrix_given) {
         PyErr_SetString(PyExc_ValueError, "using a substitution matrix");
         return NULL;
     }
@@ -1983,21 +2524,20 @@ Aligner_get_match_score(Aligner* self, void* closure)
 
 static int
 Aligner_set_match_score(Aligner* self, PyObject* value, void* closure)
-{   int i;
-    const int n = 26;
+{
     const double match = PyFloat_AsDouble(value);
     if (PyErr_Occurred()) {
         PyErr_SetString(PyExc_ValueError, "invalid match score");
         return -1;
     }
-    self->match = match;
-    for (i = 0; i < n; i++) self->substitution_matrix[i][i] = match;
-    i = 'X' - 'A';
-    self->substitution_matrix[i][i] = 0.0;
-    if (self->letters) {
-        PyMem_Free(self->letters);
-        self->letters = NULL;
+    if (self->substitution_matrix_given) {
+        /* replace the substitution matrix and its alphabet */
+        if (_use_match_mismatch_scores(self, DEFAULT_ALPHABET,
+                                       sizeof(DEFAULT_ALPHABET) - 1) < 0)
+            return -1;
     }
+    self->match = match;
+    _fill_substitution_matrix(self);
     return 0;
 }
 
@@ -2005,7 +2545,7 @@ static char Aligner_mismatch_score__doc__[] = "mismatch score";
 
 static PyObject*
 Aligner_get_mismatch_score(Aligner* self, void* closure)
-{   if (self->letters) {
+{   if (self->substitution_matrix_given) {
         PyErr_SetString(PyExc_ValueError, "using a substitution matrix");
         return NULL;
     }
@@ -2014,29 +2554,20 @@ Aligner_get_mismatch_score(Aligner* self, void* closure)
 
 static int
 Aligner_set_mismatch_score(Aligner* self, PyObject* value, void* closure)
-{   int i, j;
-    const int n = 26;
+{
     const double mismatch = PyFloat_AsDouble(value);
     if (PyErr_Occurred()) {
         PyErr_SetString(PyExc_ValueError, "invalid match score");
         return -1;
     }
+    if (self->substitution_matrix_given) {
+        /* replace the substitution matrix and its alphabet */
+        if (_use_match_mismatch_scores(self, DEFAULT_ALPHABET,
+                                       sizeof(DEFAULT_ALPHABET) - 1) < 0)
+            return -1;
+    }
     self->mismatch = mismatch;
-    for (i = 0; i < n; i++) {
-        for (j = 0; j < i; j++) {
-            self->substitution_matrix[i][j] = mismatch;
-            self->substitution_matrix[j][i] = mismatch;
-        }
-    }
-    i = 'X' - 'A';
-    for (j = 0; j < n; j++) {
-        self->substitution_matrix[i][j] = 0;
-        self->substitution_matrix[j][i] = 0;
-    }
-    if (self->letters) {
-        PyMem_Free(self->letters);
-        self->letters = NULL;
-    }
+    _fill_substitution_matrix(self);
     return 0;
 }
 
@@ -2044,29 +2575,30 @@ static char Aligner_substitution_matrix__doc__[] = "substitution_matrix";
 
 static PyObject*
 Aligner_get_substitution_matrix(Aligner* self, void* closure)
-{   if (!self->letters) {
+{   if (!self->substitution_matrix_given) {
         PyErr_SetString(PyExc_ValueError, "using affine gap scores");
         return NULL;
     }
     else {
         int i, j;
-        const int n = 26;
-        const int* letters = self->letters;
+        const char* letters = self->matrix_letters;
+        const signed char* mapping = self->mapping;
         PyObject* key = NULL;
         PyObject* value = NULL;
         PyObject* matrix = PyDict_New();
         if (!matrix) goto exit;
-        for (i = 0; i < n; i++) {
-            if (!letters[i]) continue;
-            for (j = 0; j < n; j++) {
-                if (!letters[j]) continue;
+        /* only the letters in the keys, as in the matrix that was given */
+        for (i = 0; letters[i]; i++) {
+            for (j = 0; letters[j]; j++) {
 #if PY_MAJOR_VERSION >= 3
-                key = Py_BuildValue("(CC)", 'A' + i, 'A' + j);
+                key = Py_BuildValue("(CC)", letters[i], letters[j]);
 #else
-                key = Py_BuildValue("(cc)", 'A' + i, 'A' + j);
+                key = Py_BuildValue("(cc)", letters[i], letters[j]);
 #endif
                 if (!key) goto exit;
-                value = PyFloat_FromDouble(self->substitution_matrix[i][j]);
+                value = PyFloat_FromDouble(
+                    self->substitution_matrix[mapping[(int)letters[i]]]
+                                             [mapping[(int)letters[j]]]);
                 if (!value) goto exit;
                 if (PyDict_SetItem(matrix, key, value) == -1) goto exit;
                 Py_DECREF(key);
@@ -2086,73 +2618,169 @@ exit:
 static int
 Aligner_set_substitution_matrix(Aligner* self, PyObject* values, void* closure)
 {   int i, j;
-    const int n = 26;
+    int c;
+    int n = 0;
+    int m = 0;
     PyObject* key;
     PyObject* value;
     Py_ssize_t pos = 0;
     double score;
-    double substitution_matrix[26][26];
-    int substitution_matrix_flags[26][26];
-    int letters[26];
-    PyObject* item;
+    double** matrix = NULL;
+    char* given = NULL;
+    char alphabet[128];
+    char letters[128];
+    int present[128]; /* 2 for characters in the keys, 1 for other letters */
+    int index[128];
     if (!PyDict_Check(values)) {
         PyErr_SetString(PyExc_ValueError, "expected a dictionary");
         return -1;
     }
-    for (i = 0; i < n; i++) {
-        letters[i] = 0;
-        for (j = 0; j < n; j++) substitution_matrix_flags[i][j] = 0;
-    }
+    /* The first pass finds the characters found in the keys; the alphabet
+     * consists of these and the letters A to Z in ASCII order, as sequences
+     * may contain any letter.  The second pass stores the scores. */
+    for (c = 0; c < 128; c++) present[c] = 0;
     while (PyDict_Next(values, &pos, &key, &value)) {
-        score = PyFloat_AsDouble(value);
-        if (PyErr_Occurred()) {
-            PyErr_SetString(PyExc_ValueError, "invalid score found");
-            return -1;
-        }
         if (!PyTuple_Check(key) || PyTuple_GET_SIZE(key) != 2) {
             PyErr_SetString(PyExc_ValueError,
                             "each key should be a tuple of two letters");
             return -1;
         }
-        item = PyTuple_GET_ITEM(key, 0);
-        i = _convert_single_letter(item);
-        if (i < 0) return -1;
-        item = PyTuple_GET_ITEM(key, 1);
-        j = _convert_single_letter(item);
-        if (j < 0) return -1;
-        if (substitution_matrix_flags[i][j]) {
-            i = 'A' + i;
-            j = 'A' + j;
-            PyErr_Format(PyExc_ValueError,
-                         "score for (%c,%c) specified more than once (substitution matrix is case-insensitive)",
-                         i, j);
-            return -1;
+        for (i = 0; i < 2; i++) {
+            c = _convert_single_letter(PyTuple_GET_ITEM(key, i));
+            if (c < 0) return -1;
+            present[c] = 2;
         }
-        substitution_matrix_flags[i][j] = 1;
-        substitution_matrix[i][j] = score;
-        letters[i] = 1;
-        letters[j] = 1;
     }
-    if (!self->letters) self->letters = PyMem_Malloc(n*sizeof(int));
-    if (!self->letters) {
-        PyErr_SetNone(PyExc_MemoryError);
+    for (c = 0; c < 128; c++) if (present[c]) letters[m++] = c;
+    letters[m] = '\0';
+    if (m == 0) {
+        PyErr_SetString(PyExc_ValueError, "substitution matrix is empty");
         return -1;
     }
-    /* No errors - store the new substitution matrix */
+    for (c = 'A'; c <= 'Z'; c++) if (!present[c]) present[c] = 1;
+    for (c = 0; c < 128; c++) {
+        if (present[c]) {
+            index[c] = n;
+            alphabet[n++] = c;
+        }
+    }
+    matrix = _create_substitution_matrix(n);
+    if (!matrix) return -1;
+    given = PyMem_Malloc(n*n);
+    if (!given) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    memset(given, 0, n*n);
+    pos = 0;
+    while (PyDict_Next(values, &pos, &key, &value)) {
+        score = PyFloat_AsDouble(value);
+        if (PyErr_Occurred()) {
+            PyErr_SetString(PyExc_ValueError, "invalid score found");
+            goto exit;
+        }
+        i = index[_convert_single_letter(PyTuple_GET_ITEM(key, 0))];
+        j = index[_convert_single_letter(PyTuple_GET_ITEM(key, 1))];
+        if (given[i*n+j]) {
+            PyErr_Format(PyExc_ValueError,
+                         "score for (%c,%c) specified more than once (substitution matrix is case-insensitive)",
+                         alphabet[i], alphabet[j]);
+            goto exit;
+        }
+        given[i*n+j] = 1;
+        matrix[i][j] = score;
+    }
+    /* Scores given for only one of (a, b) and (b, a) are symmetric, and
+     * other pairs of characters in the keys score zero.  Letters that are
+     * not in the keys are scored by the match and mismatch scores, with X
+     * scoring zero, as when using match and mismatch scores. */
     for (i = 0; i < n; i++) {
-        self->letters[i] = letters[i];
         for (j = 0; j < n; j++) {
-            if (!letters[i] || !letters[j]) continue;
-            if (substitution_matrix_flags[i][j])
-                score = substitution_matrix[i][j];
-            else if (substitution_matrix_flags[j][i])
-                score = substitution_matrix[j][i];
-            else
-                score = 0;
-            self->substitution_matrix[i][j] = score;
+            if (given[i*n+j]) continue;
+            if (given[j*n+i]) matrix[i][j] = matrix[j][i];
+            else if (present[(int)alphabet[i]] == 2
+                  && present[(int)alphabet[j]] == 2) matrix[i][j] = 0;
+            else if (alphabet[i] == 'X' || alphabet[j] == 'X')
+                matrix[i][j] = 0;
+            else if (i == j) matrix[i][j] = self->match;
+            else matrix[i][j] = self->mismatch;
         }
     }
+    PyMem_Free(given);
+    /* No errors - store the new substitution matrix */
+    _set_alphabet(self, alphabet, n, matrix);
+    self->substitution_matrix_given = 1;
+    memcpy(self->matrix_letters, letters, m + 1);
     return 0;
+exit:
+    PyMem_Free(given);
+    PyMem_Free(matrix);
+    return -1;
+}
+
+static char Aligner_alphabet__doc__[] =
+"alphabet of the substitution matrix, as a string of printable ASCII\n"
+"characters; letters are case-insensitive.  By default, the alphabet\n"
+"consists of the letters A to Z.  If a substitution matrix is used, its\n"
+"alphabet consists of the characters found in its keys and the letters A\n"
+"to Z; letters not found in its keys are scored by the match and mismatch\n"
+"scores.  Otherwise, the\n"
+"alphabet can be set to a smaller alphabet (such as 'ACGT') to use a more\n"
+"compact substitution matrix, or to include characters other than letters\n"
+"(such as '*' for a stop codon), which are scored by the match and\n"
+"mismatch scores.";
+
+static PyObject*
+Aligner_get_alphabet(Aligner* self, void* closure)
+{
+#if PY_MAJOR_VERSION >= 3
+    return PyUnicode_FromString(self->alphabet);
+#else
+    return PyString_FromString(self->alphabet);
+#endif
+}
+
+static int
+Aligner_set_alphabet(Aligner* self, PyObject* value, void* closure)
+{
+    int i;
+    int c;
+    int n = 0;
+    char alphabet[128];
+    int present[128];
+    Py_ssize_t length;
+    PyObject* item;
+    if (self->substitution_matrix_given) {
+        PyErr_SetString(PyExc_ValueError,
+            "the alphabet is defined by the substitution matrix");
+        return -1;
+    }
+    length = PySequence_Size(value);
+    if (length < 0) {
+        PyErr_SetString(PyExc_TypeError, "expected a string");
+        return -1;
+    }
+    if (length == 0) {
+        PyErr_SetString(PyExc_ValueError, "alphabet is empty");
+        return -1;
+    }
+    for (c = 0; c < 128; c++) present[c] = 0;
+    for (i = 0; i < length; i++) {
+        item = PySequence_GetItem(value, i);
+        if (!item) return -1;
+        c = _convert_single_letter(item);
+        Py_DECREF(item);
+        if (c < 0) return -1;
+        if (present[c]) {
+            PyErr_Format(PyExc_ValueError,
+                         "alphabet contains '%c' more than once "
+                         "(letters are case-insensitive)", c);
+            return -1;
+        }
+        present[c] = 1;
+        alphabet[n++] = c;
+    }
+    return _use_match_mismatch_scores(self, alphabet, n);
 }
 
 static char Aligner_gap_score__doc__[] = "gap score";
@@ -2849,7 +3477,12 @@ Aligner_set_target_extend_gap_score(Aligner* self, PyObject* value, void* closur
     return 0;
 }
 
-static char Aligner_target_gap_score__doc__[] = "target gap score";
+static char Aligner_target_gap_score__doc__[] =
+"target gap score, or a gap function f(i, n) returning the score of a gap of\n"
+"length n at position i of the target.  The gap function should depend on its\n"
+"arguments only, as it is called once for each position and gap length at\n"
+"the start of each score or alignment calculation, and the scores are\n"
+"reused for all cells of the dynamic programming matrices.";
 
 static PyObject*
 Aligner_get_target_gap_score(Aligner* self, void* closure)
@@ -2969,7 +3602,12 @@ Aligner_set_query_extend_gap_score(Aligner* self, PyObject* value, void* closure
     return 0;
 }
 
-static char Aligner_query_gap_score__doc__[] = "query gap score";
+static char Aligner_query_gap_score__doc__[] =
+"query gap score, or a gap function f(i, n) returning the score of a gap of\n"
+"length n at position i of the query.  The gap function should depend on its\n"
+"arguments only, as it is called once for each position and gap length at\n"
+"the start of each score or alignment calculation, and the scores are\n"
+"reused for all cells of the dynamic programming matrices.";
 
 static PyObject*
 Aligner_get_query_gap_score(Aligner* self, void* closure)
@@ -3723,6 +4361,164 @@ Aligner_set_epsilon(Aligner* self, PyObject* value, void* closure)
     return 0;
 }
 
+static char Aligner_n_threads__doc__[] =
+"number of threads used by score_many and score_pairs, and by score for\n"
+"long global alignments (0 for the number of processors)";
+
+static PyObject*
+Aligner_get_n_threads(Aligner* self, void* closure)
+{
+#if PY_MAJOR_VERSION >= 3
+    return PyLong_FromLong(self->n_threads);
+#else
+    return PyInt_FromLong(self->n_threads);
+#endif
+}
+
+static int
+Aligner_set_n_threads(Aligner* self, PyObject* value, void* closure)
+{   long n;
+    n = PyLong_AsLong(value);
+    if (n == -1 && PyErr_Occurred()) return -1;
+    if (n < 0 || n > MAXIMUM_NUMBER_OF_THREADS) {
+        PyErr_Format(PyExc_ValueError,
+                     "number of threads should be between 0 and %d",
+                     MAXIMUM_NUMBER_OF_THREADS);
+        return -1;
+    }
+    self->n_threads = (int)n;
+    return 0;
+}
+
+static char Aligner_linear_space__doc__[] =
+"if True, align finds a single optimal global alignment in linear space";
+
+static PyObject*
+Aligner_get_linear_space(Aligner* self, void* closure)
+{
+    if (self->linear_space) Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+static int
+Aligner_set_linear_space(Aligner* self, PyObject* value, void* closure)
+{
+    const int linear_space = PyObject_IsTrue(value);
+    if (linear_space == -1) return -1;
+    self->linear_space = linear_space;
+    return 0;
+}
+
+static char Aligner_band_width__doc__[] =
+"width of the band around the diagonal to which global alignments are\n"
+"restricted (None to align without a band)";
+
+static PyObject*
+Aligner_get_band_width(Aligner* self, void* closure)
+{
+    if (self->band_width < 0) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+#if PY_MAJOR_VERSION >= 3
+    return PyLong_FromLong(self->band_width);
+#else
+    return PyInt_FromLong(self->band_width);
+#endif
+}
+
+static int
+Aligner_set_band_width(Aligner* self, PyObject* value, void* closure)
+{
+    long width;
+    if (value == Py_None) {
+        self->band_width = -1;
+        return 0;
+    }
+    width = PyLong_AsLong(value);
+    if (width == -1 && PyErr_Occurred()) return -1;
+    if (width < 0 || width > INT_MAX) {
+        PyErr_SetString(PyExc_ValueError,
+                        "band width should be a non-negative integer");
+        return -1;
+    }
+    self->band_width = (int)width;
+    return 0;
+}
+
+static char Aligner_band_offset__doc__[] =
+"diagonal j - i around which the band is centered";
+
+static PyObject*
+Aligner_get_band_offset(Aligner* self, void* closure)
+{
+#if PY_MAJOR_VERSION >= 3
+    return PyLong_FromLong(self->band_offset);
+#else
+    return PyInt_FromLong(self->band_offset);
+#endif
+}
+
+static int
+Aligner_set_band_offset(Aligner* self, PyObject* value, void* closure)
+{
+    long offset = PyLong_AsLong(value);
+    if (offset == -1 && PyErr_Occurred()) return -1;
+    if (offset < INT_MIN || offset > INT_MAX) {
+        PyErr_SetString(PyExc_OverflowError, "band offset is too large");
+        return -1;
+    }
+    self->band_offset = (int)offset;
+    return 0;
+}
+
+static char Aligner_band_edge_touched__doc__[] =
+"True if the optimal path of the last banded alignment calculated by score\n"
+"or align touched the edge of the band, which suggests that a wider band\n"
+"may give a better alignment (the batch methods report this for each pair\n"
+"separately)";
+
+static PyObject*
+Aligner_get_band_edge_touched(Aligner* self, void* closure)
+{
+    if (self->band_edge_touched) Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+static char Aligner_xdrop__doc__[] =
+"X-drop threshold for alignments in extension mode: cells scoring more than\n"
+"xdrop below the best score found so far are pruned, and the calculation\n"
+"stops when a row has no cells left (None to calculate all cells)";
+
+static PyObject*
+Aligner_get_xdrop(Aligner* self, void* closure)
+{
+    if (self->xdrop < 0) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+    return PyFloat_FromDouble(self->xdrop);
+}
+
+static int
+Aligner_set_xdrop(Aligner* self, PyObject* value, void* closure)
+{
+    double xdrop;
+    if (value == Py_None) {
+        self->xdrop = -1.0;
+        return 0;
+    }
+    xdrop = PyFloat_AsDouble(value);
+    if (xdrop == -1.0 && PyErr_Occurred()) return -1;
+    if (!(xdrop >= 0)) {
+        PyErr_SetString(PyExc_ValueError,
+                        "xdrop should be a non-negative number");
+        return -1;
+    }
+    self->xdrop = xdrop;
+    return 0;
+}
+
 static Algorithm _get_algorithm(Aligner* self)
 {
     Algorithm algorithm = self->algorithm;
@@ -3773,6 +4569,9 @@ Aligner_get_algorithm(Aligner* self, void* closure)
                 case Local:
                     s = "Smith-Waterman";
                     break;
+                case Extension:
+                    s = "Needleman-Wunsch extension";
+                    break;
             }
             break;
         case Gotoh:
@@ -3783,6 +4582,9 @@ Aligner_get_algorithm(Aligner* self, void* closure)
                 case Local:
                     s = "Gotoh local alignment algorithm";
                     break;
+                case Extension:
+                    s = "Gotoh extension alignment algorithm";
+                    break;
             }
             break;
         case WatermanSmithBeyer:
@@ -3793,6 +4595,9 @@ Aligner_get_algorithm(Aligner* self, void* closure)
                 case Local:
                     s = "Waterman-Smith-Beyer local alignment algorithm";
                     break;
+                case Extension:
+                    s = "Waterman-Smith-Beyer extension alignment algorithm";
+                    break;
             }
             break;
         case Unknown:
@@ -3831,6 +4636,10 @@ static PyGetSetDef Aligner_getset[] = {
         (getter)Aligner_get_substitution_matrix,
         (setter)Aligner_set_substitution_matrix,
         Aligner_substitution_matrix__doc__, NULL},
+    {"alphabet",
+        (getter)Aligner_get_alphabet,
+        (setter)Aligner_set_alphabet,
+        Aligner_alphabet__doc__, NULL},
     {"gap_score",
         (getter)Aligner_get_gap_score,
         (setter)Aligner_set_gap_score,
@@ -4019,6 +4828,30 @@ static PyGetSetDef Aligner_getset[] = {
         (getter)Aligner_get_algorithm,
         (setter)NULL,
         Aligner_algorithm__doc__, NULL},
+    {"n_threads",
+        (getter)Aligner_get_n_threads,
+        (setter)Aligner_set_n_threads,
+        Aligner_n_threads__doc__, NULL},
+    {"linear_space",
+        (getter)Aligner_get_linear_space,
+        (setter)Aligner_set_linear_space,
+        Aligner_linear_space__doc__, NULL},
+    {"band_width",
+        (getter)Aligner_get_band_width,
+        (setter)Aligner_set_band_width,
+        Aligner_band_width__doc__, NULL},
+    {"band_offset",
+        (getter)Aligner_get_band_offset,
+        (setter)Aligner_set_band_offset,
+        Aligner_band_offset__doc__, NULL},
+    {"band_edge_touched",
+        (getter)Aligner_get_band_edge_touched,
+        (setter)NULL,
+        Aligner_band_edge_touched__doc__, NULL},
+    {"xdrop",
+        (getter)Aligner_get_xdrop,
+        (setter)Aligner_set_xdrop,
+        Aligner_xdrop__doc__, NULL},
     {NULL}  /* Sentinel */
 };
 
@@ -4293,6 +5126,43 @@ static PyGetSetDef Aligner_getset[] = {
 
 /* -------------- allocation & deallocation ------------- */
 
+/* The traceback matrices are allocated as a single contiguous block, indexed
+ * through an array of pointers to the rows.  For the Waterman-Smith-Beyer
+ * algorithm, the four zero-terminated lists of gap lengths of a cell are
+ * stored consecutively in a single block starting at MIx. */
+
+/* Store the lists of gap lengths of a cell of the Waterman-Smith-Beyer
+ * traceback matrix, replacing any previous lists.  Returns 0 if memory
+ * allocation fails. */
+static int
+_store_gaps_WSB(TraceGapsWatermanSmithBeyer* cell,
+                const int* MIx, int nMIx, const int* IyIx, int nIyIx,
+                const int* MIy, int nMIy, const int* IxIy, int nIxIy)
+{
+    int* p;
+    int* previous = cell->MIx;
+    int* block = PyMem_Malloc((nMIx + nIyIx + nMIy + nIxIy + 4) * sizeof(int));
+    if (!block) return 0;
+    p = block;
+    if (nMIx) memcpy(p, MIx, nMIx * sizeof(int));
+    p[nMIx] = 0;
+    cell->MIx = p;
+    p += nMIx + 1;
+    if (nIyIx) memcpy(p, IyIx, nIyIx * sizeof(int));
+    p[nIyIx] = 0;
+    cell->IyIx = p;
+    p += nIyIx + 1;
+    if (nMIy) memcpy(p, MIy, nMIy * sizeof(int));
+    p[nMIy] = 0;
+    cell->MIy = p;
+    p += nMIy + 1;
+    if (nIxIy) memcpy(p, IxIy, nIxIy * sizeof(int));
+    p[nIxIy] = 0;
+    cell->IxIy = p;
+    if (previous) PyMem_Free(previous);
+    return 1;
+}
+
 static PathGenerator*
 PathGenerator_create_NWSW(Py_ssize_t nA, Py_ssize_t nB, Mode mode)
 {
@@ -4314,19 +5184,24 @@ PathGenerator_create_NWSW(Py_ssize_t nA, Py_ssize_t nB, Mode mode)
     paths->algorithm = NeedlemanWunschSmithWaterman;
     paths->mode = mode;
     paths->length = 0;
+    paths->skip = 0;
+    paths->steps = NULL;
+    paths->nsteps = 0;
+    paths->band_offset = 0;
+    paths->band_width = -1;
 
     M = PyMem_Malloc((nA+1)*sizeof(Trace*));
     paths->M = M;
     if (!M) goto exit;
+    M[0] = PyMem_Malloc((nA+1)*(nB+1)*sizeof(Trace));
+    if (!M[0]) goto exit;
+    for (i = 1; i <= nA; i++) M[i] = M[i-1] + nB + 1;
     switch (mode) {
-        case Global: trace = VERTICAL; break;
+        case Global:
+        case Extension: trace = VERTICAL; break;
         case Local: trace = STARTPOINT; break;
     }
-    for (i = 0; i <= nA; i++) {
-        M[i] = PyMem_Malloc((nB+1)*sizeof(Trace));
-        if (!M[i]) goto exit;
-        M[i][0].trace = trace;
-    }
+    for (i = 0; i <= nA; i++) M[i][0].trace = trace;
     if (mode == Global) {
         M[0][0].trace = 0;
         trace = HORIZONTAL;
@@ -4361,27 +5236,31 @@ PathGenerator_create_Gotoh(Py_ssize_t nA, Py_ssize_t nB, Mode mode)
     paths->algorithm = Gotoh;
     paths->mode = mode;
     paths->length = 0;
+    paths->skip = 0;
+    paths->steps = NULL;
+    paths->nsteps = 0;
+    paths->band_offset = 0;
+    paths->band_width = -1;
 
     switch (mode) {
-        case Global: trace = 0; break;
+        case Global:
+        case Extension: trace = 0; break;
         case Local: trace = STARTPOINT; break;
     }
 
     M = PyMem_Malloc((nA+1)*sizeof(Trace*));
     if (!M) goto exit;
     paths->M = M;
-    for (i = 0; i <= nA; i++) {
-        M[i] = PyMem_Malloc((nB+1)*sizeof(Trace));
-        if (!M[i]) goto exit;
-        M[i][0].trace = trace;
-    }
+    M[0] = PyMem_Malloc((nA+1)*(nB+1)*sizeof(Trace));
+    if (!M[0]) goto exit;
+    for (i = 1; i <= nA; i++) M[i] = M[i-1] + nB + 1;
+    for (i = 0; i <= nA; i++) M[i][0].trace = trace;
     gaps = PyMem_Malloc((nA+1)*sizeof(TraceGapsGotoh*));
     if (!gaps) goto exit;
     paths->gaps.gotoh = gaps;
-    for (i = 0; i <= nA; i++) {
-        gaps[i] = PyMem_Malloc((nB+1)*sizeof(TraceGapsGotoh));
-        if (!gaps[i]) goto exit;
-    }
+    gaps[0] = PyMem_Malloc((nA+1)*(nB+1)*sizeof(TraceGapsGotoh));
+    if (!gaps[0]) goto exit;
+    for (i = 1; i <= nA; i++) gaps[i] = gaps[i-1] + nB + 1;
 
     gaps[0][0].Ix = 0;
     gaps[0][0].Iy = 0;
@@ -4422,7 +5301,6 @@ static PathGenerator*
 PathGenerator_create_WSB(Py_ssize_t nA, Py_ssize_t nB, Mode mode)
 {
     int i, j;
-    int* trace;
     Trace** M = NULL;
     TraceGapsWatermanSmithBeyer** gaps = NULL;
     PathGenerator* paths;
@@ -4439,40 +5317,40 @@ PathGenerator_create_WSB(Py_ssize_t nA, Py_ssize_t nB, Mode mode)
     paths->algorithm = WatermanSmithBeyer;
     paths->mode = mode;
     paths->length = 0;
+    paths->skip = 0;
+    paths->steps = NULL;
+    paths->nsteps = 0;
+    paths->band_offset = 0;
+    paths->band_width = -1;
 
     M = PyMem_Malloc((nA+1)*sizeof(Trace*));
     if (!M) goto exit;
     paths->M = M;
-    for (i = 0; i <= nA; i++) {
-        M[i] = PyMem_Malloc((nB+1)*sizeof(Trace));
-        if (!M[i]) goto exit;
-    }
+    M[0] = PyMem_Malloc((nA+1)*(nB+1)*sizeof(Trace));
+    if (!M[0]) goto exit;
+    for (i = 1; i <= nA; i++) M[i] = M[i-1] + nB + 1;
     gaps = PyMem_Malloc((nA+1)*sizeof(TraceGapsWatermanSmithBeyer*));
     if (!gaps) goto exit;
     paths->gaps.waterman_smith_beyer = gaps;
-    for (i = 0; i <= nA; i++) gaps[i] = NULL;
+    gaps[0] = PyMem_Malloc((nA+1)*(nB+1)*sizeof(TraceGapsWatermanSmithBeyer));
+    if (!gaps[0]) goto exit;
+    for (i = 1; i <= nA; i++) gaps[i] = gaps[i-1] + nB + 1;
     for (i = 0; i <= nA; i++) {
-        gaps[i] = PyMem_Malloc((nB+1)*sizeof(TraceGapsWatermanSmithBeyer));
-        if (!gaps[i]) goto exit;
         for (j = 0; j <= nB; j++) {
             gaps[i][j].MIx = NULL;
             gaps[i][j].IyIx = NULL;
             gaps[i][j].MIy = NULL;
             gaps[i][j].IxIy = NULL;
         }
+    }
+    for (i = 0; i <= nA; i++) {
         M[i][0].path = 0;
         switch (mode) {
             case Global:
+            case Extension:
                 M[i][0].trace = 0;
-                trace = PyMem_Malloc(2*sizeof(int));
-                if (!trace) goto exit;
-                gaps[i][0].MIx = trace;
-                trace[0] = i;
-                trace[1] = 0;
-                trace = PyMem_Malloc(sizeof(int));
-                if (!trace) goto exit;
-                gaps[i][0].IyIx = trace;
-                trace[0] = 0;
+                if (!_store_gaps_WSB(&gaps[i][0], &i, 1, NULL, 0, NULL, 0, NULL, 0))
+                    goto exit;
                 break;
             case Local:
                 M[i][0].trace = STARTPOINT;
@@ -4482,16 +5360,10 @@ PathGenerator_create_WSB(Py_ssize_t nA, Py_ssize_t nB, Mode mode)
     for (i = 1; i <= nB; i++) {
         switch (mode) {
             case Global:
+            case Extension:
                 M[0][i].trace = 0;
-                trace = PyMem_Malloc(2*sizeof(int));
-                if (!trace) goto exit;
-                gaps[0][i].MIy = trace;
-                trace[0] = i;
-                trace[1] = 0;
-                trace = PyMem_Malloc(sizeof(int));
-                if (!trace) goto exit;
-                gaps[0][i].IxIy = trace;
-                trace[0] = 0;
+                if (!_store_gaps_WSB(&gaps[0][i], NULL, 0, NULL, 0, &i, 1, NULL, 0))
+                    goto exit;
                 break;
             case Local:
                 M[0][i].trace = STARTPOINT;
@@ -4506,135 +5378,792 @@ exit:
     return NULL;
 }
 
-/* ----------------- alignment algorithms ----------------- */
+/* ------------- striped SIMD local alignment scores ------------- */
+
+/* Farrar's striped algorithm (Bioinformatics 23: 156-161, 2007), adapted to
+ * the three-state recursion used by Aligner_gotoh_local_score (the linear
+ * gap recursion of Aligner_smithwaterman_score is the special case of equal
+ * open and extend gap scores).  The query is split into segLen segments of
+ * one vector each, such that lane t of segment k holds query position
+ * k + t * segLen, and a query profile with the substitution scores of each
+ * letter against each query position is built once per query.  The 8-bit
+ * kernel is tried first, followed by the 16-bit kernel if the score
+ * saturates; if that saturates as well, the caller falls back to the scalar
+ * code.  The SIMD kernels are used only if all scores are integers and the
+ * gap scores are not positive, so that the score is identical to the one
+ * calculated by the scalar code.
+ */
 
-static PyObject*
-Aligner_needlemanwunsch_score(Aligner* self, const char* sA, Py_ssize_t nA,
-                                             const char* sB, Py_ssize_t nB)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef HAVE_SSE2
+
+static int
+_striped_local_parameters_ok(double gap_open_A, double gap_extend_A,
+                             double gap_open_B, double gap_extend_B)
 {
-    char c;
+    const double gaps[4] = {gap_open_A, gap_extend_A, gap_open_B, gap_extend_B};
     int i;
+    for (i = 0; i < 4; i++) {
+        if (gaps[i] > 0 || gaps[i] < -SHRT_MAX) return 0;
+        if (gaps[i] != (int)gaps[i]) return 0;
+    }
+    return 1;
+}
+
+/* Fill profile[k*nB + j] with the substitution score of letter k against
+ * query letter j.  Returns 0 if a score is not integral or out of range for
+ * the 16-bit kernel, or if the query contains a non-letter character. */
+static int
+_striped_query_scores(Aligner* self, const char* sB, Py_ssize_t nB,
+                      short* profile, int* minimum, int* maximum)
+{
     int j;
-    int kA;
+    int k;
     int kB;
-    const double gap_extend_A = self->target_extend_gap_score;
-    const double gap_extend_B = self->query_extend_gap_score;
-    const double left_gap_extend_A = self->target_left_extend_gap_score;
-    const double right_gap_extend_A = self->target_right_extend_gap_score;
-    const double left_gap_extend_B = self->query_left_extend_gap_score;
-    const double right_gap_extend_B = self->query_right_extend_gap_score;
-    double score;
-    double temp;
-
-    double* scores;
-
-    /* Needleman-Wunsch algorithm */
-    scores = PyMem_Malloc((nB+1)*sizeof(double));
-    if (!scores) return PyErr_NoMemory();
-
-    /* The top row of the score matrix is a special case,
-     * as there are no previously aligned characters.
-     */
-    scores[0] = 0.0;
-    for (j = 1; j <= nB; j++) scores[j] = j * left_gap_extend_A;
-    for (i = 1; i < nA; i++) {
-        kA = CHARINDEX(sA[i-1]);
-        temp = scores[0];
-        scores[0] = i * left_gap_extend_B;
-        for (j = 1; j < nB; j++) {
-            kB = CHARINDEX(sB[j-1]);
-            SELECT_SCORE_GLOBAL(temp + self->substitution_matrix[kA][kB],
-                                scores[j] + gap_extend_B,
-                                scores[j-1] + gap_extend_A);
-            temp = scores[j];
-            scores[j] = score;
+    const int n = self->alphabet_size;
+    double value;
+    int score;
+    int smin = 0;
+    int smax = 0;
+    for (j = 0; j < nB; j++) {
+        kB = sB[j];
+        if (kB < 0 || kB >= n) return 0;
+        for (k = 0; k < n; k++) {
+            value = self->substitution_matrix[k][kB];
+            if (value < -SHRT_MAX || value > SHRT_MAX) return 0;
+            score = (int)value;
+            if (score != value) return 0;
+            if (score < smin) smin = score;
+            if (score > smax) smax = score;
+            profile[k*nB + j] = (short)score;
         }
-        kB = CHARINDEX(sB[nB-1]);
-        SELECT_SCORE_GLOBAL(temp + self->substitution_matrix[kA][kB],
-                            scores[nB] + right_gap_extend_B,
-                            scores[nB-1] + gap_extend_A);
-        temp = scores[nB];
-        scores[nB] = score;
-    }
-    kA = CHARINDEX(sA[nA-1]);
-    temp = scores[0];
-    scores[0] = nA * right_gap_extend_B;
-    for (j = 1; j < nB; j++) {
-        kB = CHARINDEX(sB[j-1]);
-        SELECT_SCORE_GLOBAL(temp + self->substitution_matrix[kA][kB],
-                            scores[j] + gap_extend_B,
-                            scores[j-1] + right_gap_extend_A);
-        temp = scores[j];
-        scores[j] = score;
     }
-    kB = CHARINDEX(sB[nB-1]);
-    SELECT_SCORE_GLOBAL(temp + self->substitution_matrix[kA][kB],
-                        scores[nB] + right_gap_extend_B,
-                        scores[nB-1] + right_gap_extend_A);
-    PyMem_Free(scores);
-    return PyFloat_FromDouble(score);
+    *minimum = smin;
+    *maximum = smax;
+    return 1;
 }
 
-static PyObject*
-Aligner_smithwaterman_score(Aligner* self, const char* sA, Py_ssize_t nA,
-                                           const char* sB, Py_ssize_t nB)
+#define STRIPED_LOCAL_KERNEL(VECTOR_OP, lanes, shift) \
+    for (i = 0; i < nA; i++) { \
+        kA = sA[i]; \
+        profile = vProfile + kA * segLen; \
+        /* H'(i-1, j-1) for the first segment is found in the last \
+         * segment, shifted by one lane; the boundary is zero. */ \
+        vH = VECTOR_OP##_MAX3(pM[segLen-1], pIx[segLen-1], pIy[segLen-1]); \
+        vH = _mm_slli_si128(vH, shift); \
+        for (k = 0; k < segLen; k++) { \
+            vM = VECTOR_OP##_ADD_SCORE(vH, profile[k]); \
+            vMax = VECTOR_OP##_MAX(vMax, vM); \
+            vH = VECTOR_OP##_MAX3(pM[k], pIx[k], pIy[k]); \
+            vIx = VECTOR_OP##_MAX(VECTOR_OP##_GAP(VECTOR_OP##_MAX(pM[k], pIy[k]), vOpenB), \
+                                  VECTOR_OP##_GAP(pIx[k], vExtendB)); \
+            M[k] = vM; \
+            Ix[k] = vIx; \
+        } \
+        /* Gaps in the target run along the query, and therefore across \
+         * segments and lanes.  First propagate within each lane, then \
+         * carry over the last segment into the next lane until no score \
+         * changes (the lazy-F loop of Farrar). */ \
+        vG = VECTOR_OP##_MAX(M[segLen-1], Ix[segLen-1]); \
+        vG = _mm_slli_si128(vG, shift); \
+        vF = VECTOR_OP##_ZERO; \
+        for (k = 0; k < segLen; k++) { \
+            vF = VECTOR_OP##_MAX(VECTOR_OP##_GAP(vG, vOpenA), \
+                                 VECTOR_OP##_GAP(vF, vExtendA)); \
+            Iy[k] = vF; \
+            vG = VECTOR_OP##_MAX(M[k], Ix[k]); \
+        } \
+        for (t = 0; t < lanes; t++) { \
+            vF = _mm_slli_si128(Iy[segLen-1], shift); \
+            vF = VECTOR_OP##_GAP(vF, vExtendA); \
+            for (k = 0; k < segLen; k++) { \
+                if (!VECTOR_OP##_ANY_GREATER(vF, Iy[k])) goto done##VECTOR_OP; \
+                Iy[k] = VECTOR_OP##_MAX(Iy[k], vF); \
+                vF = VECTOR_OP##_GAP(Iy[k], vExtendA); \
+            } \
+        } \
+done##VECTOR_OP: \
+        swap = pM; pM = M; M = swap; \
+        swap = pIx; pIx = Ix; Ix = swap; \
+        swap = pIy; pIy = Iy; Iy = swap; \
+    }
+
+/* unsigned 8-bit lanes, scores shifted by bias to make them nonnegative */
+#define EPU8_ZERO _mm_setzero_si128()
+#define EPU8_MAX(a, b) _mm_max_epu8(a, b)
+#define EPU8_MAX3(a, b, c) _mm_max_epu8(_mm_max_epu8(a, b), c)
+#define EPU8_ADD_SCORE(a, s) _mm_subs_epu8(_mm_adds_epu8(a, s), vBias)
+#define EPU8_GAP(a, g) _mm_subs_epu8(a, g)
+#define EPU8_ANY_GREATER(a, b) \
+    (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(a, b), vZero)) != 0xFFFF)
+
+/* signed 16-bit lanes; all local scores are nonnegative */
+#define EPI16_ZERO _mm_setzero_si128()
+#define EPI16_MAX(a, b) _mm_max_epi16(a, b)
+#define EPI16_MAX3(a, b, c) _mm_max_epi16(_mm_max_epi16(a, b), c)
+#define EPI16_ADD_SCORE(a, s) _mm_max_epi16(_mm_adds_epi16(a, s), vZero)
+#define EPI16_GAP(a, g) _mm_max_epi16(_mm_subs_epi16(a, g), vZero)
+#define EPI16_ANY_GREATER(a, b) \
+    (_mm_movemask_epi8(_mm_cmpgt_epi16(a, b)) != 0)
+
+/* Returns 1 if the score was calculated, 0 if the striped kernels cannot be
+ * used or the score does not fit in 16 bits, and -1 if a memory error
+ * occurred. */
+static int
+_striped_local_score(Aligner* self, const char* sA, Py_ssize_t nA,
+                                    const char* sB, Py_ssize_t nB,
+                                    double gap_open_A, double gap_extend_A,
+                                    double gap_open_B, double gap_extend_B,
+                                    double* score)
 {
-    char c;
     int i;
     int j;
+    int k;
+    int t;
     int kA;
-    int kB;
-    const double gap_extend_A = self->target_extend_gap_score;
-    const double gap_extend_B = self->query_extend_gap_score;
-    double score;
-    double* scores;
-    double temp;
-    double maximum = 0;
+    const int n = self->alphabet_size;
+    int segLen;
+    int smin;
+    int smax;
+    int result = 0;
+    short* scores;
+    __m128i* memory = NULL;
+    __m128i* vProfile;
+    __m128i* profile;
+    __m128i* pM;
+    __m128i* pIx;
+    __m128i* pIy;
+    __m128i* M;
+    __m128i* Ix;
+    __m128i* Iy;
+    __m128i* swap;
+    __m128i vH, vM, vIx, vG, vF, vMax;
+    const __m128i vZero = _mm_setzero_si128();
+
+    if (nA < 1 || nB < 1 || nB > INT_MAX / 16) return 0;
+    if (!_striped_local_parameters_ok(gap_open_A, gap_extend_A,
+                                      gap_open_B, gap_extend_B)) return 0;
+    for (i = 0; i < nA; i++) {
+        kA = sA[i];
+        if (kA < 0 || kA >= n) return 0;
+    }
+    scores = PyMem_RawMalloc(n*nB*sizeof(short));
+    if (!scores) return -1;
+    if (!_striped_query_scores(self, sB, nB, scores, &smin, &smax)) goto exit;
+
+    if (smax - smin < UCHAR_MAX && -gap_open_A <= UCHAR_MAX
+                                && -gap_extend_A <= UCHAR_MAX
+                                && -gap_open_B <= UCHAR_MAX
+                                && -gap_extend_B <= UCHAR_MAX) {
+        const int bias = -smin;
+        const __m128i vBias = _mm_set1_epi8((char)bias);
+        const __m128i vOpenA = _mm_set1_epi8((char)(int)(-gap_open_A));
+        const __m128i vExtendA = _mm_set1_epi8((char)(int)(-gap_extend_A));
+        const __m128i vOpenB = _mm_set1_epi8((char)(int)(-gap_open_B));
+        const __m128i vExtendB = _mm_set1_epi8((char)(int)(-gap_extend_B));
+        unsigned char* p;
+        unsigned char buffer[16];
+        int maximum;
+        segLen = (nB + 15) / 16;
+        memory = _mm_malloc((n+6)*segLen*sizeof(__m128i), 16);
+        if (!memory) {
+            result = -1;
+            goto exit;
+        }
+        vProfile = memory;
+        p = (unsigned char*)vProfile;
+        for (kA = 0; kA < n; kA++) {
+            for (k = 0; k < segLen; k++) {
+                for (t = 0; t < 16; t++) {
+                    j = k + t * segLen;
+                    /* padding scores the lowest possible value */
+                    *p++ = (j < nB) ? scores[kA*nB + j] + bias : 0;
+                }
+            }
+        }
+        pM = memory + n*segLen;
+        pIx = pM + segLen;
+        pIy = pIx + segLen;
+        M = pIy + segLen;
+        Ix = M + segLen;
+        Iy = Ix + segLen;
+        for (k = 0; k < 3*segLen; k++) pM[k] = vZero;
+        vMax = vZero;
+        STRIPED_LOCAL_KERNEL(EPU8, 16, 1)
+        _mm_storeu_si128((__m128i*)buffer, vMax);
+        maximum = 0;
+        for (t = 0; t < 16; t++) if (buffer[t] > maximum) maximum = buffer[t];
+        if (maximum + bias < UCHAR_MAX) {
+            *score = maximum;
+            result = 1;
+            goto exit;
+        }
+        /* the score saturated; try again with 16 bits */
+        _mm_free(memory);
+        memory = NULL;
+    }
+
+    if (smax < SHRT_MAX) {
+        const __m128i vOpenA = _mm_set1_epi16((short)(-gap_open_A));
+        const __m128i vExtendA = _mm_set1_epi16((short)(-gap_extend_A));
+        const __m128i vOpenB = _mm_set1_epi16((short)(-gap_open_B));
+        const __m128i vExtendB = _mm_set1_epi16((short)(-gap_extend_B));
+        short* p;
+        short buffer[8];
+        int maximum;
+        segLen = (nB + 7) / 8;
+        memory = _mm_malloc((n+6)*segLen*sizeof(__m128i), 16);
+        if (!memory) {
+            result = -1;
+            goto exit;
+        }
+        vProfile = memory;
+        p = (short*)vProfile;
+        for (kA = 0; kA < n; kA++) {
+            for (k = 0; k < segLen; k++) {
+                for (t = 0; t < 8; t++) {
+                    j = k + t * segLen;
+                    *p++ = (j < nB) ? scores[kA*nB + j] : SHRT_MIN;
+                }
+            }
+        }
+        pM = memory + n*segLen;
+        pIx = pM + segLen;
+        pIy = pIx + segLen;
+        M = pIy + segLen;
+        Ix = M + segLen;
+        Iy = Ix + segLen;
+        for (k = 0; k < 3*segLen; k++) pM[k] = vZero;
+        vMax = vZero;
+        STRIPED_LOCAL_KERNEL(EPI16, 8, 2)
+        _mm_storeu_si128((__m128i*)buffer, vMax);
+        maximum = 0;
+        for (t = 0; t < 8; t++) if (buffer[t] > maximum) maximum = buffer[t];
+        if (maximum < SHRT_MAX - smax) {
+            *score = maximum;
+            result = 1;
+        }
+    }
 
-    /* Smith-Waterman algorithm */
-    scores = PyMem_Malloc((nB+1)*sizeof(double));
-    if (!scores) return PyErr_NoMemory();
+exit:
+    if (memory) _mm_free(memory);
+    PyMem_RawFree(scores);
+    return result;
+}
 
-    /* The top row of the score matrix is a special case,
+#endif
+
+/* ------------------ bit-parallel unit-cost scores ------------------ */
+
+/* Global alignment scores with unit costs are calculated with bit-parallel
+ * algorithms, which process 64 cells of a column of the dynamic programming
+ * matrix per machine word.  The shorter sequence is the pattern, stored as
+ * bit-vectors along the column, and the longer sequence is the text.
+ */
+
+typedef unsigned long long BitVector;
+
+#define BIT_VECTOR_SIZE 64
+
+/* Return the match bit-vectors Peq[c][k] of the pattern for each letter c of
+ * the alphabet, with nk words for each letter, allocated as a single block to
+ * be released with PyMem_RawFree; NULL if a memory error occurs. */
+static BitVector*
+_bit_vector_profile(const char* pattern, int m, int nk, int size)
+{
+    int i;
+    BitVector* peq = PyMem_RawCalloc((size_t)size * nk, sizeof(BitVector));
+    if (!peq) return NULL;
+    for (i = 0; i < m; i++)
+        peq[pattern[i] * nk + i / BIT_VECTOR_SIZE]
+            |= (BitVector)1 << (i % BIT_VECTOR_SIZE);
+    return peq;
+}
+
+/* The length of the longest common subsequence (Allison and Dix, 1986;
+ * Hyyro, 2004), or -1 if a memory error occurs. */
+static Py_ssize_t
+_bit_vector_lcs(const char* pattern, int m, const char* text, Py_ssize_t n,
+                int size)
+{
+    int k;
+    Py_ssize_t j;
+    Py_ssize_t length;
+    BitVector u;
+    BitVector v;
+    BitVector x;
+    BitVector carry;
+    BitVector* eq;
+    const int nk = (m + BIT_VECTOR_SIZE - 1) / BIT_VECTOR_SIZE;
+    BitVector* V = PyMem_RawMalloc(nk * sizeof(BitVector));
+    BitVector* peq = _bit_vector_profile(pattern, m, nk, size);
+
+    if (!V || !peq) {
+        PyMem_RawFree(V);
+        PyMem_RawFree(peq);
+        return -1;
+    }
+    for (k = 0; k < nk; k++) V[k] = ~(BitVector)0;
+    for (j = 0; j < n; j++) {
+        eq = peq + text[j] * nk;
+        carry = 0;
+        for (k = 0; k < nk; k++) {
+            v = V[k];
+            u = v & eq[k];
+            x = v + u;
+            /* v - u is v & ~u, as u is a subset of v */
+            V[k] = (x + carry) | (v & ~u);
+            carry = (x < v) || (x + carry < x);
+        }
+    }
+    length = 0;
+    for (k = 0; k < m; k++)
+        if (!(V[k / BIT_VECTOR_SIZE] & ((BitVector)1 << (k % BIT_VECTOR_SIZE))))
+            length++;
+    PyMem_RawFree(V);
+    PyMem_RawFree(peq);
+    return length;
+}
+
+/* The edit distance (Myers, 1999), with the columns calculated in blocks of
+ * 64 rows.  If pattern_free, the ends of the pattern may be unaligned to
+ * the text at no cost; if text_free, the ends of the text may be unaligned
+ * to the pattern at no cost.  Returns -1 if a memory error occurs. */
+static Py_ssize_t
+_bit_vector_edit_distance(const char* pattern, int m,
+                          const char* text, Py_ssize_t n, int size,
+                          int pattern_free, int text_free)
+{
+    int i;
+    int k;
+    int h;
+    int hout;
+    Py_ssize_t j;
+    Py_ssize_t score;
+    Py_ssize_t best;
+    BitVector pv;
+    BitVector mv;
+    BitVector xv;
+    BitVector xh;
+    BitVector ph;
+    BitVector mh;
+    BitVector eq;
+    BitVector bit;
+    const int nk = (m + BIT_VECTOR_SIZE - 1) / BIT_VECTOR_SIZE;
+    const BitVector last = (BitVector)1 << ((m - 1) % BIT_VECTOR_SIZE);
+    const BitVector high = (BitVector)1 << (BIT_VECTOR_SIZE - 1);
+    BitVector* Pv = PyMem_RawMalloc(2 * nk * sizeof(BitVector));
+    BitVector* Mv = Pv + nk;
+    BitVector* peq = _bit_vector_profile(pattern, m, nk, size);
+
+    if (!Pv || !peq) {
+        PyMem_RawFree(Pv);
+        PyMem_RawFree(peq);
+        return -1;
+    }
+    /* The first column; the vertical differences are +1, or 0 if the start
+     * of the pattern may be unaligned. */
+    for (k = 0; k < nk; k++) {
+        Pv[k] = pattern_free ? 0 : ~(BitVector)0;
+        Mv[k] = 0;
+    }
+    score = pattern_free ? 0 : m;
+    best = score;
+    for (j = 0; j < n; j++) {
+        /* horizontal difference in the top row */
+        h = text_free ? 0 : 1;
+        for (k = 0; k < nk; k++) {
+            eq = peq[text[j] * nk + k];
+            pv = Pv[k];
+            mv = Mv[k];
+            xv = eq | mv;
+            if (h < 0) eq |= 1;
+            xh = (((eq & pv) + pv) ^ pv) | eq;
+            ph = mv | ~(xh | pv);
+            mh = pv & xh;
+            bit = (k == nk - 1) ? last : high;
+            hout = (ph & bit) ? 1 : ((mh & bit) ? -1 : 0);
+            ph <<= 1;
+            mh <<= 1;
+            if (h < 0) mh |= 1;
+            else if (h > 0) ph |= 1;
+            Pv[k] = mh | ~(xv | ph);
+            Mv[k] = ph & xv;
+            h = hout;
+        }
+        score += h;
+        if (score < best) best = score;
+    }
+    if (!text_free) best = score;
+    if (pattern_free) {
+        /* the end of the pattern may be unaligned: walk up the last column */
+        Py_ssize_t d = score;
+        for (i = m - 1; i >= 0; i--) {
+            bit = (BitVector)1 << (i % BIT_VECTOR_SIZE);
+            if (Pv[i / BIT_VECTOR_SIZE] & bit) d--;
+            else if (Mv[i / BIT_VECTOR_SIZE] & bit) d++;
+            if (d < best) best = d;
+        }
+    }
+    PyMem_RawFree(Pv);
+    PyMem_RawFree(peq);
+    return best;
+}
+
+/* Calculate the score of a global alignment with the Needleman-Wunsch
+ * algorithm with bit-parallel algorithms if the scores are unit costs:
+ * - the score is the match score times the length of the longest common
+ *   subsequence if all gap scores are zero, the match score is a positive
+ *   integer, and the mismatch score is not positive;
+ * - the score is minus the edit distance times the gap score if the match
+ *   score is zero, and the mismatch score and the gap scores are equal to
+ *   the same negative integer, except that the end gap scores of the target
+ *   and of the query may be zero.
+ * Only the scores of the letters in the sequences are considered.  The
+ * scores are integers, so the score is identical to the score calculated by
+ * the Needleman-Wunsch algorithm.  Returns 1 if the score was calculated, 0
+ * if the scores are not unit costs, and -1 if a memory error occurred. */
+static int
+_bit_vector_score(const Aligner* self, const char* sA, Py_ssize_t nA,
+                                       const char* sB, Py_ssize_t nB,
+                                       double* score)
+{
+    int i;
+    int j;
+    int m;
+    int n;
+    int mismatches = 0;
+    char present[128];
+    double match = 0;
+    double mismatch = 0;
+    const char* pattern;
+    const char* text;
+    Py_ssize_t distance;
+    const int size = self->alphabet_size;
+    double** matrix = self->substitution_matrix;
+    const double gap = self->target_extend_gap_score;
+    const double target_end = self->target_left_extend_gap_score;
+    const double query_end = self->query_left_extend_gap_score;
+    const double limit = 9007199254740992.0 / ((double)nA + (double)nB);
+
+    if (self->mode != Global || nA == 0 || nB == 0) return 0;
+    if (nA > INT_MAX || nB > INT_MAX) return 0;
+    if (self->query_extend_gap_score != gap
+     || self->target_right_extend_gap_score != target_end
+     || self->query_right_extend_gap_score != query_end) return 0;
+    if (!(fabs(gap) <= limit) || gap != floor(gap)) return 0;
+
+    memset(present, 0, sizeof(present));
+    for (i = 0; i < nA; i++) present[(int)sA[i]] = 1;
+    for (i = 0; i < nB; i++) present[(int)sB[i]] = 1;
+    for (i = 0; i < size; i++) {
+        if (!present[i]) continue;
+        match = matrix[i][i];
+        break;
+    }
+    for (i = 0; i < size; i++) {
+        if (!present[i]) continue;
+        if (matrix[i][i] != match) return 0;
+        for (j = 0; j < size; j++) {
+            if (i == j || !present[j]) continue;
+            if (mismatches && matrix[i][j] != mismatch) return 0;
+            mismatch = matrix[i][j];
+            mismatches = 1;
+        }
+    }
+
+    if (nA <= nB) {
+        pattern = sA;
+        m = (int)nA;
+        text = sB;
+        n = (int)nB;
+    }
+    else {
+        pattern = sB;
+        m = (int)nB;
+        text = sA;
+        n = (int)nA;
+    }
+    if (gap == 0 && target_end == 0 && query_end == 0) {
+        if (!(match > 0 && match <= limit && match == floor(match))) return 0;
+        if (mismatches && mismatch > 0) return 0;
+        distance = _bit_vector_lcs(pattern, m, text, n, size);
+        if (distance < 0) return -1;
+        *score = match * distance;
+        return 1;
+    }
+    if (match == 0 && gap < 0 && (!mismatches || mismatch == gap)
+     && (target_end == gap || target_end == 0)
+     && (query_end == gap || query_end == 0)) {
+        /* Gaps in the query at its ends leave the ends of the target
+         * unaligned, and vice versa. */
+        if (pattern == sA)
+            distance = _bit_vector_edit_distance(pattern, m, text, n, size,
+                                                 query_end == 0,
+                                                 target_end == 0);
+        else
+            distance = _bit_vector_edit_distance(pattern, m, text, n, size,
+                                                 target_end == 0,
+                                                 query_end == 0);
+        if (distance < 0) return -1;
+        *score = (distance > 0) ? gap * distance : 0.0;  /* not -0.0 */
+        return 1;
+    }
+    return 0;
+}
+
+/* ----------------- alignment algorithms ----------------- */
+
+/* The local score-only kernels of the Smith-Waterman and Gotoh algorithms
+ * have an integer variant, which is used if all substitution and gap scores
+ * are integers small enough that no score calculated for the two sequences
+ * can overflow.  It gives exactly the same score as the double kernel, and
+ * avoids its floating point comparisons against zero.  A state that cannot
+ * be reached is scored as INT_MIN / 2; it is added to at most once before it
+ * is replaced by the score of a reachable state.  The global kernels are not
+ * faster with integers, and always use double.
+ */
+
+/* Returns the substitution matrix as integers, allocated as a single block
+ * to be released with PyMem_RawFree, if all substitution and gap scores of
+ * the aligner are integers such that the score of any path through the
+ * dynamic programming matrix for sequences of lengths nA and nB, and
+ * INT_MIN / 2 plus any single score, fit in an int.  Returns NULL
+ * otherwise, or if a memory error occurs, in which case the double kernels
+ * are used. */
+static int**
+_integer_scores(const Aligner* self, Py_ssize_t nA, Py_ssize_t nB)
+{
+    int i;
+    int j;
+    double value;
+    int** matrix;
+    const int n = self->alphabet_size;
+    const double gaps[12] = {self->target_open_gap_score,
+                             self->target_extend_gap_score,
+                             self->target_left_open_gap_score,
+                             self->target_left_extend_gap_score,
+                             self->target_right_open_gap_score,
+                             self->target_right_extend_gap_score,
+                             self->query_open_gap_score,
+                             self->query_extend_gap_score,
+                             self->query_left_open_gap_score,
+                             self->query_left_extend_gap_score,
+                             self->query_right_open_gap_score,
+                             self->query_right_extend_gap_score};
+    /* a path has at most nA + nB steps, each adding a single score */
+    const double limit = (INT_MAX / 4) / ((double)nA + (double)nB + 1);
+    for (i = 0; i < 12; i++) {
+        value = gaps[i];
+        if (!(fabs(value) <= limit)) return NULL; /* also rejects NaN */
+        if (value != floor(value)) return NULL;
+    }
+    matrix = PyMem_RawMalloc(n*sizeof(int*) + n*n*sizeof(int));
+    if (!matrix) return NULL;
+    matrix[0] = (int*)(matrix + n);
+    for (i = 0; i < n; i++) {
+        if (i > 0) matrix[i] = matrix[i-1] + n;
+        for (j = 0; j < n; j++) {
+            value = self->substitution_matrix[i][j];
+            if (!(fabs(value) <= limit) || value != floor(value)) {
+                PyMem_RawFree(matrix);
+                return NULL;
+            }
+            matrix[i][j] = (int)value;
+        }
+    }
+    return matrix;
+}
+
+static int
+Aligner_needlemanwunsch_score(Aligner* self, const char* sA, Py_ssize_t nA,
+                                             const char* sB, Py_ssize_t nB,
+                                             double* result)
+{
+    int i;
+    int j;
+    int kA;
+    int kB;
+    const double gap_extend_A = self->target_extend_gap_score;
+    const double gap_extend_B = self->query_extend_gap_score;
+    const double left_gap_extend_A = self->target_left_extend_gap_score;
+    const double right_gap_extend_A = self->target_right_extend_gap_score;
+    const double left_gap_extend_B = self->query_left_extend_gap_score;
+    const double right_gap_extend_B = self->query_right_extend_gap_score;
+    double score;
+    double temp;
+
+    double* scores;
+
+    /* Needleman-Wunsch algorithm */
+    scores = PyMem_RawMalloc((nB+1)*sizeof(double));
+    if (!scores) return MEMORY_ERROR;
+
+    /* The top row of the score matrix is a special case,
+     * as there are no previously aligned characters.
+     */
+    scores[0] = 0.0;
+    for (j = 1; j <= nB; j++) scores[j] = j * left_gap_extend_A;
+    for (i = 1; i < nA; i++) {
+        kA = sA[i-1];
+        temp = scores[0];
+        scores[0] = i * left_gap_extend_B;
+        for (j = 1; j < nB; j++) {
+            kB = sB[j-1];
+            SELECT_SCORE_GLOBAL(temp + self->substitution_matrix[kA][kB],
+                                scores[j] + gap_extend_B,
+                                scores[j-1] + gap_extend_A);
+            temp = scores[j];
+            scores[j] = score;
+        }
+        kB = sB[nB-1];
+        SELECT_SCORE_GLOBAL(temp + self->substitution_matrix[kA][kB],
+                            scores[nB] + right_gap_extend_B,
+                            scores[nB-1] + gap_extend_A);
+        temp = scores[nB];
+        scores[nB] = score;
+    }
+    kA = sA[nA-1];
+    temp = scores[0];
+    scores[0] = nA * right_gap_extend_B;
+    for (j = 1; j < nB; j++) {
+        kB = sB[j-1];
+        SELECT_SCORE_GLOBAL(temp + self->substitution_matrix[kA][kB],
+                            scores[j] + gap_extend_B,
+                            scores[j-1] + right_gap_extend_A);
+        temp = scores[j];
+        scores[j] = score;
+    }
+    kB = sB[nB-1];
+    SELECT_SCORE_GLOBAL(temp + self->substitution_matrix[kA][kB],
+                        scores[nB] + right_gap_extend_B,
+                        scores[nB-1] + right_gap_extend_A);
+    PyMem_RawFree(scores);
+    *result = score;
+    return 0;
+}
+
+static int
+Aligner_smithwaterman_score(Aligner* self, const char* sA, Py_ssize_t nA,
+                                           const char* sB, Py_ssize_t nB,
+                                           double* result)
+{
+    int i;
+    int j;
+    int kA;
+    int kB;
+    const double gap_extend_A = self->target_extend_gap_score;
+    const double gap_extend_B = self->query_extend_gap_score;
+    double score;
+    double* scores;
+    double temp;
+    double maximum = 0;
+
+    /* Smith-Waterman algorithm */
+    scores = PyMem_RawMalloc((nB+1)*sizeof(double));
+    if (!scores) return MEMORY_ERROR;
+
+    /* The top row of the score matrix is a special case,
      * as there are no previously aligned characters.
      */
     for (j = 0; j <= nB; j++)
         scores[j] = 0;
     for (i = 1; i < nA; i++) {
-        kA = CHARINDEX(sA[i-1]);
+        kA = sA[i-1];
         temp = 0;
         for (j = 1; j < nB; j++) {
-            kB = CHARINDEX(sB[j-1]);
+            kB = sB[j-1];
             SELECT_SCORE_LOCAL3(temp + self->substitution_matrix[kA][kB],
                                 scores[j] + gap_extend_B,
                                 scores[j-1] + gap_extend_A);
             temp = scores[j];
             scores[j] = score;
         }
-        kB = CHARINDEX(sB[nB-1]);
+        kB = sB[nB-1];
         SELECT_SCORE_LOCAL1(temp + self->substitution_matrix[kA][kB]);
         temp = scores[nB];
         scores[nB] = score;
     }
-    kA = CHARINDEX(sA[nA-1]);
+    kA = sA[nA-1];
     temp = 0;
     for (j = 1; j < nB; j++) {
-        kB = CHARINDEX(sB[j-1]);
+        kB = sB[j-1];
         SELECT_SCORE_LOCAL1(temp + self->substitution_matrix[kA][kB]);
         temp = scores[j];
         scores[j] = score;
     }
-    kB = CHARINDEX(sB[nB-1]);
+    kB = sB[nB-1];
     SELECT_SCORE_LOCAL1(temp + self->substitution_matrix[kA][kB]);
-    PyMem_Free(scores);
-    return PyFloat_FromDouble(maximum);
+    PyMem_RawFree(scores);
+    *result = maximum;
+    return 0;
+}
+
+static int
+Aligner_smithwaterman_score_int(Aligner* self, int** matrix,
+                                const char* sA, Py_ssize_t nA,
+                                const char* sB, Py_ssize_t nB,
+                                double* result)
+{
+    int i;
+    int j;
+    int kA;
+    int kB;
+    const int gap_extend_A = (int)self->target_extend_gap_score;
+    const int gap_extend_B = (int)self->query_extend_gap_score;
+    int score;
+    int* scores;
+    int temp;
+    int maximum = 0;
+
+    /* Smith-Waterman algorithm */
+    scores = PyMem_RawMalloc((nB+1)*sizeof(int));
+    if (!scores) return MEMORY_ERROR;
+
+    /* The top row of the score matrix is a special case,
+     * as there are no previously aligned characters.
+     */
+    for (j = 0; j <= nB; j++)
+        scores[j] = 0;
+    for (i = 1; i < nA; i++) {
+        kA = sA[i-1];
+        temp = 0;
+        for (j = 1; j < nB; j++) {
+            kB = sB[j-1];
+            SELECT_SCORE_LOCAL3(temp + matrix[kA][kB],
+                                scores[j] + gap_extend_B,
+                                scores[j-1] + gap_extend_A);
+            temp = scores[j];
+            scores[j] = score;
+        }
+        kB = sB[nB-1];
+        SELECT_SCORE_LOCAL1(temp + matrix[kA][kB]);
+        temp = scores[nB];
+        scores[nB] = score;
+    }
+    kA = sA[nA-1];
+    temp = 0;
+    for (j = 1; j < nB; j++) {
+        kB = sB[j-1];
+        SELECT_SCORE_LOCAL1(temp + matrix[kA][kB]);
+        temp = scores[j];
+        scores[j] = score;
+    }
+    kB = sB[nB-1];
+    SELECT_SCORE_LOCAL1(temp + matrix[kA][kB]);
+    PyMem_RawFree(scores);
+    *result = maximum;
+    return 0;
 }
 
 static PyObject*
 Aligner_needlemanwunsch_align(Aligner* self, const char* sA, Py_ssize_t nA,
                                              const char* sB, Py_ssize_t nB)
 {
-    char c;
     int i;
     int j;
     int kA;
@@ -4667,22 +6196,22 @@ Aligner_needlemanwunsch_align(Aligner* self, const char* sA, Py_ssize_t nA,
     for (i = 1; i < nA; i++) {
         temp = scores[0];
         scores[0] = i * left_gap_extend_B;
-        kA = CHARINDEX(sA[i-1]);
+        kA = sA[i-1];
         for (j = 1; j < nB; j++) {
-            kB = CHARINDEX(sB[j-1]);
+            kB = sB[j-1];
             SELECT_TRACE_NEEDLEMAN_WUNSCH(gap_extend_A, gap_extend_B);
         }
-        kB = CHARINDEX(sB[j-1]);
+        kB = sB[j-1];
         SELECT_TRACE_NEEDLEMAN_WUNSCH(gap_extend_A, right_gap_extend_B);
     }
     temp = scores[0];
     scores[0] = i * left_gap_extend_B;
-    kA = CHARINDEX(sA[nA-1]);
+    kA = sA[nA-1];
     for (j = 1; j < nB; j++) {
-        kB = CHARINDEX(sB[j-1]);
+        kB = sB[j-1];
         SELECT_TRACE_NEEDLEMAN_WUNSCH(right_gap_extend_A, gap_extend_B);
     }
-    kB = CHARINDEX(sB[j-1]);
+    kB = sB[j-1];
     SELECT_TRACE_NEEDLEMAN_WUNSCH(right_gap_extend_A, right_gap_extend_B);
     PyMem_Free(scores);
     M[nA][nB].path = 0;
@@ -4694,7 +6223,6 @@ static PyObject*
 Aligner_smithwaterman_align(Aligner* self, const char* sA, Py_ssize_t nA,
                                            const char* sB, Py_ssize_t nB)
 {
-    char c;
     int i;
     int j;
     int im = nA;
@@ -4724,21 +6252,21 @@ Aligner_smithwaterman_align(Aligner* self, const char* sA, Py_ssize_t nA,
     for (j = 0; j <= nB; j++) scores[j] = 0;
     for (i = 1; i < nA; i++) {
         temp = 0;
-        kA = CHARINDEX(sA[i-1]);
+        kA = sA[i-1];
         for (j = 1; j < nB; j++) {
-            kB = CHARINDEX(sB[j-1]);
+            kB = sB[j-1];
             SELECT_TRACE_SMITH_WATERMAN_HVD(gap_extend_A, gap_extend_B);
         }
-        kB = CHARINDEX(sB[nB-1]);
+        kB = sB[nB-1];
         SELECT_TRACE_SMITH_WATERMAN_D;
     }
     temp = 0;
-    kA = CHARINDEX(sA[nA-1]);
+    kA = sA[nA-1];
     for (j = 1; j < nB; j++) {
-        kB = CHARINDEX(sB[j-1]);
+        kB = sB[j-1];
         SELECT_TRACE_SMITH_WATERMAN_D;
     }
-    kB = CHARINDEX(sB[nB-1]);
+    kB = sB[nB-1];
     SELECT_TRACE_SMITH_WATERMAN_D;
     PyMem_Free(scores);
 
@@ -4780,11 +6308,11 @@ Aligner_smithwaterman_align(Aligner* self, const char* sA, Py_ssize_t nA,
     return Py_BuildValue("fN", maximum, paths);
 }
 
-static PyObject*
+static int
 Aligner_gotoh_global_score(Aligner* self, const char* sA, Py_ssize_t nA,
-                                          const char* sB, Py_ssize_t nB)
+                                          const char* sB, Py_ssize_t nB,
+                                          double* result)
 {
-    char c;
     int i;
     int j;
     int kA;
@@ -4811,11 +6339,11 @@ Aligner_gotoh_global_score(Aligner* self, const char* sA, Py_ssize_t nA,
     double Iy_temp;
 
     /* Gotoh algorithm with three states */
-    M_scores = PyMem_Malloc((nB+1)*sizeof(double));
+    M_scores = PyMem_RawMalloc((nB+1)*sizeof(double));
     if (!M_scores) goto exit;
-    Ix_scores = PyMem_Malloc((nB+1)*sizeof(double));
+    Ix_scores = PyMem_RawMalloc((nB+1)*sizeof(double));
     if (!Ix_scores) goto exit;
-    Iy_scores = PyMem_Malloc((nB+1)*sizeof(double));
+    Iy_scores = PyMem_RawMalloc((nB+1)*sizeof(double));
     if (!Iy_scores) goto exit;
 
     /* The top row of the score matrix is a special case,
@@ -4837,9 +6365,9 @@ Aligner_gotoh_global_score(Aligner* self, const char* sA, Py_ssize_t nA,
         M_scores[0] = -DBL_MAX;
         Ix_scores[0] = left_gap_open_B + left_gap_extend_B * (i-1);
         Iy_scores[0] = -DBL_MAX;
-        kA = CHARINDEX(sA[i-1]);
+        kA = sA[i-1];
         for (j = 1; j < nB; j++) {
-            kB = CHARINDEX(sB[j-1]);
+            kB = sB[j-1];
             SELECT_SCORE_GLOBAL(M_temp,
                                 Ix_temp,
                                 Iy_temp);
@@ -4856,7 +6384,7 @@ Aligner_gotoh_global_score(Aligner* self, const char* sA, Py_ssize_t nA,
             Iy_temp = Iy_scores[j];
             Iy_scores[j] = score;
         }
-        kB = CHARINDEX(sB[nB-1]);
+        kB = sB[nB-1];
         SELECT_SCORE_GLOBAL(M_temp,
                             Ix_temp,
                             Iy_temp);
@@ -4878,9 +6406,9 @@ Aligner_gotoh_global_score(Aligner* self, const char* sA, Py_ssize_t nA,
     M_scores[0] = -DBL_MAX;
     Ix_scores[0] = left_gap_open_B + left_gap_extend_B * (i-1);
     Iy_scores[0] = -DBL_MAX;
-    kA = CHARINDEX(sA[nA-1]);
+    kA = sA[nA-1];
     for (j = 1; j < nB; j++) {
-        kB = CHARINDEX(sB[j-1]);
+        kB = sB[j-1];
         SELECT_SCORE_GLOBAL(M_temp,
                             Ix_temp,
                             Iy_temp);
@@ -4898,7 +6426,7 @@ Aligner_gotoh_global_score(Aligner* self, const char* sA, Py_ssize_t nA,
         Iy_scores[j] = score;
     }
 
-    kB = CHARINDEX(sB[nB-1]);
+    kB = sB[nB-1];
     SELECT_SCORE_GLOBAL(M_temp,
                         Ix_temp,
                         Iy_temp);
@@ -4916,23 +6444,24 @@ Aligner_gotoh_global_score(Aligner* self, const char* sA, Py_ssize_t nA,
     Iy_scores[nB] = score;
 
     SELECT_SCORE_GLOBAL(M_scores[nB], Ix_scores[nB], Iy_scores[nB]);
-    PyMem_Free(M_scores);
-    PyMem_Free(Ix_scores);
-    PyMem_Free(Iy_scores);
-    return PyFloat_FromDouble(score);
+    PyMem_RawFree(M_scores);
+    PyMem_RawFree(Ix_scores);
+    PyMem_RawFree(Iy_scores);
+    *result = score;
+    return 0;
 
 exit:
-    if (M_scores) PyMem_Free(M_scores);
-    if (Ix_scores) PyMem_Free(Ix_scores);
-    if (Iy_scores) PyMem_Free(Iy_scores);
-    return PyErr_NoMemory();
+    if (M_scores) PyMem_RawFree(M_scores);
+    if (Ix_scores) PyMem_RawFree(Ix_scores);
+    if (Iy_scores) PyMem_RawFree(Iy_scores);
+    return MEMORY_ERROR;
 }
 
-static PyObject*
+static int
 Aligner_gotoh_local_score(Aligner* self, const char* sA, Py_ssize_t nA,
-                                         const char* sB, Py_ssize_t nB)
+                                         const char* sB, Py_ssize_t nB,
+                                         double* result)
 {
-    char c;
     int i;
     int j;
     int kA;
@@ -4949,14 +6478,14 @@ Aligner_gotoh_local_score(Aligner* self, const char* sA, Py_ssize_t nA,
     double M_temp;
     double Ix_temp;
     double Iy_temp;
-    double maximum = 0.0;
+    double maximum = 0;
 
     /* Gotoh algorithm with three states */
-    M_scores = PyMem_Malloc((nB+1)*sizeof(double));
+    M_scores = PyMem_RawMalloc((nB+1)*sizeof(double));
     if (!M_scores) goto exit;
-    Ix_scores = PyMem_Malloc((nB+1)*sizeof(double));
+    Ix_scores = PyMem_RawMalloc((nB+1)*sizeof(double));
     if (!Ix_scores) goto exit;
-    Iy_scores = PyMem_Malloc((nB+1)*sizeof(double));
+    Iy_scores = PyMem_RawMalloc((nB+1)*sizeof(double));
     if (!Iy_scores) goto exit;
 
     /* The top row of the score matrix is a special case,
@@ -4978,9 +6507,9 @@ Aligner_gotoh_local_score(Aligner* self, const char* sA, Py_ssize_t nA,
         M_scores[0] = -DBL_MAX;
         Ix_scores[0] = 0;
         Iy_scores[0] = -DBL_MAX;
-        kA = CHARINDEX(sA[i-1]);
+        kA = sA[i-1];
         for (j = 1; j < nB; j++) {
-            kB = CHARINDEX(sB[j-1]);
+            kB = sB[j-1];
             SELECT_SCORE_GOTOH_LOCAL_ALIGN(M_temp,
                                            Ix_temp,
                                            Iy_temp,
@@ -4999,7 +6528,7 @@ Aligner_gotoh_local_score(Aligner* self, const char* sA, Py_ssize_t nA,
             Iy_scores[j] = score;
         }
 
-        kB = CHARINDEX(sB[nB-1]);
+        kB = sB[nB-1];
 
         Ix_scores[nB] = 0;
         Iy_scores[nB] = 0;
@@ -5017,9 +6546,9 @@ Aligner_gotoh_local_score(Aligner* self, const char* sA, Py_ssize_t nA,
     M_scores[0] = -DBL_MAX;
     Ix_scores[0] = 0;
     Iy_scores[0] = -DBL_MAX;
-    kA = CHARINDEX(sA[nA-1]);
+    kA = sA[nA-1];
     for (j = 1; j < nB; j++) {
-        kB = CHARINDEX(sB[j-1]);
+        kB = sB[j-1];
         SELECT_SCORE_GOTOH_LOCAL_ALIGN(M_temp,
                                        Ix_temp,
                                        Iy_temp,
@@ -5032,93 +6561,217 @@ Aligner_gotoh_local_score(Aligner* self, const char* sA, Py_ssize_t nA,
         Iy_scores[j] = 0;
     }
 
-    kB = CHARINDEX(sB[nB-1]);
+    kB = sB[nB-1];
     SELECT_SCORE_GOTOH_LOCAL_ALIGN(M_temp,
                                    Ix_temp,
                                    Iy_temp,
                                    self->substitution_matrix[kA][kB]);
 
-    PyMem_Free(M_scores);
-    PyMem_Free(Ix_scores);
-    PyMem_Free(Iy_scores);
-    return PyFloat_FromDouble(maximum);
+    PyMem_RawFree(M_scores);
+    PyMem_RawFree(Ix_scores);
+    PyMem_RawFree(Iy_scores);
+    *result = maximum;
+    return 0;
 
 exit:
-    if (M_scores) PyMem_Free(M_scores);
-    if (Ix_scores) PyMem_Free(Ix_scores);
-    if (Iy_scores) PyMem_Free(Iy_scores);
-    return PyErr_NoMemory();
+    if (M_scores) PyMem_RawFree(M_scores);
+    if (Ix_scores) PyMem_RawFree(Ix_scores);
+    if (Iy_scores) PyMem_RawFree(Iy_scores);
+    return MEMORY_ERROR;
 }
 
-static PyObject*
-Aligner_gotoh_global_align(Aligner* self, const char* sA, Py_ssize_t nA,
-                                          const char* sB, Py_ssize_t nB)
+static int
+Aligner_gotoh_local_score_int(Aligner* self, int** matrix,
+                              const char* sA, Py_ssize_t nA,
+                              const char* sB, Py_ssize_t nB,
+                              double* result)
 {
-    char c;
     int i;
     int j;
     int kA;
     int kB;
-    const double gap_open_A = self->target_open_gap_score;
-    const double gap_open_B = self->query_open_gap_score;
-    const double gap_extend_A = self->target_extend_gap_score;
-    const double gap_extend_B = self->query_extend_gap_score;
-    const double left_gap_open_A = self->target_left_open_gap_score;
-    const double left_gap_open_B = self->query_left_open_gap_score;
-    const double left_gap_extend_A = self->target_left_extend_gap_score;
-    const double left_gap_extend_B = self->query_left_extend_gap_score;
-    const double right_gap_open_A = self->target_right_open_gap_score;
-    const double right_gap_open_B = self->query_right_open_gap_score;
-    const double right_gap_extend_A = self->target_right_extend_gap_score;
-    const double right_gap_extend_B = self->query_right_extend_gap_score;
-    const double epsilon = self->epsilon;
-    TraceGapsGotoh** gaps = NULL;
-    Trace** M = NULL;
-    double* M_scores = NULL;
-    double* Ix_scores = NULL;
-    double* Iy_scores = NULL;
-    double score;
-    int trace;
-    double temp;
-    double M_temp;
-    double Ix_temp;
-    double Iy_temp;
-    PathGenerator* paths;
+    const int gap_open_A = (int)self->target_open_gap_score;
+    const int gap_open_B = (int)self->query_open_gap_score;
+    const int gap_extend_A = (int)self->target_extend_gap_score;
+    const int gap_extend_B = (int)self->query_extend_gap_score;
+    int* M_scores = NULL;
+    int* Ix_scores = NULL;
+    int* Iy_scores = NULL;
+    int score;
+    int temp;
+    int M_temp;
+    int Ix_temp;
+    int Iy_temp;
+    int maximum = 0;
 
     /* Gotoh algorithm with three states */
-    paths = PathGenerator_create_Gotoh(nA, nB, Global);
-    if (!paths) return NULL;
-
-    M_scores = PyMem_Malloc((nB+1)*sizeof(double));
+    M_scores = PyMem_RawMalloc((nB+1)*sizeof(int));
     if (!M_scores) goto exit;
-    Ix_scores = PyMem_Malloc((nB+1)*sizeof(double));
+    Ix_scores = PyMem_RawMalloc((nB+1)*sizeof(int));
     if (!Ix_scores) goto exit;
-    Iy_scores = PyMem_Malloc((nB+1)*sizeof(double));
+    Iy_scores = PyMem_RawMalloc((nB+1)*sizeof(int));
     if (!Iy_scores) goto exit;
-    M = paths->M;
-    gaps = paths->gaps.gotoh;
 
-    /* Gotoh algorithm with three states */
+    /* The top row of the score matrix is a special case,
+     * as there are no previously aligned characters.
+     */
     M_scores[0] = 0;
-    Ix_scores[0] = -DBL_MAX;
-    Iy_scores[0] = -DBL_MAX;
-
+    Ix_scores[0] = INT_MIN / 2;
+    Iy_scores[0] = INT_MIN / 2;
     for (j = 1; j <= nB; j++) {
-        M_scores[j] = -DBL_MAX;
-        Ix_scores[j] = -DBL_MAX;
-        Iy_scores[j] = left_gap_open_A + left_gap_extend_A * (j-1);
+        M_scores[j] = INT_MIN / 2;
+        Ix_scores[j] = INT_MIN / 2;
+        Iy_scores[j] = 0;
     }
 
     for (i = 1; i < nA; i++) {
-        kA = CHARINDEX(sA[i-1]);
         M_temp = M_scores[0];
         Ix_temp = Ix_scores[0];
         Iy_temp = Iy_scores[0];
-        M_scores[0] = -DBL_MAX;
-        Ix_scores[0] = left_gap_open_B + left_gap_extend_B * (i-1);
-        Iy_scores[0] = -DBL_MAX;
+        M_scores[0] = INT_MIN / 2;
+        Ix_scores[0] = 0;
+        Iy_scores[0] = INT_MIN / 2;
+        kA = sA[i-1];
         for (j = 1; j < nB; j++) {
-            kB = CHARINDEX(sB[j-1]);
+            kB = sB[j-1];
+            SELECT_SCORE_GOTOH_LOCAL_ALIGN(M_temp,
+                                           Ix_temp,
+                                           Iy_temp,
+                                           matrix[kA][kB]);
+            M_temp = M_scores[j];
+            M_scores[j] = score;
+            SELECT_SCORE_LOCAL3(M_temp + gap_open_B,
+                                Ix_scores[j] + gap_extend_B,
+                                Iy_scores[j] + gap_open_B);
+            Ix_temp = Ix_scores[j];
+            Ix_scores[j] = score;
+            SELECT_SCORE_LOCAL3(M_scores[j-1] + gap_open_A,
+                                Ix_scores[j-1] + gap_open_A,
+                                Iy_scores[j-1] + gap_extend_A);
+            Iy_temp = Iy_scores[j];
+            Iy_scores[j] = score;
+        }
+
+        kB = sB[nB-1];
+
+        Ix_scores[nB] = 0;
+        Iy_scores[nB] = 0;
+        SELECT_SCORE_GOTOH_LOCAL_ALIGN(M_temp,
+                                       Ix_temp,
+                                       Iy_temp,
+                                       matrix[kA][kB]);
+        M_temp = M_scores[nB];
+        M_scores[nB] = score;
+    }
+
+    M_temp = M_scores[0];
+    Ix_temp = Ix_scores[0];
+    Iy_temp = Iy_scores[0];
+    M_scores[0] = INT_MIN / 2;
+    Ix_scores[0] = 0;
+    Iy_scores[0] = INT_MIN / 2;
+    kA = sA[nA-1];
+    for (j = 1; j < nB; j++) {
+        kB = sB[j-1];
+        SELECT_SCORE_GOTOH_LOCAL_ALIGN(M_temp,
+                                       Ix_temp,
+                                       Iy_temp,
+                                       matrix[kA][kB]);
+        M_temp = M_scores[j];
+        M_scores[j] = score;
+        Ix_temp = Ix_scores[j];
+        Iy_temp = Iy_scores[j];
+        Ix_scores[j] = 0;
+        Iy_scores[j] = 0;
+    }
+
+    kB = sB[nB-1];
+    SELECT_SCORE_GOTOH_LOCAL_ALIGN(M_temp,
+                                   Ix_temp,
+                                   Iy_temp,
+                                   matrix[kA][kB]);
+
+    PyMem_RawFree(M_scores);
+    PyMem_RawFree(Ix_scores);
+    PyMem_RawFree(Iy_scores);
+    *result = maximum;
+    return 0;
+
+exit:
+    if (M_scores) PyMem_RawFree(M_scores);
+    if (Ix_scores) PyMem_RawFree(Ix_scores);
+    if (Iy_scores) PyMem_RawFree(Iy_scores);
+    return MEMORY_ERROR;
+}
+
+static PyObject*
+Aligner_gotoh_global_align(Aligner* self, const char* sA, Py_ssize_t nA,
+                                          const char* sB, Py_ssize_t nB)
+{
+    int i;
+    int j;
+    int kA;
+    int kB;
+    const double gap_open_A = self->target_open_gap_score;
+    const double gap_open_B = self->query_open_gap_score;
+    const double gap_extend_A = self->target_extend_gap_score;
+    const double gap_extend_B = self->query_extend_gap_score;
+    const double left_gap_open_A = self->target_left_open_gap_score;
+    const double left_gap_open_B = self->query_left_open_gap_score;
+    const double left_gap_extend_A = self->target_left_extend_gap_score;
+    const double left_gap_extend_B = self->query_left_extend_gap_score;
+    const double right_gap_open_A = self->target_right_open_gap_score;
+    const double right_gap_open_B = self->query_right_open_gap_score;
+    const double right_gap_extend_A = self->target_right_extend_gap_score;
+    const double right_gap_extend_B = self->query_right_extend_gap_score;
+    const double epsilon = self->epsilon;
+    TraceGapsGotoh** gaps = NULL;
+    Trace** M = NULL;
+    double* M_scores = NULL;
+    double* Ix_scores = NULL;
+    double* Iy_scores = NULL;
+    double score;
+    int trace;
+    double temp;
+    double M_temp;
+    double Ix_temp;
+    double Iy_temp;
+    PathGenerator* paths;
+
+    /* Gotoh algorithm with three states */
+    paths = PathGenerator_create_Gotoh(nA, nB, Global);
+    if (!paths) return NULL;
+
+    M_scores = PyMem_Malloc((nB+1)*sizeof(double));
+    if (!M_scores) goto exit;
+    Ix_scores = PyMem_Malloc((nB+1)*sizeof(double));
+    if (!Ix_scores) goto exit;
+    Iy_scores = PyMem_Malloc((nB+1)*sizeof(double));
+    if (!Iy_scores) goto exit;
+    M = paths->M;
+    gaps = paths->gaps.gotoh;
+
+    /* Gotoh algorithm with three states */
+    M_scores[0] = 0;
+    Ix_scores[0] = -DBL_MAX;
+    Iy_scores[0] = -DBL_MAX;
+
+    for (j = 1; j <= nB; j++) {
+        M_scores[j] = -DBL_MAX;
+        Ix_scores[j] = -DBL_MAX;
+        Iy_scores[j] = left_gap_open_A + left_gap_extend_A * (j-1);
+    }
+
+    for (i = 1; i < nA; i++) {
+        kA = sA[i-1];
+        M_temp = M_scores[0];
+        Ix_temp = Ix_scores[0];
+        Iy_temp = Iy_scores[0];
+        M_scores[0] = -DBL_MAX;
+        Ix_scores[0] = left_gap_open_B + left_gap_extend_B * (i-1);
+        Iy_scores[0] = -DBL_MAX;
+        for (j = 1; j < nB; j++) {
+            kB = sB[j-1];
             SELECT_TRACE_GOTOH_GLOBAL_ALIGN;
             M_temp = M_scores[j];
             M_scores[j] = score + self->substitution_matrix[kA][kB];
@@ -5135,7 +6788,7 @@ Aligner_gotoh_global_align(Aligner* self, const char* sA, Py_ssize_t nA,
             Iy_temp = Iy_scores[j];
             Iy_scores[j] = score;
         }
-        kB = CHARINDEX(sB[nB-1]);
+        kB = sB[nB-1];
         SELECT_TRACE_GOTOH_GLOBAL_ALIGN;
         M_temp = M_scores[nB];
         M_scores[nB] = score + self->substitution_matrix[kA][kB];
@@ -5152,7 +6805,7 @@ Aligner_gotoh_global_align(Aligner* self, const char* sA, Py_ssize_t nA,
         Iy_temp = Iy_scores[nB];
         Iy_scores[nB] = score;
     }
-    kA = CHARINDEX(sA[nA-1]);
+    kA = sA[nA-1];
     M_temp = M_scores[0];
     Ix_temp = Ix_scores[0];
     Iy_temp = Iy_scores[0];
@@ -5160,7 +6813,7 @@ Aligner_gotoh_global_align(Aligner* self, const char* sA, Py_ssize_t nA,
     Ix_scores[0] = left_gap_open_B + left_gap_extend_B * (nA-1);
     Iy_scores[0] = -DBL_MAX;
     for (j = 1; j < nB; j++) {
-        kB = CHARINDEX(sB[j-1]);
+        kB = sB[j-1];
         SELECT_TRACE_GOTOH_GLOBAL_ALIGN;
         M_temp = M_scores[j];
         M_scores[j] = score + self->substitution_matrix[kA][kB];
@@ -5177,7 +6830,7 @@ Aligner_gotoh_global_align(Aligner* self, const char* sA, Py_ssize_t nA,
         Iy_temp = Iy_scores[j];
         Iy_scores[j] = score;
     }
-    kB = CHARINDEX(sB[nB-1]);
+    kB = sB[nB-1];
     SELECT_TRACE_GOTOH_GLOBAL_ALIGN;
     M_temp = M_scores[j];
     M_scores[j] = score + self->substitution_matrix[kA][kB];
@@ -5211,7 +6864,6 @@ static PyObject*
 Aligner_gotoh_local_align(Aligner* self, const char* sA, Py_ssize_t nA,
                                          const char* sB, Py_ssize_t nB)
 {
-    char c;
     int i;
     int j;
     int im = nA;
@@ -5265,9 +6917,9 @@ Aligner_gotoh_local_align(Aligner* self, const char* sA, Py_ssize_t nA,
         M_scores[0] = 0;
         Ix_scores[0] = -DBL_MAX;
         Iy_scores[0] = -DBL_MAX;
-        kA = CHARINDEX(sA[i-1]);
+        kA = sA[i-1];
         for (j = 1; j < nB; j++) {
-            kB = CHARINDEX(sB[j-1]);
+            kB = sB[j-1];
             SELECT_TRACE_GOTOH_LOCAL_ALIGN
             M_temp = M_scores[j];
             M_scores[j] = score;
@@ -5284,7 +6936,7 @@ Aligner_gotoh_local_align(Aligner* self, const char* sA, Py_ssize_t nA,
             Iy_temp = Iy_scores[j];
             Iy_scores[j] = score;
         }
-        kB = CHARINDEX(sB[nB-1]);
+        kB = sB[nB-1];
         SELECT_TRACE_GOTOH_LOCAL_ALIGN
         M_temp = M_scores[j];
         M_scores[j] = score;
@@ -5304,9 +6956,9 @@ Aligner_gotoh_local_align(Aligner* self, const char* sA, Py_ssize_t nA,
     gaps[nA][0].Iy = 0;
     Iy_temp = Iy_scores[0];
     Iy_scores[0] = -DBL_MAX;
-    kA = CHARINDEX(sA[nA-1]);
+    kA = sA[nA-1];
     for (j = 1; j < nB; j++) {
-        kB = CHARINDEX(sB[j-1]);
+        kB = sB[j-1];
         SELECT_TRACE_GOTOH_LOCAL_ALIGN
         M_temp = M_scores[j];
         M_scores[j] = score;
@@ -5317,7 +6969,7 @@ Aligner_gotoh_local_align(Aligner* self, const char* sA, Py_ssize_t nA,
         Iy_scores[j] = 0;
         gaps[nA][j].Iy = 0;
     }
-    kB = CHARINDEX(sB[nB-1]);
+    kB = sB[nB-1];
     SELECT_TRACE_GOTOH_LOCAL_ALIGN
     gaps[nA][nB].Ix = 0;
     gaps[nA][nB].Iy = 0;
@@ -5441,12 +7093,77 @@ _call_target_gap_function(Aligner* aligner, int i, int j, double* score)
     return 1;
 }
 
-static PyObject*
+/* Allocate a table with m rows of n scores as a single block, with the row
+ * pointers stored in front of the scores. */
+static double**
+_create_gap_table(Py_ssize_t m, Py_ssize_t n)
+{
+    Py_ssize_t i;
+    double** table = PyMem_Malloc(m*sizeof(double*) + m*n*sizeof(double));
+    if (!table) return NULL;
+    table[0] = (double*)(table + m);
+    for (i = 1; i < m; i++) table[i] = table[i-1] + n;
+    return table;
+}
+
+/* Free the gap tables; called when a score or alignment calculation using
+ * the Waterman-Smith-Beyer algorithm has finished, as the tables hold
+ * (nA+1)*nB + (nB+1)*nA scores. */
+static void
+_free_gap_tables(Aligner* self)
+{
+    GapTables* tables = &self->gap_tables;
+    PyMem_Free(tables->target);
+    PyMem_Free(tables->query);
+    tables->target = NULL;
+    tables->query = NULL;
+}
+
+/* Calculate the scores of all gaps that the Waterman-Smith-Beyer algorithm
+ * may need for sequences of lengths nA and nB, so that each gap function is
+ * called only once for each position and gap length, instead of once for
+ * each cell and gap length of the dynamic programming matrices.  This
+ * assumes that the gap functions depend on their arguments only.  Returns 0
+ * and sets an exception on failure. */
+static int
+_update_gap_tables(Aligner* self, Py_ssize_t nA, Py_ssize_t nB)
+{
+    Py_ssize_t i;
+    Py_ssize_t k;
+    double** target = NULL;
+    double** query = NULL;
+    GapTables* tables = &self->gap_tables;
+
+    target = _create_gap_table(nA+1, nB);
+    query = _create_gap_table(nB+1, nA);
+    if (!target || !query) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    for (i = 0; i <= nA; i++)
+        for (k = 1; k <= nB; k++)
+            if (!_call_target_gap_function(self, i, k, &target[i][k-1]))
+                goto exit;
+    for (i = 0; i <= nB; i++)
+        for (k = 1; k <= nA; k++)
+            if (!_call_query_gap_function(self, i, k, &query[i][k-1]))
+                goto exit;
+    _free_gap_tables(self);
+    tables->target = target;
+    tables->query = query;
+    return 1;
+exit:
+    PyMem_Free(target);
+    PyMem_Free(query);
+    return 0;
+}
+
+static int
 Aligner_waterman_smith_beyer_global_score(Aligner* self,
                                           const char* sA, Py_ssize_t nA,
-                                          const char* sB, Py_ssize_t nB)
+                                          const char* sB, Py_ssize_t nB,
+                                          double* result)
 {
-    char c;
     int i;
     int j;
     int k;
@@ -5458,7 +7175,13 @@ Aligner_waterman_smith_beyer_global_score(Aligner* self,
     double score = 0.0;
     double gapscore;
     double temp;
-    int ok = 1;
+    double** target_gaps;
+    double** query_gaps;
+    int status = MEMORY_ERROR;
+
+    if (!_update_gap_tables(self, nA, nB)) return PYTHON_ERROR;
+    target_gaps = self->gap_tables.target;
+    query_gaps = self->gap_tables.query;
 
     /* Waterman-Smith-Beyer algorithm */
     M = PyMem_Malloc((nA+1)*sizeof(double*));
@@ -5483,42 +7206,40 @@ Aligner_waterman_smith_beyer_global_score(Aligner* self,
     Ix[0][0] = -DBL_MAX;
     Iy[0][0] = -DBL_MAX;
     for (i = 1; i <= nA; i++) {
-        ok = _call_query_gap_function(self, 0, i, &score);
-        if (!ok) goto exit;
+        score = query_gaps[0][i-1];
         M[i][0] = -DBL_MAX;
         Ix[i][0] = score;
         Iy[i][0] = -DBL_MAX;
     }
     for (j = 1; j <= nB; j++) {
-        ok = _call_target_gap_function(self, 0, j, &score);
-        if (!ok) goto exit;
+        score = target_gaps[0][j-1];
         M[0][j] = -DBL_MAX;
         Ix[0][j] = -DBL_MAX;
         Iy[0][j] = score;
     }
     for (i = 1; i <= nA; i++) {
-        kA = CHARINDEX(sA[i-1]);
+        kA = sA[i-1];
         for (j = 1; j <= nB; j++) {
-            kB = CHARINDEX(sB[j-1]);
+            kB = sB[j-1];
             SELECT_SCORE_GLOBAL(M[i-1][j-1], Ix[i-1][j-1], Iy[i-1][j-1]);
             M[i][j] = score + self->substitution_matrix[kA][kB];
             score = -DBL_MAX;
             for (k = 1; k <= i; k++) {
-                ok = _call_query_gap_function(self, j, k, &gapscore);
-                if (!ok) goto exit;
+                gapscore = query_gaps[j][k-1];
                 SELECT_SCORE_WATERMAN_SMITH_BEYER(M[i-k][j], Iy[i-k][j]);
             }
             Ix[i][j] = score;
             score = -DBL_MAX;
             for (k = 1; k <= j; k++) {
-                ok = _call_target_gap_function(self, i, k, &gapscore);
-                if (!ok) goto exit;
+                gapscore = target_gaps[i][k-1];
                 SELECT_SCORE_WATERMAN_SMITH_BEYER(M[i][j-k], Ix[i][j-k]);
             }
             Iy[i][j] = score;
         }
     }
     SELECT_SCORE_GLOBAL(M[nA][nB], Ix[nA][nB], Iy[nA][nB]);
+    *result = score;
+    status = 0;
 
 exit:
     if (M) {
@@ -5541,8 +7262,7 @@ exit:
         }
         PyMem_Free(M);
     }
-    if (!ok) return NULL;
-    return PyFloat_FromDouble(score);
+    return status;
 }
 
 static PyObject*
@@ -5550,7 +7270,6 @@ Aligner_waterman_smith_beyer_global_align(Aligner* self,
                                           const char* sA, Py_ssize_t nA,
                                           const char* sB, Py_ssize_t nB)
 {
-    char c;
     int i;
     int j;
     int gap;
@@ -5570,15 +7289,33 @@ Aligner_waterman_smith_beyer_global_align(Aligner* self,
     int trace;
     int* gapM;
     int* gapXY;
-    int ok = 1;
+    int* gaps_MIx = NULL;
+    int* gaps_IyIx;
+    int* gaps_MIy;
+    int* gaps_IxIy;
+    int nMIx;
+    int nIyIx;
+    double** target_gaps;
+    double** query_gaps;
     PathGenerator* paths = NULL;
 
+    if (!_update_gap_tables(self, nA, nB)) return NULL;
+    target_gaps = self->gap_tables.target;
+    query_gaps = self->gap_tables.query;
+
     /* Waterman-Smith-Beyer algorithm */
     paths = PathGenerator_create_WSB(nA, nB, Global);
     if (!paths) return NULL;
     M = paths->M;
     gaps = paths->gaps.waterman_smith_beyer;
 
+    /* lists of gap lengths of the current cell */
+    gaps_MIx = PyMem_Malloc(2*(nA+nB+2)*sizeof(int));
+    if (!gaps_MIx) goto exit;
+    gaps_IyIx = gaps_MIx + nA + 1;
+    gaps_MIy = gaps_IyIx + nA + 1;
+    gaps_IxIy = gaps_MIy + nB + 1;
+
     M_scores = PyMem_Malloc((nA+1)*sizeof(double*));
     if (!M_scores) goto exit;
     Ix_scores = PyMem_Malloc((nA+1)*sizeof(double*));
@@ -5604,70 +7341,48 @@ Aligner_waterman_smith_beyer_global_align(Aligner* self,
         Iy_scores[0][i] = 0;
     }
     for (i = 1; i <= nA; i++) {
-        ok = _call_query_gap_function(self, 0, i, &score);
-        if (!ok) goto exit;
+        score = query_gaps[0][i-1];
         Ix_scores[i][0] = score;
     }
     for (j = 1; j <= nB; j++) {
-        ok = _call_target_gap_function(self, 0, j, &score);
-        if (!ok) goto exit;
+        score = target_gaps[0][j-1];
         Iy_scores[0][j] = score;
     }
     for (i = 1; i <= nA; i++) {
-        kA = CHARINDEX(sA[i-1]);
+        kA = sA[i-1];
         for (j = 1; j <= nB; j++) {
-            kB = CHARINDEX(sB[j-1]);
+            kB = sB[j-1];
             SELECT_TRACE_WATERMAN_SMITH_BEYER_GLOBAL_ALIGN(self->substitution_matrix[kA][kB]);
-            gapM = PyMem_Malloc((i+1)*sizeof(int));
-            if (!gapM) goto exit;
-            gaps[i][j].MIx = gapM;
-            gapXY = PyMem_Malloc((i+1)*sizeof(int));
-            if (!gapXY) goto exit;
-            gaps[i][j].IyIx = gapXY;
+            gapM = gaps_MIx;
+            gapXY = gaps_IyIx;
             nm = 0;
             ng = 0;
             score = -DBL_MAX;
             for (gap = 1; gap <= i; gap++) {
-                ok = _call_query_gap_function(self, j, gap, &gapscore);
-                if (!ok) goto exit;
+                gapscore = query_gaps[j][gap-1];
                 SELECT_TRACE_WATERMAN_SMITH_BEYER_GAP(M_scores[i-gap][j],
                                                       Iy_scores[i-gap][j]);
             }
-            gapM = PyMem_Realloc(gapM, (nm+1)*sizeof(int));
-            if (!gapM) goto exit;
-            gaps[i][j].MIx = gapM;
-            gapM[nm] = 0;
-            gapXY = PyMem_Realloc(gapXY, (ng+1)*sizeof(int));
-            if (!gapXY) goto exit;
-            gapXY[ng] = 0;
-            gaps[i][j].IyIx = gapXY;
+            nMIx = nm;
+            nIyIx = ng;
             Ix_scores[i][j] = score;
-            gapM = PyMem_Malloc((j+1)*sizeof(int));
-            if (!gapM) goto exit;
-            gaps[i][j].MIy = gapM;
-            gapXY = PyMem_Malloc((j+1)*sizeof(int));
-            if (!gapXY) goto exit;
-            gaps[i][j].IxIy = gapXY;
+            gapM = gaps_MIy;
+            gapXY = gaps_IxIy;
             nm = 0;
             ng = 0;
             score = -DBL_MAX;
             for (gap = 1; gap <= j; gap++) {
-                ok = _call_target_gap_function(self, i, gap, &gapscore);
-                if (!ok) goto exit;
+                gapscore = target_gaps[i][gap-1];
                 SELECT_TRACE_WATERMAN_SMITH_BEYER_GAP(M_scores[i][j-gap],
                                                       Ix_scores[i][j-gap]);
             }
             Iy_scores[i][j] = score;
-            gapM = PyMem_Realloc(gapM, (nm+1)*sizeof(int));
-            if (!gapM) goto exit;
-            gaps[i][j].MIy = gapM;
-            gapM[nm] = 0;
-            gapXY = PyMem_Realloc(gapXY, (ng+1)*sizeof(int));
-            if (!gapXY) goto exit;
-            gaps[i][j].IxIy = gapXY;
-            gapXY[ng] = 0;
+            if (!_store_gaps_WSB(&gaps[i][j], gaps_MIx, nMIx, gaps_IyIx, nIyIx,
+                                              gaps_MIy, nm, gaps_IxIy, ng))
+                goto exit;
         }
     }
+    PyMem_Free(gaps_MIx);
 
     /* traceback */
     SELECT_SCORE_GLOBAL(M_scores[nA][nB], Ix_scores[nA][nB], Iy_scores[nA][nB]);
@@ -5675,24 +7390,12 @@ Aligner_waterman_smith_beyer_global_align(Aligner* self,
 
     if (M_scores[nA][nB] < score - epsilon) M[nA][nB].trace = 0;
     if (Ix_scores[nA][nB] < score - epsilon) {
-        gapM = PyMem_Realloc(gaps[nA][nB].MIx, sizeof(int));
-        if (!gapM) goto exit;
-        gapM[0] = 0;
-        gaps[nA][nB].MIx = gapM;
-        gapXY = PyMem_Realloc(gaps[nA][nB].IyIx, sizeof(int));
-        if (!gapXY) goto exit;
-        gapXY[0] = 0;
-        gaps[nA][nB].IyIx = gapXY;
+        gaps[nA][nB].MIx[0] = 0;
+        gaps[nA][nB].IyIx[0] = 0;
     }
     if (Iy_scores[nA][nB] < score - epsilon) {
-        gapM = PyMem_Realloc(gaps[nA][nB].MIy, sizeof(int));
-        if (!gapM) goto exit;
-        gapM[0] = 0;
-        gaps[nA][nB].MIy = gapM;
-        gapXY = PyMem_Realloc(gaps[nA][nB].IxIy, sizeof(int));
-        if (!gapXY) goto exit;
-        gapXY[0] = 0;
-        gaps[nA][nB].IxIy = gapXY;
+        gaps[nA][nB].MIy[0] = 0;
+        gaps[nA][nB].IxIy[0] = 0;
     }
     for (i = 0; i <= nA; i++) {
         PyMem_Free(M_scores[i]);
@@ -5705,9 +7408,9 @@ Aligner_waterman_smith_beyer_global_align(Aligner* self,
     return Py_BuildValue("fN", score, paths);
 
 exit:
-    if (ok) /* otherwise, an exception was already set */
-        PyErr_SetNone(PyExc_MemoryError);
+    PyErr_SetNone(PyExc_MemoryError);
     Py_DECREF(paths);
+    if (gaps_MIx) PyMem_Free(gaps_MIx);
     if (M_scores) {
         /* If M is NULL, then Ix is also NULL. */
         if (Ix_scores) {
@@ -5731,12 +7434,12 @@ exit:
     return NULL;
 }
 
-static PyObject*
+static int
 Aligner_waterman_smith_beyer_local_score(Aligner* self,
                                          const char* sA, Py_ssize_t nA,
-                                         const char* sB, Py_ssize_t nB)
+                                         const char* sB, Py_ssize_t nB,
+                                         double* result)
 {
-    char c;
     int i;
     int j;
     int gap;
@@ -5748,10 +7451,15 @@ Aligner_waterman_smith_beyer_local_score(Aligner* self,
     double score = 0.0;
     double gapscore = 0.0;
     double temp;
-    int ok = 1;
+    double** target_gaps;
+    double** query_gaps;
+
+    if (!_update_gap_tables(self, nA, nB)) return PYTHON_ERROR;
+    target_gaps = self->gap_tables.target;
+    query_gaps = self->gap_tables.query;
 
     double maximum = 0.0;
-    PyObject* result = NULL;
+    int status = MEMORY_ERROR;
 
     /* Waterman-Smith-Beyer algorithm */
     M = PyMem_Malloc((nA+1)*sizeof(double*));
@@ -5786,9 +7494,9 @@ Aligner_waterman_smith_beyer_local_score(Aligner* self,
         Iy[0][j] = 0;
     }
     for (i = 1; i <= nA; i++) {
-        kA = CHARINDEX(sA[i-1]);
+        kA = sA[i-1];
         for (j = 1; j <= nB; j++) {
-            kB = CHARINDEX(sB[j-1]);
+            kB = sB[j-1];
             SELECT_SCORE_GOTOH_LOCAL_ALIGN(M[i-1][j-1],
                                            Ix[i-1][j-1],
                                            Iy[i-1][j-1],
@@ -5801,16 +7509,14 @@ Aligner_waterman_smith_beyer_local_score(Aligner* self,
             }
             score = 0.0;
             for (gap = 1; gap <= i; gap++) {
-                ok = _call_query_gap_function(self, j, gap, &gapscore);
+                gapscore = query_gaps[j][gap-1];
                 SELECT_SCORE_WATERMAN_SMITH_BEYER(M[i-gap][j], Iy[i-gap][j]);
-                if (!ok) goto exit;
             }
             if (score > maximum) maximum = score;
             Ix[i][j] = score;
             score = 0.0;
             for (gap = 1; gap <= j; gap++) {
-                ok = _call_target_gap_function(self, i, gap, &gapscore);
-                if (!ok) goto exit;
+                gapscore = target_gaps[i][gap-1];
                 SELECT_SCORE_WATERMAN_SMITH_BEYER(M[i][j-gap], Ix[i][j-gap]);
             }
             if (score > maximum) maximum = score;
@@ -5820,7 +7526,8 @@ Aligner_waterman_smith_beyer_local_score(Aligner* self,
     SELECT_SCORE_GLOBAL(M[nA][nB], Ix[nA][nB], Iy[nA][nB]);
     if (score > maximum) maximum = score;
 
-    result = PyFloat_FromDouble(maximum);
+    *result = maximum;
+    status = 0;
 exit:
     if (M) {
         /* If M is NULL, then Ix is also NULL. */
@@ -5843,9 +7550,7 @@ exit:
         }
         PyMem_Free(M);
     }
-    if (!ok) return NULL;
-    if (!result) return PyErr_NoMemory();
-    return result;
+    return status;
 }
 
 static PyObject*
@@ -5853,7 +7558,6 @@ Aligner_waterman_smith_beyer_local_align(Aligner* self,
                                          const char* sA, Py_ssize_t nA,
                                          const char* sB, Py_ssize_t nB)
 {
-    char c;
     int i;
     int j;
     int im = nA;
@@ -5864,7 +7568,7 @@ Aligner_waterman_smith_beyer_local_align(Aligner* self,
     const double epsilon = self->epsilon;
     Trace** M = NULL;
     TraceGapsWatermanSmithBeyer** gaps;
-    double** M_scores;
+    double** M_scores = NULL;
     double** Ix_scores = NULL;
     double** Iy_scores = NULL;
     double score;
@@ -5873,11 +7577,22 @@ Aligner_waterman_smith_beyer_local_align(Aligner* self,
     int trace;
     int* gapM;
     int* gapXY;
+    int* gaps_MIx = NULL;
+    int* gaps_IyIx;
+    int* gaps_MIy;
+    int* gaps_IxIy;
+    int nMIx;
+    int nIyIx;
     int nm;
     int ng;
-    int ok = 1;
+    double** target_gaps;
+    double** query_gaps;
     double maximum = 0;
 
+    if (!_update_gap_tables(self, nA, nB)) return NULL;
+    target_gaps = self->gap_tables.target;
+    query_gaps = self->gap_tables.query;
+
     PathGenerator* paths = NULL;
 
     /* Waterman-Smith-Beyer algorithm */
@@ -5886,6 +7601,13 @@ Aligner_waterman_smith_beyer_local_align(Aligner* self,
     M = paths->M;
     gaps = paths->gaps.waterman_smith_beyer;
 
+    /* lists of gap lengths of the current cell */
+    gaps_MIx = PyMem_Malloc(2*(nA+nB+2)*sizeof(int));
+    if (!gaps_MIx) goto exit;
+    gaps_IyIx = gaps_MIx + nA + 1;
+    gaps_MIy = gaps_IyIx + nA + 1;
+    gaps_IxIy = gaps_MIy + nB + 1;
+
     M_scores = PyMem_Malloc((nA+1)*sizeof(double*));
     if (!M_scores) goto exit;
     Ix_scores = PyMem_Malloc((nA+1)*sizeof(double*));
@@ -5909,9 +7631,9 @@ Aligner_waterman_smith_beyer_local_align(Aligner* self,
         Iy_scores[0][i] = -DBL_MAX;
     }
     for (i = 1; i <= nA; i++) {
-        kA = CHARINDEX(sA[i-1]);
+        kA = sA[i-1];
         for (j = 1; j <= nB; j++) {
-            kB = CHARINDEX(sB[j-1]);
+            kB = sB[j-1];
             nm = 0;
             ng = 0;
             SELECT_TRACE_WATERMAN_SMITH_BEYER_ALIGN(
@@ -5922,23 +7644,14 @@ Aligner_waterman_smith_beyer_local_align(Aligner* self,
             M[i][j].path = 0;
             if (i == nA || j == nB) {
                 Ix_scores[i][j] = score;
-                gaps[i][j].MIx = NULL;
-                gaps[i][j].IyIx = NULL;
-                gaps[i][j].MIy = NULL;
-                gaps[i][j].IxIy = NULL;
                 Iy_scores[i][j] = score;
                 continue;
             }
-            gapM = PyMem_Malloc((i+1)*sizeof(int));
-            if (!gapM) goto exit;
-            gaps[i][j].MIx = gapM;
-            gapXY = PyMem_Malloc((i+1)*sizeof(int));
-            if (!gapXY) goto exit;
-            gaps[i][j].IyIx = gapXY;
+            gapM = gaps_MIx;
+            gapXY = gaps_IyIx;
             score = -DBL_MAX;
             for (gap = 1; gap <= i; gap++) {
-                ok = _call_query_gap_function(self, j, gap, &gapscore);
-                if (!ok) goto exit;
+                gapscore = query_gaps[j][gap-1];
                 SELECT_TRACE_WATERMAN_SMITH_BEYER_GAP(M_scores[i-gap][j],
                                                       Iy_scores[i-gap][j]);
             }
@@ -5948,31 +7661,16 @@ Aligner_waterman_smith_beyer_local_align(Aligner* self,
                 ng = 0;
             }
             else if (score > maximum) maximum = score;
-            gapM[nm] = 0;
-            gapXY[ng] = 0;
+            nMIx = nm;
+            nIyIx = ng;
             Ix_scores[i][j] = score;
-            M[i][j].path = 0;
-            gapM = PyMem_Realloc(gapM, (nm+1)*sizeof(int));
-            if (!gapM) goto exit;
-            gaps[i][j].MIx = gapM;
-            gapM[nm] = 0;
-            gapXY = PyMem_Realloc(gapXY, (ng+1)*sizeof(int));
-            if (!gapXY) goto exit;
-            gaps[i][j].IyIx = gapXY;
-            gapXY[ng] = 0;
-            gapM = PyMem_Malloc((j+1)*sizeof(int));
-            if (!gapM) goto exit;
-            gaps[i][j].MIy = gapM;
-            gapXY = PyMem_Malloc((j+1)*sizeof(int));
-            if (!gapXY) goto exit;
-            gaps[i][j].IxIy = gapXY;
+            gapM = gaps_MIy;
+            gapXY = gaps_IxIy;
             nm = 0;
             ng = 0;
             score = -DBL_MAX;
-            gapM[0] = 0;
             for (gap = 1; gap <= j; gap++) {
-                ok = _call_target_gap_function(self, i, gap, &gapscore);
-                if (!ok) goto exit;
+                gapscore = target_gaps[i][gap-1];
                 SELECT_TRACE_WATERMAN_SMITH_BEYER_GAP(M_scores[i][j-gap],
                                                       Ix_scores[i][j-gap]);
             }
@@ -5982,18 +7680,14 @@ Aligner_waterman_smith_beyer_local_align(Aligner* self,
                 ng = 0;
             }
             else if (score > maximum) maximum = score;
-            gapM = PyMem_Realloc(gapM, (nm+1)*sizeof(int));
-            if (!gapM) goto exit;
-            gaps[i][j].MIy = gapM;
-            gapXY = PyMem_Realloc(gapXY, (ng+1)*sizeof(int));
-            if (!gapXY) goto exit;
-            gaps[i][j].IxIy = gapXY;
-            gapM[nm] = 0;
-            gapXY[ng] = 0;
             Iy_scores[i][j] = score;
-            M[i][j].path = 0;
+            if (!_store_gaps_WSB(&gaps[i][j], gaps_MIx, nMIx, gaps_IyIx, nIyIx,
+                                              gaps_MIy, nm, gaps_IxIy, ng))
+                goto exit;
         }
     }
+    PyMem_Free(gaps_MIx);
+    gaps_MIx = NULL;
     for (i = 0; i <= nA; i++) PyMem_Free(M_scores[i]);
     PyMem_Free(M_scores);
     for (i = 0; i <= nA; i++) PyMem_Free(Ix_scores[i]);
@@ -6031,22 +7725,17 @@ Aligner_waterman_smith_beyer_local_align(Aligner* self,
             }
             M[i][j].trace = trace;
             if (i == nA || j == nB) continue;
+            /* The lists are filtered in place, as they can only shrink. */
             gapM = gaps[i][j].MIx;
             gapXY = gaps[i][j].IyIx;
             nm = 0;
             ng = 0;
             for (im = 0; (gap = gapM[im]); im++)
                 if (M[i-gap][j].path & M_MATRIX) gapM[nm++] = gap;
-            gapM = PyMem_Realloc(gapM, (nm+1)*sizeof(int));
-            if (!gapM) goto exit;
             gapM[nm] = 0;
-            gaps[i][j].MIx = gapM;
             for (im = 0; (gap = gapXY[im]); im++)
                 if (M[i-gap][j].path & Iy_MATRIX) gapXY[ng++] = gap;
-            gapXY = PyMem_Realloc(gapXY, (ng+1)*sizeof(int));
-            if (!gapXY) goto exit;
             gapXY[ng] = 0;
-            gaps[i][j].IyIx = gapXY;
             if (nm==0 && ng==0) M[i][j].path &= ~Ix_MATRIX; /* not reachable */
             else M[i][j].path |= Ix_MATRIX; /* reachable */
             gapM = gaps[i][j].MIy;
@@ -6055,16 +7744,10 @@ Aligner_waterman_smith_beyer_local_align(Aligner* self,
             ng = 0;
             for (im = 0; (gap = gapM[im]); im++)
                 if (M[i][j-gap].path & M_MATRIX) gapM[nm++] = gap;
-            gapM = PyMem_Realloc(gapM, (nm+1)*sizeof(int));
-            if (!gapM) goto exit;
             gapM[nm] = 0;
-            gaps[i][j].MIy = gapM;
             for (im = 0; (gap = gapXY[im]); im++)
                 if (M[i][j-gap].path & Ix_MATRIX) gapXY[ng++] = gap;
-            gapXY = PyMem_Realloc(gapXY, (ng+1)*sizeof(int));
-            if (!gapXY) goto exit;
             gapXY[ng] = 0;
-            gaps[i][j].IxIy = gapXY;
             if (nm==0 && ng==0) M[i][j].path &= ~Iy_MATRIX; /* not reachable */
             else M[i][j].path |= Iy_MATRIX; /* reachable */
         }
@@ -6077,9 +7760,9 @@ Aligner_waterman_smith_beyer_local_align(Aligner* self,
     return Py_BuildValue("fN", maximum, paths);
 
 exit:
-    if (ok) /* otherwise, an exception was already set */
-        PyErr_SetNone(PyExc_MemoryError);
+    PyErr_SetNone(PyExc_MemoryError);
     Py_DECREF(paths);
+    if (gaps_MIx) PyMem_Free(gaps_MIx);
     if (M_scores) {
         /* If M is NULL, then Ix is also NULL. */
         if (Ix_scores) {
@@ -6103,112 +7786,3526 @@ exit:
     return NULL;
 }
  
-static const char Aligner_score__doc__[] = "calculates the alignment score";
+/* ------------- position-dependent affine gap scores ------------- */
 
-static PyObject*
-Aligner_score(Aligner* self, PyObject* args, PyObject* keywords)
-{
-    const char* sA;
-    const char* sB;
-    Py_ssize_t nA;
-    Py_ssize_t nB;
-    const Mode mode = self->mode;
-    const Algorithm algorithm = _get_algorithm(self);
+/* The open and extend gap scores of a global alignment with the Gotoh or
+ * Needleman-Wunsch algorithm, which depend on whether a gap is at the left
+ * end, inside, or at the right end of a sequence.  These are used by the
+ * linear-space and banded alignment algorithms, which consider each cell
+ * of the rectangle in the same way.
+ */
 
-    static char *kwlist[] = {"sequenceA", "sequenceB", NULL};
-    if(!PyArg_ParseTupleAndKeywords(args, keywords, "s#s#", kwlist,
-                                    &sA, &nA, &sB, &nB))
-        return NULL;
+typedef struct {
+    int nA;
+    int nB;
+    double gap_open_A;
+    double gap_open_B;
+    double gap_extend_A;
+    double gap_extend_B;
+    double left_gap_open_A;
+    double left_gap_open_B;
+    double left_gap_extend_A;
+    double left_gap_extend_B;
+    double right_gap_open_A;
+    double right_gap_open_B;
+    double right_gap_extend_A;
+    double right_gap_extend_B;
+} GapScores;
 
-    switch (algorithm) {
-        case NeedlemanWunschSmithWaterman:
-            switch (mode) {
-                case Global:
-                    return Aligner_needlemanwunsch_score(self, sA, nA, sB, nB);
-                case Local:
-                    return Aligner_smithwaterman_score(self, sA, nA, sB, nB);
-            }
-        case Gotoh:
-            switch (mode) {
-                case Global:
-                    return Aligner_gotoh_global_score(self, sA, nA, sB, nB);
-                case Local:
-                    return Aligner_gotoh_local_score(self, sA, nA, sB, nB);
-            }
-        case WatermanSmithBeyer:
-            switch (mode) {
-                case Global:
-                    return Aligner_waterman_smith_beyer_global_score(self, sA, nA, sB, nB);
-                case Local:
-                    return Aligner_waterman_smith_beyer_local_score(self, sA, nA, sB, nB);
-            }
-        case Unknown:
-        default:
-            PyErr_SetString(PyExc_RuntimeError, "unknown algorithm");
-            return NULL;
-    }
+static void
+_gap_scores_init(GapScores* gaps, const Aligner* self, int nA, int nB)
+{
+    gaps->nA = nA;
+    gaps->nB = nB;
+    gaps->gap_open_A = self->target_open_gap_score;
+    gaps->gap_open_B = self->query_open_gap_score;
+    gaps->gap_extend_A = self->target_extend_gap_score;
+    gaps->gap_extend_B = self->query_extend_gap_score;
+    gaps->left_gap_open_A = self->target_left_open_gap_score;
+    gaps->left_gap_open_B = self->query_left_open_gap_score;
+    gaps->left_gap_extend_A = self->target_left_extend_gap_score;
+    gaps->left_gap_extend_B = self->query_left_extend_gap_score;
+    gaps->right_gap_open_A = self->target_right_open_gap_score;
+    gaps->right_gap_open_B = self->query_right_open_gap_score;
+    gaps->right_gap_extend_A = self->target_right_extend_gap_score;
+    gaps->right_gap_extend_B = self->query_right_extend_gap_score;
+}
+
+/* score of a gap in the query at column j (a vertical step) */
+static double
+_vertical_gap_score(const GapScores* gaps, int j, int extend)
+{
+    if (j == 0)
+        return extend ? gaps->left_gap_extend_B : gaps->left_gap_open_B;
+    if (j == gaps->nB)
+        return extend ? gaps->right_gap_extend_B : gaps->right_gap_open_B;
+    return extend ? gaps->gap_extend_B : gaps->gap_open_B;
 }
 
-static const char Aligner_align__doc__[] = "align two sequences";
-
-static PyObject*
-Aligner_align(Aligner* self, PyObject* args, PyObject* keywords)
+/* score of a gap in the target at row i (a horizontal step) */
+static double
+_horizontal_gap_score(const GapScores* gaps, int i, int extend)
 {
+    if (i == 0)
+        return extend ? gaps->left_gap_extend_A : gaps->left_gap_open_A;
+    if (i == gaps->nA)
+        return extend ? gaps->right_gap_extend_A : gaps->right_gap_open_A;
+    return extend ? gaps->gap_extend_A : gaps->gap_open_A;
+}
+
+/* ------------- global alignment in linear space ------------- */
+
+/* A single optimal global alignment is found in linear space with the
+ * divide-and-conquer algorithm of Myers and Miller (1988) for three states
+ * (M, Ix, Iy), which covers both the Gotoh algorithm and the
+ * Needleman-Wunsch algorithm (for which the open and extend gap scores are
+ * equal).  The optimal path is crossed with the middle row of the
+ * rectangle by combining the scores of a forward pass over the top half
+ * with those of a backward pass over the bottom half; the two halves are
+ * then aligned recursively, with the state at the crossing point as the
+ * end state of the top half and the start state of the bottom half.  Small
+ * rectangles are aligned using a full traceback matrix.
+ *
+ * The path is stored as a sequence of steps (HORIZONTAL, VERTICAL, or
+ * DIAGONAL), which is converted to the same tuple of coordinates as
+ * created by _create_path.
+ */
+
+#define LINEAR_SPACE_M 0
+#define LINEAR_SPACE_Ix 1
+#define LINEAR_SPACE_Iy 2
+#define LINEAR_SPACE_ANY 3
+#define LINEAR_SPACE_BASE_CELLS 4096
+
+typedef struct {
     const char* sA;
     const char* sB;
-    Py_ssize_t nA;
-    Py_ssize_t nB;
-    const Mode mode = self->mode;
-    const Algorithm algorithm = _get_algorithm(self);
+    double** substitution_matrix;
+    GapScores gaps;
+    double* M; /* forward scores at the middle row */
+    double* Ix;
+    double* Iy;
+    double* M_next; /* backward scores at the middle row */
+    double* Ix_next;
+    double* Iy_next;
+    unsigned char* steps;
+    int n;
+} LinearSpace;
 
-    static char *kwlist[] = {"sequenceA", "sequenceB", NULL};
-    if(!PyArg_ParseTupleAndKeywords(args, keywords, "s#s#", kwlist,
-                                    &sA, &nA, &sB, &nB))
-        return NULL;
+#define LINEAR_SPACE_MAX3(score1, score2, score3) \
+    (score = score1, \
+     temp = score2, score = (temp > score) ? temp : score, \
+     temp = score3, (temp > score) ? temp : score)
 
-    switch (algorithm) {
-        case NeedlemanWunschSmithWaterman:
-            switch (mode) {
-                case Global:
-                    return Aligner_needlemanwunsch_align(self, sA, nA, sB, nB);
-                case Local:
-                    return Aligner_smithwaterman_align(self, sA, nA, sB, nB);
-            }
-        case Gotoh:
-            switch (mode) {
-                case Global:
-                    return Aligner_gotoh_global_align(self, sA, nA, sB, nB);
-                case Local:
-                    return Aligner_gotoh_local_align(self, sA, nA, sB, nB);
-            }
-        case WatermanSmithBeyer:
-            switch (mode) {
-                case Global:
-                    return Aligner_waterman_smith_beyer_global_align(self, sA, nA, sB, nB);
-                case Local:
-                    return Aligner_waterman_smith_beyer_local_align(self, sA, nA, sB, nB);
-            }
-        case Unknown:
-        default:
-            PyErr_SetString(PyExc_RuntimeError, "unknown algorithm");
-            return NULL;
+/* Best scores of paths from (i0, j0) in state s0 to row i1, for columns j0
+ * to j1, stored in p->M, p->Ix, p->Iy. */
+static void
+_linear_space_forward(LinearSpace* p, int i0, int j0, int s0, int i1, int j1)
+{
+    int i;
+    int j;
+    int kA;
+    int kB;
+    double* M = p->M;
+    double* Ix = p->Ix;
+    double* Iy = p->Iy;
+    double M_temp;
+    double Ix_temp;
+    double Iy_temp;
+    double h_open;
+    double h_extend;
+    double v_open;
+    double v_extend;
+    double score;
+    double temp;
+
+    M[j0] = (s0 == LINEAR_SPACE_M) ? 0 : -DBL_MAX;
+    Ix[j0] = (s0 == LINEAR_SPACE_Ix) ? 0 : -DBL_MAX;
+    Iy[j0] = (s0 == LINEAR_SPACE_Iy) ? 0 : -DBL_MAX;
+    h_open = _horizontal_gap_score(&p->gaps, i0, 0);
+    h_extend = _horizontal_gap_score(&p->gaps, i0, 1);
+    for (j = j0 + 1; j <= j1; j++) {
+        M[j] = -DBL_MAX;
+        Ix[j] = -DBL_MAX;
+        Iy[j] = LINEAR_SPACE_MAX3(M[j-1] + h_open,
+                                  Ix[j-1] + h_open,
+                                  Iy[j-1] + h_extend);
+    }
+    for (i = i0 + 1; i <= i1; i++) {
+        kA = p->sA[i-1];
+        h_open = _horizontal_gap_score(&p->gaps, i, 0);
+        h_extend = _horizontal_gap_score(&p->gaps, i, 1);
+        v_open = _vertical_gap_score(&p->gaps, j0, 0);
+        v_extend = _vertical_gap_score(&p->gaps, j0, 1);
+        M_temp = M[j0];
+        Ix_temp = Ix[j0];
+        Iy_temp = Iy[j0];
+        M[j0] = -DBL_MAX;
+        Ix[j0] = LINEAR_SPACE_MAX3(M_temp + v_open,
+                                   Ix_temp + v_extend,
+                                   Iy_temp + v_open);
+        Iy[j0] = -DBL_MAX;
+        for (j = j0 + 1; j <= j1; j++) {
+            kB = p->sB[j-1];
+            v_open = _vertical_gap_score(&p->gaps, j, 0);
+            v_extend = _vertical_gap_score(&p->gaps, j, 1);
+            score = LINEAR_SPACE_MAX3(M_temp, Ix_temp, Iy_temp)
+                  + p->substitution_matrix[kA][kB];
+            M_temp = M[j];
+            Ix_temp = Ix[j];
+            Iy_temp = Iy[j];
+            M[j] = score;
+            Ix[j] = LINEAR_SPACE_MAX3(M_temp + v_open,
+                                      Ix_temp + v_extend,
+                                      Iy_temp + v_open);
+            Iy[j] = LINEAR_SPACE_MAX3(M[j-1] + h_open,
+                                      Ix[j-1] + h_open,
+                                      Iy[j-1] + h_extend);
+        }
     }
 }
 
-static char Aligner_doc[] =
-"Aligner.\n";
-
-static PyMethodDef Aligner_methods[] = {
-    {"score",
-     (PyCFunction)Aligner_score,
-     METH_VARARGS | METH_KEYWORDS,
-     Aligner_score__doc__
-    },
+/* Best scores of paths from row i0 in each state to (i1, j1) in state s1,
+ * for columns j0 to j1, stored in p->M_next, p->Ix_next, p->Iy_next. */
+static void
+_linear_space_backward(LinearSpace* p, int i0, int j0, int i1, int j1, int s1)
+{
+    int i;
+    int j;
+    int kA;
+    int kB;
+    double* M = p->M_next;
+    double* Ix = p->Ix_next;
+    double* Iy = p->Iy_next;
+    double M_temp;
+    double Ix_temp;
+    double diagonal;
+    double vertical;
+    double horizontal;
+    double h_open;
+    double h_extend;
+    double v_open;
+    double v_extend;
+    double score;
+    double temp;
+
+    M[j1] = (s1 == LINEAR_SPACE_M || s1 == LINEAR_SPACE_ANY) ? 0 : -DBL_MAX;
+    Ix[j1] = (s1 == LINEAR_SPACE_Ix || s1 == LINEAR_SPACE_ANY) ? 0 : -DBL_MAX;
+    Iy[j1] = (s1 == LINEAR_SPACE_Iy || s1 == LINEAR_SPACE_ANY) ? 0 : -DBL_MAX;
+    h_open = _horizontal_gap_score(&p->gaps, i1, 0);
+    h_extend = _horizontal_gap_score(&p->gaps, i1, 1);
+    for (j = j1 - 1; j >= j0; j--) {
+        horizontal = Iy[j+1];
+        M[j] = horizontal + h_open;
+        Ix[j] = horizontal + h_open;
+        Iy[j] = horizontal + h_extend;
+    }
+    for (i = i1 - 1; i >= i0; i--) {
+        kA = p->sA[i];
+        h_open = _horizontal_gap_score(&p->gaps, i, 0);
+        h_extend = _horizontal_gap_score(&p->gaps, i, 1);
+        v_open = _vertical_gap_score(&p->gaps, j1, 0);
+        v_extend = _vertical_gap_score(&p->gaps, j1, 1);
+        M_temp = M[j1];
+        vertical = Ix[j1];
+        M[j1] = vertical + v_open;
+        Ix[j1] = vertical + v_extend;
+        Iy[j1] = vertical + v_open;
+        for (j = j1 - 1; j >= j0; j--) {
+            kB = p->sB[j];
+            v_open = _vertical_gap_score(&p->gaps, j, 0);
+            v_extend = _vertical_gap_score(&p->gaps, j, 1);
+            diagonal = M_temp + p->substitution_matrix[kA][kB];
+            M_temp = M[j];
+            Ix_temp = Ix[j];
+            horizontal = Iy[j+1];
+            M[j] = LINEAR_SPACE_MAX3(diagonal,
+                                     Ix_temp + v_open,
+                                     horizontal + h_open);
+            Ix[j] = LINEAR_SPACE_MAX3(diagonal,
+                                      Ix_temp + v_extend,
+                                      horizontal + h_open);
+            Iy[j] = LINEAR_SPACE_MAX3(diagonal,
+                                      Ix_temp + v_open,
+                                      horizontal + h_extend);
+        }
+    }
+}
+
+/* Align the rectangle from (i0, j0) in state s0 to (i1, j1) in state s1
+ * using a full traceback matrix, and append the path to p->steps.
+ * Returns the score, or -DBL_MAX if memory allocation fails. */
+static double
+_linear_space_full(LinearSpace* p, int i0, int j0, int s0,
+                                   int i1, int j1, int s1)
+{
+    int i;
+    int j;
+    int k;
+    int kA;
+    int kB;
+    int s;
+    int trace;
+    const int n = j1 - j0 + 1;
+    const int size = (i1 - i0 + 1) * n;
+    double* scores;
+    unsigned char* traces;
+    double* current;
+    double* previous;
+    double h_open;
+    double h_extend;
+    double v_open;
+    double v_extend;
+    double score;
+    unsigned char* steps;
+
+    scores = PyMem_RawMalloc(3 * size * sizeof(double));
+    if (!scores) return -DBL_MAX;
+    traces = PyMem_RawMalloc(3 * size * sizeof(unsigned char));
+    if (!traces) {
+        PyMem_RawFree(scores);
+        return -DBL_MAX;
+    }
+
+#define SELECT_TRACE_LINEAR_SPACE(matrix, score1, score2, score3) \
+    score = score1; \
+    trace = LINEAR_SPACE_M; \
+    if (score2 > score) { \
+        score = score2; \
+        trace = LINEAR_SPACE_Ix; \
+    } \
+    if (score3 > score) { \
+        score = score3; \
+        trace = LINEAR_SPACE_Iy; \
+    } \
+    current[matrix] = score; \
+    traces[3 * k + matrix] = trace;
+
+    for (i = i0; i <= i1; i++) {
+        h_open = _horizontal_gap_score(&p->gaps, i, 0);
+        h_extend = _horizontal_gap_score(&p->gaps, i, 1);
+        kA = (i > 0) ? p->sA[i-1] : 0;
+        for (j = j0; j <= j1; j++) {
+            k = (i - i0) * n + (j - j0);
+            current = scores + 3 * k;
+            if (i == i0 && j == j0) {
+                current[LINEAR_SPACE_M] = (s0 == LINEAR_SPACE_M) ? 0 : -DBL_MAX;
+                current[LINEAR_SPACE_Ix] = (s0 == LINEAR_SPACE_Ix) ? 0 : -DBL_MAX;
+                current[LINEAR_SPACE_Iy] = (s0 == LINEAR_SPACE_Iy) ? 0 : -DBL_MAX;
+                continue;
+            }
+            if (i > i0 && j > j0) {
+                kB = p->sB[j-1];
+                previous = scores + 3 * (k - n - 1);
+                SELECT_TRACE_LINEAR_SPACE(LINEAR_SPACE_M,
+                                          previous[LINEAR_SPACE_M],
+                                          previous[LINEAR_SPACE_Ix],
+                                          previous[LINEAR_SPACE_Iy]);
+                current[LINEAR_SPACE_M] += p->substitution_matrix[kA][kB];
+            }
+            else current[LINEAR_SPACE_M] = -DBL_MAX;
+            if (i > i0) {
+                v_open = _vertical_gap_score(&p->gaps, j, 0);
+                v_extend = _vertical_gap_score(&p->gaps, j, 1);
+                previous = scores + 3 * (k - n);
+                SELECT_TRACE_LINEAR_SPACE(LINEAR_SPACE_Ix,
+                                          previous[LINEAR_SPACE_M] + v_open,
+                                          previous[LINEAR_SPACE_Ix] + v_extend,
+                                          previous[LINEAR_SPACE_Iy] + v_open);
+            }
+            else current[LINEAR_SPACE_Ix] = -DBL_MAX;
+            if (j > j0) {
+                previous = scores + 3 * (k - 1);
+                SELECT_TRACE_LINEAR_SPACE(LINEAR_SPACE_Iy,
+                                          previous[LINEAR_SPACE_M] + h_open,
+                                          previous[LINEAR_SPACE_Ix] + h_open,
+                                          previous[LINEAR_SPACE_Iy] + h_extend);
+            }
+            else current[LINEAR_SPACE_Iy] = -DBL_MAX;
+        }
+    }
+
+#undef SELECT_TRACE_LINEAR_SPACE
+
+    current = scores + 3 * (size - 1);
+    if (s1 == LINEAR_SPACE_ANY) {
+        s = LINEAR_SPACE_M;
+        if (current[LINEAR_SPACE_Ix] > current[s]) s = LINEAR_SPACE_Ix;
+        if (current[LINEAR_SPACE_Iy] > current[s]) s = LINEAR_SPACE_Iy;
+    }
+    else s = s1;
+    score = current[s];
+
+    /* traceback; the steps are stored in reverse order first */
+    steps = p->steps + p->n;
+    i = i1;
+    j = j1;
+    k = 0;
+    while (i > i0 || j > j0) {
+        trace = traces[3 * ((i - i0) * n + (j - j0)) + s];
+        switch (s) {
+            case LINEAR_SPACE_M:
+                steps[k] = DIAGONAL;
+                i--;
+                j--;
+                break;
+            case LINEAR_SPACE_Ix:
+                steps[k] = VERTICAL;
+                i--;
+                break;
+            case LINEAR_SPACE_Iy:
+                steps[k] = HORIZONTAL;
+                j--;
+                break;
+        }
+        s = trace;
+        k++;
+    }
+    for (i = 0, j = k - 1; i < j; i++, j--) {
+        trace = steps[i];
+        steps[i] = steps[j];
+        steps[j] = trace;
+    }
+    p->n += k;
+    PyMem_RawFree(scores);
+    PyMem_RawFree(traces);
+    return score;
+}
+
+/* Align the rectangle from (i0, j0) in state s0 to (i1, j1) in state s1,
+ * and append the path to p->steps.  Returns the score, or -DBL_MAX if
+ * memory allocation fails. */
+static double
+_linear_space_align(LinearSpace* p, int i0, int j0, int s0,
+                                    int i1, int j1, int s1)
+{
+    int j;
+    int s;
+    int jm = j0;
+    int sm = LINEAR_SPACE_M;
+    const int im = (i0 + i1) / 2;
+    double score;
+    double maximum = -DBL_MAX;
+    double forward[3];
+    double backward[3];
+
+    if (i1 - i0 <= 1 || j1 - j0 <= 1
+     || (double)(i1 - i0 + 1) * (j1 - j0 + 1) <= LINEAR_SPACE_BASE_CELLS)
+        return _linear_space_full(p, i0, j0, s0, i1, j1, s1);
+    _linear_space_forward(p, i0, j0, s0, im, j1);
+    _linear_space_backward(p, im, j0, i1, j1, s1);
+    for (j = j0; j <= j1; j++) {
+        forward[LINEAR_SPACE_M] = p->M[j];
+        forward[LINEAR_SPACE_Ix] = p->Ix[j];
+        forward[LINEAR_SPACE_Iy] = p->Iy[j];
+        backward[LINEAR_SPACE_M] = p->M_next[j];
+        backward[LINEAR_SPACE_Ix] = p->Ix_next[j];
+        backward[LINEAR_SPACE_Iy] = p->Iy_next[j];
+        for (s = 0; s < 3; s++) {
+            if (forward[s] == -DBL_MAX || backward[s] == -DBL_MAX) continue;
+            score = forward[s] + backward[s];
+            if (score > maximum) {
+                maximum = score;
+                jm = j;
+                sm = s;
+            }
+        }
+    }
+    if (_linear_space_align(p, i0, j0, s0, im, jm, sm) == -DBL_MAX)
+        return -DBL_MAX;
+    if (_linear_space_align(p, im, jm, sm, i1, j1, s1) == -DBL_MAX)
+        return -DBL_MAX;
+    return maximum;
+}
+
+static PathGenerator*
+PathGenerator_create_single(int nA, int nB, Algorithm algorithm,
+                            const unsigned char* steps, int n)
+{
+    PathGenerator* paths;
+
+    paths = (PathGenerator*)PyType_GenericAlloc(&PathGenerator_Type, 0);
+    if (!paths) return NULL;
+
+    paths->iA = 0;
+    paths->iB = 0;
+    paths->nA = nA;
+    paths->nB = nB;
+    paths->M = NULL;
+    paths->gaps.gotoh = NULL;
+    paths->gaps.waterman_smith_beyer = NULL;
+    paths->algorithm = algorithm;
+    paths->mode = Global;
+    paths->length = 1;
+    paths->skip = 0;
+    paths->band_offset = 0;
+    paths->band_width = -1;
+    /* store the steps only; the path is created when it is requested */
+    paths->steps = PyMem_Malloc((n + 1) * sizeof(unsigned char));
+    if (!paths->steps) {
+        Py_DECREF(paths);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    memcpy(paths->steps, steps, n * sizeof(unsigned char));
+    paths->nsteps = n;
+    return paths;
+}
+
+static PyObject*
+Aligner_linear_space_align(Aligner* self, const char* sA, Py_ssize_t nA,
+                                          const char* sB, Py_ssize_t nB)
+{
+    int j;
+    double score;
+    double* buffer = NULL;
+    PathGenerator* paths;
+    LinearSpace p;
+
+    p.sA = sA;
+    p.sB = sB;
+    p.substitution_matrix = self->substitution_matrix;
+    _gap_scores_init(&p.gaps, self, nA, nB);
+    p.n = 0;
+    p.steps = PyMem_RawMalloc((nA + nB + 1) * sizeof(unsigned char));
+    if (!p.steps) return PyErr_NoMemory();
+    buffer = PyMem_RawMalloc(6 * (nB + 1) * sizeof(double));
+    if (!buffer) {
+        PyMem_RawFree(p.steps);
+        return PyErr_NoMemory();
+    }
+    j = nB + 1;
+    p.M = buffer;
+    p.Ix = buffer + j;
+    p.Iy = buffer + 2 * j;
+    p.M_next = buffer + 3 * j;
+    p.Ix_next = buffer + 4 * j;
+    p.Iy_next = buffer + 5 * j;
+    score = _linear_space_align(&p, 0, 0, LINEAR_SPACE_M,
+                                nA, nB, LINEAR_SPACE_ANY);
+    PyMem_RawFree(buffer);
+    if (score == -DBL_MAX) {
+        PyMem_RawFree(p.steps);
+        return PyErr_NoMemory();
+    }
+    paths = PathGenerator_create_single(nA, nB, self->algorithm, p.steps, p.n);
+    PyMem_RawFree(p.steps);
+    if (!paths) return NULL;
+    return Py_BuildValue("fN", score, paths);
+}
+
+/* The Waterman-Smith-Beyer algorithm with arbitrary gap functions cannot be
+ * divided at the middle row, as a gap may extend over any number of rows or
+ * columns.  Instead, the score matrices are calculated as usual, and a single
+ * optimal path is recovered from the scores, without storing the lists of
+ * gap lengths in the traceback matrix. */
+static PyObject*
+Aligner_waterman_smith_beyer_single_align(Aligner* self,
+                                          const char* sA, Py_ssize_t nA,
+                                          const char* sB, Py_ssize_t nB)
+{
+    int i;
+    int j;
+    int k;
+    int gap;
+    int kA;
+    int kB;
+    int s;
+    int n = 0;
+    const double epsilon = self->epsilon;
+    double** M = NULL;
+    double** Ix = NULL;
+    double** Iy = NULL;
+    double score = 0.0;
+    double gapscore;
+    double temp;
+    unsigned char* steps = NULL;
+    PathGenerator* paths = NULL;
+    double** target_gaps;
+    double** query_gaps;
+
+    if (!_update_gap_tables(self, nA, nB)) return NULL;
+    target_gaps = self->gap_tables.target;
+    query_gaps = self->gap_tables.query;
+
+    M = PyMem_Malloc((nA+1)*sizeof(double*));
+    if (!M) goto exit;
+    Ix = PyMem_Malloc((nA+1)*sizeof(double*));
+    if (!Ix) goto exit;
+    Iy = PyMem_Malloc((nA+1)*sizeof(double*));
+    if (!Iy) goto exit;
+    for (i = 0; i <= nA; i++) {
+        M[i] = NULL;
+        Ix[i] = NULL;
+        Iy[i] = NULL;
+    }
+    for (i = 0; i <= nA; i++) {
+        M[i] = PyMem_Malloc((nB+1)*sizeof(double));
+        if (!M[i]) goto exit;
+        Ix[i] = PyMem_Malloc((nB+1)*sizeof(double));
+        if (!Ix[i]) goto exit;
+        Iy[i] = PyMem_Malloc((nB+1)*sizeof(double));
+        if (!Iy[i]) goto exit;
+    }
+    steps = PyMem_Malloc((nA+nB+1)*sizeof(unsigned char));
+    if (!steps) goto exit;
+
+    M[0][0] = 0;
+    Ix[0][0] = -DBL_MAX;
+    Iy[0][0] = -DBL_MAX;
+    for (i = 1; i <= nA; i++) {
+        score = query_gaps[0][i-1];
+        M[i][0] = -DBL_MAX;
+        Ix[i][0] = score;
+        Iy[i][0] = -DBL_MAX;
+    }
+    for (j = 1; j <= nB; j++) {
+        score = target_gaps[0][j-1];
+        M[0][j] = -DBL_MAX;
+        Ix[0][j] = -DBL_MAX;
+        Iy[0][j] = score;
+    }
+    for (i = 1; i <= nA; i++) {
+        kA = sA[i-1];
+        for (j = 1; j <= nB; j++) {
+            kB = sB[j-1];
+            SELECT_SCORE_GLOBAL(M[i-1][j-1], Ix[i-1][j-1], Iy[i-1][j-1]);
+            M[i][j] = score + self->substitution_matrix[kA][kB];
+            score = -DBL_MAX;
+            for (k = 1; k <= i; k++) {
+                gapscore = query_gaps[j][k-1];
+                SELECT_SCORE_WATERMAN_SMITH_BEYER(M[i-k][j], Iy[i-k][j]);
+            }
+            Ix[i][j] = score;
+            score = -DBL_MAX;
+            for (k = 1; k <= j; k++) {
+                gapscore = target_gaps[i][k-1];
+                SELECT_SCORE_WATERMAN_SMITH_BEYER(M[i][j-k], Ix[i][j-k]);
+            }
+            Iy[i][j] = score;
+        }
+    }
+    SELECT_SCORE_GLOBAL(M[nA][nB], Ix[nA][nB], Iy[nA][nB]);
+
+    /* traceback; the steps are stored in reverse order first */
+    s = LINEAR_SPACE_M;
+    if (Ix[nA][nB] > M[nA][nB]) s = LINEAR_SPACE_Ix;
+    if (Iy[nA][nB] > M[nA][nB] && Iy[nA][nB] > Ix[nA][nB]) s = LINEAR_SPACE_Iy;
+    i = nA;
+    j = nB;
+    while (i > 0 || j > 0) {
+        switch (s) {
+            case LINEAR_SPACE_M:
+                steps[n++] = DIAGONAL;
+                i--;
+                j--;
+                s = LINEAR_SPACE_M;
+                if (Ix[i][j] > M[i][j]) s = LINEAR_SPACE_Ix;
+                if (Iy[i][j] > M[i][j] && Iy[i][j] > Ix[i][j])
+                    s = LINEAR_SPACE_Iy;
+                break;
+            case LINEAR_SPACE_Ix:
+                for (gap = 1; gap <= i; gap++) {
+                    gapscore = query_gaps[j][gap-1];
+                    if (M[i-gap][j] + gapscore > Ix[i][j] - epsilon) {
+                        s = LINEAR_SPACE_M;
+                        break;
+                    }
+                    if (Iy[i-gap][j] + gapscore > Ix[i][j] - epsilon) {
+                        s = LINEAR_SPACE_Iy;
+                        break;
+                    }
+                }
+                if (gap > i) {
+                    PyErr_SetString(PyExc_RuntimeError,
+                                    "failed to find the gap in the traceback");
+                    goto exit;
+                }
+                for (k = 0; k < gap; k++) steps[n++] = VERTICAL;
+                i -= gap;
+                break;
+            case LINEAR_SPACE_Iy:
+                for (gap = 1; gap <= j; gap++) {
+                    gapscore = target_gaps[i][gap-1];
+                    if (M[i][j-gap] + gapscore > Iy[i][j] - epsilon) {
+                        s = LINEAR_SPACE_M;
+                        break;
+                    }
+                    if (Ix[i][j-gap] + gapscore > Iy[i][j] - epsilon) {
+                        s = LINEAR_SPACE_Ix;
+                        break;
+                    }
+                }
+                if (gap > j) {
+                    PyErr_SetString(PyExc_RuntimeError,
+                                    "failed to find the gap in the traceback");
+                    goto exit;
+                }
+                for (k = 0; k < gap; k++) steps[n++] = HORIZONTAL;
+                j -= gap;
+                break;
+        }
+    }
+    for (i = 0, j = n - 1; i < j; i++, j--) {
+        s = steps[i];
+        steps[i] = steps[j];
+        steps[j] = s;
+    }
+    paths = PathGenerator_create_single(nA, nB, WatermanSmithBeyer, steps, n);
+
+exit:
+    if (!paths && !PyErr_Occurred()) PyErr_SetNone(PyExc_MemoryError);
+    if (steps) PyMem_Free(steps);
+    if (M) {
+        if (Ix) {
+            if (Iy) {
+                for (i = 0; i <= nA; i++) {
+                    if (M[i]) PyMem_Free(M[i]);
+                    if (Ix[i]) PyMem_Free(Ix[i]);
+                    if (Iy[i]) PyMem_Free(Iy[i]);
+                }
+                PyMem_Free(Iy);
+            }
+            PyMem_Free(Ix);
+        }
+        PyMem_Free(M);
+    }
+    if (!paths) return NULL;
+    return Py_BuildValue("fN", score, paths);
+}
+
+/* ------------------ banded global alignment ------------------ */
+
+/* Global alignment restricted to the cells (i, j) with
+ * |j - i - band_offset| <= band_width, using the Gotoh algorithm with
+ * position-dependent gap scores (which also covers the Needleman-Wunsch
+ * algorithm).  Both the time and the memory needed for the traceback
+ * matrices are proportional to the number of cells in the band.  For each
+ * cell, we also keep track of whether the best path reaching it has
+ * touched the edge of the band (preferring paths that do not in case of
+ * ties); if the optimal alignment touched the edge, a wider band may give
+ * a better alignment.
+ */
+
+#define BAND_EDGE(i, j, lo, hi) \
+    ((j == lo && lo > 0) || (j == hi && hi < nB))
+
+#define SELECT_SCORE_BANDED(score1, edge1, score2, edge2, score3, edge3) \
+    score = score1; \
+    edge = edge1; \
+    if (score2 > score + epsilon) { \
+        score = score2; \
+        edge = edge2; \
+    } \
+    else if (score2 > score - epsilon) edge &= edge2; \
+    if (score3 > score + epsilon) { \
+        score = score3; \
+        edge = edge3; \
+    } \
+    else if (score3 > score - epsilon) edge &= edge3;
+
+#define SELECT_TRACE_BANDED(score1, edge1, score2, edge2, score3, edge3) \
+    trace = 0; \
+    score = -DBL_MAX; \
+    edge = 1; \
+    temp = score1; \
+    if (temp > -DBL_MAX) { \
+        score = temp; \
+        edge = edge1; \
+        trace = M_MATRIX; \
+    } \
+    temp = score2; \
+    if (temp > -DBL_MAX) { \
+        if (temp > score + epsilon) { \
+            score = temp; \
+            edge = edge2; \
+            trace = Ix_MATRIX; \
+        } \
+        else if (temp > score - epsilon) { \
+            edge &= edge2; \
+            trace |= Ix_MATRIX; \
+        } \
+    } \
+    temp = score3; \
+    if (temp > -DBL_MAX) { \
+        if (temp > score + epsilon) { \
+            score = temp; \
+            edge = edge3; \
+            trace = Iy_MATRIX; \
+        } \
+        else if (temp > score - epsilon) { \
+            edge &= edge3; \
+            trace |= Iy_MATRIX; \
+        } \
+    }
+
+/* Check if the band includes the start and end points of the alignment of
+ * sequences of length nA and nB; if not, set an exception and return 0. */
+static int
+_check_band(Aligner* self, Py_ssize_t nA, Py_ssize_t nB)
+{
+    const int width = self->band_width;
+    const int offset = self->band_offset;
+    if (self->mode != Global) {
+        PyErr_SetString(PyExc_ValueError,
+                        "banded alignments are available in global mode only");
+        return 0;
+    }
+    if (_get_algorithm(self) == WatermanSmithBeyer) {
+        PyErr_SetString(PyExc_ValueError,
+                        "banded alignments are not available for gap functions");
+        return 0;
+    }
+    if (offset < -width || offset > width
+     || nB - nA - offset < -width || nB - nA - offset > width) {
+        PyErr_Format(PyExc_ValueError,
+                     "band of width %d around diagonal %d does not include "
+                     "the start and end of an alignment of sequences of "
+                     "length %zd and %zd", width, offset, nA, nB);
+        return 0;
+    }
+    return 1;
+}
+
+typedef struct {
+    double M;
+    double Ix;
+    double Iy;
+    unsigned char M_edge;
+    unsigned char Ix_edge;
+    unsigned char Iy_edge;
+} BandCell;
+
+static const BandCell outside = {-DBL_MAX, -DBL_MAX, -DBL_MAX, 1, 1, 1};
+
+/* Calculate the score of the banded global alignment without using the
+ * Python C API.  The band is assumed to have been checked by _check_band.
+ * Returns 0 on success, or MEMORY_ERROR. */
+static int
+Aligner_banded_score(Aligner* self, const char* sA, Py_ssize_t nA,
+                                    const char* sB, Py_ssize_t nB,
+                                    double* result, int* touched)
+{
+    int i;
+    int j;
+    int kA;
+    int kB;
+    int lo;
+    int hi;
+    int edge;
+    int boundary;
+    const int offset = self->band_offset;
+    const int width = self->band_width;
+    const double epsilon = self->epsilon;
+    GapScores gaps;
+    BandCell* row;
+    BandCell* previous;
+    BandCell* current;
+    BandCell* cell;
+    double h_open;
+    double h_extend;
+    double v_open;
+    double v_extend;
+    double score;
+
+    _gap_scores_init(&gaps, self, nA, nB);
+    /* two rows, with an additional cell at each end */
+    row = PyMem_RawMalloc(2 * (nB + 3) * sizeof(BandCell));
+    if (!row) return MEMORY_ERROR;
+    previous = row + 1;
+    current = row + (nB + 3) + 1;
+    for (j = -1; j <= nB + 1; j++) {
+        previous[j] = outside;
+        current[j] = outside;
+    }
+
+    _band_limits(0, nB, offset, width, &lo, &hi);
+    h_open = _horizontal_gap_score(&gaps, 0, 0);
+    h_extend = _horizontal_gap_score(&gaps, 0, 1);
+    current[0].M = 0;
+    current[0].M_edge = 0;
+    current[0].Ix_edge = 1;
+    current[0].Iy_edge = 1;
+    for (j = 1; j <= hi; j++) {
+        cell = &current[j];
+        boundary = BAND_EDGE(0, j, lo, hi);
+        cell->M = -DBL_MAX;
+        cell->Ix = -DBL_MAX;
+        SELECT_SCORE_BANDED(cell[-1].M + h_open, cell[-1].M_edge,
+                            cell[-1].Ix + h_open, cell[-1].Ix_edge,
+                            cell[-1].Iy + h_extend, cell[-1].Iy_edge);
+        cell->Iy = score;
+        cell->M_edge = 1;
+        cell->Ix_edge = 1;
+        cell->Iy_edge = edge | boundary;
+    }
+    for (i = 1; i <= nA; i++) {
+        cell = previous;
+        previous = current;
+        current = cell;
+        kA = sA[i-1];
+        h_open = _horizontal_gap_score(&gaps, i, 0);
+        h_extend = _horizontal_gap_score(&gaps, i, 1);
+        _band_limits(i, nB, offset, width, &lo, &hi);
+        /* the cells just outside the band */
+        current[lo-1] = outside;
+        for (j = lo; j <= hi; j++) {
+            cell = &current[j];
+            boundary = BAND_EDGE(i, j, lo, hi);
+            if (j > 0) {
+                kB = sB[j-1];
+                SELECT_SCORE_BANDED(previous[j-1].M, previous[j-1].M_edge,
+                                    previous[j-1].Ix, previous[j-1].Ix_edge,
+                                    previous[j-1].Iy, previous[j-1].Iy_edge);
+                cell->M = score + self->substitution_matrix[kA][kB];
+                cell->M_edge = edge | boundary;
+            }
+            else {
+                cell->M = -DBL_MAX;
+                cell->M_edge = 1;
+            }
+            v_open = _vertical_gap_score(&gaps, j, 0);
+            v_extend = _vertical_gap_score(&gaps, j, 1);
+            SELECT_SCORE_BANDED(previous[j].M + v_open, previous[j].M_edge,
+                                previous[j].Ix + v_extend, previous[j].Ix_edge,
+                                previous[j].Iy + v_open, previous[j].Iy_edge);
+            cell->Ix = score;
+            cell->Ix_edge = edge | boundary;
+            SELECT_SCORE_BANDED(cell[-1].M + h_open, cell[-1].M_edge,
+                                cell[-1].Ix + h_open, cell[-1].Ix_edge,
+                                cell[-1].Iy + h_extend, cell[-1].Iy_edge);
+            cell->Iy = score;
+            cell->Iy_edge = edge | boundary;
+        }
+        current[hi+1] = outside;
+    }
+    cell = &current[nB];
+    SELECT_SCORE_BANDED(cell->M, cell->M_edge,
+                        cell->Ix, cell->Ix_edge,
+                        cell->Iy, cell->Iy_edge);
+    PyMem_RawFree(row);
+    *result = score;
+    *touched = edge;
+    return 0;
+}
+
+static PathGenerator*
+PathGenerator_create_banded(int nA, int nB, int offset, int width)
+{
+    int i;
+    int lo;
+    int hi;
+    Py_ssize_t size = 0;
+    Trace* row;
+    TraceGapsGotoh* gaps_row;
+    PathGenerator* paths;
+
+    paths = (PathGenerator*)PyType_GenericAlloc(&PathGenerator_Type, 0);
+    if (!paths) return NULL;
+
+    paths->iA = 0;
+    paths->iB = 0;
+    paths->nA = nA;
+    paths->nB = nB;
+    paths->M = NULL;
+    paths->gaps.gotoh = NULL;
+    paths->algorithm = Gotoh;
+    paths->mode = Global;
+    paths->length = 0;
+    paths->skip = 0;
+    paths->steps = NULL;
+    paths->nsteps = 0;
+    paths->band_offset = offset;
+    paths->band_width = width;
+
+    for (i = 0; i <= nA; i++) {
+        _band_limits(i, nB, offset, width, &lo, &hi);
+        size += hi - lo + 1;
+    }
+    paths->M = PyMem_Malloc((nA+1)*sizeof(Trace*));
+    if (!paths->M) goto exit;
+    paths->M[0] = NULL;
+    paths->gaps.gotoh = PyMem_Malloc((nA+1)*sizeof(TraceGapsGotoh*));
+    if (!paths->gaps.gotoh) goto exit;
+    paths->gaps.gotoh[0] = NULL;
+    row = PyMem_Malloc(size*sizeof(Trace));
+    if (!row) goto exit;
+    gaps_row = PyMem_Malloc(size*sizeof(TraceGapsGotoh));
+    if (!gaps_row) {
+        PyMem_Free(row);
+        goto exit;
+    }
+    for (i = 0; i <= nA; i++) {
+        _band_limits(i, nB, offset, width, &lo, &hi);
+        paths->M[i] = row - lo;
+        paths->gaps.gotoh[i] = gaps_row - lo;
+        row += hi - lo + 1;
+        gaps_row += hi - lo + 1;
+    }
+    return paths;
+exit:
+    Py_DECREF(paths);
+    PyErr_SetNone(PyExc_MemoryError);
+    return NULL;
+}
+
+static PyObject*
+Aligner_banded_align(Aligner* self, const char* sA, Py_ssize_t nA,
+                                    const char* sB, Py_ssize_t nB)
+{
+    int i;
+    int j;
+    int kA;
+    int kB;
+    int lo;
+    int hi;
+    int edge;
+    int boundary;
+    int trace;
+    const int offset = self->band_offset;
+    const int width = self->band_width;
+    const double epsilon = self->epsilon;
+    GapScores gaps;
+    Trace** M;
+    TraceGapsGotoh** gaps_trace;
+    BandCell* row;
+    BandCell* previous;
+    BandCell* current;
+    BandCell* cell;
+    double h_open;
+    double h_extend;
+    double v_open;
+    double v_extend;
+    double score;
+    double temp;
+    PathGenerator* paths;
+
+    _gap_scores_init(&gaps, self, nA, nB);
+    paths = PathGenerator_create_banded(nA, nB, offset, width);
+    if (!paths) return NULL;
+    M = paths->M;
+    gaps_trace = paths->gaps.gotoh;
+    row = PyMem_RawMalloc(2 * (nB + 3) * sizeof(BandCell));
+    if (!row) {
+        Py_DECREF(paths);
+        return PyErr_NoMemory();
+    }
+    previous = row + 1;
+    current = row + (nB + 3) + 1;
+    for (j = -1; j <= nB + 1; j++) {
+        previous[j] = outside;
+        current[j] = outside;
+    }
+
+    _band_limits(0, nB, offset, width, &lo, &hi);
+    h_open = _horizontal_gap_score(&gaps, 0, 0);
+    h_extend = _horizontal_gap_score(&gaps, 0, 1);
+    current[0].M = 0;
+    current[0].M_edge = 0;
+    current[0].Ix_edge = 1;
+    current[0].Iy_edge = 1;
+    M[0][0].trace = 0;
+    gaps_trace[0][0].Ix = 0;
+    gaps_trace[0][0].Iy = 0;
+    for (j = 1; j <= hi; j++) {
+        cell = &current[j];
+        boundary = BAND_EDGE(0, j, lo, hi);
+        cell->M = -DBL_MAX;
+        cell->Ix = -DBL_MAX;
+        SELECT_TRACE_BANDED(cell[-1].M + h_open, cell[-1].M_edge,
+                            cell[-1].Ix + h_open, cell[-1].Ix_edge,
+                            cell[-1].Iy + h_extend, cell[-1].Iy_edge);
+        cell->Iy = score;
+        cell->M_edge = 1;
+        cell->Ix_edge = 1;
+        cell->Iy_edge = edge | boundary;
+        M[0][j].trace = 0;
+        gaps_trace[0][j].Ix = 0;
+        gaps_trace[0][j].Iy = trace;
+    }
+    for (i = 1; i <= nA; i++) {
+        cell = previous;
+        previous = current;
+        current = cell;
+        kA = sA[i-1];
+        h_open = _horizontal_gap_score(&gaps, i, 0);
+        h_extend = _horizontal_gap_score(&gaps, i, 1);
+        _band_limits(i, nB, offset, width, &lo, &hi);
+        current[lo-1] = outside;
+        for (j = lo; j <= hi; j++) {
+            cell = &current[j];
+            boundary = BAND_EDGE(i, j, lo, hi);
+            if (j > 0) {
+                kB = sB[j-1];
+                SELECT_TRACE_BANDED(previous[j-1].M, previous[j-1].M_edge,
+                                    previous[j-1].Ix, previous[j-1].Ix_edge,
+                                    previous[j-1].Iy, previous[j-1].Iy_edge);
+                cell->M = score + self->substitution_matrix[kA][kB];
+                cell->M_edge = edge | boundary;
+                M[i][j].trace = trace;
+            }
+            else {
+                cell->M = -DBL_MAX;
+                cell->M_edge = 1;
+                M[i][j].trace = 0;
+            }
+            v_open = _vertical_gap_score(&gaps, j, 0);
+            v_extend = _vertical_gap_score(&gaps, j, 1);
+            SELECT_TRACE_BANDED(previous[j].M + v_open, previous[j].M_edge,
+                                previous[j].Ix + v_extend, previous[j].Ix_edge,
+                                previous[j].Iy + v_open, previous[j].Iy_edge);
+            cell->Ix = score;
+            cell->Ix_edge = edge | boundary;
+            gaps_trace[i][j].Ix = trace;
+            SELECT_TRACE_BANDED(cell[-1].M + h_open, cell[-1].M_edge,
+                                cell[-1].Ix + h_open, cell[-1].Ix_edge,
+                                cell[-1].Iy + h_extend, cell[-1].Iy_edge);
+            cell->Iy = score;
+            cell->Iy_edge = edge | boundary;
+            gaps_trace[i][j].Iy = trace;
+        }
+        current[hi+1] = outside;
+    }
+    M[0][0].path = 0;
+    M[nA][nB].path = 0;
+
+    /* traceback */
+    cell = &current[nB];
+    SELECT_SCORE_BANDED(cell->M, cell->M_edge,
+                        cell->Ix, cell->Ix_edge,
+                        cell->Iy, cell->Iy_edge);
+    if (cell->M < score - epsilon) M[nA][nB].trace = 0;
+    if (cell->Ix < score - epsilon) gaps_trace[nA][nB].Ix = 0;
+    if (cell->Iy < score - epsilon) gaps_trace[nA][nB].Iy = 0;
+    PyMem_RawFree(row);
+    self->band_edge_touched = edge;
+    return Py_BuildValue("fN", score, paths);
+}
+
+/* ------------------ extension alignment with X-drop ------------------ */
+
+/* In extension mode, the alignment is anchored at the start of both
+ * sequences, and may end anywhere: the score is the highest score of an
+ * alignment of a prefix of the target to a prefix of the query.  The
+ * dynamic programming matrices are calculated row by row, using the Gotoh
+ * algorithm with position-dependent gap scores (which also covers the
+ * Needleman-Wunsch algorithm).  If xdrop is set, cells scoring more than
+ * xdrop below the best score found so far are pruned, and the calculation
+ * stops as soon as a row has no cells left (Zhang et al., 2000).  Each row
+ * is calculated starting from the first cell that survived in the previous
+ * row, and is extended to the right only while a gap in the target can
+ * still reach a surviving cell, so that only the cells visited are stored
+ * for the traceback.
+ */
+
+#define EXTENSION_M 0
+#define EXTENSION_Ix 1
+#define EXTENSION_Iy 2
+
+typedef struct {
+    double M;
+    double Ix;
+    double Iy;
+} ExtensionCell;
+
+static const ExtensionCell pruned = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+
+/* Traceback of the cells visited during an extension alignment; for each
+ * cell, one byte stores the previous state (EXTENSION_M, EXTENSION_Ix, or
+ * EXTENSION_Iy) of the M, Ix, and Iy states in bits 0-1, 2-3, and 4-5,
+ * respectively.  Cell (i, j) is stored at cells[rows[i] + j]. */
+typedef struct {
+    unsigned char* cells;
+    Py_ssize_t* rows;
+    Py_ssize_t size;
+    Py_ssize_t allocated;
+} ExtensionTrace;
+
+#define SELECT_STATE_EXTENSION(score1, score2, score3) \
+    score = score1; \
+    state = EXTENSION_M; \
+    temp = score2; \
+    if (temp > score) { \
+        score = temp; \
+        state = EXTENSION_Ix; \
+    } \
+    temp = score3; \
+    if (temp > score) { \
+        score = temp; \
+        state = EXTENSION_Iy; \
+    }
+
+/* Calculate the extension alignment without using the Python C API.  The
+ * best score, and the cell (iEnd, jEnd) and state sEnd where it is found,
+ * are stored in result, iEnd, jEnd, and sEnd; the traceback is stored in
+ * trace, if not NULL.
+ * Returns 0 on success, or MEMORY_ERROR. */
+static int
+_extension_align(const Aligner* self, const char* sA, Py_ssize_t nA,
+                                      const char* sB, Py_ssize_t nB,
+                                      double* result, int* iEnd, int* jEnd,
+                                      int* sEnd, ExtensionTrace* trace)
+{
+    int i;
+    int j;
+    int kA = 0;
+    int kB;
+    int lo = 0;
+    int hi = 0;
+    int first;
+    int last;
+    int state;
+    unsigned char byte;
+    unsigned char* cells = NULL;
+    const double xdrop = self->xdrop;
+    GapScores gaps;
+    ExtensionCell* row;
+    ExtensionCell* previous;
+    ExtensionCell* current;
+    ExtensionCell* cell;
+    double h_open;
+    double h_extend;
+    double v_open;
+    double v_extend;
+    double score;
+    double temp;
+    double best = 0;
+    double threshold = (xdrop < 0) ? -DBL_MAX : -xdrop;
+    int iBest = 0;
+    int jBest = 0;
+    int sBest = EXTENSION_M;
+
+    _gap_scores_init(&gaps, self, nA, nB);
+    /* two rows, with an additional cell at each end */
+    row = PyMem_RawMalloc(2 * (nB + 3) * sizeof(ExtensionCell));
+    if (!row) return MEMORY_ERROR;
+    previous = row + 1;
+    current = row + (nB + 3) + 1;
+
+    for (i = 0; i <= nA; i++) {
+        if (trace) {
+            if (trace->allocated - trace->size < nB + 1) {
+                Py_ssize_t allocated = 2 * trace->allocated + nB + 1;
+                cells = PyMem_RawRealloc(trace->cells, allocated);
+                if (!cells) {
+                    PyMem_RawFree(row);
+                    return MEMORY_ERROR;
+                }
+                trace->cells = cells;
+                trace->allocated = allocated;
+            }
+            trace->rows[i] = trace->size - lo;
+            cells = trace->cells + trace->rows[i];
+        }
+        h_open = _horizontal_gap_score(&gaps, i, 0);
+        h_extend = _horizontal_gap_score(&gaps, i, 1);
+        first = -1;
+        last = -1;
+        if (i == 0) {
+            current[-1] = pruned;
+            current[0].M = 0;
+            current[0].Ix = -DBL_MAX;
+            current[0].Iy = -DBL_MAX;
+            if (cells) cells[0] = 0;
+            first = 0;
+            last = 0;
+            j = 1;
+        }
+        else {
+            cell = previous;
+            previous = current;
+            current = cell;
+            kA = sA[i-1];
+            current[lo-1] = pruned;
+            j = lo;
+        }
+        for ( ; j <= nB; j++) {
+            cell = &current[j];
+            byte = 0;
+            if (i > 0 && j > 0 && j <= hi + 1) {
+                kB = sB[j-1];
+                SELECT_STATE_EXTENSION(previous[j-1].M,
+                                       previous[j-1].Ix,
+                                       previous[j-1].Iy);
+                cell->M = (score > -DBL_MAX)
+                        ? score + self->substitution_matrix[kA][kB]
+                        : -DBL_MAX;
+                byte |= state;
+            }
+            else cell->M = -DBL_MAX;
+            if (i > 0 && j <= hi) {
+                v_open = _vertical_gap_score(&gaps, j, 0);
+                v_extend = _vertical_gap_score(&gaps, j, 1);
+                SELECT_STATE_EXTENSION(previous[j].M + v_open,
+                                       previous[j].Ix + v_extend,
+                                       previous[j].Iy + v_open);
+                cell->Ix = score;
+                byte |= state << 2;
+            }
+            else cell->Ix = -DBL_MAX;
+            if (j > 0) {
+                SELECT_STATE_EXTENSION(cell[-1].M + h_open,
+                                       cell[-1].Ix + h_open,
+                                       cell[-1].Iy + h_extend);
+                cell->Iy = score;
+                byte |= state << 4;
+            }
+            else cell->Iy = -DBL_MAX;
+            SELECT_STATE_EXTENSION(cell->M, cell->Ix, cell->Iy);
+            if (score > -DBL_MAX && score >= threshold) {
+                if (first < 0) first = j;
+                last = j;
+                if (score > best) {
+                    best = score;
+                    iBest = i;
+                    jBest = j;
+                    sBest = state;
+                    if (xdrop >= 0) threshold = best - xdrop;
+                }
+            }
+            else {
+                *cell = pruned;
+                /* beyond the previous row, only a gap in the target can
+                 * reach the remaining cells of this row */
+                if (j > hi) {
+                    j++;
+                    break;
+                }
+            }
+            if (cells) cells[j] = byte;
+        }
+        if (first < 0) break;
+        if (trace) trace->size = trace->rows[i] + j;
+        current[last+1] = pruned;
+        lo = first;
+        hi = last;
+    }
+    PyMem_RawFree(row);
+    *result = best;
+    *iEnd = iBest;
+    *jEnd = jBest;
+    *sEnd = sBest;
+    return 0;
+}
+
+static int
+Aligner_extension_score(Aligner* self, const char* sA, Py_ssize_t nA,
+                                       const char* sB, Py_ssize_t nB,
+                                       double* score)
+{
+    int i;
+    int j;
+    int state;
+    return _extension_align(self, sA, nA, sB, nB, score, &i, &j, &state, NULL);
+}
+
+static PyObject*
+Aligner_extension_align(Aligner* self, const char* sA, Py_ssize_t nA,
+                                       const char* sB, Py_ssize_t nB)
+{
+    int i;
+    int j;
+    int k;
+    int n;
+    int state;
+    unsigned char byte;
+    unsigned char* steps;
+    double score;
+    ExtensionTrace trace;
+    PathGenerator* paths;
+
+    trace.cells = NULL;
+    trace.size = 0;
+    trace.allocated = 0;
+    trace.rows = PyMem_RawMalloc((nA + 1) * sizeof(Py_ssize_t));
+    if (!trace.rows) return PyErr_NoMemory();
+    if (_extension_align(self, sA, nA, sB, nB,
+                         &score, &i, &j, &state, &trace) < 0) {
+        PyMem_RawFree(trace.rows);
+        PyMem_RawFree(trace.cells);
+        return PyErr_NoMemory();
+    }
+    n = i + j;
+    steps = PyMem_RawMalloc((n + 1) * sizeof(unsigned char));
+    if (!steps) {
+        PyMem_RawFree(trace.rows);
+        PyMem_RawFree(trace.cells);
+        return PyErr_NoMemory();
+    }
+    k = n;
+    while (i > 0 || j > 0) {
+        byte = trace.cells[trace.rows[i] + j];
+        switch (state) {
+            case EXTENSION_M:
+                steps[--k] = DIAGONAL;
+                state = byte & 3;
+                i--;
+                j--;
+                break;
+            case EXTENSION_Ix:
+                steps[--k] = VERTICAL;
+                state = (byte >> 2) & 3;
+                i--;
+                break;
+            case EXTENSION_Iy:
+                steps[--k] = HORIZONTAL;
+                state = (byte >> 4) & 3;
+                j--;
+                break;
+        }
+    }
+    PyMem_RawFree(trace.rows);
+    PyMem_RawFree(trace.cells);
+    paths = PathGenerator_create_single(nA, nB, _get_algorithm(self),
+                                        steps + k, n - k);
+    PyMem_RawFree(steps);
+    if (!paths) return NULL;
+    paths->mode = Extension;
+    return Py_BuildValue("fN", score, paths);
+}
+
+/* ------------- wavefront scores of long global alignments ------------- */
+
+/* The score of a single long global alignment with the Needleman-Wunsch or
+ * Gotoh algorithm can be calculated by several threads by dividing the
+ * dynamic programming matrix into square tiles.  A tile can be calculated as
+ * soon as the tiles above it and to its left are done, so the tiles on each
+ * anti-diagonal are calculated in parallel, one anti-diagonal after another.
+ * Each tile updates in place the scores in the row below the tiles above it
+ * and in the column to the right of the tiles to its left.  The score in the
+ * cell diagonally above-left of a tile is stored for each diagonal of tiles,
+ * as the tiles on the previous anti-diagonal overwrite it in the row and
+ * column.  The scores are calculated in the same order and with the same
+ * operations as by the serial kernels, and are therefore identical.
+ */
+
+#define WAVEFRONT_TILE 512  /* number of rows and columns of a tile */
+
+typedef struct {
+    double** matrix;
+    const char* sA;
+    const char* sB;
+    int nA;
+    int nB;
+    Algorithm algorithm;
+    double gap_open_A;
+    double gap_open_B;
+    double gap_extend_A;
+    double gap_extend_B;
+    double right_gap_open_A;
+    double right_gap_open_B;
+    double right_gap_extend_A;
+    double right_gap_extend_B;
+    int ntiles; /* number of tiles in a row of tiles */
+    int first;  /* first row of tiles on the current anti-diagonal */
+    int diagonal;
+    double* row[3];     /* M, Ix, and Iy scores in the row below the tiles */
+    double* column[3];  /* and in the column to the right of the tiles */
+    double* corner[3];  /* and above-left of the tiles, for each diagonal */
+} Wavefront;
+
+static void
+_wavefront_needlemanwunsch(Wavefront* w, int k, int i0, int i1, int j0, int j1)
+{
+    int i;
+    int j;
+    int kA;
+    double score;
+    double temp;
+    double left;
+    double gap_A;
+    double** matrix = w->matrix;
+    const char* sB = w->sB;
+    const int jEnd = (j1 == w->nB) ? j1 - 1 : j1;
+    double* scores = w->row[0];
+    double* column = w->column[0];
+    double diagonal = w->corner[0][k];
+
+    for (i = i0; i <= i1; i++) {
+        kA = w->sA[i-1];
+        gap_A = (i == w->nA) ? w->right_gap_extend_A : w->gap_extend_A;
+        temp = diagonal;
+        diagonal = column[i];
+        left = diagonal;
+        for (j = j0; j <= jEnd; j++) {
+            SELECT_SCORE_GLOBAL(temp + matrix[kA][(int)sB[j-1]],
+                                scores[j] + w->gap_extend_B,
+                                left + gap_A);
+            temp = scores[j];
+            scores[j] = score;
+            left = score;
+        }
+        if (jEnd < j1) {
+            SELECT_SCORE_GLOBAL(temp + matrix[kA][(int)sB[j1-1]],
+                                scores[j1] + w->right_gap_extend_B,
+                                left + gap_A);
+            scores[j1] = score;
+            left = score;
+        }
+        column[i] = left;
+    }
+    w->corner[0][k] = scores[j1];
+}
+
+static void
+_wavefront_gotoh(Wavefront* w, int k, int i0, int i1, int j0, int j1)
+{
+    int i;
+    int j;
+    int kA;
+    double score;
+    double temp;
+    double gap_open_A;
+    double gap_extend_A;
+    double gap_open_B = w->gap_open_B;
+    double gap_extend_B = w->gap_extend_B;
+    double M_temp, Ix_temp, Iy_temp;
+    double M_left, Ix_left, Iy_left;
+    double M_diagonal = w->corner[0][k];
+    double Ix_diagonal = w->corner[1][k];
+    double Iy_diagonal = w->corner[2][k];
+    double* M_scores = w->row[0];
+    double* Ix_scores = w->row[1];
+    double* Iy_scores = w->row[2];
+    double* M_column = w->column[0];
+    double* Ix_column = w->column[1];
+    double* Iy_column = w->column[2];
+    double** matrix = w->matrix;
+    const char* sB = w->sB;
+
+    for (i = i0; i <= i1; i++) {
+        kA = w->sA[i-1];
+        if (i == w->nA) {
+            gap_open_A = w->right_gap_open_A;
+            gap_extend_A = w->right_gap_extend_A;
+        }
+        else {
+            gap_open_A = w->gap_open_A;
+            gap_extend_A = w->gap_extend_A;
+        }
+        M_temp = M_diagonal;
+        Ix_temp = Ix_diagonal;
+        Iy_temp = Iy_diagonal;
+        M_left = M_diagonal = M_column[i];
+        Ix_left = Ix_diagonal = Ix_column[i];
+        Iy_left = Iy_diagonal = Iy_column[i];
+        for (j = j0; j <= j1; j++) {
+            if (j == w->nB) {
+                gap_open_B = w->right_gap_open_B;
+                gap_extend_B = w->right_gap_extend_B;
+            }
+            SELECT_SCORE_GLOBAL(M_temp, Ix_temp, Iy_temp);
+            M_temp = M_scores[j];
+            M_scores[j] = score + matrix[kA][(int)sB[j-1]];
+            SELECT_SCORE_GLOBAL(M_temp + gap_open_B,
+                                Ix_scores[j] + gap_extend_B,
+                                Iy_scores[j] + gap_open_B);
+            Ix_temp = Ix_scores[j];
+            Ix_scores[j] = score;
+            SELECT_SCORE_GLOBAL(M_left + gap_open_A,
+                                Ix_left + gap_open_A,
+                                Iy_left + gap_extend_A);
+            Iy_temp = Iy_scores[j];
+            Iy_scores[j] = score;
+            M_left = M_scores[j];
+            Ix_left = Ix_scores[j];
+            Iy_left = Iy_scores[j];
+        }
+        gap_open_B = w->gap_open_B;
+        gap_extend_B = w->gap_extend_B;
+        M_column[i] = M_left;
+        Ix_column[i] = Ix_left;
+        Iy_column[i] = Iy_left;
+    }
+    w->corner[0][k] = M_scores[j1];
+    w->corner[1][k] = Ix_scores[j1];
+    w->corner[2][k] = Iy_scores[j1];
+}
+
+static void
+_wavefront_tile(void* data, Py_ssize_t index)
+{
+    Wavefront* w = data;
+    const int bi = w->first + (int)index;
+    const int bj = w->diagonal - bi;
+    const int k = bi - bj + w->ntiles - 1;
+    const int i0 = bi * WAVEFRONT_TILE + 1;
+    const int j0 = bj * WAVEFRONT_TILE + 1;
+    int i1 = i0 + WAVEFRONT_TILE - 1;
+    int j1 = j0 + WAVEFRONT_TILE - 1;
+    if (i1 > w->nA) i1 = w->nA;
+    if (j1 > w->nB) j1 = w->nB;
+    if (w->algorithm == Gotoh) _wavefront_gotoh(w, k, i0, i1, j0, j1);
+    else _wavefront_needlemanwunsch(w, k, i0, i1, j0, j1);
+}
+
+/* Calculate the score of a global alignment with the Needleman-Wunsch or
+ * Gotoh algorithm using n_threads threads, with the GIL released.  Must be
+ * called with the GIL held; returns 0, or -1 with an exception set. */
+static int
+_wavefront_score(Aligner* self, const char* sA, Py_ssize_t nA,
+                                const char* sB, Py_ssize_t nB,
+                                int n_threads, double* result)
+{
+    int i;
+    int j;
+    int k;
+    int s;
+    int first;
+    int last;
+    double score;
+    double temp;
+    double* buffer;
+    Wavefront w;
+    const double MINIMUM = -DBL_MAX;
+    const int size = self->alphabet_size;
+    const int nbi = (int)((nA + WAVEFRONT_TILE - 1) / WAVEFRONT_TILE);
+    const int nbj = (int)((nB + WAVEFRONT_TILE - 1) / WAVEFRONT_TILE);
+    const int ndiagonals = nbi + nbj - 1;
+    const int nstates = (_get_algorithm(self) == Gotoh) ? 3 : 1;
+
+    buffer = PyMem_Malloc(nstates * (nA + nB + 2 + ndiagonals) * sizeof(double));
+    if (!buffer) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    /* Work on a copy of the substitution matrix, as the aligner may be
+     * modified by other Python threads while the GIL is released. */
+    w.matrix = _create_substitution_matrix(size);
+    if (!w.matrix) {
+        PyMem_Free(buffer);
+        return -1;
+    }
+    memcpy(w.matrix[0], self->substitution_matrix[0],
+           size*size*sizeof(double));
+    w.sA = sA;
+    w.sB = sB;
+    w.nA = (int)nA;
+    w.nB = (int)nB;
+    w.algorithm = _get_algorithm(self);
+    w.gap_open_A = self->target_open_gap_score;
+    w.gap_open_B = self->query_open_gap_score;
+    w.gap_extend_A = self->target_extend_gap_score;
+    w.gap_extend_B = self->query_extend_gap_score;
+    w.right_gap_open_A = self->target_right_open_gap_score;
+    w.right_gap_open_B = self->query_right_open_gap_score;
+    w.right_gap_extend_A = self->target_right_extend_gap_score;
+    w.right_gap_extend_B = self->query_right_extend_gap_score;
+    w.ntiles = nbj;
+    for (s = 0; s < nstates; s++) {
+        w.row[s] = buffer + s * (nA + nB + 2 + ndiagonals);
+        w.column[s] = w.row[s] + nB + 1;
+        w.corner[s] = w.column[s] + nA + 1;
+    }
+
+    /* The top row and the left column of the score matrix, as in the serial
+     * kernels. */
+    if (nstates == 1) {
+        w.row[0][0] = 0.0;
+        for (j = 1; j <= nB; j++)
+            w.row[0][j] = j * self->target_left_extend_gap_score;
+        w.column[0][0] = 0.0;
+        for (i = 1; i < nA; i++)
+            w.column[0][i] = i * self->query_left_extend_gap_score;
+        w.column[0][nA] = nA * self->query_right_extend_gap_score;
+    }
+    else {
+        w.row[0][0] = 0;
+        w.row[1][0] = MINIMUM;
+        w.row[2][0] = MINIMUM;
+        for (j = 1; j <= nB; j++) {
+            w.row[0][j] = MINIMUM;
+            w.row[1][j] = MINIMUM;
+            w.row[2][j] = self->target_left_open_gap_score
+                        + self->target_left_extend_gap_score * (j-1);
+        }
+        w.column[0][0] = 0;
+        w.column[1][0] = MINIMUM;
+        w.column[2][0] = MINIMUM;
+        for (i = 1; i <= nA; i++) {
+            w.column[0][i] = MINIMUM;
+            w.column[1][i] = self->query_left_open_gap_score
+                           + self->query_left_extend_gap_score * (i-1);
+            w.column[2][i] = MINIMUM;
+        }
+    }
+    /* The first tile on diagonal k of the tiles is in the top row of tiles
+     * for k < nbj, and in the left column of tiles otherwise. */
+    for (s = 0; s < nstates; s++) {
+        for (k = 0; k < ndiagonals; k++) {
+            if (k < nbj) w.corner[s][k] = w.row[s][(nbj-1-k) * WAVEFRONT_TILE];
+            else w.corner[s][k] = w.column[s][(k-nbj+1) * WAVEFRONT_TILE];
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    for (w.diagonal = 0; w.diagonal < ndiagonals; w.diagonal++) {
+        first = w.diagonal - nbj + 1;
+        if (first < 0) first = 0;
+        last = (w.diagonal < nbi) ? w.diagonal : nbi - 1;
+        w.first = first;
+        _parallel_for(last - first + 1, n_threads, _wavefront_tile, &w);
+    }
+    Py_END_ALLOW_THREADS
+
+    if (nstates == 1) score = w.row[0][nB];
+    else {
+        SELECT_SCORE_GLOBAL(w.row[0][nB], w.row[1][nB], w.row[2][nB]);
+    }
+    *result = score;
+    PyMem_Free(w.matrix);
+    PyMem_Free(buffer);
+    return 0;
+}
+
+typedef int (*ScoreKernel)(Aligner*, const char*, Py_ssize_t,
+                                     const char*, Py_ssize_t, double*);
+typedef int (*IntegerScoreKernel)(Aligner*, int**, const char*, Py_ssize_t,
+                                                   const char*, Py_ssize_t,
+                                                   double*);
+
+/* Calculate the score using the integer kernel if possible, and the double
+ * kernel otherwise. */
+static int
+_kernel_score(Aligner* self, ScoreKernel kernel, IntegerScoreKernel kernel_int,
+              const char* sA, Py_ssize_t nA, const char* sB, Py_ssize_t nB,
+              double* score)
+{
+    int status;
+    int** matrix = _integer_scores(self, nA, nB);
+    if (!matrix)
+        return kernel(self, sA, nA, sB, nB, score);
+    status = kernel_int(self, matrix, sA, nA, sB, nB, score);
+    PyMem_RawFree(matrix);
+    return status;
+}
+
+/* Calculate the score of aligning a sequence against an empty sequence.  In
+ * global mode, this is the score of a gap covering the whole sequence, which
+ * is scored as a left end gap (as in the top row and left column of the
+ * dynamic programming matrices); in local mode, the score is zero.  Returns
+ * 0 on success, or PYTHON_ERROR if a user-defined gap function failed. */
+static int
+_calculate_empty_score(Aligner* self, Py_ssize_t nA, Py_ssize_t nB,
+                       double* score)
+{
+    if (self->mode != Global || (nA == 0 && nB == 0)) *score = 0.0;
+    else if (_get_algorithm(self) == WatermanSmithBeyer) {
+        if (nA == 0) {
+            if (!_call_target_gap_function(self, 0, nB, score))
+                return PYTHON_ERROR;
+        }
+        else {
+            if (!_call_query_gap_function(self, 0, nA, score))
+                return PYTHON_ERROR;
+        }
+    }
+    else if (nA == 0)
+        *score = self->target_left_open_gap_score
+               + (nB - 1) * self->target_left_extend_gap_score;
+    else
+        *score = self->query_left_open_gap_score
+               + (nA - 1) * self->query_left_extend_gap_score;
+    return 0;
+}
+
+/* Calculate the alignment score without using the Python C API, except for
+ * the Waterman-Smith-Beyer algorithm with a user-defined gap function.
+ * Returns 0 on success, or MEMORY_ERROR or PYTHON_ERROR on failure; in the
+ * latter case, a Python exception has been set.  If touched is not NULL, it
+ * is set to 1 if the optimal path of a banded alignment touched the edge of
+ * the band, and to 0 otherwise. */
+static int
+_calculate_score(Aligner* self, const char* sA, Py_ssize_t nA,
+                                const char* sB, Py_ssize_t nB, double* score,
+                                int* touched)
+{
+    const Mode mode = self->mode;
+    int edge = 0;
+    int status;
+    if (touched) *touched = 0;
+    /* extension alignments of an empty sequence are handled by the kernel */
+    if ((nA == 0 || nB == 0) && mode != Extension)
+        return _calculate_empty_score(self, nA, nB, score);
+    if (self->band_width >= 0) {
+        status = Aligner_banded_score(self, sA, nA, sB, nB, score, &edge);
+        if (touched) *touched = edge;
+        return status;
+    }
+#ifdef HAVE_SSE2
+    if (mode == Local && self->algorithm != WatermanSmithBeyer) {
+        /* equivalent to the linear gap recursion of Smith-Waterman if the
+         * open and extend gap scores are equal */
+        switch (_striped_local_score(self, sA, nA, sB, nB,
+                                     self->target_open_gap_score,
+                                     self->target_extend_gap_score,
+                                     self->query_open_gap_score,
+                                     self->query_extend_gap_score, score)) {
+            case 1: return 0;
+            case -1: return MEMORY_ERROR;
+            default: break;
+        }
+    }
+#endif
+    switch (self->algorithm) {
+        case NeedlemanWunschSmithWaterman:
+            switch (mode) {
+                case Global:
+                    switch (_bit_vector_score(self, sA, nA, sB, nB, score)) {
+                        case 1: return 0;
+                        case -1: return MEMORY_ERROR;
+                        default: break;
+                    }
+                    return Aligner_needlemanwunsch_score(self, sA, nA, sB, nB,
+                                                         score);
+                case Local:
+                    return _kernel_score(self, Aligner_smithwaterman_score,
+                                               Aligner_smithwaterman_score_int,
+                                         sA, nA, sB, nB, score);
+                case Extension:
+                    return Aligner_extension_score(self, sA, nA, sB, nB, score);
+            }
+        case Gotoh:
+            switch (mode) {
+                case Global:
+                    return Aligner_gotoh_global_score(self, sA, nA, sB, nB,
+                                                      score);
+                case Local:
+                    return _kernel_score(self, Aligner_gotoh_local_score,
+                                               Aligner_gotoh_local_score_int,
+                                         sA, nA, sB, nB, score);
+                case Extension:
+                    return Aligner_extension_score(self, sA, nA, sB, nB, score);
+            }
+        case WatermanSmithBeyer:
+            switch (mode) {
+                case Global:
+                    status = Aligner_waterman_smith_beyer_global_score(self, sA, nA, sB, nB, score);
+                    _free_gap_tables(self);
+                    return status;
+                case Local:
+                    status = Aligner_waterman_smith_beyer_local_score(self, sA, nA, sB, nB, score);
+                    _free_gap_tables(self);
+                    return status;
+                case Extension:
+                    /* the GIL is held when using gap functions */
+                    PyErr_SetString(PyExc_ValueError,
+                        "extension alignments are not available for gap functions");
+                    return PYTHON_ERROR;
+            }
+        case Unknown:
+        default:
+            return MEMORY_ERROR;
+    }
+}
+
+/* A sequence passed to score or align.  The characters are converted once
+ * to their indices in the alphabet of the aligner, which is the form in
+ * which all algorithms above expect their sequences.  A buffer of signed
+ * bytes already stores these indices; it is then used as is, and view holds
+ * the buffer until the sequence is released. */
+typedef struct {
+    char* indices;
+    Py_ssize_t length;
+    Py_buffer view;
+} Sequence;
+
+static void
+_release_sequence(Sequence* sequence)
+{
+    if (sequence->view.obj) PyBuffer_Release(&sequence->view);
+    else PyMem_Free(sequence->indices);
+    sequence->indices = NULL;
+}
+
+/* Convert the characters or indices in view to indices; returns 0 and sets
+ * an exception if the buffer has an unsupported format or an invalid item.
+ * Unsigned single-byte buffers store characters; signed single-byte buffers
+ * and integer buffers store indices into the alphabet. */
+static int
+_map_buffer(const Aligner* self, Py_buffer* view, char* indices,
+            Py_ssize_t offset, Py_ssize_t n)
+{
+    Py_ssize_t i;
+    unsigned long letter;
+    int index;
+    const char* buffer = view->buf;
+    const signed char* mapping = self->mapping;
+    const unsigned long size = self->alphabet_size;
+    char datatype = 'B';
+
+    if (view->format) {
+        datatype = view->format[0];
+        switch (datatype) {
+            case '@':
+            case '=': datatype = view->format[1]; break;
+            default: break;
+        }
+    }
+    if (view->itemsize != 1) {
+        switch (datatype) {
+            case 'h': case 'H': case 'i': case 'I': case 'l': case 'L':
+            case 'q': case 'Q': case 'n': case 'N': break;
+            default: datatype = '\0'; break;
+        }
+    }
+    else if (datatype != 'B' && datatype != 'b' && datatype != 'c')
+        datatype = '\0';
+    if (datatype == '\0') {
+        PyErr_Format(PyExc_ValueError,
+                     "sequence has incorrect data format '%s' (expected "
+                     "single-byte characters or integers)",
+                     view->format ? view->format : "B");
+        return 0;
+    }
+    buffer += offset * view->itemsize;
+    for (i = 0; i < n; i++) {
+        switch (datatype) {
+            case 'b': letter = (unsigned char)((const signed char*)buffer)[i]; break;
+            case 'h': letter = ((const short*)buffer)[i]; break;
+            case 'H': letter = ((const unsigned short*)buffer)[i]; break;
+            case 'i': letter = ((const int*)buffer)[i]; break;
+            case 'I': letter = ((const unsigned int*)buffer)[i]; break;
+            case 'l': letter = ((const long*)buffer)[i]; break;
+            case 'L': letter = ((const unsigned long*)buffer)[i]; break;
+            case 'q': letter = (unsigned long)((const long long*)buffer)[i]; break;
+            case 'Q': letter = (unsigned long)((const unsigned long long*)buffer)[i]; break;
+            case 'n': letter = ((const Py_ssize_t*)buffer)[i]; break;
+            case 'N': letter = ((const size_t*)buffer)[i]; break;
+            default: letter = ((const unsigned char*)buffer)[i]; break;
+        }
+        switch (datatype) {
+            case 'B':
+            case 'c': index = (letter < 128) ? mapping[letter] : -1; break;
+            default: index = (letter < size) ? (int)letter : -1; break;
+        }
+        if (index < 0) {
+            PyErr_Format(PyExc_ValueError,
+                         "sequence contains an invalid letter at position %zd",
+                         offset + i);
+            return 0;
+        }
+        indices[i] = index;
+    }
+    return 1;
+}
+
+/* Convert a string or a buffer to a sequence of indices, to be released
+ * with _release_sequence; returns 0 and sets an exception on failure. */
+static int
+_map_sequence(const Aligner* self, PyObject* object, Sequence* sequence)
+{
+    const int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT;
+    Py_ssize_t n;
+    char* indices;
+    const char* format;
+    Py_buffer view;
+#if PY_MAJOR_VERSION >= 3
+    if (PyUnicode_Check(object)) {
+        Py_ssize_t i;
+        Py_UCS4 letter;
+        int index;
+        int kind;
+        void* data;
+        if (PyUnicode_READY(object) == -1) return 0;
+        n = PyUnicode_GET_LENGTH(object);
+        kind = PyUnicode_KIND(object);
+        data = PyUnicode_DATA(object);
+        indices = PyMem_Malloc(n + 1);
+        if (!indices) {
+            PyErr_NoMemory();
+            return 0;
+        }
+        for (i = 0; i < n; i++) {
+            letter = PyUnicode_READ(kind, data, i);
+            index = (letter < 128) ? self->mapping[letter] : -1;
+            if (index < 0) {
+                PyErr_Format(PyExc_ValueError,
+                             "sequence contains an invalid letter at position %zd",
+                             i);
+                PyMem_Free(indices);
+                return 0;
+            }
+            indices[i] = index;
+        }
+        sequence->indices = indices;
+        sequence->length = n;
+        return 1;
+    }
+#else
+    if (PyUnicode_Check(object)) {
+        int ok;
+        object = PyUnicode_AsASCIIString(object);
+        if (!object) return 0;
+        ok = _map_sequence(self, object, sequence);
+        Py_DECREF(object);
+        return ok;
+    }
+#endif
+    if (PyObject_GetBuffer(object, &view, flags) == -1) {
+        PyErr_SetString(PyExc_TypeError,
+                        "expected a string or a bytes-like object");
+        return 0;
+    }
+    if (view.ndim != 1) {
+        PyErr_Format(PyExc_ValueError,
+                     "sequence has incorrect rank (%d expected 1)", view.ndim);
+        PyBuffer_Release(&view);
+        return 0;
+    }
+    n = view.shape[0];
+    format = view.format;
+    if (format && (format[0] == '@' || format[0] == '=')) format++;
+    if (view.itemsize == 1 && format && strcmp(format, "b") == 0) {
+        const signed char* buffer = view.buf;
+        Py_ssize_t i;
+        for (i = 0; i < n; i++) {
+            if (buffer[i] < 0 || buffer[i] >= self->alphabet_size) {
+                PyErr_Format(PyExc_ValueError,
+                             "sequence contains an invalid letter at position %zd",
+                             i);
+                PyBuffer_Release(&view);
+                return 0;
+            }
+        }
+        sequence->indices = view.buf;
+        sequence->length = n;
+        sequence->view = view;
+        return 1;
+    }
+    indices = PyMem_Malloc(n + 1);
+    if (!indices) {
+        PyBuffer_Release(&view);
+        PyErr_NoMemory();
+        return 0;
+    }
+    if (!_map_buffer(self, &view, indices, 0, n)) {
+        PyBuffer_Release(&view);
+        PyMem_Free(indices);
+        return 0;
+    }
+    PyBuffer_Release(&view);
+    sequence->indices = indices;
+    sequence->length = n;
+    return 1;
+}
+
+static PyObject*
+Aligner_score_indices(Aligner* self, const char* sA, Py_ssize_t nA,
+                                     const char* sB, Py_ssize_t nB)
+{
+    double score;
+    const Algorithm algorithm = _get_algorithm(self);
+
+    if (algorithm == Unknown) {
+        PyErr_SetString(PyExc_RuntimeError, "unknown algorithm");
+        return NULL;
+    }
+    if (self->band_width >= 0) {
+        int touched = 0;
+        if (!_check_band(self, nA, nB)) return NULL;
+        if (nA == 0 || nB == 0)
+            _calculate_empty_score(self, nA, nB, &score);
+        else if (Aligner_banded_score(self, sA, nA, sB, nB,
+                                      &score, &touched) < 0)
+            return PyErr_NoMemory();
+        self->band_edge_touched = touched;
+        return PyFloat_FromDouble(score);
+    }
+    if (self->n_threads != 1 && self->mode == Global
+     && nA >= 2 * WAVEFRONT_TILE && nB >= 2 * WAVEFRONT_TILE
+     && nA < INT_MAX && nB < INT_MAX
+     && (algorithm == NeedlemanWunschSmithWaterman || algorithm == Gotoh)
+     && _get_number_of_threads(self, -1) > 1) {
+        if (algorithm == NeedlemanWunschSmithWaterman) {
+            /* unit costs are faster with bit-vectors in a single thread */
+            switch (_bit_vector_score(self, sA, nA, sB, nB, &score)) {
+                case 1: return PyFloat_FromDouble(score);
+                case -1: return PyErr_NoMemory();
+                default: break;
+            }
+        }
+        if (_wavefront_score(self, sA, nA, sB, nB,
+                             _get_number_of_threads(self, -1), &score) < 0)
+            return NULL;
+        return PyFloat_FromDouble(score);
+    }
+    switch (_calculate_score(self, sA, nA, sB, nB, &score, NULL)) {
+        case 0: return PyFloat_FromDouble(score);
+        case MEMORY_ERROR: return PyErr_NoMemory();
+        case PYTHON_ERROR:
+        default: return NULL;
+    }
+}
+
+static const char Aligner_score__doc__[] =
+"score(sequenceA, sequenceB)\n"
+"\n"
+"Calculate the alignment score.  The sequences can be strings, or any\n"
+"object supporting the buffer protocol (such as bytes, a memoryview, or a\n"
+"NumPy array) storing unsigned single-byte characters, or signed bytes or\n"
+"integers giving the index of each letter in the alphabet.\n";
+
+static PyObject*
+Aligner_score(Aligner* self, PyObject* args, PyObject* keywords)
+{
+    PyObject* result = NULL;
+    PyObject* a;
+    PyObject* b;
+    Sequence A = {NULL, 0};
+    Sequence B = {NULL, 0};
+
+    static char *kwlist[] = {"sequenceA", "sequenceB", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, keywords, "OO", kwlist, &a, &b))
+        return NULL;
+    if (_map_sequence(self, a, &A) && _map_sequence(self, b, &B))
+        result = Aligner_score_indices(self, A.indices, A.length,
+                                             B.indices, B.length);
+    _release_sequence(&A);
+    _release_sequence(&B);
+    return result;
+}
+
+static int
+sequences_converter(PyObject* object, void* address)
+{
+    const int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT;
+    const char* format;
+    Py_buffer* view = address;
+    if (object == NULL) goto exit;
+    if (PyObject_GetBuffer(object, view, flags) == -1) {
+        PyErr_SetString(PyExc_ValueError, "expected a bytes-like object");
+        return 0;
+    }
+    format = view->format;
+    if (view->itemsize != 1 || (format && strcmp(format, "B") != 0
+                                       && strcmp(format, "b") != 0
+                                       && strcmp(format, "c") != 0)) {
+        PyErr_SetString(PyExc_ValueError,
+                        "expected a buffer of single-byte characters");
+        goto exit;
+    }
+    return Py_CLEANUP_SUPPORTED;
+exit:
+    PyBuffer_Release(view);
+    return 0;
+}
+
+static int
+offsets_converter(PyObject* object, void* address)
+{
+    const int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT;
+    char datatype;
+    Py_ssize_t i;
+    Py_ssize_t n;
+    Py_ssize_t* offsets;
+    Py_buffer* view = address;
+    if (object == NULL) goto exit;
+    if (PyObject_GetBuffer(object, view, flags) == -1) {
+        PyErr_SetString(PyExc_ValueError, "offsets should be an array");
+        return 0;
+    }
+    datatype = view->format[0];
+    switch (datatype) {
+        case '@':
+        case '=':
+        case '<':
+        case '>':
+        case '!': datatype = view->format[1]; break;
+        default: break;
+    }
+    if (view->itemsize != sizeof(Py_ssize_t)
+     || (datatype != 'n' && datatype != 'q' && datatype != 'l')) {
+        PyErr_Format(PyExc_ValueError,
+            "offsets array has incorrect data format ('%c', expected a "
+            "%d-byte integer)", datatype, (int)sizeof(Py_ssize_t));
+        goto exit;
+    }
+    if (view->ndim != 1 || view->shape[0] < 1) {
+        PyErr_SetString(PyExc_ValueError,
+            "offsets should be a one-dimensional array with at least one "
+            "element");
+        goto exit;
+    }
+    n = view->shape[0];
+    offsets = view->buf;
+    for (i = 1; i < n; i++) {
+        if (offsets[i] <= offsets[i-1]) {
+            PyErr_SetString(PyExc_ValueError,
+                "offsets should be strictly increasing (sequences cannot "
+                "have zero length)");
+            goto exit;
+        }
+    }
+    if (offsets[0] < 0) {
+        PyErr_SetString(PyExc_ValueError, "offsets should not be negative");
+        goto exit;
+    }
+    return Py_CLEANUP_SUPPORTED;
+exit:
+    PyBuffer_Release(view);
+    return 0;
+}
+
+static int
+threads_converter(PyObject* object, void* address)
+{
+    long n;
+    int* n_threads = address;
+    if (object == Py_None) return 1;
+    n = PyLong_AsLong(object);
+    if (n == -1 && PyErr_Occurred()) return 0;
+    if (n < 0 || n > MAXIMUM_NUMBER_OF_THREADS) {
+        PyErr_Format(PyExc_ValueError,
+                     "number of threads should be between 0 and %d",
+                     MAXIMUM_NUMBER_OF_THREADS);
+        return 0;
+    }
+    *n_threads = (int)n;
+    return 1;
+}
+
+static int
+batch_scores_converter(PyObject* object, void* address)
+{
+    const int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | PyBUF_WRITABLE;
+    char datatype;
+    Py_buffer* view = address;
+    if (object == NULL) goto exit;
+    if (PyObject_GetBuffer(object, view, flags) == -1) return 0;
+    datatype = view->format[0];
+    switch (datatype) {
+        case '@':
+        case '=':
+        case '<':
+        case '>':
+        case '!': datatype = view->format[1]; break;
+        default: break;
+    }
+    if (datatype != 'd') {
+        PyErr_Format(PyExc_ValueError,
+            "scores array has incorrect data format ('%c', expected 'd')",
+            datatype);
+        goto exit;
+    }
+    if (view->ndim != 1) {
+        PyErr_Format(PyExc_ValueError,
+            "scores array has incorrect rank (%d expected 1)",
+            view->ndim);
+        goto exit;
+    }
+    return Py_CLEANUP_SUPPORTED;
+exit:
+    PyBuffer_Release(view);
+    return 0;
+}
+
+/* The optional array in which the batch methods store for each pair whether
+ * the optimal path of a banded alignment touched the edge of the band. */
+static int
+batch_edges_converter(PyObject* object, void* address)
+{
+    const int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | PyBUF_WRITABLE;
+    Py_buffer* view = address;
+    if (object == NULL) goto exit;
+    if (object == Py_None) return 1;
+    if (PyObject_GetBuffer(object, view, flags) == -1) return 0;
+    if (view->itemsize != 1 || view->ndim != 1) {
+        PyErr_SetString(PyExc_ValueError,
+            "edges should be a one-dimensional array of type 'B'");
+        goto exit;
+    }
+    return Py_CLEANUP_SUPPORTED;
+exit:
+    PyBuffer_Release(view);
+    return 0;
+}
+
+typedef struct {
+    Aligner* aligner;
+    const char* sA;
+    const Py_ssize_t* oA;
+    Py_ssize_t nt;
+    const char* sB;
+    const Py_ssize_t* oB;
+    double* scores;
+    unsigned char* edges;
+    int status;
+} BatchScores;
+
+static void
+_score_batch_item(void* data, Py_ssize_t i)
+{
+    int status;
+    int touched;
+    BatchScores* batch = data;
+    const Py_ssize_t* oA = batch->oA;
+    const Py_ssize_t* oB = batch->oB;
+    const Py_ssize_t k = (batch->nt == 1) ? 0 : i;
+    if (batch->status) return;
+    status = _calculate_score(batch->aligner,
+                              batch->sA + oA[k], oA[k+1] - oA[k],
+                              batch->sB + oB[i], oB[i+1] - oB[i],
+                              &batch->scores[i], &touched);
+    /* Without the GIL, the only possible failure is a memory error */
+    if (status) batch->status = status;
+    else if (batch->edges) batch->edges[i] = (unsigned char)touched;
+}
+
+/* Call function(data, i) for i = 0, ..., n-1 to calculate alignment scores.
+ * The global interpreter lock is released and n_threads threads are used,
+ * with *aligner (a field of data) pointing to a copy of self, unless the gap
+ * functions are Python callables.  *status is the status field of data.
+ * Returns 0 on success, or -1 with an exception set. */
+static int
+_parallel_scores(Aligner* self, Aligner** aligner, int* status, Py_ssize_t n,
+                 int n_threads, ParallelFunction function, void* data)
+{
+    Py_ssize_t i;
+    Aligner copy;
+    if (_get_algorithm(self) == WatermanSmithBeyer) {
+        /* the gap functions are Python callables; keep the GIL */
+        *aligner = self;
+        for (i = 0; i < n && *status == 0; i++) function(data, i);
+    }
+    else {
+        /* Work on a copy of the aligner, as its attributes may be modified
+         * by other Python threads while the GIL is released. */
+        const int size = self->alphabet_size;
+        memcpy(&copy, self, sizeof(Aligner));
+        copy.substitution_matrix = _create_substitution_matrix(size);
+        if (!copy.substitution_matrix) return -1;
+        memcpy(copy.substitution_matrix[0], self->substitution_matrix[0],
+               size*size*sizeof(double));
+        *aligner = &copy;
+        Py_BEGIN_ALLOW_THREADS
+        _parallel_for(n, n_threads, function, data);
+        Py_END_ALLOW_THREADS
+        *aligner = self;
+        PyMem_Free(copy.substitution_matrix);
+    }
+    switch (*status) {
+        case 0:
+            return 0;
+        case MEMORY_ERROR:
+            PyErr_NoMemory();
+            return -1;
+        case PYTHON_ERROR:
+        default:
+            return -1;
+    }
+}
+
+/* Score targets against queries, both stored consecutively in a buffer and
+ * delimited by an offsets array.  If there is only one target, it is scored
+ * against all queries; otherwise, targets and queries are scored pairwise. */
+static PyObject*
+_score_batch(Aligner* self, Py_buffer* targets, Py_buffer* target_offsets,
+             Py_buffer* queries, Py_buffer* query_offsets, Py_buffer* scores,
+             Py_buffer* edges, int n_threads)
+{
+    Py_ssize_t i;
+    BatchScores batch;
+    char* sA = NULL;
+    char* sB = NULL;
+    PyObject* result = NULL;
+    const Py_ssize_t* oA = target_offsets->buf;
+    const Py_ssize_t* oB = query_offsets->buf;
+    const Py_ssize_t nt = target_offsets->shape[0] - 1;
+    const Py_ssize_t n = query_offsets->shape[0] - 1;
+    const Algorithm algorithm = _get_algorithm(self);
+
+    if (algorithm == Unknown) {
+        PyErr_SetString(PyExc_RuntimeError, "unknown algorithm");
+        return NULL;
+    }
+    if (nt != 1 && nt != n) {
+        PyErr_Format(PyExc_ValueError,
+                     "found %zd targets and %zd queries", nt, n);
+        return NULL;
+    }
+    if (oA[nt] > targets->len) {
+        PyErr_SetString(PyExc_ValueError,
+                        "target offsets exceed the size of the buffer");
+        return NULL;
+    }
+    if (oB[n] > queries->len) {
+        PyErr_SetString(PyExc_ValueError,
+                        "query offsets exceed the size of the buffer");
+        return NULL;
+    }
+    if (scores->shape[0] != n) {
+        PyErr_Format(PyExc_ValueError,
+                     "scores array has size %zd (expected %zd)",
+                     scores->shape[0], n);
+        return NULL;
+    }
+    if (edges->obj && edges->shape[0] != n) {
+        PyErr_Format(PyExc_ValueError,
+                     "edges array has size %zd (expected %zd)",
+                     edges->shape[0], n);
+        return NULL;
+    }
+    if (self->band_width >= 0) {
+        for (i = 0; i < n; i++) {
+            const Py_ssize_t k = (nt == 1) ? 0 : i;
+            if (!_check_band(self, oA[k+1] - oA[k], oB[i+1] - oB[i]))
+                return NULL;
+        }
+    }
+    n_threads = _get_number_of_threads(self, n_threads);
+    /* convert the letters of each sequence to indices */
+    sA = PyMem_Malloc(oA[nt] + 1);
+    sB = PyMem_Malloc(oB[n] + 1);
+    if (!sA || !sB) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    for (i = 0; i < nt; i++)
+        if (!_map_buffer(self, targets, sA + oA[i], oA[i], oA[i+1] - oA[i]))
+            goto exit;
+    for (i = 0; i < n; i++)
+        if (!_map_buffer(self, queries, sB + oB[i], oB[i], oB[i+1] - oB[i]))
+            goto exit;
+    batch.aligner = self;
+    batch.sA = sA;
+    batch.oA = oA;
+    batch.nt = nt;
+    batch.sB = sB;
+    batch.oB = oB;
+    batch.scores = scores->buf;
+    batch.edges = edges->obj ? edges->buf : NULL;
+    batch.status = 0;
+    if (_parallel_scores(self, &batch.aligner, &batch.status, n, n_threads,
+                         _score_batch_item, &batch) == 0) {
+        Py_INCREF(Py_None);
+        result = Py_None;
+    }
+exit:
+    PyMem_Free(sA);
+    PyMem_Free(sB);
+    return result;
+}
+
+static const char Aligner_score_many__doc__[] =
+"score_many(target, queries, offsets, scores, n_threads=None, edges=None)\n"
+"\n"
+"Calculate the alignment score of the target against each query.\n"
+"The queries are stored consecutively in a bytes-like object, with query\n"
+"i ranging from offsets[i] to offsets[i+1]; the scores are stored in the\n"
+"preallocated array scores of type 'd'.  The global interpreter lock is\n"
+"released during the calculation, which uses n_threads threads (by\n"
+"default, the n_threads attribute of the aligner; 0 for the number of\n"
+"processors).  If edges is given, a preallocated array of type 'B' of the\n"
+"same size as scores, it is set to 1 for each query whose banded\n"
+"alignment touched the edge of the band (see band_edge_touched), and to 0\n"
+"otherwise.\n";
+
+static PyObject*
+Aligner_score_many(Aligner* self, PyObject* args, PyObject* keywords)
+{
+    PyObject* result = NULL;
+    Py_buffer target;
+    Py_buffer queries;
+    Py_buffer query_offsets;
+    Py_buffer target_offsets;
+    Py_buffer scores;
+    Py_buffer edges;
+    Py_ssize_t shape[1] = {2};
+    Py_ssize_t offsets[2];
+
+    int n_threads = -1;
+
+    static char *kwlist[] = {"target", "queries", "offsets", "scores",
+                             "n_threads", "edges", NULL};
+
+    target.obj = NULL;
+    queries.obj = NULL;
+    query_offsets.obj = NULL;
+    scores.obj = NULL;
+    edges.obj = NULL;
+    if(!PyArg_ParseTupleAndKeywords(args, keywords, "O&O&O&O&|O&O&", kwlist,
+                                    sequences_converter, &target,
+                                    sequences_converter, &queries,
+                                    offsets_converter, &query_offsets,
+                                    batch_scores_converter, &scores,
+                                    threads_converter, &n_threads,
+                                    batch_edges_converter, &edges))
+        return NULL;
+    if (target.len == 0) {
+        PyErr_SetString(PyExc_ValueError, "target has zero length");
+        goto exit;
+    }
+    offsets[0] = 0;
+    offsets[1] = target.len;
+    target_offsets.buf = offsets;
+    target_offsets.shape = shape;
+    result = _score_batch(self, &target, &target_offsets,
+                                &queries, &query_offsets, &scores, &edges,
+                                n_threads);
+exit:
+    PyBuffer_Release(&target);
+    PyBuffer_Release(&queries);
+    PyBuffer_Release(&query_offsets);
+    PyBuffer_Release(&scores);
+    PyBuffer_Release(&edges);
+    return result;
+}
+
+static const char Aligner_score_pairs__doc__[] =
+"score_pairs(targets, target_offsets, queries, query_offsets, scores,\n"
+"            n_threads=None, edges=None)\n"
+"\n"
+"Calculate the alignment score of each target against the corresponding\n"
+"query.  Targets and queries are stored consecutively in bytes-like\n"
+"objects, delimited by the offsets arrays; the scores are stored in the\n"
+"preallocated array scores of type 'd'.  The global interpreter lock is\n"
+"released during the calculation, which uses n_threads threads as in\n"
+"score_many.  The optional array edges is filled as in score_many.\n";
+
+static PyObject*
+Aligner_score_pairs(Aligner* self, PyObject* args, PyObject* keywords)
+{
+    PyObject* result;
+    Py_buffer targets;
+    Py_buffer target_offsets;
+    Py_buffer queries;
+    Py_buffer query_offsets;
+    Py_buffer scores;
+    Py_buffer edges;
+
+    int n_threads = -1;
+
+    static char *kwlist[] = {"targets", "target_offsets",
+                             "queries", "query_offsets", "scores",
+                             "n_threads", "edges", NULL};
+
+    edges.obj = NULL;
+    if(!PyArg_ParseTupleAndKeywords(args, keywords, "O&O&O&O&O&|O&O&", kwlist,
+                                    sequences_converter, &targets,
+                                    offsets_converter, &target_offsets,
+                                    sequences_converter, &queries,
+                                    offsets_converter, &query_offsets,
+                                    batch_scores_converter, &scores,
+                                    threads_converter, &n_threads,
+                                    batch_edges_converter, &edges))
+        return NULL;
+    if (target_offsets.shape[0] != query_offsets.shape[0]) {
+        PyErr_SetString(PyExc_ValueError,
+                        "number of targets and queries are different");
+        result = NULL;
+    }
+    else
+        result = _score_batch(self, &targets, &target_offsets,
+                                    &queries, &query_offsets, &scores,
+                                    &edges, n_threads);
+    PyBuffer_Release(&targets);
+    PyBuffer_Release(&target_offsets);
+    PyBuffer_Release(&queries);
+    PyBuffer_Release(&query_offsets);
+    PyBuffer_Release(&scores);
+    PyBuffer_Release(&edges);
+    return result;
+}
+
+/* Number of bytes of sequence data of the targets and queries in one tile
+ * of score_all_pairs, so that the sequences in a tile stay in the cache. */
+#define ALL_PAIRS_TILE_BYTES 32768
+#define ALL_PAIRS_MAXIMUM_TILE_SIZE 32
+
+typedef struct {
+    Aligner* aligner;
+    const char* s;
+    const Py_ssize_t* o;
+    Py_ssize_t n;
+    Py_ssize_t tile_size;
+    double* scores;
+    unsigned char* edges;
+    int status;
+} AllPairsScores;
+
+/* Score all pairs of sequences i > j in tile k of the lower triangle; the
+ * tiles are numbered row by row, as the scores in the condensed array. */
+static void
+_score_all_pairs_tile(void* data, Py_ssize_t k)
+{
+    int status;
+    int touched;
+    Py_ssize_t i, j;
+    Py_ssize_t iStart, iEnd, jStart, jEnd;
+    AllPairsScores* pairs = data;
+    const Py_ssize_t* o = pairs->o;
+    const Py_ssize_t size = pairs->tile_size;
+    Py_ssize_t bi = (Py_ssize_t)((sqrt(8.0*k+1) - 1) / 2);
+    Py_ssize_t bj;
+    /* correct for rounding errors in the square root */
+    while (bi * (bi + 1) / 2 > k) bi--;
+    while ((bi + 1) * (bi + 2) / 2 <= k) bi++;
+    bj = k - bi * (bi + 1) / 2;
+    iStart = bi * size;
+    iEnd = iStart + size;
+    if (iEnd > pairs->n) iEnd = pairs->n;
+    jStart = bj * size;
+    jEnd = jStart + size;
+    for (i = iStart; i < iEnd; i++) {
+        for (j = jStart; j < jEnd && j < i; j++) {
+            if (pairs->status) return;
+            status = _calculate_score(pairs->aligner,
+                                      pairs->s + o[j], o[j+1] - o[j],
+                                      pairs->s + o[i], o[i+1] - o[i],
+                                      &pairs->scores[i*(i-1)/2+j], &touched);
+            if (status) pairs->status = status;
+            else if (pairs->edges)
+                pairs->edges[i*(i-1)/2+j] = (unsigned char)touched;
+        }
+    }
+}
+
+static const char Aligner_score_all_pairs__doc__[] =
+"score_all_pairs(sequences, offsets, scores, n_threads=None, edges=None)\n"
+"\n"
+"Calculate the alignment score of each pair of sequences.  The sequences\n"
+"are stored consecutively in a bytes-like object, with sequence i ranging\n"
+"from offsets[i] to offsets[i+1].  For j < i, the score of sequence j (as\n"
+"the target) aligned to sequence i (as the query) is stored in\n"
+"scores[i*(i-1)/2+j], where scores is a preallocated array of type 'd'.\n"
+"This is the condensed layout of a distance matrix in Bio.Cluster.  The\n"
+"global interpreter lock is released during the calculation, which uses\n"
+"n_threads threads as in score_many.  The optional array edges is filled\n"
+"as in score_many, in the same layout as scores.\n";
+
+static PyObject*
+Aligner_score_all_pairs(Aligner* self, PyObject* args, PyObject* keywords)
+{
+    Py_ssize_t i, j;
+    Py_ssize_t n;
+    Py_ssize_t size;
+    Py_ssize_t nb;
+    const Py_ssize_t* o;
+    char* s = NULL;
+    AllPairsScores pairs;
+    PyObject* result = NULL;
+    Py_buffer sequences;
+    Py_buffer offsets;
+    Py_buffer scores;
+    Py_buffer edges;
+
+    int n_threads = -1;
+
+    static char *kwlist[] = {"sequences", "offsets", "scores", "n_threads",
+                             "edges", NULL};
+
+    edges.obj = NULL;
+    if(!PyArg_ParseTupleAndKeywords(args, keywords, "O&O&O&|O&O&", kwlist,
+                                    sequences_converter, &sequences,
+                                    offsets_converter, &offsets,
+                                    batch_scores_converter, &scores,
+                                    threads_converter, &n_threads,
+                                    batch_edges_converter, &edges))
+        return NULL;
+    if (_get_algorithm(self) == Unknown) {
+        PyErr_SetString(PyExc_RuntimeError, "unknown algorithm");
+        goto exit;
+    }
+    o = offsets.buf;
+    n = offsets.shape[0] - 1;
+    if (o[n] > sequences.len) {
+        PyErr_SetString(PyExc_ValueError,
+                        "offsets exceed the size of the buffer");
+        goto exit;
+    }
+    if (scores.shape[0] != n*(n-1)/2) {
+        PyErr_Format(PyExc_ValueError,
+                     "scores array has size %zd (expected %zd)",
+                     scores.shape[0], n*(n-1)/2);
+        goto exit;
+    }
+    if (edges.obj && edges.shape[0] != n*(n-1)/2) {
+        PyErr_Format(PyExc_ValueError,
+                     "edges array has size %zd (expected %zd)",
+                     edges.shape[0], n*(n-1)/2);
+        goto exit;
+    }
+    if (self->band_width >= 0) {
+        for (i = 0; i < n; i++)
+            for (j = 0; j < i; j++)
+                if (!_check_band(self, o[j+1] - o[j], o[i+1] - o[i]))
+                    goto exit;
+    }
+    n_threads = _get_number_of_threads(self, n_threads);
+    /* convert the letters of each sequence to indices */
+    s = PyMem_Malloc(o[n] + 1);
+    if (!s) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    for (i = 0; i < n; i++)
+        if (!_map_buffer(self, &sequences, s + o[i], o[i], o[i+1] - o[i]))
+            goto exit;
+    if (n == 0) {
+        Py_INCREF(Py_None);
+        result = Py_None;
+        goto exit;
+    }
+    /* choose the tile size from the average sequence length */
+    size = ALL_PAIRS_TILE_BYTES / (2 * ((o[n] - o[0]) / n + 1));
+    if (size > ALL_PAIRS_MAXIMUM_TILE_SIZE) size = ALL_PAIRS_MAXIMUM_TILE_SIZE;
+    if (size < 1) size = 1;
+    nb = (n + size - 1) / size;
+    pairs.aligner = self;
+    pairs.s = s;
+    pairs.o = o;
+    pairs.n = n;
+    pairs.tile_size = size;
+    pairs.scores = scores.buf;
+    pairs.edges = edges.obj ? edges.buf : NULL;
+    pairs.status = 0;
+    if (_parallel_scores(self, &pairs.aligner, &pairs.status, nb*(nb+1)/2,
+                         n_threads, _score_all_pairs_tile, &pairs) == 0) {
+        Py_INCREF(Py_None);
+        result = Py_None;
+    }
+exit:
+    PyMem_Free(s);
+    PyBuffer_Release(&sequences);
+    PyBuffer_Release(&offsets);
+    PyBuffer_Release(&scores);
+    PyBuffer_Release(&edges);
+    return result;
+}
+
+typedef struct {
+    Py_ssize_t index;
+    double score;
+} SearchHit;
+
+typedef struct {
+    Aligner* aligner;
+    const char* sA;
+    const Py_ssize_t* oA;
+    const char* sB;
+    Py_ssize_t nB;
+    const Py_ssize_t* counts; /* number of times each letter occurs in sB */
+    int bounded; /* 1 if the upper bound of the score can be used */
+    double min_score;
+    Py_ssize_t k;
+    Py_ssize_t size;
+    SearchHit* heap; /* the worst of the best hits found so far is heap[0] */
+#ifdef HAVE_PTHREADS
+    pthread_mutex_t lock;
+#endif
+    int status;
+} SearchScores;
+
+/* Hits with lower scores are worse; for equal scores, the hit with the
+ * higher index is worse, so that the result does not depend on the order
+ * in which the hits were found. */
+static int
+_search_hit_worse(const SearchHit* a, const SearchHit* b)
+{
+    if (a->score < b->score) return 1;
+    if (a->score > b->score) return 0;
+    return a->index > b->index;
+}
+
+static int
+_search_hit_compare(const void* a, const void* b)
+{
+    if (_search_hit_worse(b, a)) return -1;
+    if (_search_hit_worse(a, b)) return 1;
+    return 0;
+}
+
+static void
+_search_add_hit(SearchScores* search, Py_ssize_t index, double score)
+{
+    Py_ssize_t i;
+    Py_ssize_t child;
+    SearchHit hit;
+    SearchHit* heap = search->heap;
+    const Py_ssize_t size = search->size;
+    hit.index = index;
+    hit.score = score;
+    if (size < search->k) {
+        /* sift up */
+        i = search->size++;
+        while (i > 0 && _search_hit_worse(&hit, &heap[(i-1)/2])) {
+            heap[i] = heap[(i-1)/2];
+            i = (i-1)/2;
+        }
+        heap[i] = hit;
+    }
+    else if (_search_hit_worse(&heap[0], &hit)) {
+        /* replace the worst hit, and sift down */
+        i = 0;
+        while ((child = 2*i+1) < size) {
+            if (child + 1 < size
+             && _search_hit_worse(&heap[child+1], &heap[child])) child++;
+            if (!_search_hit_worse(&heap[child], &hit)) break;
+            heap[i] = heap[child];
+            i = child;
+        }
+        heap[i] = hit;
+    }
+}
+
+/* Return an upper bound of the score of aligning sequence sA of length nA
+ * to the query, valid if no gap score is positive: each letter of the query
+ * contributes at most its best score against any letter in sA, and each
+ * letter of sA at most its best score against any letter in the query. */
+static double
+_search_bound(SearchScores* search, const char* sA, Py_ssize_t nA)
+{
+    int a, b;
+    Py_ssize_t i;
+    double score;
+    double best;
+    double boundA = 0;
+    double boundB = 0;
+    Py_ssize_t countsA[128];
+    const Py_ssize_t* countsB = search->counts;
+    double** matrix = search->aligner->substitution_matrix;
+    const int size = search->aligner->alphabet_size;
+    memset(countsA, 0, size*sizeof(Py_ssize_t));
+    for (i = 0; i < nA; i++) countsA[(int)sA[i]]++;
+    for (a = 0; a < size; a++) {
+        if (countsA[a] == 0) continue;
+        best = 0;
+        for (b = 0; b < size; b++) {
+            if (countsB[b] == 0) continue;
+            score = matrix[a][b];
+            if (score > best) best = score;
+        }
+        boundA += countsA[a] * best;
+    }
+    for (b = 0; b < size; b++) {
+        if (countsB[b] == 0) continue;
+        best = 0;
+        for (a = 0; a < size; a++) {
+            if (countsA[a] == 0) continue;
+            score = matrix[a][b];
+            if (score > best) best = score;
+        }
+        boundB += countsB[b] * best;
+    }
+    return (boundA < boundB) ? boundA : boundB;
+}
+
+static void
+_search_item(void* data, Py_ssize_t i)
+{
+    int status;
+    double score;
+    double threshold;
+    SearchScores* search = data;
+    const Py_ssize_t* oA = search->oA;
+    const char* sA = search->sA + oA[i];
+    const Py_ssize_t nA = oA[i+1] - oA[i];
+    if (search->status) return;
+    if (search->bounded) {
+        threshold = search->min_score;
+#ifdef HAVE_PTHREADS
+        pthread_mutex_lock(&search->lock);
+#endif
+        if (search->size == search->k && search->heap[0].score > threshold)
+            threshold = search->heap[0].score;
+#ifdef HAVE_PTHREADS
+        pthread_mutex_unlock(&search->lock);
+#endif
+        if (_search_bound(search, sA, nA) + search->aligner->epsilon
+            < threshold) return;
+    }
+    status = _calculate_score(search->aligner, sA, nA,
+                              search->sB, search->nB, &score, NULL);
+    if (status) {
+        /* Without the GIL, the only possible failure is a memory error */
+        search->status = status;
+        return;
+    }
+    if (score < search->min_score) return;
+#ifdef HAVE_PTHREADS
+    pthread_mutex_lock(&search->lock);
+#endif
+    _search_add_hit(search, i, score);
+#ifdef HAVE_PTHREADS
+    pthread_mutex_unlock(&search->lock);
+#endif
+}
+
+static const char Aligner_search__doc__[] =
+"search(query, database, offsets, k, min_score, n_threads=None)\n"
+"\n"
+"Find the k database sequences with the highest alignment score against\n"
+"the query, with a score of at least min_score.  The database sequences\n"
+"are stored consecutively in a bytes-like object, with sequence i ranging\n"
+"from offsets[i] to offsets[i+1], and are used as the target.  Returns a\n"
+"list of (index, score) tuples, sorted by decreasing score and then by\n"
+"index.  If no gap score is positive, database sequences whose score is\n"
+"bounded from above by a score too low to be included are skipped without\n"
+"aligning them.  The global interpreter lock is released during the\n"
+"calculation, which uses n_threads threads as in score_many.\n";
+
+static PyObject*
+Aligner_search(Aligner* self, PyObject* args, PyObject* keywords)
+{
+    Py_ssize_t i;
+    Py_ssize_t n;
+    Py_ssize_t k;
+    double min_score;
+    const Py_ssize_t* o;
+    char* sA = NULL;
+    char* sB = NULL;
+    Py_ssize_t counts[128];
+    SearchScores search;
+    PyObject* item;
+    PyObject* result = NULL;
+    Py_buffer query;
+    Py_buffer database;
+    Py_buffer offsets;
+
+    int n_threads = -1;
+
+    static char *kwlist[] = {"query", "database", "offsets", "k",
+                             "min_score", "n_threads", NULL};
+
+    if(!PyArg_ParseTupleAndKeywords(args, keywords, "O&O&O&nd|O&", kwlist,
+                                    sequences_converter, &query,
+                                    sequences_converter, &database,
+                                    offsets_converter, &offsets,
+                                    &k, &min_score,
+                                    threads_converter, &n_threads))
+        return NULL;
+    search.heap = NULL;
+    if (_get_algorithm(self) == Unknown) {
+        PyErr_SetString(PyExc_RuntimeError, "unknown algorithm");
+        goto exit;
+    }
+    if (query.len == 0) {
+        PyErr_SetString(PyExc_ValueError, "query has zero length");
+        goto exit;
+    }
+    if (k < 1) {
+        PyErr_SetString(PyExc_ValueError, "k should be positive");
+        goto exit;
+    }
+    o = offsets.buf;
+    n = offsets.shape[0] - 1;
+    if (o[n] > database.len) {
+        PyErr_SetString(PyExc_ValueError,
+                        "offsets exceed the size of the buffer");
+        goto exit;
+    }
+    if (self->band_width >= 0) {
+        for (i = 0; i < n; i++)
+            if (!_check_band(self, o[i+1] - o[i], query.len)) goto exit;
+    }
+    n_threads = _get_number_of_threads(self, n_threads);
+    /* convert the letters of each sequence to indices */
+    sA = PyMem_Malloc(o[n] + 1);
+    sB = PyMem_Malloc(query.len + 1);
+    if (k > n) k = n;
+    search.heap = PyMem_Malloc((k + 1) * sizeof(SearchHit));
+    if (!sA || !sB || !search.heap) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    for (i = 0; i < n; i++)
+        if (!_map_buffer(self, &database, sA + o[i], o[i], o[i+1] - o[i]))
+            goto exit;
+    if (!_map_buffer(self, &query, sB, 0, query.len)) goto exit;
+    memset(counts, 0, sizeof(counts));
+    for (i = 0; i < query.len; i++) counts[(int)sB[i]]++;
+    search.aligner = self;
+    search.sA = sA;
+    search.oA = o;
+    search.sB = sB;
+    search.nB = query.len;
+    search.counts = counts;
+    search.bounded = _get_algorithm(self) != WatermanSmithBeyer
+                  && self->target_open_gap_score <= 0
+                  && self->target_extend_gap_score <= 0
+                  && self->target_left_open_gap_score <= 0
+                  && self->target_left_extend_gap_score <= 0
+                  && self->target_right_open_gap_score <= 0
+                  && self->target_right_extend_gap_score <= 0
+                  && self->query_open_gap_score <= 0
+                  && self->query_extend_gap_score <= 0
+                  && self->query_left_open_gap_score <= 0
+                  && self->query_left_extend_gap_score <= 0
+                  && self->query_right_open_gap_score <= 0
+                  && self->query_right_extend_gap_score <= 0;
+    search.min_score = min_score;
+    search.k = k;
+    search.size = 0;
+    search.status = 0;
+#ifdef HAVE_PTHREADS
+    pthread_mutex_init(&search.lock, NULL);
+#endif
+    i = _parallel_scores(self, &search.aligner, &search.status, n, n_threads,
+                         _search_item, &search);
+#ifdef HAVE_PTHREADS
+    pthread_mutex_destroy(&search.lock);
+#endif
+    if (i < 0) goto exit;
+    qsort(search.heap, search.size, sizeof(SearchHit), _search_hit_compare);
+    result = PyList_New(search.size);
+    if (!result) goto exit;
+    for (i = 0; i < search.size; i++) {
+        item = Py_BuildValue("nd", search.heap[i].index, search.heap[i].score);
+        if (!item) {
+            Py_DECREF(result);
+            result = NULL;
+            goto exit;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+exit:
+    PyMem_Free(sA);
+    PyMem_Free(sB);
+    PyMem_Free(search.heap);
+    PyBuffer_Release(&query);
+    PyBuffer_Release(&database);
+    PyBuffer_Release(&offsets);
+    return result;
+}
+
+static PyObject*
+Aligner_align_indices(Aligner* self, const char* sA, Py_ssize_t nA,
+                                     const char* sB, Py_ssize_t nB)
+{
+    PyObject* result;
+    const Mode mode = self->mode;
+    const Algorithm algorithm = _get_algorithm(self);
+
+    if (nA == 0 || nB == 0) {
+        PyErr_SetString(PyExc_ValueError,
+            "sequence has zero length (use score to calculate the end gap "
+            "score)");
+        return NULL;
+    }
+    if (self->band_width >= 0) {
+        if (self->linear_space) {
+            PyErr_SetString(PyExc_ValueError,
+                "linear_space cannot be used together with band_width");
+            return NULL;
+        }
+        if (!_check_band(self, nA, nB)) return NULL;
+        return Aligner_banded_align(self, sA, nA, sB, nB);
+    }
+    if (self->linear_space) {
+        if (mode != Global) {
+            PyErr_SetString(PyExc_ValueError,
+                "alignments in linear space are available in global mode only");
+            return NULL;
+        }
+        switch (algorithm) {
+            case NeedlemanWunschSmithWaterman:
+            case Gotoh:
+                return Aligner_linear_space_align(self, sA, nA, sB, nB);
+            case WatermanSmithBeyer:
+                result = Aligner_waterman_smith_beyer_single_align(self, sA, nA, sB, nB);
+                _free_gap_tables(self);
+                return result;
+            case Unknown:
+            default:
+                break;
+        }
+    }
+    switch (algorithm) {
+        case NeedlemanWunschSmithWaterman:
+            switch (mode) {
+                case Global:
+                    return Aligner_needlemanwunsch_align(self, sA, nA, sB, nB);
+                case Local:
+                    return Aligner_smithwaterman_align(self, sA, nA, sB, nB);
+                case Extension:
+                    return Aligner_extension_align(self, sA, nA, sB, nB);
+            }
+        case Gotoh:
+            switch (mode) {
+                case Global:
+                    return Aligner_gotoh_global_align(self, sA, nA, sB, nB);
+                case Local:
+                    return Aligner_gotoh_local_align(self, sA, nA, sB, nB);
+                case Extension:
+                    return Aligner_extension_align(self, sA, nA, sB, nB);
+            }
+        case WatermanSmithBeyer:
+            switch (mode) {
+                case Global:
+                    result = Aligner_waterman_smith_beyer_global_align(self, sA, nA, sB, nB);
+                    _free_gap_tables(self);
+                    return result;
+                case Local:
+                    result = Aligner_waterman_smith_beyer_local_align(self, sA, nA, sB, nB);
+                    _free_gap_tables(self);
+                    return result;
+                case Extension:
+                    PyErr_SetString(PyExc_ValueError,
+                        "extension alignments are not available for gap functions");
+                    return NULL;
+            }
+        case Unknown:
+        default:
+            PyErr_SetString(PyExc_RuntimeError, "unknown algorithm");
+            return NULL;
+    }
+}
+
+static const char Aligner_align__doc__[] =
+"align(sequenceA, sequenceB)\n"
+"\n"
+"Align two sequences, given as in score.\n";
+
+static PyObject*
+Aligner_align(Aligner* self, PyObject* args, PyObject* keywords)
+{
+    PyObject* result = NULL;
+    PyObject* a;
+    PyObject* b;
+    Sequence A = {NULL, 0};
+    Sequence B = {NULL, 0};
+
+    static char *kwlist[] = {"sequenceA", "sequenceB", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, keywords, "OO", kwlist, &a, &b))
+        return NULL;
+    if (_map_sequence(self, a, &A) && _map_sequence(self, b, &B))
+        result = Aligner_align_indices(self, A.indices, A.length,
+                                             B.indices, B.length);
+    _release_sequence(&A);
+    _release_sequence(&B);
+    return result;
+}
+
+/* Store the target and query coordinates at the start, end, and each change
+ * of direction of the path starting at M[i][j] as pairs of ints, and return
+ * the number of pairs.  If coordinates is NULL, the pairs are only counted. */
+static int
+_path_coordinates(Trace** M, int i, int j, int* coordinates)
+{
+    int path;
+    int direction = 0;
+    int n = 0;
+
+    while (1) {
+        path = M[i][j].path;
+        if (path != direction) {
+            if (coordinates) {
+                coordinates[2*n] = i;
+                coordinates[2*n+1] = j;
+            }
+            n++;
+            direction = path;
+        }
+        switch (path) {
+            case HORIZONTAL: j++; break;
+            case VERTICAL: i++; break;
+            case DIAGONAL: i++; j++; break;
+            default: return n;
+        }
+    }
+}
+
+/* As _path_coordinates, for a path starting at (0, 0) stored as steps. */
+static int
+_steps_coordinates(const unsigned char* steps, int nsteps, int* coordinates)
+{
+    int i = 0;
+    int j = 0;
+    int k;
+    int n = 0;
+    int direction = 0;
+
+    for (k = 0; k <= nsteps; k++) {
+        if (k == nsteps || steps[k] != direction) {
+            if (coordinates) {
+                coordinates[2*n] = i;
+                coordinates[2*n+1] = j;
+            }
+            n++;
+            if (k == nsteps) break;
+            direction = steps[k];
+        }
+        switch (steps[k]) {
+            case HORIZONTAL: j++; break;
+            case VERTICAL: i++; break;
+            case DIAGONAL: i++; j++; break;
+        }
+    }
+    return n;
+}
+
+/* Write the CIGAR string of the path with n coordinate pairs to cigar, which
+ * should have room for 12 * (n + 1) characters, and return its length.  Query
+ * letters outside the path are soft-clipped. */
+static int
+_create_cigar(const int* coordinates, int n, int nB, char* cigar)
+{
+    int k;
+    int di;
+    int dj;
+    int length = 0;
+
+    if (n == 0) return 0;
+    if (coordinates[1] > 0)
+        length += sprintf(cigar + length, "%dS", coordinates[1]);
+    for (k = 1; k < n; k++) {
+        di = coordinates[2*k] - coordinates[2*k-2];
+        dj = coordinates[2*k+1] - coordinates[2*k-1];
+        if (di && dj) length += sprintf(cigar + length, "%dM", di);
+        else if (di) length += sprintf(cigar + length, "%dD", di);
+        else length += sprintf(cigar + length, "%dI", dj);
+    }
+    if (coordinates[2*n-1] < nB)
+        length += sprintf(cigar + length, "%dS", nB - coordinates[2*n-1]);
+    return length;
+}
+
+static const char Aligner_align_best__doc__[] =
+"align_best(sequenceA, sequenceB, cigar=False)\n"
+"\n"
+"Return the score and the first optimal alignment of two sequences, given\n"
+"as in score, without creating the other alignments.  The alignment is\n"
+"returned as a bytes object storing the target and query coordinates of\n"
+"its path as C ints, or, if cigar is True, as its start position in the\n"
+"target and its CIGAR string.  The alignment is None if there is none.\n";
+
+static PyObject*
+Aligner_align_best(Aligner* self, PyObject* args, PyObject* keywords)
+{
+    PyObject* result = NULL;
+    PyObject* alignment = NULL;
+    PyObject* path;
+    PyObject* a;
+    PyObject* b;
+    PyObject* c = Py_False;
+    PathGenerator* paths;
+    Sequence A = {NULL, 0};
+    Sequence B = {NULL, 0};
+    int cigar;
+    int n;
+    int* coordinates = NULL;
+    char* buffer;
+    double score;
+
+    static char *kwlist[] = {"sequenceA", "sequenceB", "cigar", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, keywords, "OO|O", kwlist,
+                                    &a, &b, &c))
+        return NULL;
+    cigar = PyObject_IsTrue(c);
+    if (cigar < 0) return NULL;
+    if (_map_sequence(self, a, &A) && _map_sequence(self, b, &B))
+        result = Aligner_align_indices(self, A.indices, A.length,
+                                             B.indices, B.length);
+    _release_sequence(&A);
+    _release_sequence(&B);
+    if (!result) return NULL;
+
+    score = PyFloat_AsDouble(PyTuple_GET_ITEM(result, 0));
+    paths = (PathGenerator*)PyTuple_GET_ITEM(result, 1);
+    paths->skip = 1;
+    path = PathGenerator_next(paths);
+    paths->skip = 0;
+    if (!path) {
+        Py_DECREF(result);
+        if (PyErr_Occurred()) return NULL;
+        if (cigar) return Py_BuildValue("fOO", score, Py_None, Py_None);
+        return Py_BuildValue("fO", score, Py_None);
+    }
+    Py_DECREF(path);
+
+    if (paths->steps)
+        n = _steps_coordinates(paths->steps, paths->nsteps, NULL);
+    else
+        n = _path_coordinates(paths->M, paths->i0, paths->j0, NULL);
+    coordinates = PyMem_Malloc(2 * n * sizeof(int));
+    if (!coordinates) {
+        Py_DECREF(result);
+        return PyErr_NoMemory();
+    }
+    if (paths->steps)
+        _steps_coordinates(paths->steps, paths->nsteps, coordinates);
+    else
+        _path_coordinates(paths->M, paths->i0, paths->j0, coordinates);
+    if (cigar) {
+        buffer = PyMem_Malloc(12 * (n + 1));
+        if (buffer) {
+            alignment = PyBytes_FromStringAndSize(buffer,
+                            _create_cigar(coordinates, n, paths->nB, buffer));
+            PyMem_Free(buffer);
+        }
+        else PyErr_NoMemory();
+        if (alignment) alignment = Py_BuildValue("fiN", score,
+                                                 coordinates[0], alignment);
+    }
+    else {
+        alignment = PyBytes_FromStringAndSize((const char*)coordinates,
+                                              2 * n * sizeof(int));
+        if (alignment) alignment = Py_BuildValue("fN", score, alignment);
+    }
+    PyMem_Free(coordinates);
+    Py_DECREF(result);
+    return alignment;
+}
+
+/* The state of an aligner as stored by __reduce__ and to_bytes, followed by
+ * its substitution matrix.  Integers and doubles are stored in the native
+ * byte order, so the state can be restored on platforms of the same kind
+ * only; the magic number and the size of the header are checked. */
+typedef struct {
+    int magic;
+    int size;
+    int mode;
+    int substitution_matrix_given;
+    int alphabet_size;
+    int n_threads;
+    int linear_space;
+    int band_width;
+    int band_offset;
+    double match;
+    double mismatch;
+    double epsilon;
+    double xdrop;
+    double gap_scores[12];
+    char alphabet[128];
+    char matrix_letters[128];
+} AlignerState;
+
+#define ALIGNER_STATE_MAGIC 0x416c6e01
+
+static PyObject*
+_get_state(Aligner* self)
+{
+    PyObject* data;
+    AlignerState* state;
+    const int n = self->alphabet_size;
+    const Py_ssize_t size = sizeof(AlignerState) + n*n*sizeof(double);
+
+    data = PyBytes_FromStringAndSize(NULL, size);
+    if (!data) return NULL;
+    state = (AlignerState*)PyBytes_AS_STRING(data);
+    memset(state, 0, sizeof(AlignerState));
+    state->magic = ALIGNER_STATE_MAGIC;
+    state->size = sizeof(AlignerState);
+    state->mode = self->mode;
+    state->substitution_matrix_given = self->substitution_matrix_given;
+    state->alphabet_size = n;
+    state->n_threads = self->n_threads;
+    state->linear_space = self->linear_space;
+    state->band_width = self->band_width;
+    state->band_offset = self->band_offset;
+    state->match = self->match;
+    state->mismatch = self->mismatch;
+    state->epsilon = self->epsilon;
+    state->xdrop = self->xdrop;
+    state->gap_scores[0] = self->target_open_gap_score;
+    state->gap_scores[1] = self->target_extend_gap_score;
+    state->gap_scores[2] = self->target_left_open_gap_score;
+    state->gap_scores[3] = self->target_left_extend_gap_score;
+    state->gap_scores[4] = self->target_right_open_gap_score;
+    state->gap_scores[5] = self->target_right_extend_gap_score;
+    state->gap_scores[6] = self->query_open_gap_score;
+    state->gap_scores[7] = self->query_extend_gap_score;
+    state->gap_scores[8] = self->query_left_open_gap_score;
+    state->gap_scores[9] = self->query_left_extend_gap_score;
+    state->gap_scores[10] = self->query_right_open_gap_score;
+    state->gap_scores[11] = self->query_right_extend_gap_score;
+    memcpy(state->alphabet, self->alphabet, n);
+    strcpy(state->matrix_letters, self->matrix_letters);
+    memcpy(state + 1, self->substitution_matrix[0], n*n*sizeof(double));
+    return data;
+}
+
+/* Restore the state stored by _get_state; returns 0, or -1 with an
+ * exception set if the state is invalid. */
+static int
+_set_state(Aligner* self, const char* data, Py_ssize_t size,
+           PyObject* target_gap_function, PyObject* query_gap_function)
+{
+    int i;
+    int c;
+    int n;
+    AlignerState state;
+    double** matrix;
+
+    if (size < (Py_ssize_t)sizeof(AlignerState)) goto error;
+    memcpy(&state, data, sizeof(AlignerState));
+    if (state.magic != ALIGNER_STATE_MAGIC) goto error;
+    if (state.size != sizeof(AlignerState)) goto error;
+    n = state.alphabet_size;
+    if (n < 1 || n > 127) goto error;
+    if (size != (Py_ssize_t)(sizeof(AlignerState) + n*n*sizeof(double)))
+        goto error;
+    for (i = 0; i < n; i++) if (state.alphabet[i] <= ' ') goto error;
+    for (i = 0; state.matrix_letters[i]; i++) {
+        if (i == 127) goto error;
+        c = state.matrix_letters[i];
+        if (c <= ' ' || !memchr(state.alphabet, c, n)) goto error;
+    }
+    switch (state.mode) {
+        case Global: case Local: case Extension: break;
+        default: goto error;
+    }
+    if (state.n_threads < 0 || state.n_threads > MAXIMUM_NUMBER_OF_THREADS)
+        goto error;
+    if (target_gap_function == Py_None) target_gap_function = NULL;
+    if (query_gap_function == Py_None) query_gap_function = NULL;
+    if ((target_gap_function && !PyCallable_Check(target_gap_function))
+     || (query_gap_function && !PyCallable_Check(query_gap_function))) {
+        PyErr_SetString(PyExc_ValueError, "gap functions should be callable");
+        return -1;
+    }
+
+    matrix = _create_substitution_matrix(n);
+    if (!matrix) return -1;
+    memcpy(matrix[0], data + sizeof(AlignerState), n*n*sizeof(double));
+    _set_alphabet(self, state.alphabet, n, matrix);
+    self->mode = state.mode;
+    self->substitution_matrix_given = state.substitution_matrix_given;
+    strcpy(self->matrix_letters, state.matrix_letters);
+    self->n_threads = state.n_threads;
+    self->linear_space = state.linear_space;
+    self->band_width = state.band_width;
+    self->band_offset = state.band_offset;
+    self->band_edge_touched = 0;
+    self->match = state.match;
+    self->mismatch = state.mismatch;
+    self->epsilon = state.epsilon;
+    self->xdrop = state.xdrop;
+    self->target_open_gap_score = state.gap_scores[0];
+    self->target_extend_gap_score = state.gap_scores[1];
+    self->target_left_open_gap_score = state.gap_scores[2];
+    self->target_left_extend_gap_score = state.gap_scores[3];
+    self->target_right_open_gap_score = state.gap_scores[4];
+    self->target_right_extend_gap_score = state.gap_scores[5];
+    self->query_open_gap_score = state.gap_scores[6];
+    self->query_extend_gap_score = state.gap_scores[7];
+    self->query_left_open_gap_score = state.gap_scores[8];
+    self->query_left_extend_gap_score = state.gap_scores[9];
+    self->query_right_open_gap_score = state.gap_scores[10];
+    self->query_right_extend_gap_score = state.gap_scores[11];
+    Py_XINCREF(target_gap_function);
+    Py_XDECREF(self->target_gap_function);
+    self->target_gap_function = target_gap_function;
+    Py_XINCREF(query_gap_function);
+    Py_XDECREF(self->query_gap_function);
+    self->query_gap_function = query_gap_function;
+    self->algorithm = Unknown;
+    return 0;
+
+error:
+    PyErr_SetString(PyExc_ValueError, "invalid aligner state");
+    return -1;
+}
+
+static const char Aligner_reduce__doc__[] = "helper for pickle";
+
+static PyObject*
+Aligner_reduce(Aligner* self, PyObject* unused)
+{
+    PyObject* data = _get_state(self);
+    if (!data) return NULL;
+    return Py_BuildValue("O()(NOO)", (PyObject*)Py_TYPE(self), data,
+        self->target_gap_function ? self->target_gap_function : Py_None,
+        self->query_gap_function ? self->query_gap_function : Py_None);
+}
+
+static const char Aligner_setstate__doc__[] =
+"__setstate__(state)\n"
+"\n"
+"Restore the state of the aligner, as returned by __reduce__.\n";
+
+static PyObject*
+Aligner_setstate(Aligner* self, PyObject* args)
+{
+    Py_buffer view;
+    PyObject* target_gap_function;
+    PyObject* query_gap_function;
+    int status;
+
+    if (!PyArg_ParseTuple(args, "(s*OO)", &view,
+                          &target_gap_function, &query_gap_function))
+        return NULL;
+    status = _set_state(self, view.buf, view.len,
+                        target_gap_function, query_gap_function);
+    PyBuffer_Release(&view);
+    if (status < 0) return NULL;
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static const char Aligner_to_bytes__doc__[] =
+"to_bytes()\n"
+"\n"
+"Return the parameters and the substitution matrix of the aligner as a\n"
+"compact bytes object, which can be restored by __setstate__ on a platform\n"
+"of the same kind.  Gap functions cannot be stored in this way.\n";
+
+static PyObject*
+Aligner_to_bytes(Aligner* self, PyObject* unused)
+{
+    if (self->target_gap_function || self->query_gap_function) {
+        PyErr_SetString(PyExc_ValueError,
+                        "gap functions cannot be stored as bytes");
+        return NULL;
+    }
+    return _get_state(self);
+}
+
+static char Aligner_doc[] =
+"Aligner.\n";
+
+static PyMethodDef Aligner_methods[] = {
+    {"score",
+     (PyCFunction)Aligner_score,
+     METH_VARARGS | METH_KEYWORDS,
+     Aligner_score__doc__
+    },
     {"align",
      (PyCFunction)Aligner_align,
      METH_VARARGS | METH_KEYWORDS,
      Aligner_align__doc__
     },
+    {"__reduce__",
+     (PyCFunction)Aligner_reduce,
+     METH_NOARGS,
+     Aligner_reduce__doc__
+    },
+    {"__setstate__",
+     (PyCFunction)Aligner_setstate,
+     METH_VARARGS,
+     Aligner_setstate__doc__
+    },
+    {"to_bytes",
+     (PyCFunction)Aligner_to_bytes,
+     METH_NOARGS,
+     Aligner_to_bytes__doc__
+    },
+    {"align_best",
+     (PyCFunction)Aligner_align_best,
+     METH_VARARGS | METH_KEYWORDS,
+     Aligner_align_best__doc__
+    },
+    {"score_many",
+     (PyCFunction)Aligner_score_many,
+     METH_VARARGS | METH_KEYWORDS,
+     Aligner_score_many__doc__
+    },
+    {"score_pairs",
+     (PyCFunction)Aligner_score_pairs,
+     METH_VARARGS | METH_KEYWORDS,
+     Aligner_score_pairs__doc__
+    },
+    {"score_all_pairs",
+     (PyCFunction)Aligner_score_all_pairs,
+     METH_VARARGS | METH_KEYWORDS,
+     Aligner_score_all_pairs__doc__
+    },
+    {"search",
+     (PyCFunction)Aligner_search,
+     METH_VARARGS | METH_KEYWORDS,
+     Aligner_search__doc__
+    },
     {NULL}  /* Sentinel */
 };
 
@@ -6288,6 +11385,10 @@ init_aligners(void)
 
   AlignerType.tp_new = PyType_GenericNew;
 
+#ifdef HAVE_PTHREADS
+  pthread_atfork(NULL, NULL, _parallel_reset_after_fork);
+#endif
+
   if (PyType_Ready(&AlignerType) < 0
    || PyType_Ready(&PathGenerator_Type) < 0)
 #if PY_MAJOR_VERSION >= 3
@@ -12,6 +12,8 @@
  */
 
 #include "Python.h"
+#include <math.h>
+#include <string.h>
 
 
 #define _PRECISION 1000
@@ -32,21 +34,168 @@ static double calc_affine_penalty(int length, double open, double extend,
     return penalty;
 }
 
+/* Scores of a dictionary_match for pairs of ASCII letters. A pair that is
+ * missing (or whose score is not a number) is left to the Python match
+ * function, so that it raises the same exception as before.
+ */
+#define PAIR_MISSING 0
+#define PAIR_SCORED 1
+#define PAIR_UNSCORED 2
+
+typedef struct {
+    double score[128][128];
+    unsigned char defined[128][128];
+} MatchTable;
+
+/* Return the ASCII code of a single-letter string, or -1 otherwise. */
+static int _get_letter(PyObject *py_letter)
+{
+    int letter = -1;
+#if PY_MAJOR_VERSION >= 3
+    if(PyUnicode_Check(py_letter) && PyUnicode_READY(py_letter) == 0
+    && PyUnicode_GET_LENGTH(py_letter) == 1)
+        letter = PyUnicode_READ_CHAR(py_letter, 0);
+#else
+    if(PyString_Check(py_letter) && PyString_GET_SIZE(py_letter) == 1)
+        letter = (unsigned char)PyString_AS_STRING(py_letter)[0];
+#endif
+    if(letter >= 128)
+        letter = -1;
+    return letter;
+}
+
+/* Return 1 if py_match_fn is called through dictionary_match.__call__,
+ * i.e. it is a dictionary_match or a subclass that does not override
+ * __call__, and 0 otherwise.
+ */
+static int _is_dictionary_match(PyObject *py_match_fn)
+{
+    PyObject *py_module = NULL, *py_class = NULL;
+    PyObject *py_call = NULL, *py_class_call = NULL;
+    int result = 0;
+
+    if(!(py_module = PyImport_ImportModule("Bio.pairwise2")))
+        goto _cleanup_is_dictionary_match;
+    if(!(py_class = PyObject_GetAttrString(py_module, "dictionary_match")))
+        goto _cleanup_is_dictionary_match;
+    if(!PyObject_TypeCheck(py_match_fn, (PyTypeObject *)py_class))
+        goto _cleanup_is_dictionary_match;
+    if(!(py_call = PyObject_GetAttrString(py_class, "__call__")))
+        goto _cleanup_is_dictionary_match;
+    if(!(py_class_call = PyObject_GetAttrString((PyObject *)Py_TYPE(py_match_fn),
+                                                "__call__")))
+        goto _cleanup_is_dictionary_match;
+    result = (py_call == py_class_call);
+
+ _cleanup_is_dictionary_match:
+    if(PyErr_Occurred())
+        PyErr_Clear();
+    Py_XDECREF(py_module);
+    Py_XDECREF(py_class);
+    Py_XDECREF(py_call);
+    Py_XDECREF(py_class_call);
+    return result;
+}
+
+/* Optimize for dictionary_match. If py_match_fn is scored by
+ * dictionary_match.__call__ and its score_dict attribute is a plain
+ * dictionary, copy the scores of all single-letter pairs into a MatchTable.
+ * Returns NULL (without an exception set) if py_match_fn cannot be handled
+ * this way.
+ */
+static MatchTable *_create_match_table(PyObject *py_match_fn)
+{
+    PyObject *py_score_dict = NULL, *py_symmetric = NULL;
+    PyObject *py_key, *py_value;
+    Py_ssize_t pos = 0;
+    PyMappingMethods *mapping;
+    MatchTable *table = NULL;
+    int symmetric;
+    int a, b;
+    double score;
+
+    if(!_is_dictionary_match(py_match_fn))
+        return NULL;
+    if(!(py_score_dict = PyObject_GetAttrString(py_match_fn, "score_dict")))
+        goto _cleanup_create_match_table;
+    if(!PyDict_Check(py_score_dict))
+        goto _cleanup_create_match_table;
+    /* Subclasses of dict are fine, as long as they look up keys as usual. */
+    mapping = Py_TYPE(py_score_dict)->tp_as_mapping;
+    if(!mapping
+    || mapping->mp_subscript != PyDict_Type.tp_as_mapping->mp_subscript
+    || Py_TYPE(py_score_dict)->tp_as_sequence->sq_contains
+       != PyDict_Type.tp_as_sequence->sq_contains)
+        goto _cleanup_create_match_table;
+    if(!(py_symmetric = PyObject_GetAttrString(py_match_fn, "symmetric")))
+        goto _cleanup_create_match_table;
+    symmetric = PyObject_IsTrue(py_symmetric);
+    if(symmetric < 0)
+        goto _cleanup_create_match_table;
+    if(!(table = malloc(sizeof(MatchTable))))
+        goto _cleanup_create_match_table;
+    memset(table->defined, PAIR_MISSING, sizeof(table->defined));
+
+    while(PyDict_Next(py_score_dict, &pos, &py_key, &py_value)) {
+        if(!PyTuple_Check(py_key) || PyTuple_GET_SIZE(py_key) != 2)
+            continue;
+        a = _get_letter(PyTuple_GET_ITEM(py_key, 0));
+        b = _get_letter(PyTuple_GET_ITEM(py_key, 1));
+        if(a < 0 || b < 0)
+            continue;
+        score = PyFloat_AsDouble(py_value);
+        if(score==-1.0 && PyErr_Occurred()) {
+            PyErr_Clear();
+            table->defined[a][b] = PAIR_UNSCORED;
+            continue;
+        }
+        table->score[a][b] = score;
+        table->defined[a][b] = PAIR_SCORED;
+    }
+    /* A symmetric dictionary_match looks up a missing pair the other way
+       round. */
+    if(symmetric) {
+        for(a=0; a<128; a++) {
+            for(b=0; b<128; b++) {
+                if(table->defined[a][b] == PAIR_MISSING
+                && table->defined[b][a] == PAIR_SCORED) {
+                    table->score[a][b] = table->score[b][a];
+                    table->defined[a][b] = PAIR_SCORED;
+                }
+            }
+        }
+    }
+
+ _cleanup_create_match_table:
+    if(PyErr_Occurred())
+        PyErr_Clear();
+    Py_XDECREF(py_score_dict);
+    Py_XDECREF(py_symmetric);
+    return table;
+}
+
 static double _get_match_score(PyObject *py_sequenceA, PyObject *py_sequenceB,
                                PyObject *py_match_fn, int i, int j,
                                char *sequenceA, char *sequenceB,
                                int use_sequence_cstring,
                                double match, double mismatch,
-                               int use_match_mismatch_scores)
+                               int use_match_mismatch_scores,
+                               const MatchTable *match_table)
 {
     PyObject *py_A=NULL, *py_B=NULL;
     PyObject *py_arglist=NULL, *py_result=NULL;
-    double score = 0;
+    double score = -1.0;
 
     if(use_sequence_cstring && use_match_mismatch_scores) {
         score = (sequenceA[i] == sequenceB[j]) ? match : mismatch;
         return score;
     }
+    if(use_sequence_cstring && match_table) {
+        unsigned char a = sequenceA[i];
+        unsigned char b = sequenceB[j];
+        if(a < 128 && b < 128 && match_table->defined[a][b] == PAIR_SCORED)
+            return match_table->score[a][b];
+    }
     /* Calculate the match score. */
     if(!(py_A = PySequence_GetItem(py_sequenceA, i)))
         goto _get_match_score_cleanup;
@@ -94,9 +243,53 @@ static PyObject* _create_bytes_object(PyObject* o)
 }
 #endif
 
+/* array.array, used to store the score and trace matrices row by row. */
+static PyObject *py_array_type = NULL;
+
+/* Create a row of the score or trace matrix as an array.array holding n
+ * copies of unit, and store a pointer to its data in *data.  The array is
+ * never resized, so the pointer remains valid for the lifetime of the row.
+ */
+static PyObject *_create_row(PyObject *unit, Py_ssize_t n, void **data)
+{
+    PyObject *row;
+#if PY_MAJOR_VERSION >= 3
+    Py_buffer view;
+#else
+    Py_ssize_t length;
+#endif
+
+    if(!(row = PySequence_Repeat(unit, n)))
+        return NULL;
+#if PY_MAJOR_VERSION >= 3
+    if(PyObject_GetBuffer(row, &view, PyBUF_WRITABLE) < 0) {
+        Py_DECREF(row);
+        return NULL;
+    }
+    *data = view.buf;
+    PyBuffer_Release(&view);
+#else
+    if(PyObject_AsWriteBuffer(row, data, &length) < 0) {
+        Py_DECREF(row);
+        return NULL;
+    }
+#endif
+    return row;
+}
+
 /* This function is a more-or-less straightforward port of the
  * equivalent function in pairwise2. Please see there for algorithm
  * documentation.
+ *
+ * The score and trace matrices are returned as lists of array.array rows
+ * (of type 'd' and 'B', respectively), which are filled in place. The trace
+ * is 0 on the edges of the matrix. If only the score is requested, just two
+ * rows of the score matrix are kept, and empty lists are returned instead.
+ *
+ * If band is not negative (which is only allowed if only the score is
+ * requested), only the cells (row, col) with
+ * min(0, lenB-lenA) - band <= col - row <= max(0, lenB-lenA) + band
+ * are calculated; all other cells are treated as unreachable.
  */
 static PyObject *cpairwise2__make_score_matrix_fast(PyObject *self,
                                                     PyObject *args)
@@ -112,6 +305,8 @@ static PyObject *cpairwise2__make_score_matrix_fast(PyObject *self,
     double open_A, extend_A, open_B, extend_B;
     int penalize_extend_when_opening, penalize_end_gaps_A, penalize_end_gaps_B;
     int align_globally, score_only;
+    int band = -1;
+    int lower, upper, start, end;
 
     PyObject *py_match=NULL, *py_mismatch=NULL;
     double first_A_gap, first_B_gap;
@@ -120,20 +315,29 @@ static PyObject *cpairwise2__make_score_matrix_fast(PyObject *self,
     double best_score = 0;
     double local_max_score = 0;
     int use_match_mismatch_scores;
+    MatchTable *match_table = NULL;
     int lenA, lenB;
-    double *score_matrix = NULL;
-    unsigned char *trace_matrix = NULL;
+    double **score_matrix = NULL;
+    double *score_rows = NULL;
+    double *previous, *current;
+    unsigned char **trace_matrix = NULL;
     PyObject *py_score_matrix=NULL, *py_trace_matrix=NULL;
+    PyObject *py_score_unit=NULL, *py_trace_unit=NULL;
 
     double *col_cache_score = NULL;
     PyObject *py_retval = NULL;
 
-    if(!PyArg_ParseTuple(args, "OOOddddi(ii)ii", &py_sequenceA, &py_sequenceB,
+    if(!PyArg_ParseTuple(args, "OOOddddi(ii)ii|i", &py_sequenceA, &py_sequenceB,
                          &py_match_fn, &open_A, &extend_A, &open_B, &extend_B,
                          &penalize_extend_when_opening,
                          &penalize_end_gaps_A, &penalize_end_gaps_B,
-                         &align_globally, &score_only))
+                         &align_globally, &score_only, &band))
         return NULL;
+    if(band >= 0 && !score_only) {
+        PyErr_SetString(PyExc_ValueError,
+                        "a band can only be used if score_only is true.");
+        return NULL;
+    }
     if(!PySequence_Check(py_sequenceA) || !PySequence_Check(py_sequenceB)) {
         PyErr_SetString(PyExc_TypeError,
                         "py_sequenceA and py_sequenceB should be sequences.");
@@ -195,70 +399,133 @@ static PyObject *cpairwise2__make_score_matrix_fast(PyObject *self,
     if(py_mismatch) {
         Py_DECREF(py_mismatch);
     }
+    if(use_sequence_cstring && !use_match_mismatch_scores)
+        match_table = _create_match_table(py_match_fn);
     /* Cache some commonly used gap penalties */
     first_A_gap = calc_affine_penalty(1, open_A, extend_A,
                                       penalize_extend_when_opening);
     first_B_gap = calc_affine_penalty(1, open_B, extend_B,
                                       penalize_extend_when_opening);
 
-    /* Allocate matrices for storing the results and initialize first row and col. */
+    /* Allocate matrices for storing the results. */
     lenA = PySequence_Length(py_sequenceA);
     lenB = PySequence_Length(py_sequenceB);
-    score_matrix = malloc((lenA+1)*(lenB+1)*sizeof(*score_matrix));
-    if(!score_matrix) {
-        PyErr_SetString(PyExc_MemoryError, "Out of memory");
-        goto _cleanup_make_score_matrix_fast;
+    if (score_only) {
+        /* We only need the previous row to calculate the next one. */
+        score_rows = malloc(2*(lenB+1)*sizeof(*score_rows));
+        if(!score_rows) {
+            PyErr_SetString(PyExc_MemoryError, "Out of memory");
+            goto _cleanup_make_score_matrix_fast;
+        }
+        if(!(py_score_matrix = PyList_New(0)))
+            goto _cleanup_make_score_matrix_fast;
+        if(!(py_trace_matrix = PyList_New(0)))
+            goto _cleanup_make_score_matrix_fast;
     }
-    for(i=0; i<(lenB+1); i++)
-        score_matrix[i] = 0;
-    for(i=0; i<(lenA+1)*(lenB+1); i += (lenB+1))
-        score_matrix[i] = 0;
-    /* If we only want the score, we don't need the trace matrix. */
-    if (!score_only){
-        trace_matrix = malloc((lenA+1)*(lenB+1)*sizeof(*trace_matrix));
+    else {
+        score_matrix = malloc((lenA+1)*sizeof(*score_matrix));
+        if(!score_matrix) {
+            PyErr_SetString(PyExc_MemoryError, "Out of memory");
+            goto _cleanup_make_score_matrix_fast;
+        }
+        trace_matrix = malloc((lenA+1)*sizeof(*trace_matrix));
         if(!trace_matrix) {
             PyErr_SetString(PyExc_MemoryError, "Out of memory");
             goto _cleanup_make_score_matrix_fast;
         }
-        for(i=0; i<(lenB+1); i++)
-            trace_matrix[i] = 0;
-        for(i=0; i<(lenA+1)*(lenB+1); i += (lenB+1))
-            trace_matrix[i] = 0;
+        if(!(py_score_unit = PyObject_CallFunction(py_array_type, "s[d]",
+                                                   "d", 0.0)))
+            goto _cleanup_make_score_matrix_fast;
+        if(!(py_trace_unit = PyObject_CallFunction(py_array_type, "s[i]",
+                                                   "B", 0)))
+            goto _cleanup_make_score_matrix_fast;
+        if(!(py_score_matrix = PyList_New(lenA+1)))
+            goto _cleanup_make_score_matrix_fast;
+        if(!(py_trace_matrix = PyList_New(lenA+1)))
+            goto _cleanup_make_score_matrix_fast;
+        for(row=0; row<=lenA; row++) {
+            PyObject *py_score_row, *py_trace_row;
+            if(!(py_score_row = _create_row(py_score_unit, lenB+1,
+                                            (void**)&score_matrix[row])))
+                goto _cleanup_make_score_matrix_fast;
+            PyList_SET_ITEM(py_score_matrix, row, py_score_row);
+            if(!(py_trace_row = _create_row(py_trace_unit, lenB+1,
+                                            (void**)&trace_matrix[row])))
+                goto _cleanup_make_score_matrix_fast;
+            PyList_SET_ITEM(py_trace_matrix, row, py_trace_row);
         }
-    else
-        trace_matrix = malloc(1);
+    }
 
-    /* Initialize the first row and col of the score matrix. */
-    for(i=0; i<=lenA; i++) {
-        if(penalize_end_gaps_B)
-            score = calc_affine_penalty(i, open_B, extend_B,
-                                        penalize_extend_when_opening);
-        else
-            score = 0;
-        score_matrix[i*(lenB+1)] = score;
+    /* The diagonals col - row that are calculated. Without a band, these
+       are all diagonals of the matrix. */
+    if (band >= 0) {
+        lower = (lenB < lenA) ? lenB - lenA - band : -band;
+        upper = (lenB > lenA) ? lenB - lenA + band : band;
+    }
+    else {
+        lower = -lenA;
+        upper = lenB;
     }
+
+    /* Initialize the first row of the score matrix. The first column is
+       initialized row by row while filling in the matrix. */
+    current = score_only ? score_rows : score_matrix[0];
     for(i=0; i<=lenB; i++) {
-        if(penalize_end_gaps_A)
+        if(i > upper)
+            score = -Py_HUGE_VAL;
+        else if(penalize_end_gaps_A)
             score = calc_affine_penalty(i, open_A, extend_A,
                                         penalize_extend_when_opening);
         else
             score = 0;
-        score_matrix[i] = score;
+        current[i] = score;
     }
 
     /* Now initialize the col cache. */
     col_cache_score = malloc((lenB+1)*sizeof(*col_cache_score));
-    memset((void *)col_cache_score, 0, (lenB+1)*sizeof(*col_cache_score));
+    if(!col_cache_score) {
+        PyErr_SetString(PyExc_MemoryError, "Out of memory");
+        goto _cleanup_make_score_matrix_fast;
+    }
     for(i=0; i<=lenB; i++) {
-        col_cache_score[i] = calc_affine_penalty(i, (2*open_B), extend_B,
-                             penalize_extend_when_opening);
+        if(i > upper)
+            col_cache_score[i] = -Py_HUGE_VAL;
+        else
+            col_cache_score[i] = calc_affine_penalty(i, (2*open_B), extend_B,
+                                 penalize_extend_when_opening);
     }
 
     /* Fill in the score matrix. The row cache is calculated on the fly.*/
     for(row=1; row<=lenA; row++) {
-        double row_cache_score = calc_affine_penalty(row, (2*open_A), extend_A,
-                                 penalize_extend_when_opening);
-        for(col=1; col<=lenB; col++) {
+        double row_cache_score;
+        if (score_only) {
+            previous = score_rows + ((row-1)%2)*(lenB+1);
+            current = score_rows + (row%2)*(lenB+1);
+        }
+        else {
+            previous = score_matrix[row-1];
+            current = score_matrix[row];
+        }
+        start = (row+lower > 1) ? row+lower : 1;
+        end = (row+upper < lenB) ? row+upper : lenB;
+        if(row+lower > 0) {
+            /* The first column is outside the band. */
+            row_cache_score = -Py_HUGE_VAL;
+            current[start-1] = -Py_HUGE_VAL;
+        }
+        else {
+            row_cache_score = calc_affine_penalty(row, (2*open_A), extend_A,
+                              penalize_extend_when_opening);
+            if(penalize_end_gaps_B)
+                current[0] = calc_affine_penalty(row, open_B, extend_B,
+                             penalize_extend_when_opening);
+            else
+                current[0] = 0;
+        }
+        /* This cell is read when calculating the next row. */
+        if(end < lenB)
+            current[end+1] = -Py_HUGE_VAL;
+        for(col=start; col<=end; col++) {
             double match_score, nogap_score;
             double row_open, row_extend, col_open, col_extend;
             int best_score_rint, row_score_rint, col_score_rint;
@@ -270,27 +537,28 @@ static PyObject *cpairwise2__make_score_matrix_fast(PyObject *self,
                                            sequenceA, sequenceB,
                                            use_sequence_cstring,
                                            match, mismatch,
-                                           use_match_mismatch_scores);
+                                           use_match_mismatch_scores,
+                                           match_table);
             if(match_score==-1.0 && PyErr_Occurred())
                 goto _cleanup_make_score_matrix_fast;
-            nogap_score = score_matrix[(row-1)*(lenB+1)+col-1] + match_score;
+            nogap_score = previous[col-1] + match_score;
 
             if (!penalize_end_gaps_A && row==lenA) {
-                row_open = score_matrix[(row)*(lenB+1)+col-1];
+                row_open = current[col-1];
                 row_extend = row_cache_score;
             }
             else {
-                row_open = score_matrix[(row)*(lenB+1)+col-1] + first_A_gap;
+                row_open = current[col-1] + first_A_gap;
                 row_extend = row_cache_score + extend_A;
             }
             row_cache_score = (row_open > row_extend) ? row_open : row_extend;
 
             if (!penalize_end_gaps_B && col==lenB){
-                col_open = score_matrix[(row-1)*(lenB+1)+col];
+                col_open = previous[col];
                 col_extend = col_cache_score[col];
             }
             else {
-                col_open = score_matrix[(row-1)*(lenB+1)+col] + first_B_gap;
+                col_open = previous[col] + first_B_gap;
                 col_extend = col_cache_score[col] + extend_B;
             }
             col_cache_score[col] = (col_open > col_extend) ? col_open : col_extend;
@@ -303,9 +571,9 @@ static PyObject *cpairwise2__make_score_matrix_fast(PyObject *self,
                 local_max_score = best_score;
 
             if(!align_globally && best_score < 0)
-                score_matrix[row*(lenB+1)+col] = 0;
+                current[col] = 0;
             else
-                score_matrix[row*(lenB+1)+col] = best_score;
+                current[col] = best_score;
 
             if (!score_only) {
                 row_score_rint = rint(row_cache_score);
@@ -329,7 +597,7 @@ static PyObject *cpairwise2__make_score_matrix_fast(PyObject *self,
                     trace_score += row_trace_score;
                 if (col_score_rint == best_score_rint)
                     trace_score += col_trace_score;
-                trace_matrix[row*(lenB+1)+col] = trace_score;
+                trace_matrix[row][col] = trace_score;
             }
         }
     }
@@ -337,62 +605,21 @@ static PyObject *cpairwise2__make_score_matrix_fast(PyObject *self,
     if (!align_globally)
         best_score = local_max_score;
 
-    /* Save the score and traceback matrices into real python objects. */
-	if(!score_only) {
-		if(!(py_score_matrix = PyList_New(lenA+1)))
-			goto _cleanup_make_score_matrix_fast;
-		if(!(py_trace_matrix = PyList_New(lenA+1)))
-			goto _cleanup_make_score_matrix_fast;
-
-		for(row=0; row<=lenA; row++) {
-			PyObject *py_score_row, *py_trace_row;
-			if(!(py_score_row = PyList_New(lenB+1)))
-				goto _cleanup_make_score_matrix_fast;
-			PyList_SET_ITEM(py_score_matrix, row, py_score_row);
-			if(!(py_trace_row = PyList_New(lenB+1)))
-				goto _cleanup_make_score_matrix_fast;
-			PyList_SET_ITEM(py_trace_matrix, row, py_trace_row);
-
-			for(col=0; col<=lenB; col++) {
-				PyObject *py_score, *py_trace;
-				int offset = row*(lenB+1) + col;
-
-				/* Set py_score_matrix[row][col] to the score. */
-				if(!(py_score = PyFloat_FromDouble(score_matrix[offset])))
-					goto _cleanup_make_score_matrix_fast;
-				PyList_SET_ITEM(py_score_row, col, py_score);
-
-				/* Set py_trace_matrix[row][col] to a list of indexes.  On
-				   the edges of the matrix (row or column is 0), the
-				   matrix should be [None]. */
-				if(!row || !col) {
-					if(!(py_trace = Py_BuildValue("B", 1)))
-						goto _cleanup_make_score_matrix_fast;
-					Py_INCREF(Py_None);
-					PyList_SET_ITEM(py_trace_row, col, Py_None);
-				}
-				else {
-					if(!(py_trace = Py_BuildValue("B", trace_matrix[offset])))
-						goto _cleanup_make_score_matrix_fast;
-					PyList_SET_ITEM(py_trace_row, col, py_trace);
-
-				}
-			}
-		}
-	}
-	else {
-		py_score_matrix = PyList_New(1);
-		py_trace_matrix = PyList_New(1);
-	}
     py_retval = Py_BuildValue("(OOd)", py_score_matrix, py_trace_matrix, best_score);
 
  _cleanup_make_score_matrix_fast:
+    if(match_table)
+        free(match_table);
     if(score_matrix)
         free(score_matrix);
+    if(score_rows)
+        free(score_rows);
     if(trace_matrix)
         free(trace_matrix);
     if(col_cache_score)
         free(col_cache_score);
+    Py_XDECREF(py_score_unit);
+    Py_XDECREF(py_trace_unit);
     if(py_score_matrix){
         Py_DECREF(py_score_matrix);
     }
@@ -408,6 +635,121 @@ static PyObject *cpairwise2__make_score_matrix_fast(PyObject *self,
     return py_retval;
 }
 
+/* Return a pointer to the scores in a row of the score matrix, if the row
+ * is a buffer of ncols doubles (as created by _make_score_matrix_fast), or
+ * NULL otherwise.
+ */
+static const double *_get_score_row(PyObject *py_row, Py_ssize_t ncols)
+{
+    const void *data = NULL;
+#if PY_MAJOR_VERSION >= 3
+    Py_buffer view;
+
+    if(!PyObject_CheckBuffer(py_row))
+        return NULL;
+    if(PyObject_GetBuffer(py_row, &view, PyBUF_FORMAT) < 0) {
+        PyErr_Clear();
+        return NULL;
+    }
+    if(view.format && strcmp(view.format, "d") == 0
+    && view.len == ncols * (Py_ssize_t)sizeof(double))
+        data = view.buf;
+    PyBuffer_Release(&view);
+#else
+    Py_ssize_t length;
+
+    if(PyList_Check(py_row) || PyTuple_Check(py_row))
+        return NULL;
+    if(PyObject_AsReadBuffer(py_row, &data, &length) < 0) {
+        PyErr_Clear();
+        return NULL;
+    }
+    if(length != ncols * (Py_ssize_t)sizeof(double))
+        data = NULL;
+#endif
+    return data;
+}
+
+/* This function is equivalent to _find_start in pairwise2, but scans the
+ * score matrix without creating a Python float for every element.
+ */
+static PyObject *cpairwise2__find_start(PyObject *self, PyObject *args)
+{
+    PyObject *py_score_matrix, *py_best_score;
+    PyObject *py_row = NULL, *py_score = NULL, *py_start;
+    PyObject *py_starts = NULL;
+    int align_globally;
+    double best_score;
+    Py_ssize_t nrows, ncols, row, col;
+
+    if(!PyArg_ParseTuple(args, "OOi", &py_score_matrix, &py_best_score,
+                         &align_globally))
+        return NULL;
+    nrows = PySequence_Length(py_score_matrix);
+    if(nrows < 0)
+        return NULL;
+    if(!(py_row = PySequence_GetItem(py_score_matrix, 0)))
+        return NULL;
+    ncols = PySequence_Length(py_row);
+    Py_DECREF(py_row);
+    py_row = NULL;
+    if(ncols < 0)
+        return NULL;
+
+    /* In this implementation of the global algorithm, the start will always
+       be the bottom right corner of the matrix. */
+    if(align_globally)
+        return Py_BuildValue("[(O(nn))]", py_best_score, nrows-1, ncols-1);
+
+    best_score = PyFloat_AsDouble(py_best_score);
+    if(best_score==-1.0 && PyErr_Occurred())
+        return NULL;
+    if(!(py_starts = PyList_New(0)))
+        return NULL;
+    for(row=0; row<nrows; row++) {
+        const double *scores;
+        if(!(py_row = PySequence_GetItem(py_score_matrix, row)))
+            goto _cleanup_find_start;
+        scores = _get_score_row(py_row, ncols);
+        for(col=0; col<ncols; col++) {
+            double score;
+            if(scores)
+                score = scores[col];
+            else {
+                if(!(py_score = PySequence_GetItem(py_row, col)))
+                    goto _cleanup_find_start;
+                score = PyFloat_AsDouble(py_score);
+                if(score==-1.0 && PyErr_Occurred())
+                    goto _cleanup_find_start;
+            }
+            /* Same as rint(abs(score - best_score)) <= rint(0). */
+            if(fabs(score - best_score) * _PRECISION + 0.5 < 1.0) {
+                if(!py_score && !(py_score = PyFloat_FromDouble(score)))
+                    goto _cleanup_find_start;
+                py_start = Py_BuildValue("(O(nn))", py_score, row, col);
+                if(!py_start)
+                    goto _cleanup_find_start;
+                if(PyList_Append(py_starts, py_start) < 0) {
+                    Py_DECREF(py_start);
+                    goto _cleanup_find_start;
+                }
+                Py_DECREF(py_start);
+            }
+            Py_XDECREF(py_score);
+            py_score = NULL;
+        }
+        Py_DECREF(py_row);
+        py_row = NULL;
+    }
+    return py_starts;
+
+ _cleanup_find_start:
+    Py_XDECREF(py_score);
+    Py_XDECREF(py_row);
+    Py_DECREF(py_starts);
+    return NULL;
+}
+
 static PyObject *cpairwise2_rint(PyObject *self, PyObject *args,
                                  PyObject *keywds)
 {
@@ -433,6 +775,8 @@ static PyObject *cpairwise2_rint(PyObject *self, PyObject *args,
 static PyMethodDef cpairwise2Methods[] = {
     {"_make_score_matrix_fast",
      (PyCFunction)cpairwise2__make_score_matrix_fast, METH_VARARGS, ""},
+    {"_find_start",
+     (PyCFunction)cpairwise2__find_start, METH_VARARGS, ""},
     {"rint", (PyCFunction)cpairwise2_rint, METH_VARARGS|METH_KEYWORDS, ""},
     {NULL, NULL, 0, NULL}
 };
@@ -467,8 +811,24 @@ initcpairwise2(void)
 #endif
 
 {
+    PyObject* array_module;
+#if PY_MAJOR_VERSION >= 3
+    PyObject* module;
+#endif
+
+    array_module = PyImport_ImportModule("array");
+    if (array_module) {
+        py_array_type = PyObject_GetAttrString(array_module, "array");
+        Py_DECREF(array_module);
+    }
+    if (py_array_type==NULL)
+#if PY_MAJOR_VERSION >= 3
+        return NULL;
+#else
+        return;
+#endif
 #if PY_MAJOR_VERSION >= 3
-    PyObject* module = PyModule_Create(&moduledef);
+    module = PyModule_Create(&moduledef);
     if (module==NULL) return NULL;
     return module;
 #else
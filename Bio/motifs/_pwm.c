@@ -1,50 +1,166 @@
+#define PY_SSIZE_T_CLEAN
 #include <Python.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+
+/* Code of each letter: 0, 1, 2, 3 for A, C, G, T (in either case), and 4
+ * for any other letter.  Handling mixed case input here rather than
+ * converting it to uppercase in Python code first, since doing so could use
+ * too much memory if sequence is too long (e.g. chromosome or plasmid). */
+static unsigned char letter_codes[256];
+
+/* A stretch of the sequence, encoded once for all columns of all motifs. */
+typedef struct {
+    unsigned char* codes;   /* letter codes, padded with k-1 zeros */
+    unsigned char* kmers;   /* the k letters starting at each position,
+                               using two bits per letter */
+    Py_ssize_t* next_bad;   /* index of the first unknown letter at or after
+                               each position */
+} Block;
+
+static int
+block_init(Block* block, Py_ssize_t size, int k)
+{
+    block->codes = malloc(size + k - 1);
+    block->kmers = malloc(size);
+    block->next_bad = malloc(size * sizeof(Py_ssize_t));
+    if (!block->codes || !block->kmers || !block->next_bad) return -1;
+    return 0;
+}
 
 static void
-calculate(const char sequence[], int s, Py_ssize_t m, double* matrix,
-          Py_ssize_t n, float* scores)
+block_free(Block* block)
 {
-    Py_ssize_t i, j;
-    char c;
+    if (block->codes) free(block->codes);
+    if (block->kmers) free(block->kmers);
+    if (block->next_bad) free(block->next_bad);
+}
+
+static void
+block_encode(Block* block, const char sequence[], Py_ssize_t length, int k)
+{
+    Py_ssize_t i, bad;
+    unsigned int kmer = 0;
+    const unsigned int mask = (1U << (2 * k)) - 1;
+    unsigned char* codes = block->codes;
+    for (i = 0; i < length; i++)
+        codes[i] = letter_codes[(unsigned char)sequence[i]];
+    for (i = 0; i < k - 1; i++) codes[length+i] = 0;
+    bad = length;
+    for (i = length - 1; i >= 0; i--) {
+        if (codes[i] == 4) bad = i;
+        block->next_bad[i] = bad;
+    }
+    /* Unknown letters are encoded as A here; the windows containing them
+     * are skipped using next_bad. */
+    for (i = 0; i < length + k - 1; i++) {
+        kmer = ((kmer << 2) | (codes[i] & 3)) & mask;
+        if (i >= k - 1) block->kmers[i-k+1] = kmer;
+    }
+}
+
+/* Create lookup tables for the m x 4 scores of a motif, one for each group
+ * of k consecutive columns, holding the summed score of the group for each
+ * k-mer.  Letters beyond the last column of the motif are ignored. */
+static double*
+create_tables(const double* matrix, Py_ssize_t m, int k)
+{
+    Py_ssize_t g, j;
+    int r, kmer;
     double score;
-    int ok;
-    float* p = scores;
+    const Py_ssize_t ngroups = (m + k - 1) / k;
+    const int size = 1 << (2 * k);
+    double* tables = malloc((ngroups ? ngroups : 1) * size * sizeof(double));
+    if (!tables) return NULL;
+    for (g = 0; g < ngroups; g++) {
+        for (kmer = 0; kmer < size; kmer++) {
+            score = 0.0;
+            for (r = 0; r < k; r++) {
+                j = g * k + r;
+                if (j == m) break;
+                score += matrix[4*j+((kmer >> (2*(k-1-r))) & 3)];
+            }
+            tables[g*size+kmer] = score;
+        }
+    }
+    return tables;
+}
+
+/* Calculate the scores of count consecutive windows, using the letter
+ * codes of the block.  The columns of the motif are added one by one, in
+ * the same order for each window as in the column-by-column sum, so that
+ * the scores are identical, also after rounding them to float32. */
+static void
+add_scores(const double* matrix, Py_ssize_t m, const unsigned char* codes,
+           Py_ssize_t count, double* scores)
+{
+    Py_ssize_t i, j;
+    const double* column;
+    const unsigned char* p;
+    for (i = 0; i < count; i++) scores[i] = 0.0;
+    for (j = 0; j < m; j++) {
+        column = matrix + 4 * j;
+        p = codes + j;
+        i = 0;
+#ifdef HAVE_SSE2
+        for ( ; i + 2 <= count; i += 2) {
+            __m128d v = _mm_loadu_pd(scores + i);
+            v = _mm_add_pd(v, _mm_set_pd(column[p[i+1] & 3],
+                                         column[p[i] & 3]));
+            _mm_storeu_pd(scores + i, v);
+        }
+#endif
+        for ( ; i < count; i++) scores[i] += column[p[i] & 3];
+    }
+}
+
+/* Number of windows scored at a time by calculate. */
+#define CALCULATE_BLOCK 4096
+
+/* Calculate the scores of all n windows of the sequence.  The sequence is
+ * encoded block by block, and the scores of all windows of a block are
+ * accumulated column by column.  Returns 0 if successful, and -1 if we ran
+ * out of memory.  This function does not need the GIL. */
+static int
+calculate(const char sequence[], Py_ssize_t s, Py_ssize_t m, double* matrix,
+          Py_ssize_t n, float* scores)
+{
+    const int k = 4;
+    Py_ssize_t start, count, i;
+    int result = -1;
     float nan = 0.0;
+    double* buffer = NULL;
+    Block block = {NULL, NULL, NULL};
     nan /= nan;
-    for (i = 0; i < n; i++)
-    {
-        score = 0.0;
-        ok = 1;
-        for (j = 0; j < m; j++)
-        {
-            c = sequence[i+j];
-            switch (c)
-            {
-              /* Handling mixed case input here rather than converting it to
-                 uppercase in Python code first, since doing so could use too
-                 much memory if sequence is too long (e.g. chromosome or
-                 plasmid). */
-                case 'A':
-                case 'a':
-                    score += matrix[j*4+0]; break;
-                case 'C':
-                case 'c':
-                    score += matrix[j*4+1]; break;
-                case 'G':
-                case 'g':
-                    score += matrix[j*4+2]; break;
-                case 'T':
-                case 't':
-                    score += matrix[j*4+3]; break;
-                default:
-                    ok = 0;
-            }
+    if (m == 0) {
+        for (i = 0; i < n; i++) scores[i] = 0.0;
+        return 0;
+    }
+    buffer = malloc(CALCULATE_BLOCK * sizeof(double));
+    if (!buffer) goto exit;
+    if (block_init(&block, CALCULATE_BLOCK + m - 1, k) < 0) goto exit;
+    for (start = 0; start < n; start += CALCULATE_BLOCK) {
+        count = n - start;
+        if (count > CALCULATE_BLOCK) count = CALCULATE_BLOCK;
+        block_encode(&block, sequence + start, count + m - 1, k);
+        add_scores(matrix, m, block.codes, count, buffer);
+        for (i = 0; i < count; i++) {
+            if (block.next_bad[i] < i + m) scores[start+i] = nan;
+            else scores[start+i] = (float)buffer[i];
         }
-        if (ok) *p = (float)score;
-        else *p = nan;
-        p++;
     }
+    result = 0;
+exit:
+    if (buffer) free(buffer);
+    block_free(&block);
+    return result;
 }
 
 static int
@@ -134,7 +250,8 @@ py_calculate(PyObject* self, PyObject* args, PyObject* keywords)
     static char* kwlist[] = {"sequence", "matrix", "scores", NULL};
     Py_ssize_t m;
     Py_ssize_t n;
-    int s;
+    Py_ssize_t s;
+    int status;
     PyObject* result = NULL;
     Py_buffer scores;
     Py_buffer matrix;
@@ -152,7 +269,13 @@ py_calculate(PyObject* self, PyObject* args, PyObject* keywords)
                         "size of scores array is inconsistent");
         goto exit;
     }
-    calculate(sequence, s, m, matrix.buf, n, scores.buf);
+    Py_BEGIN_ALLOW_THREADS
+    status = calculate(sequence, s, m, matrix.buf, n, scores.buf);
+    Py_END_ALLOW_THREADS
+    if (status < 0) {
+        PyErr_NoMemory();
+        goto exit;
+    }
     Py_INCREF(Py_None);
     result = Py_None;
 exit:
@@ -161,8 +284,840 @@ exit:
     return result;
 }
 
+/* array.array, used to return the hits found by scan. */
+static PyObject* py_array_type = NULL;
+
+/* Positions are stored as 64-bit integers, so that hits can be reported on
+ * sequences longer than 2 Gb (e.g. complete genomes). */
+#if PY_MAJOR_VERSION >= 3
+typedef long long position_t;
+#define POSITION_TYPECODE "q"
+#else
+typedef long position_t;
+#define POSITION_TYPECODE "l"
+#endif
+
+/* Number of windows scored at a time while scanning.  The motifs are
+ * scored one by one on each block, so that only the lookup tables of one
+ * motif are needed at a time. */
+#define SCAN_BLOCK 2048
+
+/* The lookup tables of one strand of a motif, with the information needed
+ * to abandon windows that cannot reach the threshold. */
+typedef struct {
+    double* tables;     /* one table for each group of k columns */
+    Py_ssize_t* order;  /* the groups, the most informative first */
+    double* bounds;     /* bounds[t] is the highest score attainable from the
+                           groups order[t], order[t+1], ...; bounds[ngroups]
+                           is zero */
+} Profile;
+
+typedef struct {
+    Py_ssize_t m;       /* length of the motif */
+    double* columns;    /* m x 4 scores, in the order A, C, G, T, followed by
+                           the same for the reverse complement */
+    Profile forward;
+    Profile reverse;
+    double threshold;
+} Motif;
+
+/* Create the lookup tables for the m x 4 scores of a motif, and sort the
+ * groups of columns by the difference between their highest and their mean
+ * score.  For a log-odds matrix, this is a measure of the information
+ * content of the columns, and of how much the bound on the score of a window
+ * is expected to drop once the group has been scored. Returns 0 if
+ * successful, and -1 if we ran out of memory. */
+static int
+profile_init(Profile* profile, const double* matrix, Py_ssize_t m, int k)
+{
+    Py_ssize_t g, t, kmer;
+    double high, sum, value;
+    const Py_ssize_t ngroups = (m + k - 1) / k;
+    const Py_ssize_t size = (Py_ssize_t)1 << (2 * k);
+    double* spread;
+    const double* table;
+    profile->order = NULL;
+    profile->bounds = NULL;
+    profile->tables = create_tables(matrix, m, k);
+    if (!profile->tables) return -1;
+    profile->order = malloc(ngroups * sizeof(Py_ssize_t));
+    if (!profile->order) return -1;
+    profile->bounds = malloc((2 * ngroups + 1) * sizeof(double));
+    if (!profile->bounds) return -1;
+    /* Use the end of the bounds array as scratch space. */
+    spread = profile->bounds + ngroups;
+    for (g = 0; g < ngroups; g++) {
+        table = profile->tables + g * size;
+        high = table[0];
+        sum = 0.0;
+        for (kmer = 0; kmer < size; kmer++) {
+            value = table[kmer];
+            if (value > high) high = value;
+            sum += value;
+        }
+        spread[g] = high - sum / size;
+        for (t = g; t > 0 && spread[profile->order[t-1]] < spread[g]; t--)
+            profile->order[t] = profile->order[t-1];
+        profile->order[t] = g;
+    }
+    for (g = 0; g < ngroups; g++) {
+        table = profile->tables + g * size;
+        high = table[0];
+        for (kmer = 1; kmer < size; kmer++)
+            if (table[kmer] > high) high = table[kmer];
+        spread[g] = high;
+    }
+    value = 0.0;
+    for (t = ngroups - 1; t >= 0; t--) {
+        value += spread[profile->order[t]];
+        profile->bounds[t] = value;
+    }
+    profile->bounds[ngroups] = 0.0;
+    return 0;
+}
+
+static void
+profile_free(Profile* profile)
+{
+    if (profile->tables) free(profile->tables);
+    if (profile->order) free(profile->order);
+    if (profile->bounds) free(profile->bounds);
+}
+
+/* Find the windows whose score may exceed the limit.  The groups of columns
+ * are scored in the order of the profile, and a window is abandoned as soon
+ * as its partial score plus the highest score attainable from the remaining
+ * groups falls below the limit.  The indices of the windows that remain are
+ * stored in active, and their number is returned. */
+static Py_ssize_t
+search_windows(const Profile* profile, Py_ssize_t m, int k,
+               const unsigned char* kmers, Py_ssize_t count, double limit,
+               double* scores, Py_ssize_t* active)
+{
+    Py_ssize_t t, g, i, j, nactive = 0, nremaining;
+    double bound;
+    const double* table;
+    const unsigned char* p;
+    const Py_ssize_t ngroups = (m + k - 1) / k;
+    const Py_ssize_t size = (Py_ssize_t)1 << (2 * k);
+    g = profile->order[0];
+    table = profile->tables + g * size;
+    p = kmers + g * k;
+    bound = limit - profile->bounds[1];
+    for (i = 0; i < count; i++) {
+        scores[i] = table[p[i]];
+        active[nactive] = i;
+        nactive += (scores[i] >= bound);
+    }
+    for (t = 1; t < ngroups && nactive > 0; t++) {
+        g = profile->order[t];
+        table = profile->tables + g * size;
+        p = kmers + g * k;
+        bound = limit - profile->bounds[t+1];
+        nremaining = 0;
+        for (j = 0; j < nactive; j++) {
+            i = active[j];
+            scores[i] += table[p[i]];
+            active[nremaining] = i;
+            nremaining += (scores[i] >= bound);
+        }
+        nactive = nremaining;
+    }
+    return nactive;
+}
+
+/* Calculate the score of a single window, adding the columns in the same
+ * order as add_scores. */
+static double
+window_score(const double* matrix, Py_ssize_t m, const unsigned char* codes)
+{
+    Py_ssize_t j;
+    double score = 0.0;
+    for (j = 0; j < m; j++) score += matrix[4*j+codes[j]];
+    return score;
+}
+
+typedef struct {
+    Py_ssize_t size;
+    Py_ssize_t allocated;
+    int* motifs;
+    position_t* positions;
+    signed char* strands;   /* +1 for the forward strand, -1 for the reverse */
+    float* scores;
+} Hits;
+
+static int
+hits_append(Hits* hits, int motif, position_t position, int strand,
+            float score)
+{
+    if (hits->size == hits->allocated) {
+        Py_ssize_t allocated = hits->allocated ? 2 * hits->allocated : 1024;
+        int* motifs;
+        position_t* positions;
+        signed char* strands;
+        float* scores;
+        motifs = realloc(hits->motifs, allocated * sizeof(int));
+        if (!motifs) return -1;
+        hits->motifs = motifs;
+        positions = realloc(hits->positions, allocated * sizeof(position_t));
+        if (!positions) return -1;
+        hits->positions = positions;
+        strands = realloc(hits->strands, allocated * sizeof(signed char));
+        if (!strands) return -1;
+        hits->strands = strands;
+        scores = realloc(hits->scores, allocated * sizeof(float));
+        if (!scores) return -1;
+        hits->scores = scores;
+        hits->allocated = allocated;
+    }
+    hits->motifs[hits->size] = motif;
+    hits->positions[hits->size] = position;
+    hits->strands[hits->size] = (signed char)strand;
+    hits->scores[hits->size] = score;
+    hits->size++;
+    return 0;
+}
+
+static void
+hits_free(Hits* hits)
+{
+    if (hits->motifs) free(hits->motifs);
+    if (hits->positions) free(hits->positions);
+    if (hits->strands) free(hits->strands);
+    if (hits->scores) free(hits->scores);
+}
+
+/* A hit found in the current block, before sorting. */
+typedef struct {
+    Py_ssize_t i;       /* index of the window in the block */
+    int motif;
+    int strand;         /* 0 for the forward strand, 1 for the reverse */
+    float score;
+} Candidate;
+
+static int
+compare_candidates(const void* a, const void* b)
+{
+    const Candidate* x = a;
+    const Candidate* y = b;
+    if (x->i != y->i) return (x->i < y->i) ? -1 : 1;
+    if (x->motif != y->motif) return (x->motif < y->motif) ? -1 : 1;
+    return x->strand - y->strand;
+}
+
+/* Score all motifs on both strands at every position of the sequence, and
+ * store the hits with a score above the threshold of the motif. The sequence
+ * is encoded block by block, so that each letter is decoded once only,
+ * independent of the number and length of the motifs; k columns of a motif
+ * are then scored with a single table lookup. Windows that cannot reach the
+ * threshold are abandoned early (see search_windows); the score of the
+ * remaining windows is then recalculated column by column, as in
+ * add_scores, so that it is identical to the score found by calculate. The hits of each
+ * block are sorted by position, motif, and strand.  Windows lying entirely
+ * within the first letters of the sequence (sequence[0:first]) are skipped,
+ * as they were scanned already when the sequence is read in chunks.  Hits
+ * are stored with the position of the window in the forward strand plus
+ * offset, and with strand +1 or -1.  Returns 0 if successful, and -1 if we
+ * ran out of memory. This function does not need the GIL.
+ */
+static int
+scan(const char sequence[], Py_ssize_t n, const Motif motifs[], int nmotifs,
+     Py_ssize_t mmax, int k, int both, Py_ssize_t first, position_t offset,
+     Hits* hits)
+{
+    Py_ssize_t start, end, count, i, m, j, nactive;
+    Py_ssize_t ncandidates, allocated = 0;
+    int index, strand;
+    float score;
+    double limit;
+    const Motif* motif;
+    const Profile* profile;
+    const Py_ssize_t* next_bad;
+    Candidate* candidates = NULL;
+    Candidate* candidate;
+    int result = -1;
+    Block block = {NULL, NULL, NULL};
+    double* buffer = malloc(SCAN_BLOCK * sizeof(double));
+    Py_ssize_t* active = malloc(SCAN_BLOCK * sizeof(Py_ssize_t));
+    if (!buffer || !active) goto exit;
+    if (block_init(&block, SCAN_BLOCK + mmax - 1, k) < 0) goto exit;
+    next_bad = block.next_bad;
+    for (start = 0; start < n; start += SCAN_BLOCK) {
+        end = start + SCAN_BLOCK;
+        if (end > n) end = n;
+        count = end + mmax - 1;
+        if (count > n) count = n;
+        block_encode(&block, sequence + start, count - start, k);
+        ncandidates = 0;
+        for (index = 0; index < nmotifs; index++) {
+            motif = &motifs[index];
+            m = motif->m;
+            count = n - m + 1 - start;
+            if (count > end - start) count = end - start;
+            if (count <= 0) continue;
+            /* Allow for rounding errors, as the groups of columns are added
+             * in a different order here, and the score is then rounded to a
+             * float. */
+            limit = motif->threshold - 1.e-6 * (fabs(motif->threshold) + 1.0);
+            for (strand = 0; strand < (both ? 2 : 1); strand++) {
+                profile = strand ? &motif->reverse : &motif->forward;
+                nactive = search_windows(profile, m, k, block.kmers, count,
+                                         limit, buffer, active);
+                for (j = 0; j < nactive; j++) {
+                    i = active[j];
+                    if (next_bad[i] < i + m) continue;
+                    if (start + i + m <= first) continue;
+                    score = (float)window_score(motif->columns
+                                                + (strand ? 4 * m : 0),
+                                                m, block.codes + i);
+                    if (!(score > motif->threshold)) continue;
+                    if (ncandidates == allocated) {
+                        allocated = allocated ? 2 * allocated : 256;
+                        candidate = realloc(candidates,
+                                            allocated * sizeof(Candidate));
+                        if (!candidate) goto exit;
+                        candidates = candidate;
+                    }
+                    candidate = &candidates[ncandidates++];
+                    candidate->i = i;
+                    candidate->motif = index;
+                    candidate->strand = strand;
+                    candidate->score = score;
+                }
+            }
+        }
+        if (ncandidates > 1)
+            qsort(candidates, ncandidates, sizeof(Candidate),
+                  compare_candidates);
+        for (j = 0; j < ncandidates; j++) {
+            candidate = &candidates[j];
+            if (hits_append(hits, candidate->motif,
+                            offset + start + candidate->i,
+                            candidate->strand ? -1 : +1,
+                            candidate->score) < 0) goto exit;
+        }
+    }
+    result = 0;
+exit:
+    if (buffer) free(buffer);
+    if (active) free(active);
+    if (candidates) free(candidates);
+    block_free(&block);
+    return result;
+}
+
+/* Fill in the scores of a motif from a C-contiguous buffer of doubles
+ * holding four scores (A, C, G, T) for each position of the motif. */
+static int
+motif_converter(PyObject* object, Motif* motif)
+{
+    const int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT;
+    char datatype;
+    Py_ssize_t j, m;
+    int b;
+    const double* scores;
+    double* reverse;
+    Py_buffer view;
+    if (PyObject_GetBuffer(object, &view, flags) == -1) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "position-weight matrix is not an array");
+        return 0;
+    }
+    datatype = view.format[0];
+    switch (datatype) {
+        case '@':
+        case '=':
+        case '<':
+        case '>':
+        case '!': datatype = view.format[1]; break;
+        default: break;
+    }
+    if (datatype != 'd') {
+        PyErr_Format(PyExc_RuntimeError,
+            "position-weight matrix data format incorrect ('%c', expected 'd')",
+            datatype);
+        PyBuffer_Release(&view);
+        return 0;
+    }
+    m = view.len / (4 * sizeof(double));
+    if (m == 0 || view.len != m * 4 * (Py_ssize_t)sizeof(double)) {
+        PyErr_SetString(PyExc_ValueError,
+            "position-weight matrix should have four scores per position");
+        PyBuffer_Release(&view);
+        return 0;
+    }
+    motif->columns = malloc(2 * 4 * m * sizeof(double));
+    if (!motif->columns) {
+        PyErr_NoMemory();
+        PyBuffer_Release(&view);
+        return 0;
+    }
+    motif->m = m;
+    scores = view.buf;
+    memcpy(motif->columns, scores, 4 * m * sizeof(double));
+    reverse = motif->columns + 4 * m;
+    for (j = 0; j < m; j++)
+        for (b = 0; b < 4; b++)
+            reverse[4*j+b] = scores[4*(m-1-j)+3-b];
+    PyBuffer_Release(&view);
+    return 1;
+}
+
+static void
+motifs_free(Motif* motifs, Py_ssize_t nmotifs)
+{
+    Py_ssize_t i;
+    for (i = 0; i < nmotifs; i++) {
+        if (motifs[i].columns) free(motifs[i].columns);
+        profile_free(&motifs[i].forward);
+        profile_free(&motifs[i].reverse);
+    }
+    PyMem_Free(motifs);
+}
+
+/* Create the motifs, with their lookup tables, from a sequence of
+ * position-weight matrices and a sequence of thresholds.  The number of
+ * motifs and the length of the longest motif are stored in nmotifs and
+ * mmax.  Returns NULL with an exception set if an error occurred. */
+static Motif*
+motifs_create(PyObject* py_matrices, PyObject* py_thresholds, int k,
+              Py_ssize_t* nmotifs, Py_ssize_t* mmax)
+{
+    PyObject* matrices = NULL;
+    PyObject* thresholds = NULL;
+    PyObject* item;
+    Py_ssize_t i, m, n = 0;
+    Motif* motifs = NULL;
+    *mmax = 0;
+    matrices = PySequence_Fast(py_matrices,
+                               "matrices should be a sequence of arrays");
+    if (!matrices) goto error;
+    thresholds = PySequence_Fast(py_thresholds,
+                                 "thresholds should be a sequence of numbers");
+    if (!thresholds) goto error;
+    n = PySequence_Fast_GET_SIZE(matrices);
+    if (PySequence_Fast_GET_SIZE(thresholds) != n) {
+        PyErr_SetString(PyExc_ValueError,
+                        "number of thresholds and matrices are inconsistent");
+        goto error;
+    }
+    if (n > INT_MAX) {
+        PyErr_SetString(PyExc_ValueError, "too many matrices");
+        goto error;
+    }
+    motifs = PyMem_Malloc((n ? n : 1) * sizeof(Motif));
+    if (!motifs) {
+        PyErr_NoMemory();
+        goto error;
+    }
+    for (i = 0; i < n; i++) {
+        motifs[i].columns = NULL;
+        motifs[i].forward.tables = NULL;
+        motifs[i].forward.order = NULL;
+        motifs[i].forward.bounds = NULL;
+        motifs[i].reverse = motifs[i].forward;
+    }
+    for (i = 0; i < n; i++) {
+        item = PySequence_Fast_GET_ITEM(thresholds, i);
+        motifs[i].threshold = PyFloat_AsDouble(item);
+        if (motifs[i].threshold == -1.0 && PyErr_Occurred()) goto error;
+        item = PySequence_Fast_GET_ITEM(matrices, i);
+        if (!motif_converter(item, &motifs[i])) goto error;
+        if (motifs[i].m > *mmax) *mmax = motifs[i].m;
+    }
+    for (i = 0; i < n; i++) {
+        m = motifs[i].m;
+        if (profile_init(&motifs[i].forward, motifs[i].columns, m, k) < 0
+         || profile_init(&motifs[i].reverse, motifs[i].columns + 4 * m, m,
+                         k) < 0) {
+            PyErr_NoMemory();
+            goto error;
+        }
+    }
+    Py_DECREF(matrices);
+    Py_DECREF(thresholds);
+    *nmotifs = n;
+    return motifs;
+error:
+    if (motifs) motifs_free(motifs, n);
+    Py_XDECREF(matrices);
+    Py_XDECREF(thresholds);
+    return NULL;
+}
+
+/* Create an array.array of the given type holding a copy of the count items
+ * stored in data. */
+static PyObject*
+create_array(const char* typecode, const void* data, Py_ssize_t count,
+             size_t itemsize)
+{
+    PyObject* unit;
+    PyObject* array;
+#if PY_MAJOR_VERSION >= 3
+    Py_buffer view;
+#else
+    void* buffer;
+    Py_ssize_t length;
+#endif
+    unit = PyObject_CallFunction(py_array_type, "s[i]", typecode, 0);
+    if (!unit) return NULL;
+    array = PySequence_Repeat(unit, count);
+    Py_DECREF(unit);
+    if (!array || count == 0) return array;
+#if PY_MAJOR_VERSION >= 3
+    if (PyObject_GetBuffer(array, &view, PyBUF_WRITABLE) < 0) {
+        Py_DECREF(array);
+        return NULL;
+    }
+    memcpy(view.buf, data, count * itemsize);
+    PyBuffer_Release(&view);
+#else
+    if (PyObject_AsWriteBuffer(array, &buffer, &length) < 0) {
+        Py_DECREF(array);
+        return NULL;
+    }
+    memcpy(buffer, data, count * itemsize);
+#endif
+    return array;
+}
+
+/* Return the hits as a tuple of arrays: the index of the motif, the
+ * position, the strand if strands is true, and the score. */
+static PyObject*
+hits_to_tuple(const Hits* hits, int strands)
+{
+    PyObject* motifs_array = NULL;
+    PyObject* positions_array = NULL;
+    PyObject* strands_array = NULL;
+    PyObject* scores_array = NULL;
+    PyObject* result = NULL;
+    const Py_ssize_t n = hits->size;
+    motifs_array = create_array("i", hits->motifs, n, sizeof(int));
+    if (!motifs_array) goto exit;
+    positions_array = create_array(POSITION_TYPECODE, hits->positions, n,
+                                   sizeof(position_t));
+    if (!positions_array) goto exit;
+    if (strands) {
+        strands_array = create_array("b", hits->strands, n,
+                                     sizeof(signed char));
+        if (!strands_array) goto exit;
+    }
+    scores_array = create_array("f", hits->scores, n, sizeof(float));
+    if (!scores_array) goto exit;
+    if (strands)
+        result = PyTuple_Pack(4, motifs_array, positions_array, strands_array,
+                              scores_array);
+    else
+        result = PyTuple_Pack(3, motifs_array, positions_array, scores_array);
+exit:
+    Py_XDECREF(motifs_array);
+    Py_XDECREF(positions_array);
+    Py_XDECREF(strands_array);
+    Py_XDECREF(scores_array);
+    return result;
+}
+
+static char scan__doc__[] =
+"    scan(sequence, matrices, thresholds, both=True) -> (motifs, positions, scores)\n"
+"\n"
+"This function scores all position-weight matrices on the sequence in a\n"
+"single pass, on both strands if both is true, and returns the hits with\n"
+"a score above the threshold of the matrix as three arrays: the index of\n"
+"the matrix (typecode 'i'), the position (as a 64-bit integer), and the\n"
+"score (typecode 'f'). Hits are ordered by position, and then by matrix.\n"
+"Hits on the reverse strand are stored with position - len(sequence).\n"
+"Each matrix is a C-contiguous array of doubles holding the scores of A,\n"
+"C, G, and T for each position of the motif.\n";
+
+static PyObject*
+py_scan(PyObject* self, PyObject* args, PyObject* keywords)
+{
+    static char* kwlist[] = {"sequence", "matrices", "thresholds", "both",
+                             NULL};
+    Py_buffer sequence;
+    PyObject* py_matrices;
+    PyObject* py_thresholds;
+    int both = 1;
+    int status;
+    const int k = 4;
+    Py_ssize_t i, nmotifs, mmax;
+    Motif* motifs = NULL;
+    Hits hits = {0, 0, NULL, NULL, NULL, NULL};
+    PyObject* result = NULL;
+    sequence.obj = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "s*OO|i", kwlist,
+                                     &sequence, &py_matrices, &py_thresholds,
+                                     &both)) return NULL;
+    motifs = motifs_create(py_matrices, py_thresholds, k, &nmotifs, &mmax);
+    if (!motifs) goto exit;
+    Py_BEGIN_ALLOW_THREADS
+    status = scan(sequence.buf, sequence.len, motifs, (int)nmotifs, mmax,
+                  k, both, 0, 0, &hits);
+    Py_END_ALLOW_THREADS
+    if (status < 0) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    /* As in PositionSpecificScoringMatrix.search, store hits on the reverse
+     * strand with a negative position. */
+    for (i = 0; i < hits.size; i++)
+        if (hits.strands[i] < 0) hits.positions[i] -= sequence.len;
+    result = hits_to_tuple(&hits, 0);
+exit:
+    if (motifs) motifs_free(motifs, nmotifs);
+    hits_free(&hits);
+    if (sequence.obj) PyBuffer_Release(&sequence);
+    return result;
+}
+
+/* Number of letters the Scanner collects before scanning them. */
+#define SCANNER_BLOCK 262144
+
+typedef struct {
+    PyObject_HEAD
+    Motif* motifs;
+    Py_ssize_t nmotifs;
+    Py_ssize_t mmax;
+    int k;
+    int both;
+    int busy;           /* set while feed runs without the GIL */
+    char* buffer;       /* the last mmax-1 letters already scanned, followed
+                           by the letters that were not scanned yet */
+    Py_ssize_t size;    /* number of letters in buffer */
+    Py_ssize_t scanned; /* number of letters in buffer already scanned */
+    position_t offset;  /* position of buffer[0] in the sequence */
+} Scanner;
+
+/* Scan the letters in the buffer, and keep the last mmax-1 letters, as they
+ * may be part of windows that extend into the next chunk. */
+static int
+scanner_flush(Scanner* self, Hits* hits)
+{
+    const Py_ssize_t overlap = self->mmax > 0 ? self->mmax - 1 : 0;
+    const Py_ssize_t size = self->size;
+    Py_ssize_t keep;
+    if (size == self->scanned) return 0;
+    if (scan(self->buffer, size, self->motifs, (int)self->nmotifs,
+             self->mmax, self->k, self->both, self->scanned, self->offset,
+             hits) < 0) return -1;
+    keep = (size < overlap) ? size : overlap;
+    memmove(self->buffer, self->buffer + size - keep, keep);
+    self->offset += size - keep;
+    self->size = keep;
+    self->scanned = keep;
+    return 0;
+}
+
+/* Append the letters in data to the buffer, skipping white space, and scan
+ * them whenever the buffer is full, and at the end of the data. */
+static int
+scanner_feed(Scanner* self, const char* data, Py_ssize_t n, Hits* hits)
+{
+    const Py_ssize_t overlap = self->mmax > 0 ? self->mmax - 1 : 0;
+    const Py_ssize_t capacity = overlap + SCANNER_BLOCK;
+    Py_ssize_t i;
+    char c;
+    for (i = 0; i < n; i++) {
+        c = data[i];
+        switch (c) {
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\v':
+            case '\f':
+            case '\r': continue;
+            default: break;
+        }
+        /* Flush before appending, so that the buffer cannot overflow if a
+         * previous flush failed; the letters left unscanned then are
+         * scanned by this flush. */
+        if (self->size >= capacity && scanner_flush(self, hits) < 0)
+            return -1;
+        self->buffer[self->size++] = c;
+    }
+    return scanner_flush(self, hits);
+}
+
+static int
+Scanner_init(Scanner* self, PyObject* args, PyObject* keywords)
+{
+    static char* kwlist[] = {"matrices", "thresholds", "both", NULL};
+    PyObject* py_matrices;
+    PyObject* py_thresholds;
+    Py_ssize_t nmotifs, mmax;
+    Motif* motifs;
+    char* buffer;
+    int both = 1;
+    const int k = 4;
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "OO|i", kwlist,
+                                     &py_matrices, &py_thresholds, &both))
+        return -1;
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "Scanner is in use");
+        return -1;
+    }
+    motifs = motifs_create(py_matrices, py_thresholds, k, &nmotifs, &mmax);
+    if (!motifs) return -1;
+    buffer = malloc(mmax + SCANNER_BLOCK);
+    if (!buffer) {
+        motifs_free(motifs, nmotifs);
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (self->motifs) motifs_free(self->motifs, self->nmotifs);
+    if (self->buffer) free(self->buffer);
+    self->motifs = motifs;
+    self->nmotifs = nmotifs;
+    self->mmax = mmax;
+    self->k = k;
+    self->both = both;
+    self->buffer = buffer;
+    self->size = 0;
+    self->scanned = 0;
+    self->offset = 0;
+    return 0;
+}
+
+static void
+Scanner_dealloc(Scanner* self)
+{
+    if (self->motifs) motifs_free(self->motifs, self->nmotifs);
+    if (self->buffer) free(self->buffer);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static char Scanner_feed__doc__[] =
+"    feed(data) -> (motifs, positions, strands, scores)\n"
+"\n"
+"Append the letters in data (a string or an object supporting the buffer\n"
+"protocol, such as a slice of a memory-mapped file) to the sequence, and\n"
+"return the hits that were completed by these letters. White space in\n"
+"data is skipped. The hits are returned as four arrays: the index of the\n"
+"matrix (typecode 'i'), the position of the hit in the sequence read so\n"
+"far (as a 64-bit integer), the strand (typecode 'b', +1 or -1), and the\n"
+"score (typecode 'f'). Positions are counted on the forward strand, also\n"
+"for hits on the reverse strand.\n";
+
+static PyObject*
+Scanner_feed(Scanner* self, PyObject* args)
+{
+    Py_buffer data;
+    int status;
+    Hits hits = {0, 0, NULL, NULL, NULL, NULL};
+    PyObject* result = NULL;
+    if (!PyArg_ParseTuple(args, "s*:feed", &data)) return NULL;
+    if (!self->buffer) {
+        PyErr_SetString(PyExc_RuntimeError, "Scanner was not initialized");
+        goto exit;
+    }
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "Scanner is in use");
+        goto exit;
+    }
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
+    status = scanner_feed(self, data.buf, data.len, &hits);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+    if (status < 0) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    result = hits_to_tuple(&hits, 1);
+exit:
+    hits_free(&hits);
+    PyBuffer_Release(&data);
+    return result;
+}
+
+static char Scanner_reset__doc__[] =
+"    reset()\n"
+"\n"
+"Start a new sequence.\n";
+
+static PyObject*
+Scanner_reset(Scanner* self)
+{
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "Scanner is in use");
+        return NULL;
+    }
+    self->size = 0;
+    self->scanned = 0;
+    self->offset = 0;
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject*
+Scanner_get_length(Scanner* self, void* closure)
+{
+    return PyLong_FromLongLong((long long)(self->offset + self->size));
+}
+
+static PyMethodDef Scanner_methods[] = {
+    {"feed", (PyCFunction)Scanner_feed, METH_VARARGS, Scanner_feed__doc__},
+    {"reset", (PyCFunction)Scanner_reset, METH_NOARGS, Scanner_reset__doc__},
+    {NULL}  /* Sentinel */
+};
+
+static PyGetSetDef Scanner_getset[] = {
+    {"length", (getter)Scanner_get_length, NULL,
+     "number of letters read so far", NULL},
+    {NULL}  /* Sentinel */
+};
+
+static char Scanner_doc[] =
+"Scanner(matrices, thresholds, both=True)\n"
+"\n"
+"Scan a sequence supplied in successive chunks for hits of several\n"
+"position-weight matrices, as in scan. Only the last letters of the\n"
+"previous chunk (one less than the length of the longest matrix) are kept\n"
+"between calls to feed, so that hits spanning two chunks are found while\n"
+"memory use is independent of the length of the sequence.\n";
+
+static PyTypeObject ScannerType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "_pwm.Scanner",             /* tp_name */
+    sizeof(Scanner),            /* tp_basicsize */
+    0,                          /* tp_itemsize */
+    (destructor)Scanner_dealloc,  /* tp_dealloc */
+    0,                          /* tp_print */
+    0,                          /* tp_getattr */
+    0,                          /* tp_setattr */
+    0,                          /* tp_reserved */
+    0,                          /* tp_repr */
+    0,                          /* tp_as_number */
+    0,                          /* tp_as_sequence */
+    0,                          /* tp_as_mapping */
+    0,                          /* tp_hash */
+    0,                          /* tp_call */
+    0,                          /* tp_str */
+    0,                          /* tp_getattro */
+    0,                          /* tp_setattro */
+    0,                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,         /* tp_flags */
+    Scanner_doc,                /* tp_doc */
+    0,                          /* tp_traverse */
+    0,                          /* tp_clear */
+    0,                          /* tp_richcompare */
+    0,                          /* tp_weaklistoffset */
+    0,                          /* tp_iter */
+    0,                          /* tp_iternext */
+    Scanner_methods,            /* tp_methods */
+    0,                          /* tp_members */
+    Scanner_getset,             /* tp_getset */
+    0,                          /* tp_base */
+    0,                          /* tp_dict */
+    0,                          /* tp_descr_get */
+    0,                          /* tp_descr_set */
+    0,                          /* tp_dictoffset */
+    (initproc)Scanner_init,     /* tp_init */
+};
+
 static struct PyMethodDef methods[] = {
    {"calculate", (PyCFunction)py_calculate, METH_VARARGS | METH_KEYWORDS, calculate__doc__},
+   {"scan", (PyCFunction)py_scan, METH_VARARGS | METH_KEYWORDS, scan__doc__},
    {NULL,          NULL, 0, NULL} /* sentinel */
 };
 
@@ -190,6 +1145,32 @@ void init_pwm(void)
 #endif
 {
   PyObject *m;
+  PyObject *array_module;
+  int i;
+
+  memset(letter_codes, 4, sizeof(letter_codes));
+  for (i = 0; i < 4; i++) {
+      letter_codes[(unsigned char)"ACGT"[i]] = i;
+      letter_codes[(unsigned char)"acgt"[i]] = i;
+  }
+  array_module = PyImport_ImportModule("array");
+  if (array_module) {
+      py_array_type = PyObject_GetAttrString(array_module, "array");
+      Py_DECREF(array_module);
+  }
+  if (py_array_type == NULL)
+#if PY_MAJOR_VERSION >= 3
+      return NULL;
+#else
+      return;
+#endif
+  ScannerType.tp_new = PyType_GenericNew;
+  if (PyType_Ready(&ScannerType) < 0)
+#if PY_MAJOR_VERSION >= 3
+      return NULL;
+#else
+      return;
+#endif
 #if PY_MAJOR_VERSION >= 3
   m = PyModule_Create(&moduledef);
   if (m==NULL) return NULL;
@@ -202,6 +1183,9 @@ void init_pwm(void)
   if (m==NULL) return;
 #endif
 
+  Py_INCREF(&ScannerType);
+  PyModule_AddObject(m, "Scanner", (PyObject*) &ScannerType);
+
   if (PyErr_Occurred()) Py_FatalError("can't initialize module _pwm");
 #if PY_MAJOR_VERSION >= 3
     return m;
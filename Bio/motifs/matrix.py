@@ -8,8 +8,10 @@ Implementation of frequency (count) matrices, position-weight matrices,
 and position-specific scoring matrices.
 """
 
+import array
 import math
 import platform
+import sys
 
 from Bio._py3k import range
 
@@ -64,6 +66,287 @@ except ImportError:
         return scores
 
 
+# Positions of hits are stored as 64-bit integers (as in the C code).
+if sys.version_info[0] >= 3:
+    _POSITION_TYPECODE = "q"
+else:
+    _POSITION_TYPECODE = "l"
+
+# Number of windows scanned at a time by PositionSpecificScoringMatrix.search.
+_SEARCH_BLOCK_SIZE = 65536
+
+try:
+    from ._pwm import scan as _scan
+except ImportError:
+
+    def _scan(sequence, matrices, thresholds, both=True):
+        """Find hits of several motifs using Python code (PRIVATE).
+
+        Each matrix is a flat sequence holding the scores of A, C, G, and T
+        for each position of the motif, as passed to the C function.
+        """
+        codes = {"A": 0, "C": 1, "G": 2, "T": 3}
+        if not isinstance(sequence, str):
+            sequence = bytes(sequence).decode("ASCII")
+        sequence = sequence.upper()
+        n = len(sequence)
+        motifs = array.array("i")
+        positions = array.array(_POSITION_TYPECODE)
+        scores = array.array("f")
+        lengths = [len(matrix) // 4 for matrix in matrices]
+        for position in range(n):
+            for index, matrix in enumerate(matrices):
+                m = lengths[index]
+                if position + m > n:
+                    continue
+                forward = 0.0
+                reverse = 0.0
+                for j in range(m):
+                    try:
+                        code = codes[sequence[position + j]]
+                    except KeyError:
+                        break
+                    forward += matrix[4 * j + code]
+                    reverse += matrix[4 * (m - 1 - j) + 3 - code]
+                else:
+                    threshold = thresholds[index]
+                    if forward > threshold:
+                        motifs.append(index)
+                        positions.append(position)
+                        scores.append(forward)
+                    if both and reverse > threshold:
+                        motifs.append(index)
+                        positions.append(position - n)
+                        scores.append(reverse)
+        return motifs, positions, scores
+
+
+try:
+    from ._pwm import Scanner as _Scanner
+except ImportError:
+
+    class _Scanner(object):
+        """Find hits of several motifs in a sequence read in chunks (PRIVATE).
+
+        This is the Python version of the Scanner class in the C module.
+        """
+
+        def __init__(self, matrices, thresholds, both=True):
+            """Initialize the class."""
+            self.matrices = matrices
+            self.thresholds = thresholds
+            self.both = both
+            self.lengths = [len(matrix) // 4 for matrix in matrices]
+            self.overlap = max(self.lengths) - 1 if self.lengths else 0
+            self.reset()
+
+        def reset(self):
+            """Start a new sequence."""
+            self.letters = ""
+            self.offset = 0
+
+        @property
+        def length(self):
+            """Return the number of letters read so far."""
+            return self.offset + len(self.letters)
+
+        def feed(self, data):
+            """Append the letters in data and return the completed hits."""
+            if not isinstance(data, str):
+                data = bytes(data).decode("ASCII")
+            scanned = len(self.letters)
+            letters = self.letters + "".join(data.split())
+            n = len(letters)
+            motifs = array.array("i")
+            positions = array.array(_POSITION_TYPECODE)
+            strands = array.array("b")
+            scores = array.array("f")
+            hits = _scan(letters, self.matrices, self.thresholds, self.both)
+            for index, position, score in zip(*hits):
+                strand = +1
+                if position < 0:
+                    position += n
+                    strand = -1
+                if position + self.lengths[index] <= scanned:
+                    # found already in the previous chunk
+                    continue
+                motifs.append(index)
+                positions.append(self.offset + position)
+                strands.append(strand)
+                scores.append(score)
+            keep = min(n, self.overlap)
+            self.letters = letters[n - keep:]
+            self.offset += n - keep
+            return motifs, positions, strands, scores
+
+
+def _prepare_scan(pssms, thresholds):
+    """Return the matrices and thresholds to be passed to _scan (PRIVATE)."""
+    for pssm in pssms:
+        if sorted(pssm.alphabet) != ["A", "C", "G", "T"]:
+            raise ValueError("PSSM has wrong alphabet: %s - Use only with "
+                             "DNA motifs" % pssm.alphabet)
+    try:
+        thresholds = [float(thresholds)] * len(pssms)
+    except TypeError:
+        thresholds = [float(threshold) for threshold in thresholds]
+        if len(thresholds) != len(pssms):
+            raise ValueError("Expected one threshold for each PSSM")
+    matrices = []
+    for pssm in pssms:
+        matrix = array.array("d")
+        for i in range(pssm.length):
+            matrix.extend(pssm[letter][i] for letter in "ACGT")
+        matrices.append(matrix)
+    return matrices, thresholds
+
+
+def scan(pssms, sequence, thresholds=0.0, both=True):
+    """Find the hits of several position-specific scoring matrices at once.
+
+    Arguments:
+     - pssms       - list of PositionSpecificScoringMatrix objects; the
+                     motifs can have different lengths.
+     - sequence    - a DNA sequence (a string, Seq object, or an object
+                     supporting the buffer protocol, such as bytes or a
+                     memory-mapped file).
+     - thresholds  - the score a hit should exceed, either a single number
+                     for all motifs, or a list with one number per motif.
+     - both        - if True (default), also search the reverse strand.
+
+    The sequence is read only once, and both strands are scored at the same
+    time. Windows are abandoned as soon as they can no longer exceed the
+    threshold, so the search is faster for stricter thresholds. Positions
+    containing letters other than A, C, G, T (such as N) never give a hit.
+    Three arrays are returned: the index of the motif in pssms, the position
+    of the hit, and its score (as a 32-bit float). As in the search method,
+    hits on the reverse strand are reported as negative positions, counted
+    from the end of the sequence. Hits are ordered by position and then by
+    motif.
+
+    >>> from Bio import motifs
+    >>> from Bio.Seq import Seq
+    >>> m1 = motifs.create([Seq("TACAA"), Seq("TACGC"), Seq("TACAC")])
+    >>> m2 = motifs.create([Seq("GTATA"), Seq("GTAAA"), Seq("GCATA")])
+    >>> pssms = [m.counts.normalize(pseudocounts=0.5).log_odds()
+    ...          for m in (m1, m2)]
+    >>> indices, positions, scores = scan(pssms, "TTACACGTATACGCAGTATA", 4.0)
+    >>> for index, position, score in zip(indices, positions, scores):
+    ...     print("%d %d %.2f" % (index, position, score))
+    0 1 6.46
+    1 6 6.46
+    1 -13 6.46
+    0 9 5.72
+    1 15 6.46
+
+    """
+    matrices, thresholds = _prepare_scan(pssms, thresholds)
+    if not isinstance(sequence, (str, bytes)):
+        try:
+            memoryview(sequence)
+        except TypeError:
+            sequence = str(sequence)
+    return _scan(sequence, matrices, thresholds, both)
+
+
+def scan_chunks(pssms, chunks, thresholds=0.0, both=True):
+    """Find the hits of several PSSMs in a sequence supplied in chunks.
+
+    Arguments:
+     - pssms       - list of PositionSpecificScoringMatrix objects.
+     - chunks      - an iterable of successive pieces of one DNA sequence
+                     (strings, bytes, or objects supporting the buffer
+                     protocol, such as slices of a memory-mapped file).
+                     White space in the chunks is ignored.
+     - thresholds  - as in scan.
+     - both        - if True (default), also search the reverse strand.
+
+    This generator yields (index, position, strand, score) tuples as soon as
+    the chunk completing the hit has been read, where position is counted
+    from the start of the sequence on the forward strand (also for hits on
+    the reverse strand) and strand is +1 or -1. Hits spanning two chunks are
+    found, as the last letters of each chunk are kept for the next one, but
+    the sequence is never stored in full. The hits of each motif are yielded
+    in the order of their position.
+
+    >>> from Bio import motifs
+    >>> from Bio.Seq import Seq
+    >>> m1 = motifs.create([Seq("TACAA"), Seq("TACGC"), Seq("TACAC")])
+    >>> m2 = motifs.create([Seq("GTATA"), Seq("GTAAA"), Seq("GCATA")])
+    >>> pssms = [m.counts.normalize(pseudocounts=0.5).log_odds()
+    ...          for m in (m1, m2)]
+    >>> chunks = ["TTACACGT", "ATACGCAG", "TATA"]
+    >>> for index, position, strand, score in scan_chunks(pssms, chunks, 4.0):
+    ...     print("%d %d %+d %.2f" % (index, position, strand, score))
+    0 1 +1 6.46
+    1 6 +1 6.46
+    1 7 -1 6.46
+    0 9 +1 5.72
+    1 15 +1 6.46
+
+    """
+    matrices, thresholds = _prepare_scan(pssms, thresholds)
+    scanner = _Scanner(matrices, thresholds, both)
+    for chunk in chunks:
+        if not isinstance(chunk, (str, bytes)):
+            try:
+                memoryview(chunk)
+            except TypeError:
+                chunk = str(chunk)
+        for hit in zip(*scanner.feed(chunk)):
+            yield hit
+
+
+def scan_fasta(pssms, filename, thresholds=0.0, both=True,
+               chunk_size=1048576):
+    """Find the hits of several PSSMs in each sequence of a FASTA file.
+
+    Arguments:
+     - pssms       - list of PositionSpecificScoringMatrix objects.
+     - filename    - the name of a FASTA file with DNA sequences.
+     - thresholds  - as in scan.
+     - both        - if True (default), also search the reverse strand.
+     - chunk_size  - the number of bytes read from the file at a time.
+
+    The file is memory-mapped and each sequence is scanned in chunks of
+    chunk_size bytes, as in scan_chunks, so that the memory used does not
+    depend on the length of the sequences (e.g. chromosomes). This generator
+    yields (title, index, position, strand, score) tuples, where title is
+    the title line of the record without the leading '>' and position is
+    counted from the start of the sequence on the forward strand.
+    """
+    import mmap
+    import os
+
+    if chunk_size < 1:
+        raise ValueError("chunk_size should be positive")
+    matrices, thresholds = _prepare_scan(pssms, thresholds)
+    scanner = _Scanner(matrices, thresholds, both)
+    if os.path.getsize(filename) == 0:
+        return
+    with open(filename, "rb") as handle:
+        data = mmap.mmap(handle.fileno(), 0, access=mmap.ACCESS_READ)
+        try:
+            n = len(data)
+            start = data.find(b">")
+            while start >= 0:
+                end = data.find(b"\n", start)
+                if end < 0:
+                    end = n
+                title = data[start + 1:end].strip().decode()
+                start = data.find(b"\n>", end)
+                stop = n if start < 0 else start + 1
+                scanner.reset()
+                for position in range(end + 1, stop, chunk_size):
+                    chunk = data[position:min(position + chunk_size, stop)]
+                    for hit in zip(*scanner.feed(chunk)):
+                        yield (title,) + hit
+                if start >= 0:
+                    start += 1
+        finally:
+            data.close()
+
+
 class GenericPositionMatrix(dict):
     """Base class for the support of position matrix operations."""
 
@@ -409,22 +692,31 @@ class PositionSpecificScoringMatrix(GenericPositionMatrix):
         """Find hits with PWM score above given threshold.
 
         A generator function, returning found hits in the given sequence
-        with the pwm score higher than the threshold.
+        with the pwm score higher than the threshold. The sequence is scanned
+        in blocks, and the hits in each block are returned before the next
+        block is scanned.
         """
-        sequence = sequence.upper()
+        matrices, thresholds = _prepare_scan([self], threshold)
+        if not isinstance(sequence, (str, bytes)):
+            try:
+                sequence = memoryview(sequence)
+            except TypeError:
+                sequence = str(sequence)
         n = len(sequence)
         m = self.length
-        if both:
-            rc = self.reverse_complement()
-        for position in range(0, n - m + 1):
-            s = sequence[position:position + m]
-            score = self.calculate(s)
-            if score > threshold:
+        for start in range(0, n - m + 1, _SEARCH_BLOCK_SIZE):
+            # consecutive blocks overlap by m - 1 letters, so that each window
+            # starts in exactly one block
+            block = sequence[start:start + _SEARCH_BLOCK_SIZE + m - 1]
+            end = start + len(block)
+            motifs, positions, scores = _scan(block, matrices, thresholds, both)
+            for position, score in zip(positions, scores):
+                if position < 0:
+                    # on the reverse strand, counted from the end of the block
+                    position += end - n
+                else:
+                    position += start
                 yield (position, score)
-            if both:
-                score = rc.calculate(s)
-                if score > threshold:
-                    yield (position - n, score)
 
     @property
     def max(self):
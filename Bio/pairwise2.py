@@ -98,6 +98,14 @@ All alignment functions have the following arguments:
 - ``one_alignment_only``: boolean (default: False).
   Only recover one alignment.
 
+- ``band``: integer (default: None).
+  Together with ``score_only``, only calculate the score of the best
+  alignment that stays within ``band`` diagonals of the main diagonal (or
+  of the diagonals through both corners, if the sequences differ in
+  length). This is much faster for long, similar sequences, but may give a
+  lower score than the unrestricted alignment if the band is too narrow.
+  Requires affine gap penalties.
+
 The other parameters of the alignment function depend on the function called.
 Some examples:
 
@@ -413,6 +421,7 @@ alignment occurs.
                 ("force_generic", 0),
                 ("score_only", 0),
                 ("one_alignment_only", 0),
+                ("band", None),
             ]
             for name, default in default_params:
                 keywds[name] = keywds.get(name, default)
@@ -450,7 +459,7 @@ align = align()
 def _align(sequenceA, sequenceB, match_fn, gap_A_fn, gap_B_fn,
            penalize_extend_when_opening, penalize_end_gaps,
            align_globally, gap_char, force_generic, score_only,
-           one_alignment_only):
+           one_alignment_only, band):
     """Return optimal alignments between two sequences (PRIVATE).
 
     This method either returns a list of optimal alignments (with the same
@@ -475,6 +484,13 @@ def _align(sequenceA, sequenceB, match_fn, gap_A_fn, gap_B_fn,
                       "alignments. The resulting score may be wrong.",
                       BiopythonWarning)
 
+    if band is None:
+        band = -1
+    elif not score_only:
+        raise ValueError('"band" can only be used together with "score_only"')
+    elif band < 0:
+        raise ValueError('"band" should not be negative')
+
     if (not force_generic) and isinstance(gap_A_fn, affine_penalty) \
        and isinstance(gap_B_fn, affine_penalty):
         open_A, extend_A = gap_A_fn.open, gap_A_fn.extend
@@ -482,7 +498,9 @@ def _align(sequenceA, sequenceB, match_fn, gap_A_fn, gap_B_fn,
         matrices = _make_score_matrix_fast(
             sequenceA, sequenceB, match_fn, open_A, extend_A, open_B,
             extend_B, penalize_extend_when_opening, penalize_end_gaps,
-            align_globally, score_only)
+            align_globally, score_only, band)
+    elif band >= 0:
+        raise ValueError('"band" requires affine gap penalties')
     else:
         matrices = _make_score_matrix_generic(
             sequenceA, sequenceB, match_fn, gap_A_fn, gap_B_fn,
@@ -621,7 +639,8 @@ def _make_score_matrix_generic(sequenceA, sequenceB, match_fn, gap_A_fn,
 
 def _make_score_matrix_fast(sequenceA, sequenceB, match_fn, open_A, extend_A,
                             open_B, extend_B, penalize_extend_when_opening,
-                            penalize_end_gaps, align_globally, score_only):
+                            penalize_end_gaps, align_globally, score_only,
+                            band=-1):
     """Generate a score and traceback matrix according to Gotoh (PRIVATE).
 
     This is an implementation of the Needleman-Wunsch dynamic programming
@@ -632,6 +651,10 @@ def _make_score_matrix_fast(sequenceA, sequenceB, match_fn, open_A, extend_A,
     which holds the best scores, and store only those values from the
     other matrices that are actually used for the next step of calculation.
     The traceback matrix holds the positions for backtracing the alignment.
+
+    If band is not negative, only the cells within band diagonals of the
+    diagonals through the corners of the matrix are calculated; the other
+    cells are unreachable (score -inf). This is only used for score_only.
     """
     first_A_gap = calc_affine_penalty(1, open_A, extend_A,
                                       penalize_extend_when_opening)
@@ -649,6 +672,14 @@ def _make_score_matrix_fast(sequenceA, sequenceB, match_fn, open_A, extend_A,
         if not score_only:
             trace_matrix.append([None] * (lenB + 1))
 
+    # The diagonals (col - row) that are calculated:
+    if band >= 0:
+        lower = min(0, lenB - lenA) - band
+        upper = max(0, lenB - lenA) + band
+    else:
+        lower, upper = -lenA, lenB
+    unreachable = float("-inf")
+
     # Initialize first row and column with gap scores. This is like opening up
     # i gaps at the beginning of sequence A or B.
     for i in range(lenA + 1):
@@ -657,6 +688,8 @@ def _make_score_matrix_fast(sequenceA, sequenceB, match_fn, open_A, extend_A,
                                         penalize_extend_when_opening)
         else:
             score = 0
+        if i > -lower:
+            score = unreachable
         score_matrix[i][0] = score
     for i in range(lenB + 1):
         if penalize_end_gaps[0]:  # [0]:gap in sequence A
@@ -664,22 +697,35 @@ def _make_score_matrix_fast(sequenceA, sequenceB, match_fn, open_A, extend_A,
                                         penalize_extend_when_opening)
         else:
             score = 0
+        if i > upper:
+            score = unreachable
         score_matrix[0][i] = score
 
     # Now initialize the col 'matrix'. Actually this is only a one dimensional
     # list, since we only need the col scores from the last row.
     col_score = [0]  # Best score, if actual alignment ends with gap in seqB
     for i in range(1, lenB + 1):
-        col_score.append(calc_affine_penalty(i, 2 * open_B, extend_B,
-                                             penalize_extend_when_opening))
+        if i > upper:
+            col_score.append(unreachable)
+        else:
+            col_score.append(calc_affine_penalty(i, 2 * open_B, extend_B,
+                                                 penalize_extend_when_opening))
 
     # The row 'matrix' is calculated on the fly. Here we only need the actual
     # score.
     # Now, filling up the score and traceback matrices:
     for row in range(1, lenA + 1):
-        row_score = calc_affine_penalty(row, 2 * open_A, extend_A,
-                                        penalize_extend_when_opening)
-        for col in range(1, lenB + 1):
+        start = max(1, row + lower)
+        end = min(lenB, row + upper)
+        if row + lower > 0:
+            row_score = unreachable
+            score_matrix[row][start - 1] = unreachable
+        else:
+            row_score = calc_affine_penalty(row, 2 * open_A, extend_A,
+                                            penalize_extend_when_opening)
+        if end < lenB:
+            score_matrix[row][end + 1] = unreachable
+        for col in range(start, end + 1):
             # Calculate the score that would occur by extending the
             # alignment without gaps.
             nogap_score = score_matrix[row - 1][col - 1] + \
@@ -938,7 +984,7 @@ def _reverse_matrices(score_matrix, trace_matrix):
                      10: 18, 11: 22, 12: 17, 13: 21, 14: 19, 15: 23, 16: 8,
                      17: 12, 18: 10, 19: 14, 20: 9, 21: 13, 22: 11, 23: 15,
                      24: 24, 25: 28, 26: 26, 27: 30, 28: 25, 29: 29, 30: 27,
-                     31: 31, None: None}
+                     31: 31, None: None, 0: 0}
     for col in range(len(score_matrix[0])):
         new_score_row = []
         new_trace_row = []
@@ -1198,10 +1244,11 @@ def format_alignment(align1, align2, score, begin, end,
 # Before, we secure access to the pure Python functions (for testing purposes):
 
 _python_make_score_matrix_fast = _make_score_matrix_fast
+_python_find_start = _find_start
 _python_rint = rint
 
 try:
-    from .cpairwise2 import rint, _make_score_matrix_fast  # noqa
+    from .cpairwise2 import rint, _make_score_matrix_fast, _find_start  # noqa
 except ImportError:
     warnings.warn("Import of C module failed. Falling back to pure Python " +
                   "implementation. This may be slooow...", BiopythonWarning)
@@ -0,0 +1,92 @@
+#!/usr/bin/env python
+# This file is part of the Biopython distribution and governed by your
+# choice of the "Biopython License Agreement" or the "BSD 3-Clause License".
+# Please see the LICENSE file that should have been included as part of this
+# package.
+
+"""Time the score of a long global alignment for different numbers of threads.
+
+The score of a single global alignment of two long sequences is calculated by
+PairwiseAligner using the anti-diagonal wavefront if its n_threads attribute
+is larger than one.  This script aligns a random DNA sequence to a mutated
+copy of itself for each sequence length and number of threads, and prints the
+time, the speedup relative to one thread, and the number of dynamic
+programming cells calculated per second.  Note that aligning two sequences of
+10 Mb requires 10^14 cells, which takes many hours even with 32 threads.
+
+Example:
+
+    python pairwise_aligner_wavefront.py --lengths 100000 1000000 \
+        --threads 1 2 4 8 16 32
+"""
+
+from __future__ import print_function
+
+import argparse
+import random
+import time
+
+from Bio import Align
+
+
+def mutate(sequence, rate, rng):
+    """Return a copy of sequence with substitutions, insertions, and deletions."""
+    letters = []
+    for letter in sequence:
+        r = rng.random()
+        if r < rate / 3:
+            letters.append(rng.choice("ACGT"))
+        elif r < 2 * rate / 3:
+            letters.append(letter)
+            letters.append(rng.choice("ACGT"))
+        elif r >= rate:
+            letters.append(letter)
+    return "".join(letters)
+
+
+def main():
+    """Run the benchmark."""
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--lengths", type=int, nargs="+", default=[100000],
+                        help="sequence lengths (default: 100000)")
+    parser.add_argument("--threads", type=int, nargs="+",
+                        default=[1, 2, 4, 8, 16, 32],
+                        help="numbers of threads (default: 1 2 4 8 16 32)")
+    parser.add_argument("--affine", action="store_true",
+                        help="use affine gap scores (Gotoh algorithm)")
+    parser.add_argument("--seed", type=int, default=0,
+                        help="random seed (default: 0)")
+    args = parser.parse_args()
+
+    aligner = Align.PairwiseAligner()
+    aligner.mismatch_score = -1
+    if args.affine:
+        aligner.open_gap_score = -3
+        aligner.extend_gap_score = -1
+    else:
+        aligner.gap_score = -2
+    print(aligner.algorithm)
+    rng = random.Random(args.seed)
+    for length in args.lengths:
+        target = "".join(rng.choice("ACGT") for i in range(length))
+        query = mutate(target, 0.1, rng)
+        cells = float(len(target)) * len(query)
+        print()
+        print("target length %d, query length %d" % (len(target), len(query)))
+        print("%8s %12s %10s %10s %8s" % ("threads", "score", "seconds",
+                                          "speedup", "GCUPS"))
+        reference = None
+        for n_threads in args.threads:
+            aligner.n_threads = n_threads
+            start = time.time()
+            score = aligner.score(target, query)
+            seconds = time.time() - start
+            if reference is None:
+                reference = seconds
+            print("%8d %12.1f %10.2f %10.2f %8.3f"
+                  % (n_threads, score, seconds, reference / seconds,
+                     cells / seconds / 1e9))
+
+
+if __name__ == "__main__":
+    main()
@@ -261,6 +261,38 @@ class TestScoreOnly(unittest.TestCase):
                                           1, -0.5, -3, -1, score_only=True)
         self.assertEqual(aligns1[0][2], aligns2)
 
+    def test_score_only_band(self):
+        """Test ``band`` together with ``score_only``."""
+        seq1 = "GAACTGGATCCAGT"
+        seq2 = "GATGGTTCCAGTAAC"
+        for band in (2, 3, 20):
+            self.assertEqual(pairwise2.align.globalms(seq1, seq2,
+                                                      2, -1, -2, -0.5,
+                                                      score_only=True,
+                                                      band=band), 15.5)
+            self.assertEqual(pairwise2.align.localms(seq1, seq2,
+                                                     2, -1, -2, -0.5,
+                                                     score_only=True,
+                                                     band=band), 18.5)
+        # The best alignment starts with a gap of two; it does not fit into
+        # a narrower band:
+        self.assertEqual(pairwise2.align.globalms(seq1, seq2, 2, -1, -2, -0.5,
+                                                  score_only=True, band=1),
+                         -2.5)
+        self.assertEqual(pairwise2.align.globalms(seq1, seq2, 2, -1, -2, -0.5,
+                                                  score_only=True, band=0),
+                         -4.0)
+
+    def test_band_errors(self):
+        """Test invalid uses of ``band``."""
+        self.assertRaises(ValueError, pairwise2.align.globalxx,
+                          "GAACT", "GAT", band=1)
+        self.assertRaises(ValueError, pairwise2.align.globalxx,
+                          "GAACT", "GAT", score_only=True, band=-1)
+        self.assertRaises(ValueError, pairwise2.align.globalxc,
+                          "GAACT", "GAT", lambda x, y: -y, lambda x, y: -y,
+                          score_only=True, band=1)
+
 
 class TestPairwiseOpenPenalty(unittest.TestCase):
     """Alignments with gap-open penalty."""
@@ -619,6 +651,33 @@ AT-T
   Score=3
 """)
 
+    def test_match_dictionary4(self):
+        """Test 4, with missing keys, asymmetry and a subclass."""
+        self.assertRaises(KeyError, pairwise2.align.globalds, "ATC", "ATT",
+                          self.match_dict, -1, 0)
+        match_fn = pairwise2.dictionary_match(self.match_dict, symmetric=0)
+        self.assertRaises(KeyError, pairwise2.align.globalcs, "ATAT", "ATT",
+                          match_fn, -1, 0)
+        score = pairwise2.align.globalcs("AA", "AT", match_fn, -1, 0,
+                                         score_only=True)
+        self.assertEqual(score, 2.0)
+        self.assertEqual(pairwise2.align.globalds("TAT", "ATA",
+                                                  self.match_dict, -1, 0,
+                                                  score_only=True),
+                         pairwise2.align.globalds("ATA", "TAT",
+                                                  self.match_dict, -1, 0,
+                                                  score_only=True))
+
+        class TenfoldMatch(pairwise2.dictionary_match):
+            def __call__(self, charA, charB):
+                return 10 * pairwise2.dictionary_match.__call__(self, charA,
+                                                                charB)
+
+        match_fn = TenfoldMatch(self.match_dict)
+        score = pairwise2.align.globalcs("ATTA", "ATTA", match_fn, -1, 0,
+                                         score_only=True)
+        self.assertEqual(score, 50.0)
+
 
 class TestPairwiseOneCharacter(unittest.TestCase):
     """Alignments where one sequence has length 1."""
@@ -787,6 +846,27 @@ class TestOtherFunctions(unittest.TestCase):
                          "-3.0   1.5   6.0  10.0 \n")
         sys.stdout = sys.__stdout__
 
+    def test_find_start(self):
+        """``_find_start`` returns the same starts for any score matrix."""
+        match_fn = pairwise2.identity_match(2, -1)
+        score_matrix, trace_matrix, best_score = \
+            pairwise2._make_score_matrix_fast("GAACTTG", "ACTGAAC", match_fn,
+                                              -1, -0.5, -1, -0.5, False,
+                                              (False, False), False, False)
+        self.assertEqual(best_score, 8.0)
+        as_lists = [list(row) for row in score_matrix]
+        for align_globally in (True, False):
+            expected = pairwise2._python_find_start(as_lists, best_score,
+                                                    align_globally)
+            self.assertEqual(pairwise2._find_start(score_matrix, best_score,
+                                                   align_globally),
+                             expected)
+            self.assertEqual(pairwise2._find_start(as_lists, best_score,
+                                                   align_globally),
+                             expected)
+        self.assertEqual(expected, [(8.0, (4, 7)), (8.0, (5, 7)), (8.0, (6, 7)),
+                                    (8.0, (7, 7))])
+
     def test_recover_alignments(self):
         """One possible start position in local alignment is not a match."""
         self.assertEqual(len(pairwise2.align.localxx("AC", "GA")), 1)
@@ -804,6 +884,7 @@ if __name__ == "__main__":
     # Now, we switch explicitly to the fallback Python functions:
     pairwise2._make_score_matrix_fast = (pairwise2
                                          ._python_make_score_matrix_fast)
+    pairwise2._find_start = pairwise2._python_find_start
     pairwise2.rint = pairwise2._python_rint
 
     runner = unittest.TextTestRunner(verbosity=2)
@@ -15,6 +15,8 @@ from Bio.Alphabet import generic_dna
 from Bio.Alphabet import Gapped
 from Bio.Alphabet import IUPAC
 from Bio import motifs
+from Bio.motifs.matrix import PositionSpecificScoringMatrix
+from Bio.motifs.matrix import scan, scan_chunks, scan_fasta
 from Bio.Seq import Seq
 
 
@@ -2245,6 +2247,172 @@ class MotifTestPWM(unittest.TestCase):
         self.assertAlmostEqual(result[5], -25.18009186, places=5)
         self.assertTrue(math.isnan(result[6]), "Expected nan, not %r" % result[6])
 
+    def test_search(self):
+        """Test searching for hits on both strands."""
+        counts = self.m.counts
+        pwm = counts.normalize(pseudocounts=0.25)
+        pssm = pwm.log_odds()
+        hits = list(pssm.search(Seq("ACGTGTGCGTAGTGCGTN", self.m.alphabet),
+                                threshold=-30.0))
+        self.assertEqual([position for position, score in hits],
+                         [0, -18, 2, -16, -15, 4, -14, 5])
+        self.assertAlmostEqual(hits[0][1], -29.18363571, places=5)
+        self.assertAlmostEqual(hits[1][1], -26.58589554, places=5)
+        self.assertAlmostEqual(hits[5][1], -20.3014183, places=5)
+        hits = list(pssm.search(Seq("ACGTGTGCGTAGTGCGTN", self.m.alphabet),
+                                threshold=-30.0, both=False))
+        self.assertEqual([position for position, score in hits],
+                         [0, 2, 4, 5])
+
+    def test_scan(self):
+        """Test scanning for hits of several motifs at once."""
+        counts = self.m.counts
+        pssm = counts.normalize(pseudocounts=0.25).log_odds()
+        motif = motifs.create([Seq("GTGCG", self.m.alphabet),
+                               Seq("GTACG", self.m.alphabet)])
+        short = motif.counts.normalize(pseudocounts=0.25).log_odds()
+        sequence = "ACGTGTGCGTAGTGCGTN"
+        indices, positions, scores = scan([pssm, short], sequence,
+                                          thresholds=[-25.0, 2.0])
+        self.assertEqual(list(indices), [1, 0, 1, 1, 1])
+        self.assertEqual(list(positions), [2, 4, 4, -11, 11])
+        self.assertAlmostEqual(scores[0], 3.90689063, places=5)
+        self.assertAlmostEqual(scores[1], -20.3014183, places=5)
+        # The same hits are found by searching with each motif separately:
+        for index, motif, threshold in ((0, pssm, -25.0), (1, short, 2.0)):
+            hits = [(position, score)
+                    for i, position, score in zip(indices, positions, scores)
+                    if i == index]
+            self.assertEqual(hits, list(motif.search(sequence, threshold)))
+        # The sequence can also be bytes, in upper or lower case:
+        result = scan([pssm, short], sequence.lower().encode("ASCII"),
+                      thresholds=[-25.0, 2.0], both=False)
+        self.assertEqual(list(result[0]), [1, 0, 1, 1])
+        self.assertEqual(list(result[1]), [2, 4, 4, 11])
+        self.assertRaises(ValueError, scan, [pssm, short], sequence, [0.0])
+
+    def test_score_rounding(self):
+        """Test that the columns are added one by one, in order."""
+        # Adding 2**-53 to 1 + 2**-24 is a tie in double precision, which is
+        # rounded to even, so the column-by-column sum remains 1 + 2**-24,
+        # which as a float is rounded to 1.0.  Adding the last four columns
+        # first would give 1 + 2**-24 + 2**-51, rounded up to 1 + 2**-23.
+        a = 1 + 2.0 ** -24
+        b = 2.0 ** -53
+        values = {"A": [a, 0.0, 0.0, 0.0, b, b, b, b],
+                  "C": [0.0] * 8, "G": [0.0] * 8, "T": [0.0] * 8}
+        pssm = PositionSpecificScoringMatrix("ACGT", values)
+        sequence = "AAAAAAAAA"
+        self.assertEqual(list(pssm.calculate(sequence)), [1.0, 1.0])
+        # The scores are therefore not above a threshold of 1.0:
+        indices, positions, scores = scan([pssm], sequence, [1.0], False)
+        self.assertEqual(len(indices), 0)
+        self.assertEqual(list(pssm.search(sequence, 1.0, both=False)), [])
+        indices, positions, scores = scan([pssm], sequence, [0.5], False)
+        self.assertEqual(list(positions), [0, 1])
+        self.assertEqual(list(scores), [1.0, 1.0])
+
+    def test_scan_long(self):
+        """Test scanning a sequence longer than the blocks used in C."""
+        counts = self.m.counts
+        pssm = counts.normalize(pseudocounts=0.25).log_odds()
+        sequence = "".join("ACGTN"[(i * i + i // 7) % 5] if i % 97 == 0
+                           else "ACGT"[(i * i + i // 7) % 4]
+                           for i in range(5000))
+        consensus = str(pssm.consensus)
+        for i in (1000, 2500, 4090):
+            sequence = sequence[:i] + consensus + sequence[i + len(consensus):]
+        scores = pssm.calculate(sequence)
+        # Windows are abandoned early if they cannot reach the threshold:
+        for threshold in (-22.0, -10.0, pssm.max - 5.0):
+            result = scan([pssm], sequence, threshold, False)
+            expected = [i for i, score in enumerate(scores)
+                        if score > threshold]
+            self.assertEqual(list(result[1]), expected)
+            self.assertEqual(list(result[0]), [0] * len(expected))
+            for i, score in zip(result[1], result[2]):
+                self.assertAlmostEqual(score, scores[i], places=5)
+
+    def test_search_long(self):
+        """Test searching a sequence longer than the blocks used by search."""
+        counts = self.m.counts
+        pssm = counts.normalize(pseudocounts=0.25).log_odds()
+        sequence = "".join("ACGT"[(i * i + i // 7) % 4] for i in range(140000))
+        # put hits across the boundaries between blocks on both strands:
+        consensus = str(pssm.consensus)
+        reverse = str(pssm.consensus.reverse_complement())
+        for i, word in ((65530, consensus), (131066, reverse)):
+            sequence = sequence[:i] + word + sequence[i + len(word):]
+        hits = pssm.search(sequence, threshold=-10.0)
+        # the first hit is found before the rest of the sequence is scanned:
+        self.assertEqual(next(hits)[0], 17)
+        indices, positions, scores = scan([pssm], sequence, -10.0)
+        self.assertIn(65530, positions)
+        self.assertIn(131066 - len(sequence), positions)
+        hits = [(17, scores[0])] + list(hits)
+        self.assertEqual(hits, list(zip(positions, scores)))
+
+    def test_scan_chunks(self):
+        """Test scanning a sequence supplied in chunks."""
+        counts = self.m.counts
+        pssm = counts.normalize(pseudocounts=0.25).log_odds()
+        motif = motifs.create([Seq("GTGCG", self.m.alphabet),
+                               Seq("GTACG", self.m.alphabet)])
+        short = motif.counts.normalize(pseudocounts=0.25).log_odds()
+        sequence = "".join("ACGTN"[(i * i + i // 7) % 5] if i % 97 == 0
+                           else "ACGT"[(i * i + i // 7) % 4]
+                           for i in range(3000))
+        n = len(sequence)
+        thresholds = [-10.0, 2.0]
+        expected = []
+        for index, position, score in zip(*scan([pssm, short], sequence,
+                                                thresholds)):
+            if position < 0:
+                expected.append((index, position + n, -1, score))
+            else:
+                expected.append((index, position, +1, score))
+        expected.sort()
+        self.assertEqual(len(expected), 726)
+        # Hits spanning two chunks should be found once, whatever the size of
+        # the chunks; white space is ignored.
+        for size in (1, 3, 10, 17, 1000, n):
+            chunks = [sequence[i:i + size] + "\n" for i in range(0, n, size)]
+            hits = list(scan_chunks([pssm, short], chunks, thresholds))
+            self.assertEqual(sorted(hits), expected)
+            chunks = [chunk.encode("ASCII") for chunk in chunks]
+            hits = list(scan_chunks([pssm, short], chunks, thresholds))
+            self.assertEqual(sorted(hits), expected)
+        hits = list(scan_chunks([pssm, short], [sequence], thresholds, False))
+        self.assertEqual(sorted(hits),
+                         [hit for hit in expected if hit[2] == +1])
+
+    def test_scan_fasta(self):
+        """Test scanning the sequences in a FASTA file."""
+        counts = self.m.counts
+        pssm = counts.normalize(pseudocounts=0.25).log_odds()
+        sequences = ["".join("ACGT"[(i * i + i // (j + 3)) % 4]
+                             for i in range(length))
+                     for j, length in enumerate((500, 0, 123))]
+        filename = "motifs/scan.fa"
+        try:
+            with open(filename, "w") as handle:
+                for j, sequence in enumerate(sequences):
+                    handle.write(">seq%d test\n" % j)
+                    for i in range(0, len(sequence), 60):
+                        handle.write(sequence[i:i + 60] + "\n")
+            expected = []
+            for j, sequence in enumerate(sequences):
+                for hit in scan_chunks([pssm], [sequence], -15.0):
+                    expected.append(("seq%d test" % j,) + hit)
+            self.assertEqual(len(expected), 63)
+            for chunk_size in (7, 1048576):
+                hits = scan_fasta([pssm], filename, -15.0,
+                                  chunk_size=chunk_size)
+                self.assertEqual(sorted(hits), sorted(expected))
+        finally:
+            if os.path.exists(filename):
+                os.remove(filename)
+
     def test_mixed_alphabets(self):
         """Test creating motif with mixed alphabets."""
         # TODO - Can we support this?
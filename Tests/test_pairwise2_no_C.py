@@ -20,6 +20,7 @@ from Bio import pairwise2
 
 # Explicitly using pure Python fallback functions:
 pairwise2._make_score_matrix_fast = pairwise2._python_make_score_matrix_fast
+pairwise2._find_start = pairwise2._python_find_start
 pairwise2.rint = pairwise2._python_rint
 
 
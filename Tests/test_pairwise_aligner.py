@@ -7,6 +7,9 @@
 
 """Tests for pairwise aligner module."""
 
+import array
+import itertools
+import pickle
 import unittest
 
 from Bio import Align
@@ -1573,6 +1576,1382 @@ TTGGAA
             alignments = aligner.align(seq1, seq2)
             alignments = list(alignments)
 
+    def test_gap_function_calls(self):
+        # The gap functions are called once for each position and length.
+        seq1 = "AAAABBBAAAACCCCCCCCCCCCCCAAAABBBAAAA"
+        seq2 = "AABBBAAAACCCCAAAABBBAA"
+        n1 = len(seq1)
+        n2 = len(seq2)
+        calls = []
+
+        def gap_score(i, n):
+            calls.append((i, n))
+            return -2 - n if i % 5 else -1 - n
+
+        aligner = Align.PairwiseAligner()
+        aligner.mismatch_score = -1
+        aligner.gap_score = gap_score
+        score = aligner.score(seq1, seq2)
+        self.assertAlmostEqual(score, 5.0)
+        self.assertEqual(len(calls), (n1 + 1) * n2 + (n2 + 1) * n1)
+        # the gap scores are calculated again for each call, and are not
+        # kept in the aligner afterwards
+        del calls[:]
+        aligner.mode = "local"
+        self.assertAlmostEqual(aligner.score(seq1, seq2), 13.0)
+        self.assertEqual(len(calls), (n1 + 1) * n2 + (n2 + 1) * n1)
+        del calls[:]
+        alignments = aligner.align(seq1, seq2)
+        self.assertAlmostEqual(alignments.score, 13.0)
+        self.assertEqual(len(calls), (n1 + 1) * n2 + (n2 + 1) * n1)
+        aligner.mode = "global"
+        aligner.gap_score = lambda i, n: gap_score(i, n) - 1
+        self.assertAlmostEqual(aligner.score(seq1, seq2), 2.0)
+        # errors raised by the gap function are propagated
+        aligner.gap_score = lambda i, n: 1 / (n - n2)
+        with self.assertRaises(ZeroDivisionError):
+            aligner.score(seq1, seq2)
+
+
+class TestIntegerLocalScore(unittest.TestCase):
+    """Check local scores calculated by the striped SIMD code, if available.
+
+    With integer scores, PairwiseAligner.score may use 8-bit or 16-bit
+    arithmetic, falling back to double precision if the score saturates.
+    The queries are longer than the 16 lanes of an SSE2 register, so that
+    they are divided into several stripes.
+    """
+
+    target = "GATTACA" * 5
+
+    def test_smith_waterman(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mode = "local"
+        aligner.match_score = 2
+        aligner.mismatch_score = -3
+        aligner.gap_score = -2
+        self.assertEqual(aligner.algorithm, "Smith-Waterman")
+        # 9 matches and a gap: 9 * 2 - 2 = 16
+        self.assertAlmostEqual(aligner.score("GAACTGCTAG", "GAACTCTAG"), 16.0)
+        alignments = aligner.align("GAACTGCTAG", "GAACTCTAG")
+        self.assertAlmostEqual(alignments.score, 16.0)
+        self.assertEqual(str(alignments[0]), """\
+GAACTGCTAG
+|||||-||||
+GAACT-CTAG
+""")
+        # 34 matches and a gap: 34 * 2 - 2 = 66
+        query = self.target[:17] + self.target[18:]
+        self.assertAlmostEqual(aligner.score(self.target, query), 66.0)
+        self.assertAlmostEqual(aligner.score(query, self.target), 66.0)
+        self.assertAlmostEqual(aligner.align(self.target, query).score, 66.0)
+
+    def test_gotoh_local(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mode = "local"
+        aligner.match_score = 2
+        aligner.mismatch_score = -3
+        aligner.open_gap_score = -5
+        aligner.extend_gap_score = -2
+        aligner.query_open_gap_score = -4
+        self.assertEqual(aligner.algorithm, "Gotoh local alignment algorithm")
+        # 32 matches and a gap of 3 in the query: 64 - 4 - 2 * 2 = 56
+        query = self.target[:17] + self.target[20:]
+        self.assertAlmostEqual(aligner.score(self.target, query), 56.0)
+        alignments = aligner.align(self.target, query)
+        self.assertAlmostEqual(alignments.score, 56.0)
+        self.assertEqual(str(alignments[0]), """\
+GATTACAGATTACAGATTACAGATTACAGATTACA
+|||||||||||||||||---|||||||||||||||
+GATTACAGATTACAGAT---AGATTACAGATTACA
+""")
+        # the same gap in the target: 64 - 5 - 2 * 2 = 55
+        self.assertAlmostEqual(aligner.score(query, self.target), 55.0)
+        self.assertAlmostEqual(aligner.align(query, self.target).score, 55.0)
+
+    def test_saturation(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mode = "local"
+        aligner.mismatch_score = -3
+        aligner.open_gap_score = -5
+        aligner.extend_gap_score = -2
+        target = "GATTACA" * 30
+        query = target[:105] + target[106:]
+        # 209 matches and a gap of 1, giving 209 - 5 = 204 (8-bit),
+        # 2090 - 5 = 2085 (16-bit), and 41800 - 5 = 41795 (double precision)
+        for match, score in ((1, 204.0), (10, 2085.0), (200, 41795.0)):
+            aligner.match_score = match
+            self.assertAlmostEqual(aligner.score(target, query), score)
+            self.assertAlmostEqual(aligner.score(query, target), score)
+            self.assertAlmostEqual(aligner.align(target, query).score, score)
+
+    def test_substitution_matrix(self):
+        from Bio.SubsMat.MatrixInfo import blosum62
+        aligner = Align.PairwiseAligner()
+        aligner.mode = "local"
+        aligner.substitution_matrix = blosum62
+        aligner.open_gap_score = -11
+        aligner.extend_gap_score = -1
+        target = "MKTAYIAKQRQISFVKSHFSRQLEERLGLIEVQAPILSRVGDGTQDNLSGAEKAVQVKVKALPDAQ"
+        query = "MKTAYIAKQRQISFVKSHFSRQDILDLWIYHTQGYFPDWQNYTPGPGVRYPLTFGWCYKLVP"
+        # the sum of the BLOSUM62 diagonal over the 22 identical letters
+        # MKTAYIAKQRQISFVKSHFSRQ at the start
+        self.assertAlmostEqual(aligner.score(target, query), 109.0)
+        alignment = aligner.align(target, query)[0]
+        self.assertAlmostEqual(alignment.score, 109.0)
+        self.assertEqual(alignment.path, ((0, 0), (22, 22)))
+
+
+class TestIntegerScore(unittest.TestCase):
+    """Check scores calculated with integer arithmetic.
+
+    If all scores are integers, PairwiseAligner.score calculates local
+    scores using integer instead of double precision arithmetic, unless the
+    score could overflow. Global scores always use double precision, and
+    are checked against the same values.
+    """
+
+    target = "GATTACA" * 5
+
+    def make_aligner(self, mode, **scores):
+        aligner = Align.PairwiseAligner()
+        aligner.mode = mode
+        for name, value in scores.items():
+            setattr(aligner, name, value)
+        return aligner
+
+    def test_needleman_wunsch(self):
+        aligner = self.make_aligner("global", match_score=2,
+                                    mismatch_score=-3, gap_score=-2)
+        # 3 matches and 2 gaps: 3 * 2 - 2 * 2 = 2
+        self.assertAlmostEqual(aligner.score("GAACT", "GAT"), 2.0)
+        alignments = aligner.align("GAACT", "GAT")
+        self.assertAlmostEqual(alignments.score, 2.0)
+        self.assertEqual(str(alignments[0]), """\
+GAACT
+||--|
+GA--T
+""")
+        # 34 matches and a gap: 34 * 2 - 2 = 66, also if end gaps are free
+        query = self.target[:17] + self.target[18:]
+        self.assertAlmostEqual(aligner.score(self.target, query), 66.0)
+        self.assertAlmostEqual(aligner.score(query, self.target), 66.0)
+        aligner.end_gap_score = 0
+        self.assertAlmostEqual(aligner.score(self.target, query), 66.0)
+        self.assertAlmostEqual(aligner.score(query, self.target), 66.0)
+
+    def test_smith_waterman(self):
+        aligner = self.make_aligner("local", match_score=2,
+                                    mismatch_score=-3, gap_score=-3)
+        # 34 matches and a gap: 34 * 2 - 3 = 65
+        query = self.target[:17] + self.target[18:]
+        self.assertAlmostEqual(aligner.score(self.target, query), 65.0)
+        self.assertAlmostEqual(aligner.score(query, self.target), 65.0)
+        self.assertAlmostEqual(aligner.align(self.target, query).score, 65.0)
+
+    def test_gotoh(self):
+        aligner = self.make_aligner("global", match_score=2,
+                                    mismatch_score=-3, open_gap_score=-5,
+                                    extend_gap_score=-1,
+                                    query_end_gap_score=0)
+        # 32 matches and a gap of 3: 32 * 2 - 5 - 1 - 1 = 57
+        query = self.target[:17] + self.target[20:]
+        self.assertAlmostEqual(aligner.score(self.target, query), 57.0)
+        self.assertAlmostEqual(aligner.score(query, self.target), 57.0)
+        self.assertAlmostEqual(aligner.align(self.target, query).score, 57.0)
+        aligner.mode = "local"
+        self.assertAlmostEqual(aligner.score(self.target, query), 57.0)
+        self.assertAlmostEqual(aligner.score(query, self.target), 57.0)
+        self.assertAlmostEqual(aligner.align(query, self.target).score, 57.0)
+        # 3 matches; a gap to reach TT would cost more than it gains
+        self.assertAlmostEqual(aligner.score("GAACTT", "AACGTT"), 6.0)
+        alignments = aligner.align("GAACTT", "AACGTT")
+        self.assertAlmostEqual(alignments.score, 6.0)
+        self.assertEqual(str(alignments[0]), """\
+GAACTT.
+.|||...
+.AACGTT
+""")
+
+    def test_overflow(self):
+        aligner = Align.PairwiseAligner()
+        aligner.match_score = 2 ** 30
+        aligner.mismatch_score = -2 ** 30
+        aligner.gap_score = -2 ** 31
+        score = aligner.score(self.target, self.target)
+        self.assertEqual(score, len(self.target) * 2.0 ** 30)
+        aligner.open_gap_score = -2 ** 31
+        aligner.extend_gap_score = -2 ** 30
+        score = aligner.score(self.target, self.target)
+        self.assertEqual(score, len(self.target) * 2.0 ** 30)
+
+
+class TestBatchScore(unittest.TestCase):
+
+    targets = ["GAACT", "GATTACA", "ACGTACGT", "TTT"]
+    queries = ["GAT", "GATCA", "ACGAGT", "TATT"]
+
+    def test_scores(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mismatch_score = -1
+        aligner.gap_score = -0.5
+        # 3 matches and 4 gaps, and 5 matches and 2 gaps
+        self.assertAlmostEqual(aligner.score("GATTACA", "GAT"), 1.0)
+        alignments = aligner.align("GATTACA", "GAT")
+        self.assertAlmostEqual(alignments.score, 1.0)
+        self.assertEqual(str(alignments[0]), """\
+GATTACA
+|||----
+GAT----
+""")
+        self.assertAlmostEqual(aligner.score("GATTACA", "GATCA"), 4.0)
+        scores = aligner.score_many("GATTACA", ["GAT", "GATCA"])
+        self.assertEqual(list(scores), [1.0, 4.0])
+        scores = aligner.score_pairs(["GATTACA", "GAT"], ["GATCA", "GAT"])
+        self.assertEqual(list(scores), [4.0, 3.0])
+
+    def test_algorithms(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mismatch_score = -1
+        # Against GATTACA, the queries have 7 matches; 6 matches and a gap
+        # of 1 in the query; 3 matches and a gap of 4 in the query; and 7
+        # matches and a gap of 1 in the target.  In local mode, GAT has 3
+        # matches only.  The gap scores are -0.5 per position (linear),
+        # -2 - 0.5 * (n - 1) (affine), and -1 - 0.2 * n for gaps in the
+        # target (function).  score_pairs swaps the target and the query.
+        queries = ["GATTACA", "GATACA", "GAT", "GATTTACA"]
+        for mode, expected in (
+                ("global", (([7.0, 5.5, 1.0, 6.5], [7.0, 5.5, 1.0, 6.5]),
+                            ([7.0, 4.0, -0.5, 5.0], [7.0, 4.0, -0.5, 5.0]),
+                            ([7.0, 4.0, -0.5, 5.8], [7.0, 4.8, 1.2, 5.0]))),
+                ("local", (([7.0, 5.5, 3.0, 6.5], [7.0, 5.5, 3.0, 6.5]),
+                           ([7.0, 4.0, 3.0, 5.0], [7.0, 4.0, 3.0, 5.0]),
+                           ([7.0, 4.0, 3.0, 5.8], [7.0, 4.8, 3.0, 5.0])))):
+            aligner.mode = mode
+            aligner.gap_score = -0.5
+            for gaps, (many, pairs) in zip(("linear", "affine", "function"),
+                                           expected):
+                if gaps == "affine":
+                    aligner.open_gap_score = -2
+                elif gaps == "function":
+                    aligner.target_gap_score = lambda i, n: -1 - 0.2 * n
+                scores = aligner.score_many("GATTACA", queries)
+                self.assertEqual(len(scores), 4)
+                for score, value in zip(scores, many):
+                    self.assertAlmostEqual(score, value)
+                scores = aligner.score_pairs(queries, ["GATTACA"] * 4)
+                self.assertEqual(len(scores), 4)
+                for score, value in zip(scores, pairs):
+                    self.assertAlmostEqual(score, value)
+
+    def test_packed(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mode = "local"
+        data = "".join(self.queries).encode("ascii")
+        offsets = [0, 3, 8, 14, 18]
+        # the longest common subsequences are GAT, GATCA, ACA, and ATT
+        expected = [3.0, 5.0, 3.0, 3.0]
+        scores = aligner.score_many("GATTACA", data, offsets)
+        self.assertEqual(list(scores), expected)
+        scores = aligner.score_many(b"GATTACA", memoryview(data), offsets)
+        self.assertEqual(list(scores), expected)
+        scores = aligner.score_pairs(b"GATTACA" * 4, data,
+                                     [0, 7, 14, 21, 28], offsets)
+        self.assertEqual(list(scores), expected)
+
+    def test_empty(self):
+        aligner = Align.PairwiseAligner()
+        scores = aligner.score_many("GATTACA", [])
+        self.assertEqual(scores, array.array("d"))
+        scores = aligner.score_many("GATTACA", b"", [0])
+        self.assertEqual(scores, array.array("d"))
+        scores = aligner.score_pairs([], [])
+        self.assertEqual(scores, array.array("d"))
+        scores = aligner.score_pairs(b"", b"", [0], [0])
+        self.assertEqual(scores, array.array("d"))
+        with self.assertRaises(ValueError):
+            aligner.score_many("GATTACA", b"", [])
+
+    def test_errors(self):
+        aligner = Align.PairwiseAligner()
+        with self.assertRaises(ValueError):
+            aligner.score_many("GATTACA", ["GAT", ""])
+        with self.assertRaises(ValueError):
+            aligner.score_many("GATTACA", b"GATTACA", [0, 3, 10])
+        with self.assertRaises(ValueError):
+            aligner.score_pairs(["GATTACA"], ["GAT", "GA"])
+
+
+class TestThreads(unittest.TestCase):
+
+    def test_attribute(self):
+        aligner = Align.PairwiseAligner()
+        self.assertEqual(aligner.n_threads, 1)
+        aligner.n_threads = 4
+        self.assertEqual(aligner.n_threads, 4)
+        # 0 means one thread per processor, both for the attribute and for
+        # the n_threads argument
+        aligner.n_threads = 0
+        self.assertEqual(aligner.n_threads, 0)
+        # resolved when used, so that it is not pickled as a processor count
+        copy = pickle.loads(pickle.dumps(aligner))
+        self.assertEqual(copy.n_threads, 0)
+        self.assertEqual(Align.PairwiseAligner.from_bytes(
+            aligner.to_bytes()).n_threads, 0)
+        self.assertAlmostEqual(aligner.score("GATTACA", "GATCA"), 5.0)
+        self.assertEqual(list(aligner.score_many("GATTACA", ["GATCA", "A"])),
+                         [5.0, 1.0])
+        with self.assertRaises(ValueError):
+            aligner.n_threads = -1
+        with self.assertRaises(TypeError):
+            aligner.n_threads = None
+        aligner.n_threads = 1
+        with self.assertRaises(ValueError):
+            aligner.score_many("GATTACA", ["GAT"], n_threads=-1)
+
+    def test_scores(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mode = "local"
+        aligner.mismatch_score = -1
+        aligner.open_gap_score = -2
+        aligner.extend_gap_score = -1
+        # Queries of different lengths, so that the threads finish their
+        # share at different times.  Only the first i letters of GATTACA
+        # match; the Cs in front can only match the one C of GATTACA, so
+        # the score is i.
+        queries = ["C" * j + "GATTACA"[:i]
+                   for i in range(1, 8) for j in range(12)]
+        expected = [float(i) for i in range(1, 8) for j in range(12)]
+        for n_threads in (1, 2, 3, 8, 0):
+            scores = aligner.score_many("GATTACA", queries,
+                                        n_threads=n_threads)
+            self.assertEqual(list(scores), expected)
+        aligner.n_threads = 3
+        scores = aligner.score_pairs(queries, ["GATTACA"] * len(queries))
+        self.assertEqual(list(scores), expected)
+
+
+class TestAllPairs(unittest.TestCase):
+
+    def test_scores(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mismatch_score = -1
+        aligner.gap_score = -0.5
+        sequences = ["GATTACA", "GATACA", "GAT", "GATTTACA"]
+        # in the order (0, 1), (0, 2), (1, 2), (0, 3), (1, 3), (2, 3); each
+        # pair has only matches and a single gap, of 1, 4, 3, 1, 2, and 5
+        # letters, respectively
+        scores = aligner.score_all_pairs(sequences)
+        self.assertEqual(list(scores), [5.5, 1.0, 1.5, 6.5, 5.0, 0.5])
+        aligner.open_gap_score = -2
+        scores = aligner.score_all_pairs(sequences)
+        self.assertEqual(list(scores), [4.0, -0.5, 0.0, 5.0, 3.5, -1.0])
+
+    def test_tiles(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mode = "local"
+        aligner.mismatch_score = -1
+        aligner.open_gap_score = -2
+        aligner.extend_gap_score = -1
+        # More sequences than fit in one tile.  Sequence k consists of j Cs
+        # followed by the first i letters of GATTA; the best local alignment
+        # of two of them matches the Cs and the letters of GATTA they have
+        # in common.
+        keys = [(j, i) for j in range(16) for i in range(1, 6)]
+        sequences = ["C" * j + "GATTA"[:i] for j, i in keys]
+        expected = [min(keys[k][0], keys[l][0]) + min(keys[k][1], keys[l][1])
+                    for k in range(len(keys)) for l in range(k)]
+        for n_threads in (1, 3, 0):
+            scores = aligner.score_all_pairs(sequences, n_threads=n_threads)
+            self.assertEqual(len(scores), 80 * 79 // 2)
+            self.assertEqual(list(scores), expected)
+
+    def test_empty(self):
+        aligner = Align.PairwiseAligner()
+        scores = aligner.score_all_pairs([])
+        self.assertEqual(scores, array.array("d"))
+        scores = aligner.score_all_pairs(b"", [0])
+        self.assertEqual(scores, array.array("d"))
+        scores = aligner.score_all_pairs(["GATTACA"])
+        self.assertEqual(scores, array.array("d"))
+
+    def test_errors(self):
+        aligner = Align.PairwiseAligner()
+        with self.assertRaises(ValueError):
+            aligner.score_all_pairs(["GATTACA", ""])
+        with self.assertRaises(ValueError):
+            aligner.score_all_pairs(b"GATTACA", [0, 3, 10])
+
+
+class TestSearch(unittest.TestCase):
+
+    def test_search(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mode = "local"
+        aligner.mismatch_score = -1
+        aligner.open_gap_score = -2
+        aligner.extend_gap_score = -1
+        # The best local alignments to GATTACA are GATTACA (7), GATTA (5),
+        # TT (2), GATTACA (7), ACA (3), G (1), GAT or CA (3), and TACA or
+        # GATT (4). Hits with equal scores are sorted by index.
+        database = ["CCGATTACACC", "GATTA", "TTTT", "GATTACA", "ACA", "GGGG",
+                    "GATCA", "TACAGATT"]
+        expected = [(0, 7.0), (3, 7.0), (1, 5.0), (7, 4.0), (4, 3.0)]
+        for n_threads in (1, 3):
+            hits = aligner.search("GATTACA", database, k=5,
+                                  n_threads=n_threads)
+            self.assertEqual([hit[:2] for hit in hits], expected)
+            for index, score, alignments in hits:
+                self.assertEqual(alignments.score, score)
+                self.assertEqual(alignments[0].target, database[index])
+                self.assertEqual(alignments[0].query, "GATTACA")
+        hits = aligner.search("GATTACA", database, k=100, min_score=5)
+        self.assertEqual([hit[:2] for hit in hits], expected[:3])
+        data = "".join(database).encode("ascii")
+        offsets = [0]
+        for target in database:
+            offsets.append(offsets[-1] + len(target))
+        hits = aligner.search(b"GATTACA", data, k=3, offsets=offsets)
+        self.assertEqual([hit[:2] for hit in hits], expected[:3])
+        self.assertEqual(hits[0][2][0].target, "CCGATTACACC")
+
+    def test_positive_gap_score(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mismatch_score = -1
+        aligner.open_gap_score = -2
+        aligner.extend_gap_score = -1
+        aligner.target_end_gap_score = 1
+        # Each letter of the query scores at most 1, as a match or outside
+        # the target, so only the targets found in GATTACA score 7.  As the
+        # score is not bounded by the length of the target, no candidates
+        # can be skipped.
+        database = ["GATTACA", "T", "CCCCCCC", "GAAT"]
+        hits = aligner.search("GATTACA", database, k=2)
+        self.assertEqual([hit[:2] for hit in hits], [(0, 7.0), (1, 7.0)])
+        scores = aligner.score_pairs(database, ["GATTACA"] * len(database))
+        expected = sorted(enumerate(scores), key=lambda hit: -hit[1])
+        hits = aligner.search("GATTACA", database, k=4)
+        self.assertEqual([hit[:2] for hit in hits], expected)
+
+    def test_empty(self):
+        aligner = Align.PairwiseAligner()
+        self.assertEqual(aligner.search("GATTACA", []), [])
+        self.assertEqual(aligner.search("GATTACA", b"", offsets=[0]), [])
+
+    def test_errors(self):
+        aligner = Align.PairwiseAligner()
+        with self.assertRaises(ValueError):
+            aligner.search("GATTACA", ["GAT", "GA"], k=0)
+        with self.assertRaises(ValueError):
+            aligner.search("", ["GAT", "GA"])
+
+
+class TestWavefront(unittest.TestCase):
+
+    def test_scores(self):
+        # long enough to be divided into tiles calculated by several threads
+        target = "GATTACA" * 200
+        query = list(target[:600] + target[603:])
+        for i in (100, 300, 900, 1200):
+            query[i] = "C"
+        query = "".join(query)
+        aligner = Align.PairwiseAligner()
+        aligner.mismatch_score = -1
+        aligner.gap_score = -1
+        self.assertEqual(aligner.algorithm, "Needleman-Wunsch")
+        # The deletion of 3 letters shifts the query out of phase with the
+        # repeats of GATTACA, so it needs a gap of 3; the query then has
+        # 1393 matches and 4 mismatches: 1393 - 4 - 3 = 1386
+        for n_threads in (1, 3):
+            aligner.n_threads = n_threads
+            self.assertEqual(aligner.score(target, query), 1386.0)
+            # one match for each of the 1400 letters
+            self.assertEqual(aligner.score(target, target), 1400.0)
+        aligner.open_gap_score = -2.5
+        aligner.extend_gap_score = -0.5
+        aligner.query_end_gap_score = -0.25
+        self.assertEqual(aligner.algorithm, "Gotoh global alignment algorithm")
+        # the gap of 3 now scores -2.5 - 2 * 0.5 = -3.5; there are no end
+        # gaps
+        for n_threads in (1, 3, 0):
+            aligner.n_threads = n_threads
+            self.assertEqual(aligner.score(target, query), 1385.5)
+
+
+class TestLazyAlignments(unittest.TestCase):
+
+    def check_lazy(self, aligner, target, query, score, paths):
+        """Check the score, the number of alignments, and their paths.
+
+        The paths of all optimal alignments are given in sorted order; the
+        alignments are counted, indexed, and iterated over without
+        calculating all of them first, and indexing must give them in the
+        same order as iterating.
+        """
+        count = len(paths)
+        self.assertAlmostEqual(aligner.score(target, query), score)
+        alignments = aligner.align(target, query)
+        self.assertAlmostEqual(alignments.score, score)
+        self.assertEqual(alignments.count(2), min(2, count))
+        self.assertEqual(alignments.count(), count)
+        self.assertEqual(len(alignments), count)
+        found = [alignment.path for alignment in aligner.align(target, query)]
+        self.assertEqual(sorted(found), paths)
+        # go back and forth between the alignments
+        alignments = aligner.align(target, query)
+        for index in reversed(range(count)):
+            self.assertEqual(alignments[index].path, found[index])
+        for index in range(count):
+            self.assertEqual(alignments[index - count].path, found[index])
+        with self.assertRaises(IndexError):
+            alignments[count]
+        with self.assertRaises(IndexError):
+            alignments[-count - 1]
+
+    def embeddings(self, target, query):
+        """Return the paths of all global alignments without mismatches.
+
+        Each query letter is aligned to an identical target letter, and
+        the remaining target letters to gaps.
+        """
+        paths = []
+        for positions in itertools.combinations(range(len(target)),
+                                                len(query)):
+            if any(target[i] != letter
+                   for i, letter in zip(positions, query)):
+                continue
+            steps = []
+            start = 0
+            for i in positions:
+                steps.extend([(1, 0)] * (i - start) + [(1, 1)])
+                start = i + 1
+            steps.extend([(1, 0)] * (len(target) - start))
+            point = (0, 0)
+            path = [point]
+            for index, step in enumerate(steps):
+                if index > 0 and step != steps[index - 1]:
+                    path.append(point)
+                point = (point[0] + step[0], point[1] + step[1])
+            path.append(point)
+            paths.append(tuple(path))
+        return sorted(paths)
+
+    def test_needleman_wunsch_smith_waterman(self):
+        aligner = Align.PairwiseAligner()
+        aligner.gap_score = -0.5
+        aligner.mode = "global"
+        # 3 matches and 4 gaps, with the matched letters chosen in
+        # C(7, 3) = 35 ways
+        paths = self.embeddings("AAAAAAA", "AAA")
+        self.assertEqual(len(paths), 35)
+        self.check_lazy(aligner, "AAAAAAA", "AAA", 1.0, paths)
+        # 5 matches and 4 gaps; GACTA is found in GAACTTAGA in 2 * 2 * 2 ways
+        paths = self.embeddings("GAACTTAGA", "GACTA")
+        self.assertEqual(len(paths), 8)
+        self.check_lazy(aligner, "GAACTTAGA", "GACTA", 3.0, paths)
+        aligner.mode = "local"
+        # 3 matches, at 5 positions
+        self.check_lazy(aligner, "AAAAAAA", "AAA", 3.0,
+                        [((i, 0), (i + 3, 3)) for i in range(5)])
+        # 5 matches and 2 gaps, skipping one of the two As and one of the
+        # two Ts of GAACTTAGA
+        self.check_lazy(aligner, "GAACTTAGA", "GACTA", 4.0, [
+            ((0, 0), (1, 1), (2, 1), (4, 3), (5, 3), (7, 5)),
+            ((0, 0), (1, 1), (2, 1), (5, 4), (6, 4), (7, 5)),
+            ((0, 0), (2, 2), (3, 2), (4, 3), (5, 3), (7, 5)),
+            ((0, 0), (2, 2), (3, 2), (5, 4), (6, 4), (7, 5))])
+
+    def test_gotoh(self):
+        aligner = Align.PairwiseAligner()
+        aligner.open_gap_score = -1
+        aligner.extend_gap_score = -0.5
+        aligner.mode = "global"
+        # 3 matches and a single gap of 4 (-2.5), placed in 4 ways
+        self.check_lazy(aligner, "AAAAAAA", "AAA", 0.5, [
+            ((0, 0), (1, 1), (5, 1), (7, 3)),
+            ((0, 0), (2, 2), (6, 2), (7, 3)),
+            ((0, 0), (3, 3), (7, 3)),
+            ((0, 0), (4, 0), (7, 3))])
+        # 5 matches, a gap of 1, and a gap of 3 (-2)
+        self.check_lazy(aligner, "GAACTTAGA", "GACTA", 2.0, [
+            ((0, 0), (1, 1), (2, 1), (5, 4), (8, 4), (9, 5)),
+            ((0, 0), (2, 2), (3, 2), (5, 4), (8, 4), (9, 5))])
+        aligner.mode = "local"
+        self.check_lazy(aligner, "AAAAAAA", "AAA", 3.0,
+                        [((i, 0), (i + 3, 3)) for i in range(5)])
+        # ACT; GA and CT, or AC and TA, with a gap of 1; or all of GACTA
+        # with two gaps of 1
+        self.check_lazy(aligner, "GAACTTAGA", "GACTA", 3.0, [
+            ((0, 0), (2, 2), (3, 2), (4, 3), (5, 3), (7, 5)),
+            ((0, 0), (2, 2), (3, 2), (5, 4)),
+            ((2, 1), (4, 3), (5, 3), (7, 5)),
+            ((2, 1), (5, 4))])
+
+    def test_waterman_smith_beyer(self):
+        aligner = Align.PairwiseAligner()
+        aligner.gap_score = lambda i, n: -n
+        aligner.mode = "global"
+        # as for Needleman-Wunsch, with a score of -1 for each gap position
+        paths = self.embeddings("AAAAAAA", "AAA")
+        self.check_lazy(aligner, "AAAAAAA", "AAA", -1.0, paths)
+        paths = self.embeddings("GAACTTAGA", "GACTA")
+        self.check_lazy(aligner, "GAACTTAGA", "GACTA", 1.0, paths)
+        aligner.mode = "local"
+        self.check_lazy(aligner, "AAAAAAA", "AAA", 3.0,
+                        [((i, 0), (i + 3, 3)) for i in range(5)])
+        # as for Gotoh, with a score of -1 for a gap of 1
+        self.check_lazy(aligner, "GAACTTAGA", "GACTA", 3.0, [
+            ((0, 0), (2, 2), (3, 2), (4, 3), (5, 3), (7, 5)),
+            ((0, 0), (2, 2), (3, 2), (5, 4)),
+            ((2, 1), (4, 3), (5, 3), (7, 5)),
+            ((2, 1), (5, 4))])
+
+    def test_many_alignments(self):
+        aligner = Align.PairwiseAligner()
+        aligner.gap_score = 0
+        aligner.mismatch_score = 0
+        alignments = aligner.align("A" * 200, "A" * 100)
+        self.assertEqual(alignments.count(1000), 1000)
+        with self.assertRaises(OverflowError):
+            len(alignments)
+        with self.assertRaises(ValueError):
+            alignments.count(0)
+        alignment = alignments[5000]
+        self.assertAlmostEqual(alignment.score, 100.0)
+        path = alignments[5001].path
+        alignments = aligner.align("A" * 200, "A" * 100)
+        for index, alignment in enumerate(alignments):
+            if index == 5001:
+                break
+        self.assertEqual(alignment.path, path)
+
+
+class TestAlignBest(unittest.TestCase):
+
+    target = "GAACTGACCTTGCATTAGGCA"
+    query = "GAACTGCATTAAGGCA"
+
+    def check_best(self, aligner, target, query, score, path, cigar):
+        """Check align_best against the expected score, path, and CIGAR.
+
+        The path is that of the first alignment found by align.
+        """
+        alignments = aligner.align(target, query)
+        self.assertAlmostEqual(alignments.score, score)
+        self.assertEqual(alignments[0].path, path)
+        score, coordinates = aligner.align_best(target, query)
+        self.assertAlmostEqual(score, alignments.score)
+        self.assertEqual(tuple(zip(coordinates[::2], coordinates[1::2])),
+                         path)
+        self.assertEqual(aligner.align_best(target, query, cigar=True),
+                         (score, path[0][0], cigar))
+
+    def test_global(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mismatch_score = -1
+        aligner.gap_score = -1
+        # 15 matches, 1 mismatch, and 5 gap positions: 15 - 1 - 5 = 9
+        path = ((0, 0), (6, 6), (7, 6), (11, 10), (13, 10), (14, 11),
+                (16, 11), (21, 16))
+        self.check_best(aligner, self.target, self.query, 9.0, path,
+                        b"6M1D4M2D1M2D5M")
+        # 15 matches, a gap of length 6 (-4.5) and a gap of length 1 (-2)
+        aligner.open_gap_score = -2
+        aligner.extend_gap_score = -0.5
+        path = ((0, 0), (4, 4), (10, 4), (16, 10), (16, 11), (21, 16))
+        self.check_best(aligner, self.target, self.query, 8.5, path,
+                        b"4M6D6M1I5M")
+        aligner.linear_space = True
+        self.check_best(aligner, self.target, self.query, 8.5, path,
+                        b"4M6D6M1I5M")
+        aligner.linear_space = False
+        aligner.band_width = 6
+        self.check_best(aligner, self.target, self.query, 8.5, path,
+                        b"4M6D6M1I5M")
+        aligner.band_width = None
+        # 15 matches, 1 mismatch, and gaps of length 1, 2, and 2:
+        # 15 - 1 - 2 - 3 - 3 = 6
+        aligner.gap_score = lambda i, n: -1 - n
+        path = ((0, 0), (6, 6), (7, 6), (11, 10), (13, 10), (14, 11),
+                (16, 11), (21, 16))
+        self.check_best(aligner, self.target, self.query, 6.0, path,
+                        b"6M1D4M2D1M2D5M")
+
+    def test_local(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mode = "local"
+        aligner.mismatch_score = -1
+        aligner.gap_score = -2
+        # the 4 matches of ACGT, with the other letters of the query clipped
+        self.check_best(aligner, "TTTACGTAT", "GGACGTCC", 4.0,
+                        ((3, 2), (7, 6)), b"2S4M2S")
+        score, coordinates = aligner.align_best("AAA", "TTT")
+        self.assertAlmostEqual(score, 0.0)
+        self.assertIsNone(coordinates)
+        self.assertEqual(aligner.align_best("AAA", "TTT", cigar=True),
+                         (0.0, None, None))
+
+    def test_extension(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mode = "extension"
+        aligner.mismatch_score = -2
+        aligner.open_gap_score = -3
+        aligner.extend_gap_score = -1
+        # the 6 matches of GAACTG; the mismatches after them are not included
+        self.check_best(aligner, "GAACTGATTT", "GAACTGCCCC", 6.0,
+                        ((0, 0), (6, 6)), b"6M4S")
+
+
+class TestUnitCost(unittest.TestCase):
+
+    # long enough to need several words per column of bit-vectors: the
+    # query is the target with letters 70, 71, 72 deleted and 5 letters
+    # replaced by an N, which does not occur in the target
+    @classmethod
+    def setUpClass(cls):
+        cls.target = "GATTACA" * 21
+        query = list(cls.target[:70] + cls.target[73:])
+        for i in (20, 45, 90, 110, 125):
+            query[i] = "N"
+        cls.query = "".join(query)
+
+    def check_unit(self, aligner, expected):
+        """Check score and align for each sequence pair against the expected score.
+
+        The third pair is a substring of 50 letters of the 147 letters of
+        the target, and the fourth pair is a substring of 3 letters of 70
+        letters.
+        """
+        for (target, query), score in zip(((self.target, self.query),
+                                           (self.query, self.target),
+                                           (self.target, self.target[30:80]),
+                                           ("A" * 70, "A" * 3)),
+                                          expected):
+            self.assertAlmostEqual(aligner.score(target, query), score)
+            self.assertAlmostEqual(aligner.align(target, query).score, score)
+
+    def test_longest_common_subsequence(self):
+        aligner = Align.PairwiseAligner()
+        self.assertEqual(aligner.match_score, 1)
+        self.assertEqual(aligner.mismatch_score, 0)
+        # all 144 - 5 = 139 letters of the query other than N are matched
+        self.check_unit(aligner, [139.0, 139.0, 50.0, 3.0])
+        aligner.mismatch_score = -1
+        self.check_unit(aligner, [139.0, 139.0, 50.0, 3.0])
+
+    def test_edit_distance(self):
+        aligner = Align.PairwiseAligner()
+        aligner.match_score = 0
+        aligner.mismatch_score = -1
+        aligner.gap_score = -1
+        # 5 mismatches to N and 3 deleted letters: -5 - 3 = -8;
+        # 147 - 50 = 97 and 70 - 3 = 67 deleted letters
+        self.check_unit(aligner, [-8.0, -8.0, -97.0, -67.0])
+        # the deletion of 3 letters is not in phase with the period of 7,
+        # so it cannot be moved to the ends of the sequences
+        aligner.query_end_gap_score = 0
+        self.check_unit(aligner, [-8.0, -8.0, 0.0, 0.0])
+        aligner.target_end_gap_score = 0
+        self.check_unit(aligner, [0.0, 0.0, 0.0, 0.0])
+        aligner.query_end_gap_score = -1
+        self.check_unit(aligner, [-8.0, -8.0, -97.0, -67.0])
+        aligner.gap_score = -2
+        aligner.mismatch_score = -2
+        self.check_unit(aligner, [-16.0, -16.0, -194.0, -134.0])
+
+
+class TestLinearSpace(unittest.TestCase):
+
+    target = "GAACTGACCTTGCATTAGGCA"
+    query = "GAACTGCATTAAGGCA"
+
+    def test_needleman_wunsch(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mismatch_score = -1
+        aligner.gap_score = -1
+        # 15 matches, 1 mismatch, and 5 gaps
+        alignment = """\
+GAACTGACCTTGCATTAGGCA
+||||||-|X||--|--|||||
+GAACTG-CATT--A--AGGCA
+"""
+        alignments = aligner.align(self.target, self.query)
+        self.assertAlmostEqual(alignments.score, 9.0)
+        self.assertEqual(str(alignments[0]), alignment)
+        aligner.linear_space = True
+        self.assertAlmostEqual(aligner.score(self.target, self.query), 9.0)
+        alignments = aligner.align(self.target, self.query)
+        self.assertAlmostEqual(alignments.score, 9.0)
+        self.assertEqual(len(alignments), 1)
+        self.assertEqual(str(alignments[0]), alignment)
+
+    def test_gotoh(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mismatch_score = -1
+        aligner.open_gap_score = -2
+        aligner.extend_gap_score = -0.5
+        # 15 matches, a gap of 6 (-4.5), and a gap of 1 (-2); the gap of 6
+        # can start at three positions, and the gap of 1 at two
+        alignments = aligner.align(self.target, self.query)
+        self.assertAlmostEqual(alignments.score, 8.5)
+        self.assertEqual(len(alignments), 6)
+        aligner.linear_space = True
+        self.assertAlmostEqual(aligner.score(self.target, self.query), 8.5)
+        alignments = aligner.align(self.target, self.query)
+        self.assertAlmostEqual(alignments.score, 8.5)
+        self.assertEqual(len(alignments), 1)
+        self.assertEqual(str(alignments[0]), """\
+GAACTGACCTTGCATT-AGGCA
+||||------||||||-|||||
+GAAC------TGCATTAAGGCA
+""")
+        self.assertEqual(alignments[0].path,
+                         ((0, 0), (4, 4), (10, 4), (16, 10), (16, 11),
+                          (21, 16)))
+        aligner.target_end_gap_score = 0
+        aligner.query_left_open_gap_score = -5
+        # 14 matches, 1 mismatch, a free end gap, and two gaps of 1
+        alignments = aligner.align(self.query, self.target)
+        self.assertAlmostEqual(alignments.score, 9.0)
+        self.assertEqual(str(alignments[0]), """\
+-----GAAC-TGCATTAAGGCA
+-----||X|-||||||-|||||
+GAACTGACCTTGCATT-AGGCA
+""")
+
+    def test_waterman_smith_beyer(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mismatch_score = -1
+        aligner.target_gap_score = lambda i, n: -1 - n
+        aligner.query_gap_score = lambda i, n: -2 * n
+        # 15 matches, 1 mismatch, and gaps of 1, 2, and 2 in the query:
+        # 15 - 1 - 2 - 4 - 4 = 4
+        alignment = """\
+GAACTGACCTTGCATTAGGCA
+||||||-|X||--|--|||||
+GAACTG-CATT--A--AGGCA
+"""
+        for linear_space in (False, True):
+            aligner.linear_space = linear_space
+            alignments = aligner.align(self.target, self.query)
+            self.assertAlmostEqual(alignments.score, 4.0)
+            self.assertEqual(str(alignments[0]), alignment)
+
+    def test_long(self):
+        # long enough to be divided into smaller rectangles
+        target = "GATTACA" * 60
+        query = target[:100] + target[110:300] + target[303:]
+        aligner = Align.PairwiseAligner()
+        aligner.mismatch_score = -1
+        aligner.open_gap_score = -3
+        aligner.extend_gap_score = -1
+        aligner.linear_space = True
+        # 407 matches, a gap of 10 (-12), and a gap of 3 (-5); as the target
+        # is periodic, the gaps can be shifted, but not shortened
+        alignments = aligner.align(target, query)
+        self.assertAlmostEqual(alignments.score, 390.0)
+        path = alignments[0].path
+        self.assertEqual(path[0], (0, 0))
+        self.assertEqual(path[-1], (len(target), len(query)))
+        gaps = [end[0] - start[0]
+                for start, end in zip(path[:-1], path[1:])
+                if start[1] == end[1]]
+        self.assertEqual(gaps, [10, 3])
+
+    def test_local(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mode = "local"
+        aligner.linear_space = True
+        with self.assertRaises(ValueError):
+            aligner.align(self.target, self.query)
+
+
+class TestBanded(unittest.TestCase):
+
+    target = "GAACTGACCTTGCATTAGGCA"
+    query = "GAACTGCATTAAGGCA"
+
+    def test_properties(self):
+        aligner = Align.PairwiseAligner()
+        self.assertIsNone(aligner.band_width)
+        self.assertEqual(aligner.band_offset, 0)
+        self.assertFalse(aligner.band_edge_touched)
+        aligner.band_width = 5
+        aligner.band_offset = -2
+        self.assertEqual(aligner.band_width, 5)
+        self.assertEqual(aligner.band_offset, -2)
+        with self.assertRaises(ValueError):
+            aligner.band_width = -1
+        with self.assertRaises(AttributeError):
+            aligner.band_edge_touched = True
+        aligner.band_width = None
+        self.assertIsNone(aligner.band_width)
+
+    def test_wide_band(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mismatch_score = -1
+        aligner.open_gap_score = -2
+        aligner.extend_gap_score = -0.5
+        aligner.band_width = 10
+        # 15 matches, a gap of 6 (-4.5), and a gap of 1 (-2): 8.5; the gap
+        # of 6 can start at three positions, and the gap of 1 at two
+        self.assertAlmostEqual(aligner.score(self.target, self.query), 8.5)
+        self.assertFalse(aligner.band_edge_touched)
+        alignments = aligner.align(self.target, self.query)
+        self.assertAlmostEqual(alignments.score, 8.5)
+        self.assertFalse(aligner.band_edge_touched)
+        self.assertEqual(sorted(alignment.path for alignment in alignments),
+                         [((0, 0), (4, 4), (10, 4), (16, 10), (16, 11),
+                           (21, 16)),
+                          ((0, 0), (4, 4), (10, 4), (17, 11), (17, 12),
+                           (21, 16)),
+                          ((0, 0), (5, 5), (11, 5), (16, 10), (16, 11),
+                           (21, 16)),
+                          ((0, 0), (5, 5), (11, 5), (17, 11), (17, 12),
+                           (21, 16)),
+                          ((0, 0), (6, 6), (12, 6), (16, 10), (16, 11),
+                           (21, 16)),
+                          ((0, 0), (6, 6), (12, 6), (17, 11), (17, 12),
+                           (21, 16))])
+
+    def test_narrow_band(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mismatch_score = -1
+        aligner.open_gap_score = -2
+        aligner.extend_gap_score = -0.5
+        aligner.band_width = 3
+        aligner.band_offset = -2
+        # the gap of 6 does not fit in the band; 15 matches, 1 mismatch, and
+        # gaps of 1, 2, and 2: 15 - 1 - 2 - 2.5 - 2.5 = 7
+        self.assertAlmostEqual(aligner.score(self.target, self.query), 7.0)
+        self.assertTrue(aligner.band_edge_touched)
+        alignments = aligner.align(self.target, self.query)
+        self.assertAlmostEqual(alignments.score, 7.0)
+        self.assertTrue(aligner.band_edge_touched)
+        self.assertEqual(len(alignments), 1)
+        self.assertEqual(str(alignments[0]), """\
+GAACTGACCTTGCATTAGGCA
+||||||-|X||--|--|||||
+GAACTG-CATT--A--AGGCA
+""")
+        # around diagonal -3, the band holds the gap of 6 as well, and the
+        # target aligned to itself has 21 matches
+        aligner.band_offset = -3
+        self.assertAlmostEqual(aligner.score(self.target, self.query), 8.5)
+        scores = aligner.score_many(self.target, [self.query, self.target])
+        self.assertEqual(list(scores), [8.5, 21.0])
+
+    def test_batch_band_edges(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mismatch_score = -1
+        aligner.open_gap_score = -2
+        aligner.extend_gap_score = -0.5
+        aligner.band_width = 3
+        aligner.band_offset = -2
+        # as in test_narrow_band, the query only fits into the band by
+        # touching its edge; the target aligned to itself stays on the
+        # diagonal
+        for n_threads in (1, 2):
+            scores, edges = aligner.score_many(self.target,
+                                               [self.query, self.target],
+                                               n_threads=n_threads,
+                                               band_edges=True)
+            self.assertEqual(list(scores), [7.0, 21.0])
+            self.assertEqual(list(edges), [1, 0])
+            scores, edges = aligner.score_pairs([self.target, self.query],
+                                                [self.query, self.query],
+                                                n_threads=n_threads,
+                                                band_edges=True)
+            self.assertEqual(list(scores), [7.0, 16.0])
+            self.assertEqual(list(edges), [1, 0])
+            scores, edges = aligner.score_all_pairs([self.target, self.query],
+                                                    n_threads=n_threads,
+                                                    band_edges=True)
+            self.assertEqual(list(scores), [7.0])
+            self.assertEqual(list(edges), [1])
+        scores = aligner.score_many(self.target, [self.query, self.target])
+        self.assertEqual(list(scores), [7.0, 21.0])
+        aligner.band_width = None
+        scores, edges = aligner.score_many(self.target,
+                                           [self.query, self.target],
+                                           band_edges=True)
+        self.assertEqual(list(scores), [8.5, 21.0])
+        self.assertEqual(list(edges), [0, 0])
+
+    def test_needleman_wunsch(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mismatch_score = -1
+        aligner.gap_score = -1
+        aligner.band_width = 8
+        # 15 matches, 1 mismatch, and 5 gaps: 15 - 1 - 5 = 9
+        self.assertAlmostEqual(aligner.score(self.target, self.query), 9.0)
+        alignments = aligner.align(self.target, self.query)
+        self.assertAlmostEqual(alignments.score, 9.0)
+        self.assertEqual(len(alignments), 1)
+        self.assertEqual(str(alignments[0]), """\
+GAACTGACCTTGCATTAGGCA
+||||||-|X||--|--|||||
+GAACTG-CATT--A--AGGCA
+""")
+
+    def test_errors(self):
+        aligner = Align.PairwiseAligner()
+        aligner.band_width = 2
+        with self.assertRaises(ValueError):
+            aligner.score(self.target, self.query)
+        with self.assertRaises(ValueError):
+            aligner.align(self.target, self.query)
+        with self.assertRaises(ValueError):
+            aligner.score_many(self.target, [self.target, self.query])
+        aligner.band_width = 5
+        aligner.mode = "local"
+        with self.assertRaises(ValueError):
+            aligner.score(self.target, self.query)
+        aligner.mode = "global"
+        aligner.target_gap_score = lambda i, n: -n
+        with self.assertRaises(ValueError):
+            aligner.align(self.target, self.query)
+
+
+class TestExtension(unittest.TestCase):
+
+    target = "GAACTGACCTTGCATTAGGCATTTTTTTTTT"
+    query = "GAACTGCCTTGCATTAGGCACCCCCCCCCCCCCCC"
+
+    def setUp(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mode = "extension"
+        aligner.mismatch_score = -2
+        aligner.open_gap_score = -3
+        aligner.extend_gap_score = -1
+        self.aligner = aligner
+
+    def test_properties(self):
+        aligner = self.aligner
+        self.assertEqual(aligner.mode, "extension")
+        self.assertEqual(aligner.algorithm,
+                         "Gotoh extension alignment algorithm")
+        self.assertIsNone(aligner.xdrop)
+        aligner.xdrop = 10
+        self.assertAlmostEqual(aligner.xdrop, 10.0)
+        with self.assertRaises(ValueError):
+            aligner.xdrop = -1
+        aligner.xdrop = None
+        self.assertIsNone(aligner.xdrop)
+
+    def test_extension(self):
+        aligner = self.aligner
+        # 20 matches and a gap of 1: 20 - 3 = 17; the Ts and Cs at the end
+        # are left out, as they only add mismatches
+        self.assertAlmostEqual(aligner.score(self.target, self.query), 17.0)
+        alignments = aligner.align(self.target, self.query)
+        self.assertAlmostEqual(alignments.score, 17.0)
+        self.assertEqual(len(alignments), 1)
+        self.assertEqual(str(alignments[0]), """\
+GAACTGACCTTGCATTAGGCATTTTTTTTTT.....
+||||||-||||||||||||||...............
+GAACTG-CCTTGCATTAGGCACCCCCCCCCCCCCCC
+""")
+        alignment = alignments[0]
+        self.assertEqual(alignment.path, ((0, 0), (6, 6), (7, 6), (21, 20)))
+
+    def test_short(self):
+        aligner = self.aligner
+        # 3 matches; extending past them only adds mismatches
+        self.assertAlmostEqual(aligner.score("ACGTTT", "ACGAAA"), 3.0)
+        alignments = aligner.align("ACGTTT", "ACGAAA")
+        self.assertAlmostEqual(alignments.score, 3.0)
+        self.assertEqual(str(alignments[0]), """\
+ACGTTT
+|||...
+ACGAAA
+""")
+        self.assertEqual(alignments[0].path, ((0, 0), (3, 3)))
+        # 7 matches and a gap of length 1: 7 - 3 = 4
+        self.assertAlmostEqual(aligner.score("ACGTACGT", "ACGACGT"), 4.0)
+        alignments = aligner.align("ACGTACGT", "ACGACGT")
+        self.assertAlmostEqual(alignments.score, 4.0)
+        self.assertEqual(len(alignments), 1)
+        self.assertEqual(str(alignments[0]), """\
+ACGTACGT
+|||-||||
+ACG-ACGT
+""")
+        self.assertEqual(alignments[0].path, ((0, 0), (3, 3), (4, 3), (8, 7)))
+
+    def test_xdrop(self):
+        aligner = self.aligner
+        aligner.xdrop = 10
+        self.assertAlmostEqual(aligner.score(self.target, self.query), 17.0)
+        alignment = aligner.align(self.target, self.query)[0]
+        self.assertEqual(alignment.path, ((0, 0), (6, 6), (7, 6), (21, 20)))
+        # the gap costs more than the X-drop threshold, so only the first 6
+        # matches remain; the target aligned to itself has 31 matches
+        aligner.xdrop = 2
+        self.assertAlmostEqual(aligner.score(self.target, self.query), 6.0)
+        alignment = aligner.align(self.target, self.query)[0]
+        self.assertAlmostEqual(alignment.score, 6.0)
+        self.assertEqual(alignment.path, ((0, 0), (6, 6)))
+        scores = aligner.score_many(self.target, [self.query, self.target])
+        self.assertEqual(list(scores), [6.0, 31.0])
+
+    def test_long(self):
+        aligner = self.aligner
+        aligner.xdrop = 20
+        target = "ACGTTGCA" * 50 + "A" * 100000
+        query = "ACGTTGCA" * 50 + "C" * 100000
+        # 400 matches; the mismatches after them are abandoned
+        self.assertAlmostEqual(aligner.score(target, query), 400.0)
+        alignment = aligner.align(target, query)[0]
+        self.assertEqual(alignment.path, ((0, 0), (400, 400)))
+
+    def test_errors(self):
+        aligner = self.aligner
+        aligner.target_gap_score = lambda i, n: -n
+        with self.assertRaises(ValueError):
+            aligner.score(self.target, self.query)
+        with self.assertRaises(ValueError):
+            aligner.align(self.target, self.query)
+        aligner.linear_space = True
+        with self.assertRaises(ValueError):
+            aligner.align(self.target, self.query)
+
+
+class TestSequenceInput(unittest.TestCase):
+
+    target = "GAACTGACCTTGCATTAGG"
+    query = "GAACTGCCTTGCATTAGG"
+
+    def setUp(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mismatch_score = -1
+        aligner.open_gap_score = -2
+        aligner.extend_gap_score = -1
+        self.aligner = aligner
+
+    def check_input(self, target, query):
+        # 18 matches and a gap of 1: 18 - 2 = 16
+        self.assertAlmostEqual(self.aligner.score(target, query), 16.0)
+        alignments = self.aligner.align(target, query)
+        self.assertAlmostEqual(alignments.score, 16.0)
+        alignment = alignments[0]
+        self.assertEqual(str(alignment), """\
+GAACTGACCTTGCATTAGG
+||||||-||||||||||||
+GAACTG-CCTTGCATTAGG
+""")
+        self.assertEqual(alignment.path, ((0, 0), (6, 6), (7, 6), (19, 18)))
+
+    def test_string(self):
+        self.check_input(self.target, self.query)
+        aligner = self.aligner
+        score = aligner.score(self.target.lower(), self.query)
+        self.assertAlmostEqual(score, 16.0)
+
+    def test_bytes(self):
+        target = self.target.encode("ascii")
+        query = self.query.encode("ascii")
+        self.check_input(target, query)
+        self.check_input(bytearray(target), memoryview(query))
+
+    def test_indices(self):
+        target = array.array("i", [ord(c) - ord("A") for c in self.target])
+        query = array.array("b", [ord(c) - ord("A") for c in self.query])
+        self.check_input(target, query)
+        # signed bytes are used without copying, and released afterwards
+        query.append(0)
+
+    def test_invalid(self):
+        aligner = self.aligner
+        with self.assertRaises(ValueError):
+            aligner.score("GAA-CTG", self.query)
+        with self.assertRaises(ValueError):
+            aligner.align(self.target, array.array("i", [0, 1, 26]))
+        with self.assertRaises(ValueError):
+            aligner.score(self.target, array.array("b", [0, 1, 26]))
+        with self.assertRaises(ValueError):
+            aligner.align(array.array("b", [0, -1, 2]), self.query)
+        with self.assertRaises(ValueError):
+            aligner.score(array.array("d", [0.0, 1.0]), self.query)
+        # unsigned bytes are always characters, never alphabet indices
+        with self.assertRaises(ValueError):
+            aligner.score(b"\x00\x01\x02", self.query)
+        with self.assertRaises(ValueError):
+            aligner.align(array.array("B", [0, 1, 2]), self.query)
+
+    def test_empty(self):
+        aligner = self.aligner
+        # only the end gap is scored: -2 - 3 * 1 = -5
+        self.assertAlmostEqual(aligner.score("", "ACGT"), -5.0)
+        self.assertAlmostEqual(aligner.score(b"ACGT", b""), -5.0)
+        self.assertAlmostEqual(aligner.score("", ""), 0.0)
+        aligner.target_end_gap_score = -3
+        self.assertAlmostEqual(aligner.score("", "ACGT"), -12.0)
+        self.assertAlmostEqual(aligner.score("ACGT", ""), -5.0)
+        aligner = Align.PairwiseAligner()
+        self.assertAlmostEqual(aligner.score("", "ACGT"), 0.0)
+        aligner.gap_score = -1
+        self.assertAlmostEqual(aligner.score("", "ACGT"), -4.0)
+        aligner.target_gap_score = target_gap_function
+        self.assertAlmostEqual(aligner.score("", "ACGT"), -5.0)
+        aligner.mode = "local"
+        self.assertAlmostEqual(aligner.score("", "ACGT"), 0.0)
+        # there are no alignments to show
+        for target, query in (("", "ACGT"), ("ACGT", ""), ("", "")):
+            with self.assertRaises(ValueError):
+                aligner.align(target, query)
+
+
+class TestAlphabet(unittest.TestCase):
+
+    def test_default(self):
+        aligner = Align.PairwiseAligner()
+        self.assertEqual(aligner.alphabet, "ABCDEFGHIJKLMNOPQRSTUVWXYZ")
+        with self.assertRaises(ValueError):
+            aligner.score("ACGT*", "ACGT*")
+
+    def test_alphabet(self):
+        aligner = Align.PairwiseAligner()
+        aligner.match_score = 2
+        aligner.mismatch_score = -1
+        aligner.gap_score = -2
+        aligner.alphabet = "ACGT*"
+        self.assertEqual(aligner.alphabet, "ACGT*")
+        self.assertAlmostEqual(aligner.score("ACGT*", "acgt*"), 10.0)
+        self.assertAlmostEqual(aligner.score("AC*GT", "ACGGT"), 7.0)
+        with self.assertRaises(ValueError):
+            aligner.score("ACGN", "ACGT")
+        # indices into the alphabet
+        query = array.array("b", [0, 1, 4, 2, 3])
+        alignments = aligner.align("AC*GT", query)
+        self.assertAlmostEqual(alignments.score, 10.0)
+        self.assertEqual(str(alignments[0]), """\
+AC*GT
+|||||
+AC*GT
+""")
+        scores = aligner.score_many("ACGT*", ["ACGT*", "AC*", "T"])
+        self.assertEqual(list(scores), [10.0, 2.0, -6.0])
+        # setting the match score keeps the alphabet
+        aligner.match_score = 1
+        self.assertEqual(aligner.alphabet, "ACGT*")
+
+    def test_invalid_alphabet(self):
+        aligner = Align.PairwiseAligner()
+        for alphabet in ("", "ACA", "Aa", "A C"):
+            with self.assertRaises(ValueError):
+                aligner.alphabet = alphabet
+        self.assertEqual(aligner.alphabet, "ABCDEFGHIJKLMNOPQRSTUVWXYZ")
+
+    def test_substitution_matrix(self):
+        aligner = Align.PairwiseAligner()
+        aligner.substitution_matrix = {("A", "A"): 2, ("a", "*"): -4,
+                                       ("*", "*"): 1, ("C", "C"): 3}
+        self.assertEqual(aligner.alphabet, "*ABCDEFGHIJKLMNOPQRSTUVWXYZ")
+        self.assertEqual(len(aligner.substitution_matrix), 9)
+        self.assertAlmostEqual(aligner.substitution_matrix[("*", "A")], -4)
+        self.assertAlmostEqual(aligner.substitution_matrix[("A", "C")], 0)
+        self.assertAlmostEqual(aligner.score("AC*", "ac*"), 6.0)
+        # letters not in the matrix use the match and mismatch scores
+        self.assertAlmostEqual(aligner.score("ACG", "ACG"), 6.0)
+        with self.assertRaises(ValueError):
+            aligner.score("AC#", "AC#")
+        with self.assertRaises(ValueError):
+            aligner.alphabet = "AC"
+        # match and mismatch scores restore the default alphabet
+        aligner.match_score = 1
+        self.assertEqual(aligner.alphabet, "ABCDEFGHIJKLMNOPQRSTUVWXYZ")
+
+    def test_letters_outside_matrix(self):
+        from Bio.SubsMat.MatrixInfo import blosum62
+        aligner = Align.PairwiseAligner()
+        aligner.substitution_matrix = blosum62
+        # U is not in BLOSUM62, and is scored by the match score
+        self.assertAlmostEqual(aligner.score("MKU", "MKU"), 11.0)
+        self.assertAlmostEqual(aligner.score("MKU", "MKW"), 10.0)
+        copy = pickle.loads(pickle.dumps(aligner))
+        self.assertEqual(copy.substitution_matrix,
+                         aligner.substitution_matrix)
+        self.assertAlmostEqual(copy.score("MKU", "MKU"), 11.0)
+        aligner = Align.PairwiseAligner()
+        aligner.match_score = 2
+        aligner.mismatch_score = -3
+        aligner.gap_score = -5
+        aligner.substitution_matrix = {("A", "A"): 1, ("C", "C"): 1,
+                                       ("A", "C"): -1}
+        self.assertAlmostEqual(aligner.score("ACN", "ACN"), 4.0)
+        self.assertAlmostEqual(aligner.score("ACN", "ACC"), -1.0)
+        self.assertAlmostEqual(aligner.score("ACX", "ACN"), 2.0)
+
+
+def target_gap_function(i, n):
+    return -1 - n
+
+
+class TestPickle(unittest.TestCase):
+
+    target = "GAACTGACCTTGCATTAGGCA"
+    query = "GAACTGCATTAAGGCA"
+
+    def check(self, aligner):
+        for protocol in range(pickle.HIGHEST_PROTOCOL + 1):
+            copy = pickle.loads(pickle.dumps(aligner, protocol))
+            self.assertIsInstance(copy, Align.PairwiseAligner)
+            self.assertEqual(str(copy), str(aligner))
+            self.assertEqual(copy.alphabet, aligner.alphabet)
+            self.assertEqual(copy.n_threads, aligner.n_threads)
+            self.assertEqual(copy.algorithm, aligner.algorithm)
+            self.assertEqual(copy.score(self.target, self.query),
+                             aligner.score(self.target, self.query))
+            self.assertEqual(
+                [alignment.path
+                 for alignment in copy.align(self.target, self.query)],
+                [alignment.path
+                 for alignment in aligner.align(self.target, self.query)])
+
+    def test_default(self):
+        aligner = Align.PairwiseAligner()
+        self.check(aligner)
+
+    def test_parameters(self):
+        aligner = Align.PairwiseAligner()
+        aligner.mode = "local"
+        aligner.alphabet = "ACGT"
+        aligner.mismatch_score = -2
+        aligner.open_gap_score = -3
+        aligner.extend_gap_score = -0.5
+        aligner.target_end_gap_score = 0
+        aligner.n_threads = 2
+        self.check(aligner)
+        aligner.mode = "global"
+        aligner.band_width = 6
+        self.check(aligner)
+        aligner.band_width = None
+        aligner.linear_space = True
+        self.check(aligner)
+
+    def test_gap_function(self):
+        aligner = Align.PairwiseAligner()
+        aligner.target_gap_score = target_gap_function
+        aligner.query_gap_score = -2
+        self.check(aligner)
+        with self.assertRaises(ValueError):
+            aligner.to_bytes()
+
+    def test_bytes(self):
+        aligner = Align.PairwiseAligner()
+        aligner.alphabet = "ACGT"
+        aligner.mismatch_score = -1
+        aligner.gap_score = -2
+        data = aligner.to_bytes()
+        copy = Align.PairwiseAligner.from_bytes(data)
+        self.assertEqual(str(copy), str(aligner))
+        self.assertEqual(copy.to_bytes(), data)
+        with self.assertRaises(ValueError):
+            Align.PairwiseAligner.from_bytes(data[:-1])
+        with self.assertRaises(ValueError):
+            Align.PairwiseAligner.from_bytes(b"x" * len(data))
+
 
 if __name__ == "__main__":
     runner = unittest.TextTestRunner(verbosity=2)